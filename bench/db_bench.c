@@ -0,0 +1,480 @@
+/*
+ * Metadata store micro-benchmark.
+ *
+ * Synthesizes containers.db / images.db of increasing size in a scratch
+ * state root and measures the bookkeeping paths that ps, stop, rm and run
+ * go through. Results are printed as JSON so runs can be diffed between
+ * versions.
+ *
+ * Usage: db_bench [--sizes 1000,10000,...] [--iterations N] [--writers W]
+ *                 [--dir DIR] [--out FILE]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "container.h"
+#include "image.h"
+#include "fsutil.h"
+#include "record.h"
+#include "report.h"
+
+#define MAX_SIZES 16
+#define NS_PER_SEC 1000000000LL
+#define BENCH_EPOCH_NS (1735689600LL * NS_PER_SEC)  /* 2025-01-01T00:00:00Z */
+
+struct bench_opts {
+    long sizes[MAX_SIZES];
+    int nsizes;
+    long iterations;
+    int writers;
+    const char *dir;
+    FILE *out;
+};
+
+struct bench_ctx {
+    const struct bench_opts *opts;
+    char base_dir[PATH_MAX];
+    long records;
+    long next_id;           /* next container number for inserts */
+    int first_result;
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void report(struct bench_ctx *ctx, const char *op, int writers,
+                   double *lat, long n, double wall_us)
+{
+    if (n <= 0) {
+        return;
+    }
+    mdock_sort_samples(lat, (size_t)n);
+
+    double sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += lat[i];
+    }
+
+    fprintf(ctx->opts->out,
+            "%s\n    {\"records\": %ld, \"op\": \"%s\", \"writers\": %d, \"iterations\": %ld, "
+            "\"p50_us\": %.1f, \"p99_us\": %.1f, \"mean_us\": %.1f, \"max_us\": %.1f, "
+            "\"ops_per_sec\": %.1f}",
+            ctx->first_result ? "" : ",",
+            ctx->records, op, writers, n,
+            mdock_percentile(lat, (size_t)n, 0.50), mdock_percentile(lat, (size_t)n, 0.99),
+            sum / n, lat[n - 1],
+            wall_us > 0 ? n / (wall_us / 1e6) : 0.0);
+    fflush(ctx->opts->out);
+    ctx->first_result = 0;
+}
+
+/* ----- Synthesis ----- */
+
+static int synthesize(struct bench_ctx *ctx)
+{
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s/containers.db", ctx->base_dir) >= (int)sizeof(path)) {
+        return -1;
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("[bench] fopen containers.db");
+        return -1;
+    }
+
+    struct container_record rec;
+    memset(&rec, 0, sizeof(rec));
+    for (long i = 1; i <= ctx->records; i++) {
+        snprintf(rec.id, sizeof(rec.id), "c%ld", i);
+        rec.pid = (int)(100000 + i % 3000000);
+        snprintf(rec.image, sizeof(rec.image), "img%ld", i % 64);
+        /* A small share of records still claims to be running */
+        snprintf(rec.status, sizeof(rec.status), "%s", (i % 500 == 0) ? "running" : "exited");
+        rec.start_ns = BENCH_EPOCH_NS;
+        rec.end_ns = (i % 500 == 0) ? 0 : BENCH_EPOCH_NS + 600 * NS_PER_SEC;
+        rec.duration_ns = rec.end_ns ? rec.end_ns - rec.start_ns : 0;
+        rec.exit_code = (i % 500 == 0) ? -1 : 0;
+        container_record_write(f, &rec);
+    }
+    fclose(f);
+
+    if (snprintf(path, sizeof(path), "%s/images.db", ctx->base_dir) >= (int)sizeof(path)) {
+        return -1;
+    }
+    f = fopen(path, "w");
+    if (!f) {
+        perror("[bench] fopen images.db");
+        return -1;
+    }
+
+    struct image_record img;
+    memset(&img, 0, sizeof(img));
+    img.created_ns = BENCH_EPOCH_NS;
+    for (long i = 0; i < ctx->records; i++) {
+        snprintf(img.name, sizeof(img.name), "img%ld", i);
+        if (snprintf(img.rootfs, sizeof(img.rootfs), "%s/images/img%ld/rootfs",
+                     ctx->base_dir, i) >= (int)sizeof(img.rootfs)) {
+            fclose(f);
+            return -1;
+        }
+        image_record_write(f, &img);
+    }
+    fclose(f);
+
+    ctx->next_id = ctx->records + 1;
+    return 0;
+}
+
+/* ----- Operations ----- */
+
+enum bench_op {
+    OP_LOOKUP,
+    OP_IMAGE_LOOKUP,
+    OP_STATUS_UPDATE,
+    OP_INSERT,
+    OP_DELETE,
+    OP_GENERATE_ID,
+    OP_LIST,
+    OP_LIST_RUNNING
+};
+
+static const char *random_id(struct bench_ctx *ctx, unsigned *seed, char *buf, size_t size)
+{
+    snprintf(buf, size, "c%ld", 1 + (long)(rand_r(seed) % ctx->records));
+    return buf;
+}
+
+static int run_ps(char **args, int nargs)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    int ret = cmd_ps(nargs, args);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return ret;
+}
+
+static int run_op(struct bench_ctx *ctx, enum bench_op op, unsigned *seed, long *next_id)
+{
+    char id[MDOCK_ID_MAX];
+    char buf[PATH_MAX];
+    struct container_record rec;
+
+    switch (op) {
+    case OP_LOOKUP:
+        return find_container_record(ctx->base_dir, random_id(ctx, seed, id, sizeof(id)), &rec);
+    case OP_IMAGE_LOOKUP:
+        snprintf(id, sizeof(id), "img%ld", (long)(rand_r(seed) % ctx->records));
+        return find_image_rootfs(ctx->base_dir, id, buf, sizeof(buf));
+    case OP_STATUS_UPDATE:
+        return update_container_status(ctx->base_dir, random_id(ctx, seed, id, sizeof(id)),
+                                       (rand_r(seed) & 1) ? "stopped" : "exited");
+    case OP_INSERT:
+        snprintf(id, sizeof(id), "c%ld", (*next_id)++);
+        return add_container_record(ctx->base_dir, id, 1, "img0", "");
+    case OP_DELETE:
+        /* Delete the newest inserted record so the file keeps its size */
+        snprintf(id, sizeof(id), "c%ld", --(*next_id));
+        return remove_container_record(ctx->base_dir, id);
+    case OP_GENERATE_ID:
+        return generate_container_id(ctx->base_dir, id, sizeof(id));
+    case OP_LIST: {
+        char *args[] = { "ps", NULL };
+        return run_ps(args, 1);
+    }
+    case OP_LIST_RUNNING: {
+        char filter[] = "status=running";   /* ps tokenizes it in place */
+        char *args[] = { "ps", "--filter", filter, NULL };
+        return run_ps(args, 3);
+    }
+    }
+    return -1;
+}
+
+/* Drop every container numbered at or above *arg (what the insert phases added) */
+static int drop_inserted(const struct db_row *row, FILE *out, void *arg)
+{
+    (void)out;
+    const struct db_field *id = &row->fields[CF_ID];
+    if (id->len < 2 || id->ptr[0] != 'c') {
+        return 0;
+    }
+    struct db_field num = { id->ptr + 1, id->len - 1 };
+    return db_field_long(&num) >= *(long *)arg;
+}
+
+static void drop_inserts(struct bench_ctx *ctx)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/containers.db", ctx->base_dir) < (int)sizeof(path)) {
+        db_rewrite(path, drop_inserted, &ctx->next_id);
+    }
+}
+
+/* Rewrites and full listings touch every row; scale them down for big files */
+static long op_iterations(const struct bench_ctx *ctx, enum bench_op op)
+{
+    long n = ctx->opts->iterations;
+    long cap = n;
+
+    switch (op) {
+    case OP_LOOKUP:
+    case OP_IMAGE_LOOKUP:
+    case OP_GENERATE_ID:
+    case OP_INSERT:
+        cap = 20000000 / ctx->records;
+        break;
+    case OP_STATUS_UPDATE:
+    case OP_DELETE:
+    case OP_LIST_RUNNING:
+        cap = 5000000 / ctx->records;
+        break;
+    case OP_LIST:
+        cap = 1000000 / ctx->records;
+        break;
+    }
+
+    if (cap < 5) cap = 5;
+    return n < cap ? n : cap;
+}
+
+static void bench_single(struct bench_ctx *ctx, const char *name, enum bench_op op)
+{
+    long n = op_iterations(ctx, op);
+    double *lat = calloc((size_t)n, sizeof(*lat));
+    if (!lat) {
+        perror("[bench] calloc");
+        return;
+    }
+
+    unsigned seed = (unsigned)ctx->records;
+    long next_id = ctx->next_id;
+    long done = 0;
+
+    /* Deletions consume what the insert phase added */
+    if (op == OP_DELETE) {
+        next_id = ctx->next_id;
+        for (long i = 0; i < n; i++) {
+            char id[MDOCK_ID_MAX];
+            snprintf(id, sizeof(id), "c%ld", next_id++);
+            add_container_record(ctx->base_dir, id, 1, "img0", "");
+        }
+    }
+
+    double wall = now_us();
+    for (long i = 0; i < n; i++) {
+        double t0 = now_us();
+        if (run_op(ctx, op, &seed, &next_id) != 0 && op != OP_IMAGE_LOOKUP) {
+            fprintf(stderr, "[bench] %s failed\n", name);
+            break;
+        }
+        lat[done++] = now_us() - t0;
+    }
+    wall = now_us() - wall;
+
+    if (op == OP_INSERT) {
+        /* Remove what we inserted so later phases see the nominal size */
+        drop_inserts(ctx);
+    }
+
+    report(ctx, name, 1, lat, done, wall);
+    free(lat);
+}
+
+/* W forked writers; each sends its latencies back over a pipe */
+static void bench_concurrent(struct bench_ctx *ctx, const char *name, enum bench_op op)
+{
+    int writers = ctx->opts->writers;
+    long per_writer = op_iterations(ctx, op) / writers;
+    if (per_writer < 1) per_writer = 1;
+
+    double *lat = calloc((size_t)(per_writer * writers), sizeof(*lat));
+    pid_t *pids = calloc((size_t)writers, sizeof(*pids));
+    int *fds = calloc((size_t)writers, sizeof(*fds));
+    if (!lat || !pids || !fds) {
+        perror("[bench] calloc");
+        goto out;
+    }
+
+    double wall = now_us();
+    for (int w = 0; w < writers; w++) {
+        int p[2];
+        if (pipe(p) == -1) {
+            perror("[bench] pipe");
+            writers = w;
+            break;
+        }
+
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            close(p[0]);
+            unsigned seed = (unsigned)(ctx->records * 31 + w);
+            /* Give every writer its own id range for inserts */
+            long next_id = ctx->next_id + (long)w * per_writer;
+            for (long i = 0; i < per_writer; i++) {
+                double t0 = now_us();
+                run_op(ctx, op, &seed, &next_id);
+                double dt = now_us() - t0;
+                if (write(p[1], &dt, sizeof(dt)) != sizeof(dt)) {
+                    _exit(1);
+                }
+            }
+            _exit(0);
+        }
+        close(p[1]);
+        fds[w] = p[0];
+    }
+
+    long done = 0;
+    for (int w = 0; w < writers; w++) {
+        double dt;
+        while (read(fds[w], &dt, sizeof(dt)) == sizeof(dt)) {
+            lat[done++] = dt;
+        }
+        close(fds[w]);
+        waitpid(pids[w], NULL, 0);
+    }
+    wall = now_us() - wall;
+
+    if (op == OP_INSERT) {
+        drop_inserts(ctx);
+    }
+
+    report(ctx, name, writers, lat, done, wall);
+
+out:
+    free(lat);
+    free(pids);
+    free(fds);
+}
+
+static int bench_size(struct bench_ctx *ctx, long records)
+{
+    ctx->records = records;
+
+    char tmpl[PATH_MAX];
+    snprintf(tmpl, sizeof(tmpl), "%s/mdock-bench-XXXXXX", ctx->opts->dir);
+    if (!mkdtemp(tmpl)) {
+        perror("[bench] mkdtemp");
+        return -1;
+    }
+    mdock_set_root(tmpl);
+    if (mdock_init_home(ctx->base_dir, sizeof(ctx->base_dir)) != 0) {
+        return -1;
+    }
+
+    fprintf(stderr, "[bench] %ld records in %s\n", records, ctx->base_dir);
+    if (synthesize(ctx) != 0) {
+        return -1;
+    }
+
+    bench_single(ctx, "lookup", OP_LOOKUP);
+    bench_single(ctx, "image_lookup", OP_IMAGE_LOOKUP);
+    bench_single(ctx, "generate_id", OP_GENERATE_ID);
+    bench_single(ctx, "status_update", OP_STATUS_UPDATE);
+    bench_single(ctx, "insert", OP_INSERT);
+    bench_single(ctx, "delete", OP_DELETE);
+    bench_single(ctx, "list", OP_LIST);
+    bench_single(ctx, "list_running", OP_LIST_RUNNING);
+
+    if (ctx->opts->writers > 1) {
+        bench_concurrent(ctx, "status_update", OP_STATUS_UPDATE);
+        bench_concurrent(ctx, "insert", OP_INSERT);
+    }
+
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", ctx->base_dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "[bench] failed to remove %s\n", ctx->base_dir);
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: db_bench [--sizes N,N,...] [--iterations N] [--writers W]\n");
+    fprintf(stderr, "                [--dir DIR] [--out FILE]\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_opts opts = {
+        .sizes = { 1000, 10000, 100000, 1000000 },
+        .nsizes = 4,
+        .iterations = 200,
+        .writers = 4,
+        .dir = "/tmp",
+        .out = stdout,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (strcmp(argv[i], "--sizes") == 0) {
+            opts.nsizes = 0;
+            for (char *tok = strtok(argv[++i], ","); tok && opts.nsizes < MAX_SIZES;
+                 tok = strtok(NULL, ",")) {
+                long n = strtol(tok, NULL, 10);
+                if (n > 0) {
+                    opts.sizes[opts.nsizes++] = n;
+                }
+            }
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            opts.iterations = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--writers") == 0) {
+            opts.writers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dir") == 0) {
+            opts.dir = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0) {
+            opts.out = fopen(argv[++i], "w");
+            if (!opts.out) {
+                perror("[bench] fopen");
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (opts.nsizes == 0 || opts.iterations <= 0 || opts.writers <= 0) {
+        usage();
+        return 1;
+    }
+
+    struct bench_ctx ctx = { .opts = &opts, .first_result = 1 };
+
+    fprintf(opts.out, "{\n  \"benchmark\": \"mdock-metadata\",\n  \"timestamp\": %ld,\n  \"results\": [",
+            (long)time(NULL));
+    for (int i = 0; i < opts.nsizes; i++) {
+        if (bench_size(&ctx, opts.sizes[i]) != 0) {
+            return 1;
+        }
+    }
+    fprintf(opts.out, "\n  ]\n}\n");
+
+    if (opts.out != stdout) {
+        fclose(opts.out);
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * Memory density benchmark.
+ *
+ * Starts replicas through launch_container() until their summed PSS
+ * exceeds a fixed budget, once as they are and once with --ksm
+ * (PR_SET_MEMORY_MERGE). Every replica fills the same anonymous data, as
+ * replicas of one image loading the same model or cache do, plus a share
+ * of pages that differ per replica. With KSM each step waits for two full
+ * ksmd scans, so the PSS of a replica reflects its merged pages. ksmd is
+ * started and sped up for the run when /sys/kernel/mm/ksm is writable and
+ * put back afterwards. Results are printed as JSON so runs can be diffed
+ * between versions.
+ *
+ * Usage: density_bench [--budget MB] [--size MB] [--unique PCT] [--max N] [--out FILE]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+
+#define KSM_DIR          "/sys/kernel/mm/ksm"
+#define MAX_REPLICAS     1024
+#define SCAN_TIMEOUT_MS  60000
+
+struct bench_opts {
+    long budget_mb;
+    long size_mb;           /* touched anonymous memory per replica */
+    long unique_pct;        /* of it, pages that differ between replicas */
+    long max;
+    FILE *out;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(long ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* The replica: shared pages are the same in every process, unique ones carry the pid */
+static int replica_main(long size_mb, long unique_pct)
+{
+    size_t size = (size_t)size_mb << 20;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = size / page;
+    size_t unique = pages * (size_t)unique_pct / 100;
+    char *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return 1;
+    }
+    uint64_t salt = (uint64_t)getpid() << 32;
+    for (size_t i = 0; i < pages; i++) {
+        uint64_t *words = (uint64_t *)(mem + i * page);
+        uint64_t seed = (i + 1) * 0x9e3779b97f4a7c15ULL ^ (i < unique ? salt : 0);
+        for (size_t w = 0; w < page / sizeof(*words); w++) {
+            words[w] = seed + w;
+        }
+    }
+    for (;;) {
+        pause();
+    }
+}
+
+/* "<name>:  N kB" from /proc/<pid>/smaps_rollup, in kB; -1 when unreadable */
+static long smaps_kb(pid_t pid, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    size_t len = strlen(name);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, name, len) == 0 && line[len] == ':') {
+            kb = strtol(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static long ksm_read(const char *name)
+{
+    char path[128];
+    snprintf(path, sizeof(path), KSM_DIR "/%s", name);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    long value = -1;
+    if (fscanf(f, "%ld", &value) != 1) {
+        value = -1;
+    }
+    fclose(f);
+    return value;
+}
+
+static int ksm_write(const char *name, long value)
+{
+    char path[128];
+    snprintf(path, sizeof(path), KSM_DIR "/%s", name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    int rc = fprintf(f, "%ld\n", value) < 0 ? -1 : 0;
+    return (fclose(f) != 0 || rc != 0) ? -1 : 0;
+}
+
+/* Wait for ksmd to go over every mergeable page twice, so new pages are merged */
+static int ksm_settle(void)
+{
+    long start = ksm_read("full_scans");
+    for (long waited = 0; waited < SCAN_TIMEOUT_MS; waited += 10) {
+        if (ksm_read("full_scans") >= start + 2) {
+            return 0;
+        }
+        sleep_ms(10);
+    }
+    return -1;
+}
+
+static int run_scenario(const struct bench_opts *opts, int ksm, int first)
+{
+    char size_arg[32];
+    char unique_arg[32];
+    snprintf(size_arg, sizeof(size_arg), "%ld", opts->size_mb);
+    snprintf(unique_arg, sizeof(unique_arg), "%ld", opts->unique_pct);
+    char *argv[] = { "density_bench", "--replica", size_arg, unique_arg, NULL };
+    char *envp[] = { NULL };
+    /* No huge pages in either run: ksmd only merges base pages */
+    struct launch_memory mem = { LAUNCH_THP_NEVER, ksm, 0 };
+    struct launch_spec spec = {
+        .rootfs = "/",
+        .log_path = "/dev/null",
+        .path = "/proc/self/exe",
+        .argv = argv,
+        .envp = envp,
+        .memory = &mem,
+        .mode = LAUNCH_VFORK,
+    };
+
+    pid_t *pids = calloc((size_t)opts->max, sizeof(*pids));
+    if (!pids) {
+        perror("[bench] calloc");
+        return -1;
+    }
+    long budget_kb = opts->budget_mb * 1024;
+    long fit = 0;
+    long fit_pss_kb = 0;
+    long started = 0;
+    int rc = 0;
+    double t0 = now_s();
+    while (started < opts->max) {
+        int exec_errno;
+        pid_t pid = launch_container(&spec, &exec_errno);
+        if (pid == -1 || exec_errno != 0) {
+            fprintf(stderr, "[bench] launch failed: %s\n", strerror(pid == -1 ? errno : exec_errno));
+            if (pid != -1) {
+                waitpid(pid, NULL, 0);
+            }
+            rc = -1;
+            break;
+        }
+        pids[started++] = pid;
+
+        /* Until the replica has touched all of its memory */
+        while (smaps_kb(pid, "Rss") < opts->size_mb * 1024) {
+            if (waitpid(pid, NULL, WNOHANG) == pid) {
+                fprintf(stderr, "[bench] replica %d exited\n", (int)pid);
+                pids[--started] = 0;
+                rc = -1;
+                break;
+            }
+            sleep_ms(5);
+        }
+        if (rc != 0) {
+            break;
+        }
+        if (ksm && ksm_settle() != 0) {
+            fprintf(stderr, "[bench] ksmd did not finish a scan in %d ms\n", SCAN_TIMEOUT_MS);
+            rc = -1;
+            break;
+        }
+
+        long pss_kb = 0;
+        for (long k = 0; k < started; k++) {
+            pss_kb += smaps_kb(pids[k], "Pss");
+        }
+        if (pss_kb > budget_kb) {
+            break;
+        }
+        fit = started;
+        fit_pss_kb = pss_kb;
+    }
+    double seconds = now_s() - t0;
+
+    if (rc == 0) {
+        fprintf(opts->out,
+                "%s\n    {\"ksm\": %s, \"replicas_fit\": %ld, \"pss_mb\": %.1f, "
+                "\"pss_per_replica_mb\": %.2f, \"pages_sharing\": %ld, \"hit_max\": %s, \"seconds\": %.1f}",
+                first ? "" : ",", ksm ? "true" : "false", fit, fit_pss_kb / 1024.0,
+                fit ? fit_pss_kb / 1024.0 / fit : 0.0, ksm ? ksm_read("pages_sharing") : 0,
+                fit == opts->max ? "true" : "false", seconds);
+        fflush(opts->out);
+    }
+
+    for (long k = 0; k < started; k++) {
+        kill(pids[k], SIGKILL);
+    }
+    for (long k = 0; k < started; k++) {
+        waitpid(pids[k], NULL, 0);
+    }
+    free(pids);
+    return rc;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: density_bench [--budget MB] [--size MB] [--unique PCT] [--max N] [--out FILE]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && strcmp(argv[1], "--replica") == 0) {
+        return replica_main(strtol(argv[2], NULL, 10), strtol(argv[3], NULL, 10));
+    }
+
+    struct bench_opts opts = {
+        .budget_mb = 256,
+        .size_mb = 32,
+        .unique_pct = 25,
+        .max = 128,
+        .out = stdout,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (strcmp(argv[i], "--budget") == 0) {
+            opts.budget_mb = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            opts.size_mb = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--unique") == 0) {
+            opts.unique_pct = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max") == 0) {
+            opts.max = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--out") == 0) {
+            opts.out = fopen(argv[++i], "w");
+            if (!opts.out) {
+                perror("[bench] fopen");
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (opts.budget_mb <= 0 || opts.size_mb <= 0 || opts.unique_pct < 0 || opts.unique_pct > 100 ||
+        opts.max < 1 || opts.max > MAX_REPLICAS) {
+        usage();
+        return 1;
+    }
+
+    /* ksmd at its defaults would take minutes per step */
+    long saved_run = ksm_read("run");
+    long saved_pages = ksm_read("pages_to_scan");
+    long saved_sleep = ksm_read("sleep_millisecs");
+    if (saved_run < 0 || ksm_write("run", 1) != 0 || ksm_write("pages_to_scan", 5000) != 0 ||
+        ksm_write("sleep_millisecs", 10) != 0) {
+        fprintf(stderr, "[bench] cannot start ksmd through " KSM_DIR " (needs root)\n");
+        if (saved_run >= 0) {
+            ksm_write("run", saved_run);
+        }
+        return 1;
+    }
+
+    fprintf(opts.out, "{\n  \"benchmark\": \"mdock-density\",\n  \"timestamp\": %ld,\n"
+                      "  \"budget_mb\": %ld,\n  \"replica_mb\": %ld,\n  \"unique_pct\": %ld,\n"
+                      "  \"results\": [",
+            (long)time(NULL), opts.budget_mb, opts.size_mb, opts.unique_pct);
+    int rc = run_scenario(&opts, 0, 1) == 0 && run_scenario(&opts, 1, 0) == 0 ? 0 : 1;
+    fprintf(opts.out, "\n  ]\n}\n");
+
+    ksm_write("pages_to_scan", saved_pages);
+    ksm_write("sleep_millisecs", saved_sleep);
+    ksm_write("run", saved_run);
+    if (opts.out != stdout) {
+        fclose(opts.out);
+    }
+    return rc;
+}
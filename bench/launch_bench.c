@@ -0,0 +1,170 @@
+/*
+ * Container launch micro-benchmark.
+ *
+ * Starts bursts of /bin/true through launch_container() with the fork and
+ * the clone(CLONE_VM | CLONE_VFORK) paths while the benchmark itself holds
+ * an increasing amount of touched heap, the way a long-lived mdockd does.
+ * Results are printed as JSON so runs can be diffed between versions.
+ *
+ * Usage: launch_bench [--count N] [--rss 0,64,512] [--out FILE]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+#include "report.h"
+
+#define MAX_RSS_STEPS 16
+
+struct bench_opts {
+    long count;
+    long rss_mb[MAX_RSS_STEPS];
+    int nrss;
+    FILE *out;
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Launch count containers back to back, then reap them all */
+static int bench_mode(const struct bench_opts *opts, enum launch_mode mode, long rss_mb, int first)
+{
+    char *argv[] = { "/bin/true", NULL };
+    char *envp[] = { "PATH=/bin:/usr/bin", NULL };
+    struct launch_spec spec = {
+        .rootfs = "/",
+        .log_path = "/dev/null",
+        .path = "/bin/true",
+        .argv = argv,
+        .envp = envp,
+        .mode = mode,
+    };
+
+    double *lat = malloc((size_t)opts->count * sizeof(*lat));
+    if (!lat) {
+        perror("[bench] malloc");
+        return -1;
+    }
+
+    double start = now_us();
+    long launched = 0;
+    for (long i = 0; i < opts->count; i++) {
+        int exec_errno;
+        double t0 = now_us();
+        pid_t pid = launch_container(&spec, &exec_errno);
+        lat[launched] = now_us() - t0;
+        if (pid == -1 || exec_errno != 0) {
+            fprintf(stderr, "[bench] launch failed: %s\n", strerror(pid == -1 ? errno : exec_errno));
+            break;
+        }
+        launched++;
+    }
+    double launch_us = now_us() - start;
+
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+
+    if (launched > 0) {
+        mdock_sort_samples(lat, (size_t)launched);
+        fprintf(opts->out,
+                "%s\n    {\"mode\": \"%s\", \"parent_rss_mb\": %ld, \"launches\": %ld, "
+                "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"launches_per_sec\": %.1f}",
+                first ? "" : ",", mode == LAUNCH_FORK ? "fork" : "vfork", rss_mb, launched,
+                mdock_percentile(lat, (size_t)launched, 0.50),
+                mdock_percentile(lat, (size_t)launched, 0.99),
+                lat[launched - 1], launched / (launch_us / 1e6));
+        fflush(opts->out);
+    }
+    free(lat);
+    return launched == opts->count ? 0 : -1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: launch_bench [--count N] [--rss MB,MB,...] [--out FILE]\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_opts opts = {
+        .count = 500,
+        .rss_mb = { 0, 64, 512 },
+        .nrss = 3,
+        .out = stdout,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (strcmp(argv[i], "--count") == 0) {
+            opts.count = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rss") == 0) {
+            opts.nrss = 0;
+            for (char *tok = strtok(argv[++i], ","); tok && opts.nrss < MAX_RSS_STEPS;
+                 tok = strtok(NULL, ",")) {
+                long mb = strtol(tok, NULL, 10);
+                if (mb >= 0) {
+                    opts.rss_mb[opts.nrss++] = mb;
+                }
+            }
+        } else if (strcmp(argv[i], "--out") == 0) {
+            opts.out = fopen(argv[++i], "w");
+            if (!opts.out) {
+                perror("[bench] fopen");
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (opts.count <= 0 || opts.nrss == 0) {
+        usage();
+        return 1;
+    }
+
+    fprintf(opts.out, "{\n  \"benchmark\": \"mdock-launch\",\n  \"timestamp\": %ld,\n  \"results\": [",
+            (long)time(NULL));
+
+    char *ballast = NULL;
+    int first = 1;
+    for (int r = 0; r < opts.nrss; r++) {
+        /* Touched memory is what fork() has to duplicate page tables for */
+        size_t size = (size_t)opts.rss_mb[r] << 20;
+        free(ballast);
+        ballast = size ? malloc(size) : NULL;
+        if (size && !ballast) {
+            perror("[bench] malloc");
+            return 1;
+        }
+        if (ballast) {
+            memset(ballast, 1, size);
+        }
+
+        if (bench_mode(&opts, LAUNCH_FORK, opts.rss_mb[r], first) != 0 ||
+            bench_mode(&opts, LAUNCH_VFORK, opts.rss_mb[r], 0) != 0) {
+            return 1;
+        }
+        first = 0;
+    }
+    free(ballast);
+
+    fprintf(opts.out, "\n  ]\n}\n");
+    if (opts.out != stdout) {
+        fclose(opts.out);
+    }
+    return 0;
+}
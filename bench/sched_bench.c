@@ -0,0 +1,249 @@
+/*
+ * Scheduling isolation benchmark.
+ *
+ * A foreground loop wakes every period, does a fixed slice of work and
+ * records how late it finished, while batch containers started through
+ * launch_container() spin on every CPU with the priority under test. The
+ * spread between "none" (an idle host) and each policy is the latency a
+ * batch neighbour costs the foreground. Results are printed as JSON so
+ * runs can be diffed between versions.
+ *
+ * Usage: sched_bench [--batch N] [--samples N] [--period-us N] [--work-us N]
+ *                    [--policies none,other,batch,idle,nice19] [--out FILE]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+#include "report.h"
+
+#define MAX_POLICIES  8
+#define MAX_BATCH     256
+
+struct bench_opts {
+    long batch;             /* spinning containers, default four per CPU */
+    long samples;
+    long period_us;
+    long work_us;
+    const char *policies[MAX_POLICIES];
+    int npolicies;
+    FILE *out;
+};
+
+static volatile unsigned long sink;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void work(unsigned long loops)
+{
+    for (unsigned long i = 0; i < loops; i++) {
+        sink += i;
+    }
+}
+
+/* Loops that take work_us on an otherwise idle CPU */
+static unsigned long calibrate(long work_us)
+{
+    unsigned long loops = 1000;
+    for (;;) {
+        double t0 = now_us();
+        work(loops);
+        double took = now_us() - t0;
+        if (took > 2000) {
+            return (unsigned long)(loops * (work_us / took));
+        }
+        loops *= 2;
+    }
+}
+
+/* Scenario name to the priority of the batch containers; returns -1 when unknown */
+static int scenario_priority(const char *name, struct launch_priority *prio)
+{
+    launch_priority_init(prio);
+    if (strcmp(name, "none") == 0 || strcmp(name, "other") == 0) {
+        return 0;
+    }
+    if (strcmp(name, "nice19") == 0) {
+        prio->nice = 19;
+        return 0;
+    }
+    prio->policy = launch_parse_sched(name);
+    return prio->policy < 0 ? -1 : 0;
+}
+
+static int run_scenario(const struct bench_opts *opts, const char *name, unsigned long loops,
+                        double *lat, int first)
+{
+    struct launch_priority prio;
+    if (scenario_priority(name, &prio) != 0) {
+        fprintf(stderr, "[bench] unknown policy '%s'\n", name);
+        return -1;
+    }
+
+    /* The batch containers are this program again, spinning until killed */
+    char *argv[] = { "sched_bench", "--spin", NULL };
+    char *envp[] = { NULL };
+    struct launch_spec spec = {
+        .rootfs = "/",
+        .log_path = "/dev/null",
+        .path = "/proc/self/exe",
+        .argv = argv,
+        .envp = envp,
+        .prio = &prio,
+        .mode = LAUNCH_VFORK,
+    };
+    long nbatch = strcmp(name, "none") == 0 ? 0 : opts->batch;
+    pid_t pids[MAX_BATCH];
+    long started = 0;
+    for (; started < nbatch; started++) {
+        int exec_errno;
+        pids[started] = launch_container(&spec, &exec_errno);
+        if (pids[started] == -1 || exec_errno != 0) {
+            fprintf(stderr, "[bench] launch failed: %s\n",
+                    strerror(pids[started] == -1 ? errno : exec_errno));
+            if (pids[started] != -1) {
+                waitpid(pids[started], NULL, 0);
+            }
+            break;
+        }
+    }
+
+    int rc = -1;
+    if (started == nbatch) {
+        /* Let the spinners reach a steady state before measuring */
+        struct timespec settle = { 0, 200 * 1000000L };
+        nanosleep(&settle, NULL);
+
+        struct timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        for (long i = 0; i < opts->samples; i++) {
+            next.tv_nsec += opts->period_us * 1000;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+            }
+            work(loops);
+            /* Lateness: from when the wakeup was due to the end of the work */
+            lat[i] = now_us() - (next.tv_sec * 1e6 + next.tv_nsec / 1e3);
+        }
+
+        mdock_sort_samples(lat, (size_t)opts->samples);
+        fprintf(opts->out,
+                "%s\n    {\"batch_policy\": \"%s\", \"batch_containers\": %ld, \"samples\": %ld, "
+                "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}",
+                first ? "" : ",", name, nbatch, opts->samples,
+                mdock_percentile(lat, (size_t)opts->samples, 0.50),
+                mdock_percentile(lat, (size_t)opts->samples, 0.99),
+                mdock_percentile(lat, (size_t)opts->samples, 0.999), lat[opts->samples - 1]);
+        fflush(opts->out);
+        rc = 0;
+    }
+
+    for (long k = 0; k < started; k++) {
+        kill(pids[k], SIGKILL);
+    }
+    for (long k = 0; k < started; k++) {
+        waitpid(pids[k], NULL, 0);
+    }
+    return rc;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sched_bench [--batch N] [--samples N] [--period-us N] [--work-us N]\n"
+                    "                   [--policies none,other,batch,idle,nice19] [--out FILE]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "--spin") == 0) {
+        for (;;) {
+            sink++;
+        }
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    struct bench_opts opts = {
+        .batch = 4 * (cpus > 0 ? cpus : 1),
+        .samples = 2000,
+        .period_us = 4000,
+        .work_us = 1000,
+        .policies = { "none", "other", "batch", "idle" },
+        .npolicies = 4,
+        .out = stdout,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (strcmp(argv[i], "--batch") == 0) {
+            opts.batch = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--samples") == 0) {
+            opts.samples = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--period-us") == 0) {
+            opts.period_us = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--work-us") == 0) {
+            opts.work_us = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--policies") == 0) {
+            opts.npolicies = 0;
+            for (char *tok = strtok(argv[++i], ","); tok && opts.npolicies < MAX_POLICIES;
+                 tok = strtok(NULL, ",")) {
+                opts.policies[opts.npolicies++] = tok;
+            }
+        } else if (strcmp(argv[i], "--out") == 0) {
+            opts.out = fopen(argv[++i], "w");
+            if (!opts.out) {
+                perror("[bench] fopen");
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (opts.batch < 1 || opts.batch > MAX_BATCH || opts.samples <= 0 || opts.period_us <= 0 ||
+        opts.work_us < 0 || opts.work_us >= opts.period_us || opts.npolicies == 0) {
+        usage();
+        return 1;
+    }
+
+    double *lat = malloc((size_t)opts.samples * sizeof(*lat));
+    if (!lat) {
+        perror("[bench] malloc");
+        return 1;
+    }
+    unsigned long loops = calibrate(opts.work_us);
+
+    fprintf(opts.out, "{\n  \"benchmark\": \"mdock-sched\",\n  \"timestamp\": %ld,\n  \"cpus\": %ld,\n"
+                      "  \"period_us\": %ld,\n  \"work_us\": %ld,\n  \"results\": [",
+            (long)time(NULL), cpus, opts.period_us, opts.work_us);
+    for (int p = 0; p < opts.npolicies; p++) {
+        if (run_scenario(&opts, opts.policies[p], loops, lat, p == 0) != 0) {
+            free(lat);
+            return 1;
+        }
+    }
+    fprintf(opts.out, "\n  ]\n}\n");
+    if (opts.out != stdout) {
+        fclose(opts.out);
+    }
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef MDOCK_BENCH_H
+#define MDOCK_BENCH_H
+
+/*
+ * mdock bench run: time from starting `mdock run` to the first instruction
+ * of the workload. Each iteration runs real_programs/probe in the image,
+ * which writes its start time on CLOCK_MONOTONIC to a FIFO; the latency is
+ * that minus the moment the harness spawned mdock. Phases with a warm and
+ * a cold page cache (the image's files evicted before every launch) are
+ * reported as JSON.
+ */
+#define BENCH_DEFAULT_ITERATIONS  200
+#define BENCH_MAX_ITERATIONS      100000
+#define BENCH_MAX_CONCURRENCY     256
+
+int cmd_bench(int argc, char **argv);
+
+#endif /* MDOCK_BENCH_H */
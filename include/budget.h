@@ -0,0 +1,47 @@
+#ifndef MDOCK_BUDGET_H
+#define MDOCK_BUDGET_H
+
+#include <stdint.h>
+#include <linux/limits.h>
+
+/*
+ * Memory admission control for run. A container started with a memory
+ * limit (--mem, --memory or --mem-rss; the largest counts) commits that
+ * many bytes until it exits, and a run that would take the committed sum
+ * of the running containers past the host budget is refused, or waits
+ * with --wait. The budget is $MDOCK_MEM_BUDGET, else the first line of
+ * <root>/mem_budget: a size ("48G"), a share of MemTotal ("75%") or
+ * "off"; unconfigured it is BUDGET_DEFAULT_PERCENT of MemTotal.
+ * Containers without a limit are not counted.
+ */
+#define BUDGET_DEFAULT_PERCENT  75
+#define BUDGET_RECHECK_MS       1000    /* --wait: recount without a DB change */
+
+struct mem_budget {
+    int64_t total;          /* MemTotal */
+    int64_t available;      /* MemAvailable */
+    int64_t budget;         /* 0 when admission is off */
+    char source[PATH_MAX + 32];     /* where the budget came from, for info */
+};
+
+/* What the running containers hold */
+struct mem_commit {
+    int64_t committed;
+    int containers;         /* running containers with a limit */
+    int unlimited;          /* running containers without one */
+};
+
+int budget_load(const char *base_dir, struct mem_budget *b);
+
+/* Sum up the running containers in containers.db; the caller may hold its lock */
+int budget_committed(const char *db_path, struct mem_commit *c);
+
+/* --wait: sleep until containers.db is rewritten or timeout_ms pass */
+void budget_wait_change(const char *base_dir, int timeout_ms);
+
+/* Bytes as "1.5GiB" */
+void budget_format(int64_t bytes, char *buf, size_t size);
+
+int cmd_info(int argc, char **argv);
+
+#endif /* MDOCK_BUDGET_H */
@@ -0,0 +1,47 @@
+#ifndef MDOCK_CGROUP_H
+#define MDOCK_CGROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * cgroup v2 limits. A container started with any of them runs in its own
+ * leaf <cgroup root>/<state key>/<container id>. The cgroup root is
+ * $MDOCK_CGROUP_ROOT (a delegated subtree) or "mdock" under the cgroup2
+ * mount; the state key keeps containers of different state roots apart.
+ */
+#define CGROUP_CPU_PERIOD_US  100000
+#define CGROUP_IO_MAX_RULES   8
+
+struct cgroup_limits {
+    int64_t memory_max;     /* memory.max bytes, 0 = unlimited */
+    int64_t cpu_quota_us;   /* cpu.max quota per CGROUP_CPU_PERIOD_US, 0 = unlimited */
+    int64_t pids_max;       /* pids.max, 0 = unlimited */
+    int io_weight;          /* io.weight 1-10000, 0 = default */
+    const char *io_max[CGROUP_IO_MAX_RULES];   /* io.max lines, "MAJ:MIN rbps=..." */
+    int io_max_count;
+};
+
+/* 1 when any limit is set, i.e. the container needs a leaf */
+int cgroup_limits_any(const struct cgroup_limits *l);
+
+/* --cpus value (e.g. 1.5) as a cpu.max quota, -1 when invalid */
+int64_t cgroup_parse_cpus(const char *str);
+
+/*
+ * Create the leaf for a container with the limits written, and store the
+ * path of its cgroup.procs (which the container joins before exec).
+ * Prints the error and returns -1 when cgroup v2 or a controller is
+ * missing.
+ */
+int cgroup_create(const char *base_dir, const char *container_id,
+                  const struct cgroup_limits *l, char *procs_path, size_t size);
+
+/*
+ * After the container has exited: why the kernel ended it according to
+ * memory.events (NULL when it did not), then remove the leaf. Containers
+ * without a leaf return NULL.
+ */
+const char *cgroup_release(const char *base_dir, const char *container_id);
+
+#endif /* MDOCK_CGROUP_H */
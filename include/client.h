@@ -0,0 +1,12 @@
+#ifndef MDOCK_CLIENT_H
+#define MDOCK_CLIENT_H
+
+/*
+ * Run a command through mdockd if one is listening for the state root.
+ * Returns 0 and stores the command's exit status in *status when the
+ * daemon served it, or -1 when there is no daemon and the caller should
+ * run the command itself.
+ */
+int mdock_client_run(int argc, char **argv, int *status);
+
+#endif /* MDOCK_CLIENT_H */
@@ -0,0 +1,15 @@
+#ifndef MDOCK_COMMANDS_H
+#define MDOCK_COMMANDS_H
+
+/* Shared by the mdock CLI and mdockd: argv[0] is the program, argv[1] the command */
+void mdock_print_usage(const char *prog);
+int mdock_dispatch(int argc, char **argv);
+
+/*
+ * Commands that block, stream or measure in the client (a foreground run,
+ * run --wait, stop, wait, logs -f, stats, top, bench, compose) always run
+ * in the client process so they never hold up the daemon.
+ */
+int mdock_command_is_local(int argc, char **argv);
+
+#endif /* MDOCK_COMMANDS_H */
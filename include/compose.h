@@ -0,0 +1,22 @@
+#ifndef MDOCK_COMPOSE_H
+#define MDOCK_COMPOSE_H
+
+/*
+ * Multi-container startup from a manifest. `compose up -f app.conf` reads
+ * one [service] section per container (image, command, env, run options,
+ * depends_on, ready) and orders the services into waves: a service is in
+ * the wave after the last of its dependencies. Every service of a wave is
+ * started at once, and the next wave waits for this one's readiness checks.
+ * `compose down` stops the waves in reverse order, each in parallel. The
+ * containers of a project are kept in <root>/compose/<project>.state.
+ */
+#define COMPOSE_DEFAULT_FILE      "compose.conf"
+#define COMPOSE_MAX_SERVICES      64
+#define COMPOSE_LINE_MAX          4096
+#define COMPOSE_MAX_ARGS          256     /* run argv of one service */
+#define COMPOSE_READY_TIMEOUT_S   30
+#define COMPOSE_READY_POLL_MS     20
+
+int cmd_compose(int argc, char **argv);
+
+#endif /* MDOCK_COMPOSE_H */
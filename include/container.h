@@ -2,25 +2,56 @@
 #define MDOCK_CONTAINER_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+struct container_record;
+struct rusage;
+
 /* Container database helpers */
 int add_container_record(const char *base_dir,
                          const char *container_id,
                          int pid,
-                         const char *image_name);
+                         const char *image_name,
+                         const char *shard);
 
+/* duration_ns is the CLOCK_MONOTONIC run time measured by the caller */
 int update_container_exit(const char *base_dir,
                           const char *container_id,
-                          int exit_code);
+                          int exit_code,
+                          const char *reason,
+                          int64_t duration_ns);
+
+/* How one container ended */
+struct container_exit {
+    const char *container_id;
+    pid_t pid;
+    int status;             /* as returned by waitpid() */
+    int64_t duration_ns;    /* CLOCK_MONOTONIC run time measured by the caller */
+    const char *limit_reason;   /* a limit enforced by signals (watchdog), NULL for none */
+    int cpu_milli;          /* CPU rate achieved under --cpu-rate, 1/1000 CPUs */
+    const struct rusage *usage; /* from wait4(), NULL when unknown */
+};
+
+/*
+ * Record how a container ended: exit code, reason, measured run time and
+ * resource usage. limit_reason overrides the reason taken from the wait
+ * status.
+ */
+void record_container_exit(const char *base_dir, const struct container_exit *e);
+
+/* Record several exits with one rewrite; the caller holds the containers.db lock */
+int record_container_exits_locked(const char *base_dir,
+                                  const struct container_exit *exits,
+                                  int count);
 
 /* Generate next container ID (c1, c2, ...) */
 int generate_container_id(const char *base_dir,
                           char *out_id,
                           size_t out_size);
 
-/* Check if a PID is still alive */
-int is_pid_alive(pid_t pid);
+/* Check if the container's process is still alive (not a reused pid) */
+int container_is_alive(const struct container_record *rec);
 
 /* Find container by ID and get its PID and status */
 int find_container_by_id(const char *base_dir,
@@ -29,16 +60,42 @@ int find_container_by_id(const char *base_dir,
                          char *out_status,
                          size_t status_size);
 
+/* Find container by ID and return its full record */
+int find_container_record(const char *base_dir,
+                          const char *container_id,
+                          struct container_record *out);
+
 /* Update container status field */
 int update_container_status(const char *base_dir,
                             const char *container_id,
                             const char *new_status);
 
+/* Delete a container record from containers.db */
+int remove_container_record(const char *base_dir,
+                            const char *container_id);
+
+/* The options of run; a name ending in '=' matches "--name=value" */
+struct run_option {
+    const char *name;
+    int takes_value;
+};
+
+extern const struct run_option run_options[];
+
+/* The entry for a run option, NULL when run has no such option */
+const struct run_option *run_option_find(const char *arg);
+
+/* --mem / --cpu values: bytes and seconds, -1 when invalid */
+long parse_memory_limit(const char *str);
+long parse_cpu_limit(const char *str);
+
 /* Commands */
 int cmd_run(int argc, char **argv);
 int cmd_ps(int argc, char **argv);
 int cmd_stop(int argc, char **argv);
 int cmd_rm(int argc, char **argv);
 int cmd_logs(int argc, char **argv);
+int cmd_wait(int argc, char **argv);
+int cmd_inspect(int argc, char **argv);
 
 #endif /* MDOCK_CONTAINER_H */
@@ -5,6 +5,10 @@
 #include <stddef.h>
 
 int mdock_get_home(char *buf, size_t size);
+
+/* State root: --root, then $MDOCK_ROOT, then $HOME/.mdock */
+void mdock_set_root(const char *path);
+int mdock_get_root(char *buf, size_t size);
 int ensure_dir_exists(const char *path, mode_t mode);
 int copy_dir(const char *src, const char *dst);
 
@@ -0,0 +1,80 @@
+#ifndef MDOCK_HISTORY_H
+#define MDOCK_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct stats_sample;
+
+/*
+ * Metrics history of one container: <root>/history/<id>.hist, a file of
+ * fixed size mapped by the container's monitor, which appends a sample
+ * every interval. The space after the header is split between
+ * HISTORY_TIERS rings of equal length; every HISTORY_FACTOR samples of a
+ * tier are folded into one sample of the next, so the newest minutes are
+ * kept at full resolution and older hours at 10x and 100x the interval.
+ * Readers copy the mapping and retry while the writer's sequence count
+ * is odd or moved.
+ */
+#define HISTORY_DEFAULT_SIZE   (64 * 1024)
+#define HISTORY_MIN_SIZE       4096
+#define HISTORY_MAX_SIZE       (64 * 1024 * 1024)
+#define HISTORY_INTERVAL_MS    1000
+#define HISTORY_TIERS          3
+#define HISTORY_FACTOR         10
+
+struct history_sample {
+    int64_t time_ns;        /* CLOCK_REALTIME at the end of the slot */
+    int64_t cpu_ns;         /* CPU time of the tree at that point */
+    int64_t rss;            /* average resident bytes over the slot */
+    int64_t rss_max;        /* highest sample in the slot */
+    uint64_t minflt;        /* counters as of time_ns */
+    uint64_t majflt;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    int32_t cpu_milli;      /* average CPU rate over the slot, 1/1000 CPUs */
+    int32_t threads;        /* highest count in the slot */
+    int32_t pids;
+    int32_t reserved;
+};
+
+struct history_tier {
+    uint32_t step_ms;       /* time one slot covers */
+    uint32_t capacity;      /* slots in the ring */
+    uint64_t offset;        /* of slot 0 in the file */
+    uint64_t written;       /* samples appended so far; the next goes to written % capacity */
+};
+
+struct history_header {
+    char magic[8];
+    uint32_t sample_size;
+    uint32_t ntiers;
+    uint64_t seq;           /* odd while an append is in progress */
+    struct history_tier tiers[HISTORY_TIERS];
+};
+
+struct history {
+    int fd;
+    void *map;
+    size_t size;
+    struct history_header *hdr;
+    struct history_sample pending[HISTORY_TIERS];  /* folding into the next tier */
+    int npending[HISTORY_TIERS];
+};
+
+/* Create (or replace) the file of size bytes; -1 when it cannot be mapped */
+int history_create(const char *base_dir, const char *container_id, int64_t size,
+                   int interval_ms, struct history *h);
+void history_append(struct history *h, const struct stats_sample *s);
+void history_close(struct history *h);
+
+/*
+ * Samples at or after since_ns in time order, the finest tier that still
+ * covers each stretch. *out is malloc'ed. Returns the count or -1.
+ */
+int history_read(const char *base_dir, const char *container_id, int64_t since_ns,
+                 struct history_sample **out);
+
+void history_remove(const char *base_dir, const char *container_id);
+
+#endif /* MDOCK_HISTORY_H */
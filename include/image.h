@@ -7,7 +7,7 @@ int cmd_build(int argc, char **argv);
 int cmd_images(int argc, char **argv);
 int cmd_rmi(int argc, char **argv);
 
-/* Initialize ~/.mdock and return its path in out_base_dir */
+/* Initialize the state root (~/.mdock by default) and return its path in out_base_dir */
 int mdock_init_home(char *out_base_dir, size_t size);
 
 /* Lookup rootfs path for an image (used later in run) */
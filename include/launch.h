@@ -0,0 +1,121 @@
+#ifndef MDOCK_LAUNCH_H
+#define MDOCK_LAUNCH_H
+
+#include <limits.h>
+#include <sched.h>     /* cpu_set_t: users define _GNU_SOURCE */
+#include <stddef.h>
+#include <sys/types.h>
+
+enum launch_mode {
+    LAUNCH_VFORK,   /* clone(CLONE_VM | CLONE_VFORK): nothing is copied */
+    LAUNCH_FORK     /* plain fork(): the whole caller is copied on write */
+};
+
+#define LAUNCH_UNSET INT_MIN     /* nice or oom_score_adj left as inherited */
+
+/*
+ * How the container competes with its neighbours for CPU, disk and
+ * memory. Each setting is applied by the child before exec, so the
+ * program and everything it forks start with it.
+ */
+struct launch_priority {
+    int nice;           /* setpriority() value -20..19, LAUNCH_UNSET to inherit */
+    int policy;         /* SCHED_OTHER, SCHED_BATCH or SCHED_IDLE, -1 to inherit */
+    int ioprio;         /* ioprio_set() value (class << 13 | level), -1 to inherit */
+    int oom_score_adj;  /* -1000..1000, LAUNCH_UNSET to inherit */
+};
+
+void launch_priority_init(struct launch_priority *prio);
+int launch_priority_any(const struct launch_priority *prio);
+
+/* "other", "batch" or "idle" to a SCHED_* policy; -1 for anything else */
+int launch_parse_sched(const char *name);
+const char *launch_sched_name(int policy);
+
+/* "rt:N", "be:N" (N 0-7, 0 highest) or "idle" to an ioprio value; -1 when invalid */
+int launch_parse_ioprio(const char *str);
+int launch_format_ioprio(int ioprio, char *buf, size_t size);
+
+/* Transparent huge pages for the container, on top of the system policy */
+enum launch_thp {
+    LAUNCH_THP_INHERIT,
+    LAUNCH_THP_NEVER,       /* no huge pages at all */
+    LAUNCH_THP_MADVISE,     /* only in ranges the program madvise()s (Linux 6.18+) */
+    LAUNCH_THP_ALWAYS       /* clear an inherited opt-out; the system policy applies */
+};
+
+/*
+ * Memory behaviour of the container, set up by the child before exec.
+ * Both prctl() settings survive exec; an mlockall() would not, so
+ * mlock_all only lifts RLIMIT_MEMLOCK for a program that locks itself.
+ */
+struct launch_memory {
+    enum launch_thp thp;
+    int ksm;                /* PR_SET_MEMORY_MERGE: offer all anonymous memory to KSM */
+    int mlock_all;          /* RLIMIT_MEMLOCK to unlimited */
+};
+
+int launch_memory_any(const struct launch_memory *mem);
+
+/* "never", "madvise" or "always"; -1 for anything else */
+int launch_parse_thp(const char *name);
+const char *launch_thp_name(enum launch_thp thp);
+
+/* Steps of a launch, timed when spec->trace is set (run --trace) */
+enum launch_phase {
+    LAUNCH_PHASE_CLONE,     /* clone() or fork() until the child runs */
+    LAUNCH_PHASE_SIGNALS,   /* handler reset, setpgid */
+    LAUNCH_PHASE_CGROUP,
+    LAUNCH_PHASE_BIND,      /* sched_setaffinity, set_mempolicy */
+    LAUNCH_PHASE_PRIORITY,
+    LAUNCH_PHASE_MEMORY,
+    LAUNCH_PHASE_LOG,       /* stdout/stderr to the log file */
+    LAUNCH_PHASE_RLIMIT,
+    LAUNCH_PHASE_CHDIR,
+    LAUNCH_PHASE_EXECVE,    /* execve() until the caller resumes */
+    LAUNCH_PHASE_COUNT
+};
+
+extern const char *const launch_phase_names[LAUNCH_PHASE_COUNT];
+
+/* CLOCK_MONOTONIC ends of the phases; 0 for those never reached */
+struct launch_trace {
+    int64_t start_ns;
+    int64_t end_ns[LAUNCH_PHASE_COUNT];
+};
+
+/*
+ * Everything the container process needs, prepared by the parent so the
+ * child only redirects, applies limits and execs.
+ */
+struct launch_spec {
+    const char *rootfs;         /* working directory of the container */
+    const char *log_path;       /* stdout/stderr are appended here */
+    const char *path;           /* program to exec */
+    const char *fallback_path;  /* tried when path fails, may be NULL */
+    char **argv;
+    char **envp;
+    long mem_limit;             /* RLIMIT_AS bytes, <= 0 for none */
+    long cpu_limit;             /* RLIMIT_CPU seconds, <= 0 for none */
+    const char *cgroup_procs;   /* cgroup.procs of the leaf to join, NULL for none */
+    const cpu_set_t *cpuset;    /* sched_setaffinity() mask, NULL for none */
+    const unsigned long *mem_nodes;  /* set_mempolicy(MPOL_BIND) nodemask, NULL for none */
+    unsigned long mem_maxnode;       /* bits in mem_nodes */
+    const struct launch_priority *prio;  /* NULL to inherit everything */
+    const struct launch_memory *memory;  /* NULL to inherit everything */
+    int own_pgrp;               /* lead a new process group (--cpu-rate stops the group) */
+    enum launch_mode mode;
+    struct launch_trace *trace; /* filled in by launch_container(), NULL when not tracing */
+};
+
+/*
+ * Start the container process and wait until it has exec'd. Returns its
+ * pid and stores 0 in *exec_errno, or the errno of the failed cgroup
+ * join, CPU/NUMA binding, priority, memory setup, chdir or execve (the
+ * child has then already exited with status 1 and must still be reaped).
+ * Returns -1 when no process could be created. LAUNCH_VFORK falls back to
+ * fork() where clone() is not permitted.
+ */
+pid_t launch_container(const struct launch_spec *spec, int *exec_errno);
+
+#endif /* MDOCK_LAUNCH_H */
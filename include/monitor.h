@@ -0,0 +1,40 @@
+#ifndef MDOCK_MONITOR_H
+#define MDOCK_MONITOR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "launch.h"
+
+struct watchdog_limits;
+struct watchdog_result;
+
+/*
+ * Start a container under a monitor process, which waits for it, enforcing
+ * the userspace limits wd (may be NULL) meanwhile, and records its exit.
+ * With detach (run -d) the monitor is double-forked so it outlives the
+ * caller. Otherwise (a foreground --replicas run with --mem-rss, --cpu-rate
+ * or --history) it is a child of the caller in the caller's session, and
+ * its pid is returned in *out_monitor for the caller to reap. The caller
+ * writes the running record. Returns 0 with the container pid in *out_pid
+ * once the container has exec'd, or -1 (a pid is still returned when the
+ * exec itself failed).
+ */
+int monitor_start(const char *base_dir,
+                  const char *container_id,
+                  const struct launch_spec *spec,
+                  const struct watchdog_limits *wd,
+                  int detach,
+                  pid_t *out_pid,
+                  pid_t *out_monitor);
+
+/*
+ * Wait for the container child pid, started at mono_start, while enforcing
+ * wd and keeping its --history, then record its exit. Monitors call it,
+ * and so does a foreground run that watches its only container itself.
+ * Returns 0 or -1.
+ */
+int monitor_watch(const char *base_dir, const char *container_id, pid_t pid, int64_t mono_start,
+                  const struct watchdog_limits *wd, struct watchdog_result *res);
+
+#endif /* MDOCK_MONITOR_H */
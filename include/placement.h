@@ -0,0 +1,55 @@
+#ifndef MDOCK_PLACEMENT_H
+#define MDOCK_PLACEMENT_H
+
+#include <sched.h>     /* cpu_set_t: users define _GNU_SOURCE */
+#include <stddef.h>
+
+#define PLACEMENT_MAX_NODES    1024
+#define PLACEMENT_NODEMASK_LONGS (PLACEMENT_MAX_NODES / (8 * sizeof(unsigned long)))
+
+enum placement_policy {
+    PLACE_NONE,
+    PLACE_PACK,     /* fill the free CPUs of one NUMA node before the next */
+    PLACE_SPREAD    /* least loaded NUMA node, least loaded CPUs in it */
+};
+
+/* What run asked for: --cpuset, --numa-node, --placement, --cpu-count */
+struct placement_request {
+    cpu_set_t cpus;
+    int have_cpus;
+    int numa_node;          /* -1 for none */
+    enum placement_policy policy;
+    int count;              /* CPUs per container under a policy */
+};
+
+/* CPUs pinned by the running containers, as seen under the containers.db lock */
+struct placement_map {
+    cpu_set_t online;
+    int load[CPU_SETSIZE];  /* running containers pinned to each CPU */
+    int node[CPU_SETSIZE];  /* NUMA node of each CPU */
+    int nnodes;
+};
+
+void placement_request_init(struct placement_request *req);
+int placement_any(const struct placement_request *req);
+int placement_parse_policy(const char *str, enum placement_policy *out);
+
+/* "0-7,12" lists as used by the kernel and containers.db */
+int cpulist_parse(const char *str, cpu_set_t *set);
+int cpulist_format(const cpu_set_t *set, char *buf, size_t size);
+
+/* CPUs of a NUMA node; -1 when the node does not exist */
+int numa_node_cpus(int node, cpu_set_t *set);
+
+/* Count the pinned CPUs of every running container in containers.db */
+int placement_load(const char *db_path, struct placement_map *map);
+
+/*
+ * CPUs for the next container, and the MPOL_BIND nodemask when a NUMA
+ * node was requested (*bind_memory is then 1). Chosen CPUs are counted
+ * in map so the replicas of one run spread or pack among themselves.
+ */
+int placement_choose(struct placement_map *map, const struct placement_request *req,
+                     cpu_set_t *out, unsigned long *nodemask, int *bind_memory);
+
+#endif /* MDOCK_PLACEMENT_H */
@@ -0,0 +1,61 @@
+#ifndef MDOCK_POOL_H
+#define MDOCK_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "launch.h"
+
+/*
+ * Warm pools: a zygote process per image keeps `size` children forked
+ * ahead of time, already in the rootfs with the pool's rlimits applied.
+ * A run hands a child its log path, argv and envp and the child execs
+ * immediately; the zygote refills the pool between requests, reaps the
+ * containers it started and records their exit.
+ */
+#define POOL_DEFAULT_SIZE 4
+#define POOL_MAX_SIZE     256
+#define POOL_MISMATCH     (-1)  /* STARTED err: pool limits differ, launch locally */
+
+/* MSG_POOL_STATUS reply */
+struct pool_stats {
+    int32_t zygote_pid;
+    int32_t size;           /* warm children the zygote keeps */
+    int32_t idle;
+    int32_t running;
+    int64_t mem_limit;
+    int64_t cpu_limit;
+    uint64_t hits;          /* runs served by a warm child */
+    uint64_t misses;        /* runs that had to fork a child on demand */
+    uint64_t spawned;       /* children forked in total */
+    uint64_t spawn_ns;      /* time spent forking them */
+};
+
+/* Client side of a pool connection, used by run */
+struct pool_conn {
+    int fd;
+    struct { pid_t pid; int status; } *exited;     /* EXITED frames seen early */
+    size_t nexited;
+    size_t cap;
+};
+
+/* Connect to the warm pool of an image. Returns -1 when it has none. */
+int pool_connect(const char *base_dir, const char *image_name, struct pool_conn *conn);
+void pool_disconnect(struct pool_conn *conn);
+
+/*
+ * Start a container on a warm child. Returns 0 with *out_pid and
+ * *exec_errno set as launch_container() would, 1 when this pool cannot
+ * serve the spec (different limits) and -1 on a broken connection; in
+ * both of those cases nothing was started.
+ */
+int pool_launch(struct pool_conn *conn, const char *container_id,
+                const struct launch_spec *spec, pid_t *out_pid, int *exec_errno);
+
+/* Wait for any container started on conn to exit (the zygote records it) */
+int pool_wait(struct pool_conn *conn, pid_t *pid, int *status);
+
+int cmd_pool(int argc, char **argv);
+
+#endif /* MDOCK_POOL_H */
@@ -0,0 +1,109 @@
+#ifndef MDOCK_PROC_H
+#define MDOCK_PROC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Sorted set of the PIDs that were alive during one /proc scan */
+struct pid_set {
+    pid_t *pids;
+    size_t count;
+    size_t cap;
+};
+
+int pid_set_scan(struct pid_set *set);
+int pid_set_contains(const struct pid_set *set, pid_t pid);
+void pid_set_free(struct pid_set *set);
+
+/*
+ * Process handles. A pidfd keeps referring to the process it was opened
+ * for, so signals and exit notification cannot hit a later process that
+ * reuses the pid; starttime (from /proc/<pid>/stat, 0 to skip the check)
+ * covers the window before the pidfd is opened.
+ */
+uint64_t proc_starttime(pid_t pid);
+
+/* pidfd for pid, or -1 with errno ESRCH when it is gone or was reused */
+int proc_open(pid_t pid, uint64_t starttime);
+
+/* 1 once the process behind pidfd has exited (it becomes readable) */
+int proc_exited(int pidfd);
+int proc_signal(int pidfd, int sig);
+
+/* Liveness check through a short-lived pidfd */
+int proc_alive(pid_t pid, uint64_t starttime);
+
+/*
+ * pid and its descendants, found through /proc/<pid>/task/<tid>/children
+ * (or a scan of every process's parent on kernels without it). Returns how
+ * many were stored in pids; processes beyond max are not listed.
+ */
+int proc_tree(pid_t root, pid_t *pids, int max);
+
+/* Resident set size in bytes from /proc/<pid>/statm, -1 when it is gone */
+int64_t proc_rss(pid_t pid);
+
+/*
+ * CPU time in nanoseconds from /proc/<pid>/stat: utime+stime of every
+ * thread plus cutime+cstime of the children it has reaped. Clock tick
+ * resolution; -1 when it is gone. Samplers keep the file open with
+ * proc_stat_open() and re-read it with proc_cputime_fd().
+ */
+int64_t proc_cputime(pid_t pid);
+int proc_stat_open(pid_t pid);
+int64_t proc_cputime_fd(int fd);
+
+/* The fields of /proc/<pid>/stat (or task/<tid>/stat) samplers use */
+struct proc_stat {
+    char comm[64];          /* executable name, possibly truncated by the kernel */
+    char state;             /* R, S, D, Z, ... */
+    pid_t ppid;
+    int64_t cpu_ns;         /* utime+stime */
+    int64_t child_cpu_ns;   /* cutime+cstime of reaped children */
+    uint64_t minflt;        /* own and reaped children's faults */
+    uint64_t majflt;
+    int threads;
+    int64_t rss;            /* resident bytes, as in statm */
+    int processor;          /* CPU it last ran on */
+};
+
+/*
+ * pread() a stat file kept open; -1 once the process is gone. For a
+ * thread's task/<tid>/stat, cpu_ns and processor are the thread's own and
+ * the other fields those of its process.
+ */
+int proc_stat_read(int fd, struct proc_stat *st);
+
+/* /proc/<pid>/task/<tid>/<name>, e.g. "stat" or "wchan" */
+int proc_task_open(pid_t pid, pid_t tid, const char *name);
+
+/* Kernel function task/<tid>/wchan sleeps in, "" when running or hidden */
+int proc_wchan_read(int fd, char *buf, size_t size);
+
+/* read_bytes/write_bytes of /proc/<pid>/io (storage I/O, reaped children included) */
+int proc_io_open(pid_t pid);
+int proc_io_read(int fd, uint64_t *read_bytes, uint64_t *write_bytes);
+
+/*
+ * Children of pid. proc_children() reads the children file of every
+ * thread; a single-threaded process can keep its one file open with
+ * proc_children_open() and re-read it with proc_children_fd(). Both need
+ * CONFIG_PROC_CHILDREN, which proc_have_children() reports.
+ */
+int proc_have_children(void);
+int proc_children(pid_t pid, pid_t *pids, int max);
+int proc_children_open(pid_t pid);
+int proc_children_fd(int fd, pid_t *pids, int max);
+
+/*
+ * Turn a freshly forked child into a background helper called name: new
+ * session, stdio on /dev/null, default signal handlers and every other fd
+ * except keep_fd closed.
+ */
+void proc_detach(const char *name, int keep_fd);
+
+/* Close every fd above stderr except keep_fd, e.g. a lock held by the parent */
+void proc_close_fds(int keep_fd);
+
+#endif /* MDOCK_PROC_H */
@@ -0,0 +1,81 @@
+#ifndef MDOCK_PROTOCOL_H
+#define MDOCK_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Wire protocol between the mdock client and mdockd over <root>/mdockd.sock.
+ * Every message is a fixed header followed by len payload bytes, in host
+ * byte order (both ends are on the same machine).
+ *
+ *   client -> daemon: MSG_CMD     payload = cwd\0 the client's MDOCK_*
+ *                                 variables as NAME=value\0... \0
+ *                                 argv[0]\0argv[1]\0..., with the client's
+ *                                 stdout and stderr attached (SCM_RIGHTS);
+ *                                 the command sees those variables and
+ *                                 writes to those descriptors directly
+ *   daemon -> client: MSG_STDERR  an error of the daemon itself
+ *                     MSG_EXIT    struct msg_exit, last frame; a stream
+ *                                 the daemon buffered instead of writing
+ *                                 to a pipe or socket comes back as a
+ *                                 memfd attached to it, stdout first
+ *
+ * The warm pool zygotes (pool.c) speak the same framing on
+ * <root>/pools/<image>.sock with the MSG_POOL_* types, and the job
+ * scheduler (queue.c) on <root>/scheduler.sock with the MSG_SCHED_* types.
+ */
+#define MDOCK_PROTO_MAGIC    0x4d444b44u    /* "MDKD" */
+#define MDOCK_PROTO_VERSION  2
+#define MDOCK_PROTO_MAX      (1u << 20)     /* largest payload of one frame */
+#define MDOCK_PROTO_MAX_FDS  2              /* descriptors passed with one frame */
+#define MDOCK_SOCKET_NAME    "mdockd.sock"
+
+enum msg_type {
+    MSG_CMD = 1,
+    MSG_STDERR,
+    MSG_EXIT,
+    MSG_POOL_SPAWN,     /* start a container on a warm child */
+    MSG_POOL_STARTED,   /* int32 pid, int32 exec errno */
+    MSG_POOL_EXITED,    /* int32 pid, int32 wait status */
+    MSG_POOL_STATUS,    /* request / struct pool_stats reply */
+    MSG_POOL_STOP,
+    MSG_SCHED_WAKE,     /* jobs were submitted, no reply */
+    MSG_SCHED_STATUS,   /* request / struct sched_stats reply */
+    MSG_SCHED_STOP
+};
+
+struct msg_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t len;
+};
+
+/* MSG_EXIT payload */
+struct msg_exit {
+    int32_t status;
+    int32_t buffered;   /* MSG_EXIT_STDOUT | MSG_EXIT_STDERR: memfds attached */
+};
+#define MSG_EXIT_STDOUT  1
+#define MSG_EXIT_STDERR  2
+
+/* <root>/mdockd.sock */
+int mdock_socket_path(char *buf, size_t size);
+
+/* Send one frame. Returns 0, or -1 with errno set. */
+int msg_send(int fd, enum msg_type type, const void *payload, size_t len);
+
+/*
+ * Receive one frame into *payload (malloc'ed, NUL-terminated for
+ * convenience, freed by the caller). Returns 1 for a frame, 0 on a clean
+ * EOF before a header, -1 on error or a malformed frame.
+ */
+int msg_recv(int fd, struct msg_header *hdr, char **payload);
+
+/* The same, passing up to MDOCK_PROTO_MAX_FDS descriptors with the frame */
+int msg_send_fds(int fd, enum msg_type type, const void *payload, size_t len,
+                 const int *fds, int nfds);
+int msg_recv_fds(int fd, struct msg_header *hdr, char **payload, int *fds, int *nfds);
+
+#endif /* MDOCK_PROTOCOL_H */
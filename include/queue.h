@@ -0,0 +1,50 @@
+#ifndef MDOCK_QUEUE_H
+#define MDOCK_QUEUE_H
+
+#include <stdint.h>
+
+#include "record.h"
+
+/*
+ * Batch jobs: `submit` appends a job to <root>/jobs.db and returns. A
+ * detached scheduler started with `scheduler start` keeps a fixed set of
+ * worker processes, each running one job at a time through the normal
+ * run path and then taking the next, so at most --max-concurrent
+ * containers run however many jobs are queued. Jobs are taken in submit
+ * order, or by priority first, skipping images that are at their
+ * --image-max cap; the result of each lands back in jobs.db.
+ */
+#define QUEUE_DEFAULT_CONCURRENCY  4
+#define QUEUE_MAX_CONCURRENCY      256
+#define QUEUE_MAX_IMAGE_CAPS       64
+#define QUEUE_POLL_MS              1000     /* rescan jobs.db without a wakeup */
+#define QUEUE_RATE_WINDOW_S        60       /* recent throughput in mdock jobs */
+
+enum queue_order {
+    QUEUE_FIFO,
+    QUEUE_PRIORITY
+};
+
+/* MSG_SCHED_STATUS reply */
+struct sched_stats {
+    int32_t pid;
+    int32_t workers;
+    int32_t busy;
+    int32_t order;          /* enum queue_order */
+    int32_t draining;
+    int32_t ncaps;
+    uint64_t started;       /* jobs handed to a worker */
+    uint64_t finished;
+    uint64_t failed;        /* no container started */
+    struct {
+        char image[MDOCK_NAME_MAX];
+        int32_t max;
+        int32_t running;
+    } caps[QUEUE_MAX_IMAGE_CAPS];
+};
+
+int cmd_submit(int argc, char **argv);
+int cmd_scheduler(int argc, char **argv);
+int cmd_jobs(int argc, char **argv);
+
+#endif /* MDOCK_QUEUE_H */
@@ -0,0 +1,269 @@
+#ifndef MDOCK_RECORD_H
+#define MDOCK_RECORD_H
+
+#include <stdio.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/limits.h>
+
+/* Field limits shared by every reader of the .db files */
+#define MDOCK_ID_MAX      64
+#define MDOCK_NAME_MAX    256
+#define MDOCK_STATUS_MAX  32
+#define MDOCK_TIME_MAX    32
+#define MDOCK_REASON_MAX  64
+#define MDOCK_CPUSET_MAX  128
+#define MDOCK_POLICY_MAX  16
+
+#define MDOCK_UNSET       INT_MIN   /* optional integer field that is empty */
+
+#define DB_MAX_FIELDS     48
+
+/* A field is a slice of the mapped file; it is NOT NUL-terminated */
+struct db_field {
+    const char *ptr;
+    size_t len;
+};
+
+/* A whole .db file mapped read-only */
+struct db_map {
+    const char *data;
+    size_t size;
+};
+
+/* One line of a .db file split on '|' */
+struct db_row {
+    const char *line;   /* start of the raw line */
+    size_t len;         /* raw length, including the newline if present */
+    struct db_field fields[DB_MAX_FIELDS];
+    int nfields;
+};
+
+struct db_scanner {
+    const char *pos;
+    const char *end;
+};
+
+/* Map a .db file. An empty file maps as an empty buffer; a missing one fails with ENOENT. */
+int db_map_open(const char *path, struct db_map *map);
+void db_map_close(struct db_map *map);
+
+/* Keep mappings across db_map_open() calls while the file is unchanged (mdockd) */
+void db_map_cache_enable(void);
+
+/* Split the next line into fields. Returns 1 for a row, 0 at end of buffer. */
+void db_scanner_init(struct db_scanner *s, const struct db_map *map);
+int db_scanner_next(struct db_scanner *s, struct db_row *row);
+
+/* Same, walking backwards from the end of the buffer (newest row first) */
+int db_scanner_prev(struct db_scanner *s, struct db_row *row);
+
+/* Field helpers */
+int db_field_eq(const struct db_field *f, const char *s);
+long db_field_long(const struct db_field *f);
+void db_field_copy(const struct db_field *f, char *buf, size_t size);
+
+/* Nanosecond timestamp field; legacy "%Y-%m-%dT%H:%M:%S" values are converted */
+int64_t db_field_time(const struct db_field *f);
+
+/*
+ * Writers serialize on an flock() of <path>.lock. Returns the lock fd to
+ * pass to db_unlock(), or -1 on error.
+ */
+int db_lock(const char *path);
+void db_unlock(int fd);
+
+/* Non-blocking db_lock(): -1 with errno EWOULDBLOCK while another writer holds it */
+int db_trylock(const char *path);
+
+/*
+ * Rewrite a .db file through <path>.tmp and rename() under db_lock(). The callback is
+ * called for every row: it returns 0 to keep the row verbatim, or 1 when
+ * it has dropped the row or written its own replacement to out.
+ * Returns the number of changed rows (the file is untouched when 0),
+ * or -1 on error.
+ */
+typedef int (*db_rewrite_fn)(const struct db_row *row, FILE *out, void *arg);
+int db_rewrite(const char *path, db_rewrite_fn fn, void *arg);
+
+/* Same, for a caller that already holds db_lock(path) */
+int db_rewrite_locked(const char *path, db_rewrite_fn fn, void *arg);
+
+/* ----- containers.db ----- */
+
+/*
+ * Format: id|pid|image|status|start_ns|end_ns|exit_code|shard|duration_ns|pid_start|reason|cpuset|numa_node|cpu_rate|cpu_used|
+ *         utime_us|stime_us|maxrss_kb|minflt|majflt|nvcsw|nivcsw|inblock|oublock|
+ *         nice|sched|ioprio|oom_score_adj|thp|ksm|mlock_all|mem_commit
+ * Times are CLOCK_REALTIME nanoseconds; duration is measured by the
+ * runtime with CLOCK_MONOTONIC. pid_start is the process start time from
+ * /proc/<pid>/stat, which tells the container apart from a later process
+ * that reuses its pid. reason says why the kernel ended the container,
+ * when it did. cpuset ("0-7,12") and numa_node are empty for a container
+ * that may run anywhere. cpu_rate is the --cpu-rate limit and cpu_used
+ * the rate the container achieved under it, both in 1/1000 CPUs (0 for
+ * none). The usage fields are the rusage of the reaped container (its
+ * waited-for descendants included) and stay empty until it has exited.
+ * nice, sched ("batch"), ioprio ("be:4") and oom_score_adj are the
+ * priorities given to run, empty for those the container inherited.
+ * thp is the --thp policy (empty for the system's); ksm and mlock_all are
+ * 1 when the container ran with --ksm or --mlock-all. mem_commit is the
+ * memory admission counted for the container (its largest memory limit,
+ * in bytes), empty for a container run without one.
+ * Rows need the first CF_REQUIRED fields;
+ * later fields are optional so records written by older versions still
+ * parse.
+ */
+enum {
+    CF_ID,
+    CF_PID,
+    CF_IMAGE,
+    CF_STATUS,
+    CF_START,
+    CF_END,
+    CF_EXIT,
+    CF_SHARD,       /* data directory holding the container's log */
+    CF_DURATION,
+    CF_PID_START,
+    CF_REASON,
+    CF_CPUSET,
+    CF_NUMA_NODE,
+    CF_CPU_RATE,
+    CF_CPU_USED,
+    CF_UTIME,       /* rusage of the reaped container, see struct container_usage */
+    CF_STIME,
+    CF_MAXRSS,
+    CF_MINFLT,
+    CF_MAJFLT,
+    CF_NVCSW,
+    CF_NIVCSW,
+    CF_INBLOCK,
+    CF_OUBLOCK,
+    CF_NICE,
+    CF_SCHED,
+    CF_IOPRIO,
+    CF_OOM_SCORE_ADJ,
+    CF_THP,
+    CF_KSM,
+    CF_MLOCK_ALL,
+    CF_MEM_COMMIT,  /* bytes held against the memory budget */
+    CF_COUNT
+};
+
+#define CF_REQUIRED (CF_EXIT + 1)
+
+/* What wait4() reported for a container, in the units getrusage() uses */
+struct container_usage {
+    int64_t utime_us;       /* user CPU time */
+    int64_t stime_us;       /* system CPU time */
+    int64_t maxrss_kb;      /* peak resident set of the largest process */
+    int64_t minflt;         /* page faults served without I/O */
+    int64_t majflt;         /* page faults that needed I/O */
+    int64_t nvcsw;          /* voluntary context switches (blocked) */
+    int64_t nivcsw;         /* involuntary context switches (preempted) */
+    int64_t inblock;        /* 512-byte blocks read from storage */
+    int64_t oublock;        /* 512-byte blocks written */
+};
+
+struct container_record {
+    char id[MDOCK_ID_MAX];
+    int pid;
+    char image[MDOCK_NAME_MAX];
+    char status[MDOCK_STATUS_MAX];
+    int64_t start_ns;
+    int64_t end_ns;         /* 0 while running */
+    int exit_code;
+    char shard[PATH_MAX];   /* empty = the state root */
+    int64_t duration_ns;    /* 0 until the runtime has measured it */
+    uint64_t pid_start;     /* clock ticks after boot, 0 when unknown */
+    char reason[MDOCK_REASON_MAX];  /* empty for a normal exit */
+    char cpuset[MDOCK_CPUSET_MAX];  /* CPUs it is pinned to, empty for none */
+    int numa_node;                  /* memory bound to this node, -1 for none */
+    int cpu_rate_milli;             /* --cpu-rate limit, 0 for none */
+    int cpu_used_milli;             /* average rate achieved under it, 0 until exit */
+    int has_usage;                  /* usage was recorded when it was reaped */
+    struct container_usage usage;
+    int nice;                       /* --nice, MDOCK_UNSET when inherited */
+    char sched[MDOCK_POLICY_MAX];   /* --sched policy, empty when inherited */
+    char ioprio[MDOCK_POLICY_MAX];  /* --ioprio class:level, empty when inherited */
+    int oom_score_adj;              /* --oom-score-adj, MDOCK_UNSET when inherited */
+    char thp[MDOCK_POLICY_MAX];     /* --thp policy, empty for the system's */
+    int ksm;                        /* anonymous memory offered to KSM */
+    int mlock_all;                  /* RLIMIT_MEMLOCK lifted for mlockall() */
+    int64_t mem_commit;             /* bytes counted against the memory budget, 0 for none */
+};
+
+int container_record_parse(const struct db_row *row, struct container_record *rec);
+int container_record_write(FILE *f, const struct container_record *rec);
+
+/* ----- images.db ----- */
+
+/* Format: image_name|rootfs_path|created_ns|shard */
+enum {
+    IF_NAME,
+    IF_ROOTFS,
+    IF_CREATED,
+    IF_SHARD,       /* data directory holding the rootfs */
+    IF_COUNT
+};
+
+#define IF_REQUIRED (IF_CREATED + 1)
+
+struct image_record {
+    char name[MDOCK_NAME_MAX];
+    char rootfs[PATH_MAX];
+    int64_t created_ns;
+    char shard[PATH_MAX];   /* empty = the state root */
+};
+
+int image_record_parse(const struct db_row *row, struct image_record *rec);
+int image_record_write(FILE *f, const struct image_record *rec);
+
+/* ----- jobs.db ----- */
+
+/*
+ * Format: id|state|priority|image|submit_ns|start_ns|end_ns|container|exit_code|worker|args
+ * A job is submitted "queued"; the scheduler makes it "running" when a
+ * worker takes it and "exited" (exit_code is the container's) or "failed"
+ * (no container started) when it ends. container, exit_code and worker
+ * (the pid of the worker) stay empty until then. args are the arguments
+ * of the run that executes it: options, image, program and its arguments,
+ * each %XX-escaped and separated by spaces.
+ */
+enum {
+    JF_ID,
+    JF_STATE,
+    JF_PRIORITY,
+    JF_IMAGE,
+    JF_SUBMIT,
+    JF_START,
+    JF_END,
+    JF_CONTAINER,
+    JF_EXIT,
+    JF_WORKER,
+    JF_ARGS,
+    JF_COUNT
+};
+
+#define JF_REQUIRED JF_COUNT
+#define MDOCK_JOB_ARGS_MAX  8192
+
+struct job_record {
+    char id[MDOCK_ID_MAX];
+    char state[MDOCK_STATUS_MAX];
+    int priority;
+    char image[MDOCK_NAME_MAX];
+    int64_t submit_ns;
+    int64_t start_ns;               /* 0 while queued */
+    int64_t end_ns;                 /* 0 until it ended */
+    char container[MDOCK_ID_MAX];   /* empty until it ended */
+    int exit_code;                  /* MDOCK_UNSET until it ended */
+    int worker;                     /* 0 while queued */
+    char args[MDOCK_JOB_ARGS_MAX];
+};
+
+int job_record_parse(const struct db_row *row, struct job_record *rec);
+int job_record_write(FILE *f, const struct job_record *rec);
+
+#endif /* MDOCK_RECORD_H */
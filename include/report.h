@@ -0,0 +1,18 @@
+#ifndef MDOCK_REPORT_H
+#define MDOCK_REPORT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Helpers shared by the commands and benchmarks that print measurements */
+
+/* s as a quoted JSON string, with '"', '\\' and control characters escaped */
+void mdock_json_string(FILE *f, const char *s);
+
+/* Sort samples ascending, for mdock_percentile */
+void mdock_sort_samples(double *samples, size_t n);
+
+/* Nearest-rank percentile (p in 0..1) of sorted samples; 0 when n is 0 */
+double mdock_percentile(const double *sorted, size_t n, double p);
+
+#endif /* MDOCK_REPORT_H */
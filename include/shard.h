@@ -0,0 +1,37 @@
+#ifndef MDOCK_SHARD_H
+#define MDOCK_SHARD_H
+
+#include <stddef.h>
+#include <linux/limits.h>
+
+#define MDOCK_MAX_SHARDS 16
+
+enum shard_policy {
+    SHARD_HASH,     /* stable placement by object name */
+    SHARD_SPACE     /* data directory with the most free space */
+};
+
+/*
+ * Data directories that hold image rootfs trees and container logs.
+ * Configured by $MDOCK_DATA_DIRS (colon-separated) or <root>/data_dirs
+ * (one directory per line, plus an optional "placement=hash|space" line).
+ * Without configuration the state root is the only shard.
+ */
+struct shard_set {
+    int count;
+    enum shard_policy policy;
+    char dirs[MDOCK_MAX_SHARDS][PATH_MAX];
+};
+
+int shard_load(const char *base_dir, struct shard_set *set);
+
+/* Choose the data directory for a new object and make sure it exists */
+const char *shard_place(const struct shard_set *set, const char *key);
+
+/* What to record for a data directory: empty when it is the state root */
+const char *shard_label(const char *base_dir, const char *dir);
+
+/* Data directory recorded for an object; empty means the state root */
+const char *shard_resolve(const char *base_dir, const char *recorded);
+
+#endif /* MDOCK_SHARD_H */
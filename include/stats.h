@@ -0,0 +1,86 @@
+#ifndef MDOCK_STATS_H
+#define MDOCK_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/limits.h>
+
+#include "record.h"
+
+/*
+ * Live resource usage of running containers, summed over each process
+ * tree. The sampler keeps /proc/<pid>/stat and io (and the children file
+ * of single-threaded processes) open for every process it has seen and
+ * re-reads them with pread(); only processes new since the last tick are
+ * opened. containers.db is rescanned only when its mtime or size change.
+ */
+#define STATS_INTERVAL_MS  1000
+#define STATS_MAX_PIDS     4096     /* processes sampled per container */
+
+struct stats_sample {
+    int64_t time_ns;        /* CLOCK_REALTIME of the sample */
+    int64_t cpu_ns;         /* CPU time of the tree, reaped children included */
+    int cpu_milli;          /* rate since the previous sample, 1/1000 CPUs */
+    int64_t rss;            /* resident bytes summed over the tree */
+    uint64_t minflt;
+    uint64_t majflt;
+    uint64_t read_bytes;    /* storage I/O from /proc/<pid>/io */
+    uint64_t write_bytes;
+    int threads;
+    int pids;
+};
+
+struct stats_proc {
+    pid_t pid;
+    int stat_fd;
+    int io_fd;              /* -1 when not readable */
+    int children_fd;        /* -1 until the process is single-threaded and sampled */
+    int seen;
+};
+
+struct stats_container {
+    char id[MDOCK_ID_MAX];
+    pid_t pid;
+    struct stats_proc *procs;
+    int nprocs;
+    int cap;
+    int64_t last_mono_ns;   /* previous sample, for the CPU rate */
+    int64_t last_cpu_ns;
+    int samples;
+    int gone;               /* the root process has exited */
+    struct stats_sample sample;
+};
+
+struct stats_sampler {
+    char db_path[PATH_MAX];
+    char **ids;             /* only these containers, NULL for every running one */
+    int nids;
+    int64_t db_mtime_ns;    /* containers.db as of the last scan */
+    int64_t db_size;
+    struct stats_container *containers;
+    int count;
+    int cap;
+};
+
+/*
+ * Sample one container: open its root process (-1 when it is gone or
+ * pid_start, if not 0, does not match), then refresh c->sample on every
+ * call until it returns -1 because the root has exited.
+ */
+int stats_container_open(struct stats_container *c, const char *id, pid_t pid, uint64_t pid_start);
+int stats_container_sample(struct stats_container *c);
+void stats_container_close(struct stats_container *c);
+
+int stats_sampler_init(struct stats_sampler *s, const char *base_dir, char **ids, int nids);
+
+/* Pick up started and exited containers, then sample every one of them */
+int stats_sampler_tick(struct stats_sampler *s);
+
+void stats_sampler_free(struct stats_sampler *s);
+
+int cmd_stats(int argc, char **argv);
+
+/* Threads of one container's process tree with their CPU rate, state, CPU and wchan */
+int cmd_top(int argc, char **argv);
+
+#endif /* MDOCK_STATS_H */
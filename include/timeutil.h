@@ -1,10 +1,20 @@
 #ifndef MDOCK_TIMEUTIL_H
 #define MDOCK_TIMEUTIL_H
 
-int mdock_current_timestamp(char *buf, size_t size);
+#include <stddef.h>
+#include <stdint.h>
 
-/* Calculate uptime between two timestamps, or from start to now if end is empty/NULL */
-int calculate_uptime(const char *start_time, const char *end_time,
-                     char *uptime_buf, size_t size);
+/* Records store CLOCK_REALTIME nanoseconds; formatting happens only for display */
+int64_t mdock_realtime_ns(void);
+int64_t mdock_monotonic_ns(void);
+
+/* Local time as "YYYY-MM-DDTHH:MM:SS.mmm" (timezone is loaded once) */
+int mdock_format_time(int64_t ns, char *buf, size_t size);
+
+/* Duration as "HH:MM:SS.mmm" */
+int mdock_format_duration(int64_t ns, char *buf, size_t size);
+
+/* Parse a legacy "%Y-%m-%dT%H:%M:%S" local-time string; returns 0 on failure */
+int64_t mdock_parse_timestamp(const char *str);
 
 #endif /* MDOCK_TIMEUTIL_H */
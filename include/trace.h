@@ -0,0 +1,37 @@
+#ifndef MDOCK_TRACE_H
+#define MDOCK_TRACE_H
+
+#include <stdint.h>
+
+#include "timeutil.h"
+
+/*
+ * Phase tracing of the run path: run --trace[=FILE] or MDOCK_TRACE=1|FILE.
+ * Spans are timestamped with CLOCK_MONOTONIC and kept in memory until the
+ * command ends, then printed to stderr as one "[mdock] trace" line each,
+ * or written to FILE as Chrome trace-event JSON for Perfetto or
+ * chrome://tracing. While tracing is off each hook only tests
+ * trace_enabled, and no clock is read.
+ */
+#define TRACE_MAX_SPANS  4096
+
+extern int trace_enabled;
+
+/* dest "1" (or NULL/"") traces to stderr, anything else names the JSON file */
+int trace_start(const char *dest);
+
+/* Record [start_ns, end_ns] of a phase; id names the container, NULL for none */
+void trace_span(const char *name, const char *id, int64_t start_ns, int64_t end_ns);
+
+/* Emit what was recorded and turn tracing off again */
+void trace_finish(void);
+
+#define TRACE_BEGIN(var)  int64_t var = trace_enabled ? mdock_monotonic_ns() : 0
+#define TRACE_END(var, name, id) \
+    do { \
+        if (trace_enabled) { \
+            trace_span(name, id, var, mdock_monotonic_ns()); \
+        } \
+    } while (0)
+
+#endif /* MDOCK_TRACE_H */
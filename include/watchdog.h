@@ -0,0 +1,74 @@
+#ifndef MDOCK_WATCHDOG_H
+#define MDOCK_WATCHDOG_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+struct history;
+
+/*
+ * Userspace limits for hosts without a delegated cgroup, enforced by the
+ * container's monitor or by the foreground run that started it.
+ *
+ * --mem-rss: the container's process tree is sampled every interval; once
+ * its resident memory exceeds the limit the container gets SIGTERM, and
+ * the whole tree SIGKILL if it is still running WATCHDOG_GRACE_MS later.
+ * Sampling reads statm of each process, so pages shared between them are
+ * counted once per process.
+ *
+ * --cpu-rate: the CPU time of the tree (utime+stime from /proc) is sampled
+ * every period against a token bucket filled at the requested rate and
+ * holding at most the burst. When the bucket runs dry the container's
+ * process group is stopped with SIGSTOP until the rate has paid the debt
+ * back, then resumed with SIGCONT.
+ *
+ * --history is not a limit, but needs the same loop: the tree is sampled
+ * every history interval and appended to the container's metrics history.
+ */
+#define WATCHDOG_INTERVAL_MS    1000
+#define WATCHDOG_GRACE_MS       3000
+#define WATCHDOG_CPU_PERIOD_MS  100
+#define WATCHDOG_MAX_PIDS       1024
+
+#define WATCHDOG_REASON_RSS   "rss limit exceeded"
+
+struct watchdog_limits {
+    int64_t rss_max;        /* bytes summed over the tree, 0 = none */
+    int interval_ms;        /* RSS sampling interval */
+    int cpu_milli;          /* CPU rate in 1/1000 CPUs, 0 = none */
+    int cpu_period_ms;      /* CPU sampling and duty-cycle period */
+    int cpu_burst_ms;       /* CPU time that may be saved up, 0 = one period's worth */
+    int64_t history_size;   /* bytes of metrics history, 0 = none */
+    int history_interval_ms;
+};
+
+/* What the watchdog saw by the time the container exited */
+struct watchdog_result {
+    const char *reason;     /* WATCHDOG_REASON_RSS when it signalled the container, else NULL */
+    int cpu_milli;          /* average CPU rate over the run, under --cpu-rate */
+    int cpu_peak_milli;     /* highest rate of a one-second window */
+    int64_t stopped_ns;     /* time spent stopped by the duty cycle */
+    struct rusage ru;       /* what wait4() reported for the container */
+};
+
+/* 1 when any limit needs a monitor to enforce it */
+int watchdog_active(const struct watchdog_limits *wd);
+
+/* --cpu-rate value (e.g. 0.5, 2) in 1/1000 CPUs, -1 when invalid */
+int watchdog_parse_rate(const char *str);
+
+/* Resident bytes of pid and its descendants */
+int64_t watchdog_tree_rss(pid_t pid);
+
+/*
+ * wait4() for the container child pid while enforcing wd (NULL or no
+ * limits only waits) and appending to hist when it is not NULL. The container must lead its own process group for
+ * --cpu-rate. The caller becomes a child subreaper, so processes the
+ * container orphans stay in its tree and are killed with it once it went
+ * over --mem-rss. Returns 0 or -1.
+ */
+int watchdog_wait(const char *container_id, pid_t pid, const struct watchdog_limits *wd,
+                  struct history *hist, int *status, struct watchdog_result *res);
+
+#endif /* MDOCK_WATCHDOG_H */
@@ -0,0 +1,38 @@
+/*
+ * Launch-latency probe for mdock bench run
+ * Reports the moment its main() starts and exits at once
+ *
+ * Usage: probe <iteration>
+ * Writes "<iteration> <pid> <CLOCK_MONOTONIC ns>\n" to the FIFO named by
+ * MDOCK_PROBE_FIFO; the line is shorter than PIPE_BUF, so concurrent
+ * probes never interleave.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    const char *fifo = getenv("MDOCK_PROBE_FIFO");
+    if (argc < 2 || !fifo) {
+        fprintf(stderr, "Usage: MDOCK_PROBE_FIFO=<path> probe <iteration>\n");
+        return 2;
+    }
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%s %d %lld\n", argv[1], (int)getpid(),
+                       (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+    int fd = open(fifo, O_WRONLY | O_NONBLOCK);
+    if (fd == -1 || write(fd, line, (size_t)len) != len) {
+        perror("probe");
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
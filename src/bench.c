@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "bench.h"
+#include "image.h"
+#include "record.h"
+#include "report.h"
+#include "timeutil.h"
+
+extern char **environ;
+
+struct bench_run {
+    const char *base_dir;
+    const char *image;
+    const char *probe;      /* program inside the image */
+    long iterations;
+    int concurrency;
+    int keep;               /* leave the containers in containers.db */
+    char rootfs[PATH_MAX];
+    char fifo_path[PATH_MAX];
+    int fifo_fd;
+    char line[4096];        /* partial line read from the FIFO */
+    size_t line_len;
+
+    /* One phase */
+    int64_t *spawn_ns;      /* when mdock run was spawned */
+    int64_t *start_ns;      /* when the probe reported, 0 until then */
+    pid_t *probe_pids;      /* to find their records afterwards */
+    long npids;
+};
+
+struct bench_result {
+    const char *cache;
+    long launches;          /* probes that reported */
+    long failures;          /* runs that failed or never reported */
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+    double mean_us;
+    double per_sec;
+};
+
+/* ----- Page cache ----- */
+
+static int evict_file(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)ftw;
+    if (type == FTW_F) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+    return 0;
+}
+
+/* Drop the image's files from the page cache; pages mapped by a running process stay */
+static void evict_image(const struct bench_run *b)
+{
+    nftw(b->rootfs, evict_file, 16, FTW_PHYS | FTW_MOUNT);
+}
+
+/* ----- Probe reports ----- */
+
+/* Lines "<iteration> <pid> <ns>" from the FIFO */
+static void read_reports(struct bench_run *b)
+{
+    for (;;) {
+        ssize_t n = read(b->fifo_fd, b->line + b->line_len, sizeof(b->line) - b->line_len - 1);
+        if (n <= 0) {
+            return;
+        }
+        b->line_len += (size_t)n;
+        b->line[b->line_len] = '\0';
+
+        char *p = b->line;
+        char *nl;
+        while ((nl = strchr(p, '\n')) != NULL) {
+            *nl = '\0';
+            long it;
+            int pid;
+            long long ns;
+            if (sscanf(p, "%ld %d %lld", &it, &pid, &ns) == 3 && it >= 0 && it < b->iterations &&
+                b->start_ns[it] == 0) {
+                b->start_ns[it] = ns;
+                b->probe_pids[b->npids++] = pid;
+            }
+            p = nl + 1;
+        }
+        b->line_len = strlen(p);
+        memmove(b->line, p, b->line_len);
+    }
+}
+
+/* ----- Launching ----- */
+
+static pid_t spawn_run(const struct bench_run *b, long iteration)
+{
+    char env_arg[PATH_MAX + 32];
+    char it_arg[32];
+    snprintf(env_arg, sizeof(env_arg), "MDOCK_PROBE_FIFO=%s", b->fifo_path);
+    snprintf(it_arg, sizeof(it_arg), "%ld", iteration);
+    char *argv[] = {
+        "mdock", "--root", (char *)b->base_dir, "run", "-e", env_arg,
+        (char *)b->image, (char *)b->probe, it_arg, NULL,
+    };
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    int err = posix_spawn(&pid, "/proc/self/exe", &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+static int run_phase(struct bench_run *b, int cold, struct bench_result *res)
+{
+    memset(b->start_ns, 0, (size_t)b->iterations * sizeof(*b->start_ns));
+    memset(res, 0, sizeof(*res));
+    res->cache = cold ? "cold" : "warm";
+
+    long next = 0;
+    long running = 0;
+    int64_t t0 = mdock_monotonic_ns();
+    while (next < b->iterations || running > 0) {
+        while (running < b->concurrency && next < b->iterations) {
+            if (cold) {
+                evict_image(b);
+            }
+            b->spawn_ns[next] = mdock_monotonic_ns();
+            if (spawn_run(b, next) == -1) {
+                perror("[mdock] posix_spawn");
+                return -1;
+            }
+            next++;
+            running++;
+        }
+
+        struct pollfd pfd = { b->fifo_fd, POLLIN, 0 };
+        poll(&pfd, 1, 1);
+        read_reports(b);
+
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            running--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                res->failures++;
+            }
+        }
+        if (pid == -1 && errno == ECHILD) {
+            running = 0;
+        }
+    }
+    /* Each run waited for its probe, so every report is in the FIFO by now */
+    read_reports(b);
+    double seconds = (mdock_monotonic_ns() - t0) / 1e9;
+
+    double *lat = malloc((size_t)b->iterations * sizeof(*lat));
+    if (!lat) {
+        perror("[mdock] malloc");
+        return -1;
+    }
+    long n = 0;
+    double sum = 0;
+    for (long i = 0; i < b->iterations; i++) {
+        if (b->start_ns[i] > 0) {
+            lat[n] = (b->start_ns[i] - b->spawn_ns[i]) / 1e3;
+            sum += lat[n++];
+        }
+    }
+    /* A run that exited 0 but whose probe never wrote still failed */
+    long silent = b->iterations - n - res->failures;
+    res->failures += silent > 0 ? silent : 0;
+    res->launches = n;
+    if (n > 0) {
+        mdock_sort_samples(lat, (size_t)n);
+        res->p50_us = mdock_percentile(lat, (size_t)n, 0.50);
+        res->p90_us = mdock_percentile(lat, (size_t)n, 0.90);
+        res->p99_us = mdock_percentile(lat, (size_t)n, 0.99);
+        res->max_us = lat[n - 1];
+        res->mean_us = sum / n;
+        res->per_sec = seconds > 0 ? n / seconds : 0;
+    }
+    free(lat);
+    return 0;
+}
+
+/* ----- Cleanup ----- */
+
+static int cmp_pid(const void *a, const void *b)
+{
+    pid_t x = *(const pid_t *)a;
+    pid_t y = *(const pid_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Drop the exited containers of this image whose pid a probe reported */
+static int drop_probe_row(const struct db_row *row, FILE *out, void *arg)
+{
+    (void)out;
+    struct bench_run *b = arg;
+    struct container_record rec;
+    if (container_record_parse(row, &rec) != 0 || strcmp(rec.image, b->image) != 0) {
+        return 0;
+    }
+    pid_t pid = rec.pid;
+    if (!bsearch(&pid, b->probe_pids, (size_t)b->npids, sizeof(pid), cmp_pid)) {
+        return 0;
+    }
+    return strcmp(rec.status, "running") != 0;
+}
+
+static void remove_probe_containers(struct bench_run *b)
+{
+    char db_path[PATH_MAX];
+    if (b->npids == 0 ||
+        snprintf(db_path, sizeof(db_path), "%s/containers.db", b->base_dir) >= (int)sizeof(db_path)) {
+        return;
+    }
+    qsort(b->probe_pids, (size_t)b->npids, sizeof(*b->probe_pids), cmp_pid);
+
+    /* Each run has recorded its container's exit by the time it returned */
+    if (db_rewrite(db_path, drop_probe_row, b) < 0) {
+        fprintf(stderr, "[mdock] warning: failed to remove the benchmark's containers\n");
+    }
+}
+
+/* ----- Command ----- */
+
+static void bench_usage(void)
+{
+    fprintf(stderr, "Usage: mdock bench run [OPTIONS] <image>\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -n, --iterations N   Containers per phase (default %d)\n", BENCH_DEFAULT_ITERATIONS);
+    fprintf(stderr, "  -c, --concurrency C  Runs in flight at once (default 1)\n");
+    fprintf(stderr, "  --cache MODE         warm, cold or both (default both)\n");
+    fprintf(stderr, "  --probe PATH         Probe program in the image (default /bin/probe)\n");
+    fprintf(stderr, "  --out FILE           Write the JSON results to FILE instead of stdout\n");
+    fprintf(stderr, "  --keep               Keep the benchmark's containers in mdock ps\n");
+    fprintf(stderr, "\nThe image needs real_programs/probe (make -C real_programs probe).\n");
+}
+
+int cmd_bench(int argc, char **argv)
+{
+    if (argc < 2 || strcmp(argv[1], "run") != 0) {
+        bench_usage();
+        return 1;
+    }
+
+    struct bench_run b;
+    memset(&b, 0, sizeof(b));
+    b.iterations = BENCH_DEFAULT_ITERATIONS;
+    b.concurrency = 1;
+    b.probe = "/bin/probe";
+    b.fifo_fd = -1;
+    int warm = 1;
+    int cold = 1;
+    const char *out_path = NULL;
+
+    for (int i = 2; i < argc; i++) {
+        const char *opt = argv[i];
+        int has_value = i + 1 < argc;
+        if ((strcmp(opt, "-n") == 0 || strcmp(opt, "--iterations") == 0) && has_value) {
+            char *end;
+            b.iterations = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || b.iterations < 1 || b.iterations > BENCH_MAX_ITERATIONS) {
+                fprintf(stderr, "[mdock] error: invalid iterations '%s' (1-%d)\n", argv[i],
+                        BENCH_MAX_ITERATIONS);
+                return 1;
+            }
+        } else if ((strcmp(opt, "-c") == 0 || strcmp(opt, "--concurrency") == 0) && has_value) {
+            char *end;
+            long c = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || c < 1 || c > BENCH_MAX_CONCURRENCY) {
+                fprintf(stderr, "[mdock] error: invalid concurrency '%s' (1-%d)\n", argv[i],
+                        BENCH_MAX_CONCURRENCY);
+                return 1;
+            }
+            b.concurrency = (int)c;
+        } else if (strcmp(opt, "--cache") == 0 && has_value) {
+            const char *mode = argv[++i];
+            warm = strcmp(mode, "warm") == 0 || strcmp(mode, "both") == 0;
+            cold = strcmp(mode, "cold") == 0 || strcmp(mode, "both") == 0;
+            if (!warm && !cold) {
+                fprintf(stderr, "[mdock] error: --cache requires warm, cold or both\n");
+                return 1;
+            }
+        } else if (strcmp(opt, "--probe") == 0 && has_value) {
+            b.probe = argv[++i];
+        } else if (strcmp(opt, "--out") == 0 && has_value) {
+            out_path = argv[++i];
+        } else if (strcmp(opt, "--keep") == 0) {
+            b.keep = 1;
+        } else if (opt[0] == '-' || b.image) {
+            bench_usage();
+            return 1;
+        } else {
+            b.image = opt;
+        }
+    }
+    if (!b.image) {
+        bench_usage();
+        return 1;
+    }
+
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        fprintf(stderr, "[mdock] failed to initialize home directory\n");
+        return 1;
+    }
+    b.base_dir = base_dir;
+    if (find_image_rootfs(base_dir, b.image, b.rootfs, sizeof(b.rootfs)) != 0) {
+        fprintf(stderr, "[mdock] error: image '%s' not found\n", b.image);
+        return 1;
+    }
+    char probe_path[PATH_MAX];
+    struct stat st;
+    if (snprintf(probe_path, sizeof(probe_path), "%s/%s", b.rootfs, b.probe) >= (int)sizeof(probe_path) ||
+        stat(probe_path, &st) != 0) {
+        fprintf(stderr, "[mdock] error: image '%s' has no %s\n", b.image, b.probe);
+        fprintf(stderr, "[mdock] hint: build real_programs/probe.c and copy it into the rootfs\n");
+        return 1;
+    }
+
+    /* Held open for reading and writing, so it never reports EOF between probes */
+    if (snprintf(b.fifo_path, sizeof(b.fifo_path), "%s/bench-%d.fifo", base_dir, (int)getpid()) >=
+        (int)sizeof(b.fifo_path)) {
+        fprintf(stderr, "[mdock] FIFO path too long\n");
+        return 1;
+    }
+    unlink(b.fifo_path);
+    if (mkfifo(b.fifo_path, 0600) != 0 ||
+        (b.fifo_fd = open(b.fifo_path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1) {
+        perror("[mdock] mkfifo");
+        unlink(b.fifo_path);
+        return 1;
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    b.spawn_ns = calloc((size_t)b.iterations, sizeof(*b.spawn_ns));
+    b.start_ns = calloc((size_t)b.iterations, sizeof(*b.start_ns));
+    b.probe_pids = calloc((size_t)b.iterations * 2 + 1, sizeof(*b.probe_pids));
+    int rc = 1;
+    if (!out) {
+        perror("[mdock] fopen");
+        goto done;
+    }
+    if (!b.spawn_ns || !b.start_ns || !b.probe_pids) {
+        perror("[mdock] calloc");
+        goto done;
+    }
+
+    struct bench_result results[2];
+    int nresults = 0;
+    if (warm) {
+        /* One unmeasured run pulls the image and mdock itself into the cache */
+        long iterations = b.iterations;
+        b.iterations = 1;
+        struct bench_result warmup;
+        if (run_phase(&b, 0, &warmup) != 0) {
+            goto done;
+        }
+        b.iterations = iterations;
+        if (run_phase(&b, 0, &results[nresults++]) != 0) {
+            goto done;
+        }
+    }
+    if (cold && run_phase(&b, 1, &results[nresults++]) != 0) {
+        goto done;
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"mdock-bench-run\",\n  \"timestamp\": %ld,\n  \"image\": ",
+            (long)time(NULL));
+    mdock_json_string(out, b.image);
+    fprintf(out, ",\n  \"iterations\": %ld,\n  \"concurrency\": %d,\n  \"results\": [",
+            b.iterations, b.concurrency);
+    for (int k = 0; k < nresults; k++) {
+        const struct bench_result *r = &results[k];
+        fprintf(out,
+                "%s\n    {\"cache\": \"%s\", \"launches\": %ld, \"failures\": %ld, \"p50_us\": %.1f, "
+                "\"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"mean_us\": %.1f, "
+                "\"containers_per_sec\": %.1f}",
+                k ? "," : "", r->cache, r->launches, r->failures, r->p50_us, r->p90_us, r->p99_us,
+                r->max_us, r->mean_us, r->per_sec);
+    }
+    fprintf(out, "\n  ]\n}\n");
+    rc = 0;
+    for (int k = 0; k < nresults; k++) {
+        if (results[k].failures > 0) {
+            fprintf(stderr, "[mdock] %ld of %ld %s runs failed\n", results[k].failures,
+                    b.iterations, results[k].cache);
+            rc = 1;
+        }
+    }
+
+done:
+    if (!b.keep) {
+        remove_probe_containers(&b);
+    }
+    if (out && out != stdout) {
+        fclose(out);
+    }
+    close(b.fifo_fd);
+    unlink(b.fifo_path);
+    free(b.spawn_ns);
+    free(b.start_ns);
+    free(b.probe_pids);
+    return rc;
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "budget.h"
+#include "container.h"
+#include "image.h"
+#include "proc.h"
+#include "record.h"
+#include "report.h"
+
+/* ----- Host memory and the budget ----- */
+
+static int read_meminfo(int64_t *total, int64_t *available)
+{
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f) {
+        perror("[mdock] /proc/meminfo");
+        return -1;
+    }
+    char line[256];
+    long long kb;
+    *total = 0;
+    *available = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "MemTotal: %lld kB", &kb) == 1) {
+            *total = (int64_t)kb * 1024;
+        } else if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1) {
+            *available = (int64_t)kb * 1024;
+        }
+    }
+    fclose(f);
+    if (*total <= 0) {
+        fprintf(stderr, "[mdock] MemTotal missing from /proc/meminfo\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* "48G", "75%" or "off"; -1 when it is none of them */
+static int64_t parse_budget(const char *str, int64_t total)
+{
+    if (strcmp(str, "off") == 0 || strcmp(str, "0") == 0) {
+        return 0;
+    }
+    size_t len = strlen(str);
+    if (len > 1 && str[len - 1] == '%') {
+        char *end;
+        double pct = strtod(str, &end);
+        if (end != str + len - 1 || pct <= 0 || pct > 100) {
+            return -1;
+        }
+        return (int64_t)(total * (pct / 100.0));
+    }
+    return parse_memory_limit(str);
+}
+
+int budget_load(const char *base_dir, struct mem_budget *b)
+{
+    memset(b, 0, sizeof(*b));
+    if (read_meminfo(&b->total, &b->available) != 0) {
+        return -1;
+    }
+
+    char value[64] = "";
+    const char *env = getenv("MDOCK_MEM_BUDGET");
+    char path[PATH_MAX];
+    if (env && env[0]) {
+        snprintf(value, sizeof(value), "%s", env);
+        snprintf(b->source, sizeof(b->source), "MDOCK_MEM_BUDGET=%s", env);
+    } else if (snprintf(path, sizeof(path), "%s/mem_budget", base_dir) < (int)sizeof(path)) {
+        FILE *f = fopen(path, "r");
+        if (f) {
+            if (fgets(value, sizeof(value), f)) {
+                value[strcspn(value, " \t\r\n")] = '\0';
+            }
+            fclose(f);
+            snprintf(b->source, sizeof(b->source), "%s", path);
+        }
+    }
+
+    if (!value[0]) {
+        b->budget = b->total / 100 * BUDGET_DEFAULT_PERCENT;
+        snprintf(b->source, sizeof(b->source), "default, %d%% of MemTotal", BUDGET_DEFAULT_PERCENT);
+        return 0;
+    }
+    b->budget = parse_budget(value, b->total);
+    if (b->budget < 0) {
+        fprintf(stderr, "[mdock] Invalid memory budget '%s' from %s (use e.g. 48G, 75%% or off)\n",
+                value, b->source);
+        return -1;
+    }
+    return 0;
+}
+
+int budget_committed(const char *db_path, struct mem_commit *c)
+{
+    memset(c, 0, sizeof(*c));
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct db_scanner s;
+    struct db_row row;
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        struct container_record rec;
+        if (row.nfields <= CF_STATUS || !db_field_eq(&row.fields[CF_STATUS], "running") ||
+            container_record_parse(&row, &rec) != 0 ||
+            !proc_alive(rec.pid, rec.pid_start)) {
+            continue;
+        }
+        if (rec.mem_commit > 0) {
+            c->committed += rec.mem_commit;
+            c->containers++;
+        } else {
+            c->unlimited++;
+        }
+    }
+    db_map_close(&map);
+    return 0;
+}
+
+/* Every containers.db rewrite ends in a rename, and appends in a close */
+void budget_wait_change(const char *base_dir, int timeout_ms)
+{
+    int ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (ino < 0) {
+        poll(NULL, 0, timeout_ms);
+        return;
+    }
+    inotify_add_watch(ino, base_dir, IN_MOVED_TO | IN_CLOSE_WRITE);
+    struct pollfd pfd = { .fd = ino, .events = POLLIN };
+    poll(&pfd, 1, timeout_ms);
+    close(ino);
+}
+
+void budget_format(int64_t bytes, char *buf, size_t size)
+{
+    static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(buf, size, unit ? "%.1f%s" : "%.0f%s", value, units[unit]);
+}
+
+/* ----- mdock info ----- */
+
+static void info_usage(void)
+{
+    fprintf(stderr, "Usage: mdock info [--json]\n");
+}
+
+int cmd_info(int argc, char **argv)
+{
+    int json = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else {
+            info_usage();
+            return 1;
+        }
+    }
+
+    char base_dir[PATH_MAX];
+    char db_path[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        return 1;
+    }
+    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
+        fprintf(stderr, "[mdock] containers.db path too long\n");
+        return 1;
+    }
+    struct mem_budget b;
+    struct mem_commit c;
+    if (budget_load(base_dir, &b) != 0 || budget_committed(db_path, &c) != 0) {
+        return 1;
+    }
+    int64_t free_budget = b.budget > c.committed ? b.budget - c.committed : 0;
+
+    if (json) {
+        printf("{\"root\": ");
+        mdock_json_string(stdout, base_dir);
+        printf(", \"running\": %d, \"mem_total\": %lld, \"mem_available\": %lld, \"mem_budget\": %lld, "
+               "\"mem_budget_source\": ",
+               c.containers + c.unlimited, (long long)b.total, (long long)b.available, (long long)b.budget);
+        mdock_json_string(stdout, b.source);
+        printf(", \"mem_committed\": %lld, \"mem_budget_free\": %lld, \"committed_containers\": %d, "
+               "\"unlimited_containers\": %d}\n",
+               (long long)c.committed, (long long)(b.budget > 0 ? free_budget : 0), c.containers, c.unlimited);
+        return 0;
+    }
+
+    char total[32], avail[32], budget[32], committed[32], left[32];
+    budget_format(b.total, total, sizeof(total));
+    budget_format(b.available, avail, sizeof(avail));
+    budget_format(b.budget, budget, sizeof(budget));
+    budget_format(c.committed, committed, sizeof(committed));
+    budget_format(free_budget, left, sizeof(left));
+    printf("Root:              %s\n", base_dir);
+    printf("Running:           %d containers\n", c.containers + c.unlimited);
+    printf("Memory total:      %s\n", total);
+    printf("Memory available:  %s\n", avail);
+    if (b.budget > 0) {
+        printf("Memory budget:     %s (%s)\n", budget, b.source);
+        printf("Committed:         %s by %d containers (%.1f%% of budget)\n", committed,
+               c.containers, 100.0 * (double)c.committed / (double)b.budget);
+        printf("Budget free:       %s\n", left);
+    } else {
+        printf("Memory budget:     off (%s)\n", b.source);
+        printf("Committed:         %s by %d containers\n", committed, c.containers);
+    }
+    if (c.unlimited > 0) {
+        printf("Not counted:       %d running containers without a memory limit\n", c.unlimited);
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+
+#include "cgroup.h"
+
+/* ----- Paths ----- */
+
+/* $MDOCK_CGROUP_ROOT, or <cgroup2 mount>/mdock */
+static int cgroup_root(char *buf, size_t size)
+{
+    const char *env = getenv("MDOCK_CGROUP_ROOT");
+    if (env && *env) {
+        return snprintf(buf, size, "%s", env) >= (int)size ? -1 : 0;
+    }
+
+    FILE *f = fopen("/proc/self/mounts", "re");
+    if (!f) {
+        return -1;
+    }
+    char line[PATH_MAX + 256];
+    int found = -1;
+    while (found != 0 && fgets(line, sizeof(line), f)) {
+        char mnt[PATH_MAX];
+        char type[64];
+        if (sscanf(line, "%*s %4095s %63s", mnt, type) == 2 && strcmp(type, "cgroup2") == 0) {
+            found = snprintf(buf, size, "%s/mdock", mnt) >= (int)size ? -1 : 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/* FNV-1a of the state root, so two roots never share a leaf name */
+static uint32_t state_key(const char *base_dir)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = base_dir; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int leaf_path(const char *base_dir, const char *container_id,
+                     char *key_dir, char *leaf, size_t size)
+{
+    char root[PATH_MAX];
+    if (cgroup_root(root, sizeof(root)) != 0) {
+        return -1;
+    }
+    if (snprintf(key_dir, size, "%s/s%08x", root, state_key(base_dir)) >= (int)size ||
+        snprintf(leaf, size, "%s/%s", key_dir, container_id) >= (int)size) {
+        return -1;
+    }
+    return 0;
+}
+
+static int write_file(const char *dir, const char *name, const char *value)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t len = strlen(value);
+    ssize_t n = write(fd, value, len);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+static int make_dir(const char *path)
+{
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "[mdock] error: cannot create cgroup %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* ----- Limits ----- */
+
+int cgroup_limits_any(const struct cgroup_limits *l)
+{
+    return l->memory_max > 0 || l->cpu_quota_us > 0 || l->pids_max > 0 ||
+           l->io_weight > 0 || l->io_max_count > 0;
+}
+
+int64_t cgroup_parse_cpus(const char *str)
+{
+    char *end;
+    double cpus = strtod(str, &end);
+    if (end == str || *end != '\0' || !(cpus > 0) || cpus > 4096) {
+        return -1;
+    }
+    /* The kernel refuses quotas below 1ms */
+    int64_t quota = (int64_t)(cpus * CGROUP_CPU_PERIOD_US + 0.5);
+    return quota < 1000 ? 1000 : quota;
+}
+
+struct cgroup_setting {
+    const char *controller;
+    const char *file;
+    char value[128];
+};
+
+int cgroup_create(const char *base_dir, const char *container_id,
+                  const struct cgroup_limits *l, char *procs_path, size_t size)
+{
+    char key_dir[PATH_MAX];
+    char leaf[PATH_MAX];
+    if (leaf_path(base_dir, container_id, key_dir, leaf, sizeof(leaf)) != 0) {
+        fprintf(stderr, "[mdock] error: cgroup v2 is not mounted\n");
+        fprintf(stderr, "[mdock] hint: set MDOCK_CGROUP_ROOT to a delegated cgroup2 directory\n");
+        return -1;
+    }
+
+    struct cgroup_setting set[4 + CGROUP_IO_MAX_RULES];
+    int n = 0;
+    if (l->memory_max > 0) {
+        set[n] = (struct cgroup_setting){ "memory", "memory.max", "" };
+        snprintf(set[n++].value, sizeof(set[0].value), "%lld", (long long)l->memory_max);
+    }
+    if (l->cpu_quota_us > 0) {
+        set[n] = (struct cgroup_setting){ "cpu", "cpu.max", "" };
+        snprintf(set[n++].value, sizeof(set[0].value), "%lld %d",
+                 (long long)l->cpu_quota_us, CGROUP_CPU_PERIOD_US);
+    }
+    if (l->pids_max > 0) {
+        set[n] = (struct cgroup_setting){ "pids", "pids.max", "" };
+        snprintf(set[n++].value, sizeof(set[0].value), "%lld", (long long)l->pids_max);
+    }
+    if (l->io_weight > 0) {
+        set[n] = (struct cgroup_setting){ "io", "io.weight", "" };
+        snprintf(set[n++].value, sizeof(set[0].value), "default %d", l->io_weight);
+    }
+    for (int i = 0; i < l->io_max_count && i < CGROUP_IO_MAX_RULES; i++) {
+        set[n] = (struct cgroup_setting){ "io", "io.max", "" };
+        snprintf(set[n++].value, sizeof(set[0].value), "%s", l->io_max[i]);
+    }
+
+    /*
+     * Controllers have to be enabled on every level above the leaf. The
+     * parent of the cgroup root is only writable when we own it; a
+     * delegated subtree has them enabled already.
+     */
+    char root[PATH_MAX];
+    snprintf(root, sizeof(root), "%s", key_dir);
+    *strrchr(root, '/') = '\0';
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", root);
+    char *slash = strrchr(parent, '/');
+    if (slash && slash != parent) {
+        *slash = '\0';
+    }
+
+    const char *levels[] = { parent, root, key_dir };
+    for (int lv = 0; lv < 3; lv++) {
+        if (lv > 0 && make_dir(levels[lv]) != 0) {
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            char ctl[32];
+            snprintf(ctl, sizeof(ctl), "+%s", set[i].controller);
+            write_file(levels[lv], "cgroup.subtree_control", ctl);
+        }
+    }
+
+    if (make_dir(leaf) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (write_file(leaf, set[i].file, set[i].value) == 0) {
+            continue;
+        }
+        if (errno == ENOENT) {
+            fprintf(stderr, "[mdock] error: cgroup controller '%s' is not available in %s\n",
+                    set[i].controller, key_dir);
+        } else {
+            fprintf(stderr, "[mdock] error: cannot set %s to '%s': %s\n",
+                    set[i].file, set[i].value, strerror(errno));
+        }
+        rmdir(leaf);
+        return -1;
+    }
+
+    if (snprintf(procs_path, size, "%s/cgroup.procs", leaf) >= (int)size) {
+        rmdir(leaf);
+        return -1;
+    }
+    return 0;
+}
+
+const char *cgroup_release(const char *base_dir, const char *container_id)
+{
+    char key_dir[PATH_MAX];
+    char leaf[PATH_MAX];
+    if (leaf_path(base_dir, container_id, key_dir, leaf, sizeof(leaf)) != 0) {
+        return NULL;
+    }
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/memory.events", leaf) >= (int)sizeof(path)) {
+        return NULL;
+    }
+
+    const char *reason = NULL;
+    FILE *f = fopen(path, "re");
+    if (f) {
+        char line[128];
+        long long count;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "oom_kill %lld", &count) == 1 && count > 0) {
+                reason = "out of memory (cgroup memory.max)";
+            }
+        }
+        fclose(f);
+    }
+
+    /* Fails with EBUSY while processes the container left behind still run */
+    rmdir(leaf);
+    return reason;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/limits.h>
+
+#include "client.h"
+#include "commands.h"
+#include "protocol.h"
+
+static int client_connect(void)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    char path[PATH_MAX];
+    if (mdock_socket_path(path, sizeof(path)) != 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        /* No socket or a stale one left by a dead daemon: run locally */
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+extern char **environ;
+
+static int is_mdock_var(const char *entry)
+{
+    return strncmp(entry, "MDOCK_", 6) == 0 && strchr(entry, '=');
+}
+
+/* cwd\0MDOCK_X=v\0...\0\0argv[0]\0...argv[argc-1]\0 */
+static char *build_request(int argc, char **argv, size_t *len)
+{
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return NULL;
+    }
+
+    size_t total = strlen(cwd) + 1 + 1;
+    for (char **e = environ; *e; e++) {
+        if (is_mdock_var(*e)) {
+            total += strlen(*e) + 1;
+        }
+    }
+    for (int i = 0; i < argc; i++) {
+        total += strlen(argv[i]) + 1;
+    }
+    if (total > MDOCK_PROTO_MAX) {
+        return NULL;
+    }
+
+    char *buf = malloc(total);
+    if (!buf) {
+        return NULL;
+    }
+    char *p = buf;
+    size_t n = strlen(cwd) + 1;
+    memcpy(p, cwd, n);
+    p += n;
+    for (char **e = environ; *e; e++) {
+        if (is_mdock_var(*e)) {
+            n = strlen(*e) + 1;
+            memcpy(p, *e, n);
+            p += n;
+        }
+    }
+    *p++ = '\0';
+    for (int i = 0; i < argc; i++) {
+        n = strlen(argv[i]) + 1;
+        memcpy(p, argv[i], n);
+        p += n;
+    }
+    *len = total;
+    return buf;
+}
+
+/* Copy output the daemon buffered for us to where it was meant to go */
+static void copy_buffered(int from, int to)
+{
+    char buf[65536];
+    ssize_t n;
+    if (lseek(from, 0, SEEK_SET) == -1) {
+        return;
+    }
+    while ((n = read(from, buf, sizeof(buf))) > 0) {
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(to, buf + done, (size_t)(n - done));
+            if (w == -1 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return;     /* the reader went away, e.g. `| head` */
+            }
+            done += w;
+        }
+    }
+}
+
+int mdock_client_run(int argc, char **argv, int *status)
+{
+    if (mdock_command_is_local(argc, argv)) {
+        return -1;
+    }
+
+    size_t len;
+    char *req = build_request(argc, argv, &len);
+    if (!req) {
+        return -1;
+    }
+
+    int fd = client_connect();
+    if (fd < 0) {
+        free(req);
+        return -1;
+    }
+
+    /* The command writes straight to our stdout and stderr */
+    int out_fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    fflush(NULL);
+    int rc = msg_send_fds(fd, MSG_CMD, req, len, out_fds, 2);
+    free(req);
+    if (rc != 0) {
+        /* The daemon went away before taking the request: nothing ran yet */
+        close(fd);
+        return -1;
+    }
+
+    /* From here on the daemon owns the command; never fall back and run it twice */
+    *status = 1;
+    for (;;) {
+        struct msg_header hdr;
+        char *payload;
+        int bufs[MDOCK_PROTO_MAX_FDS];
+        int nbufs = 0;
+        rc = msg_recv_fds(fd, &hdr, &payload, bufs, &nbufs);
+        if (rc <= 0) {
+            fprintf(stderr, "[mdock] lost connection to mdockd: %s\n",
+                    rc == 0 ? "unexpected EOF" : strerror(errno));
+            break;
+        }
+
+        if (hdr.type == MSG_STDERR) {
+            fwrite(payload, 1, hdr.len, stderr);
+        } else if (hdr.type == MSG_EXIT && hdr.len == sizeof(struct msg_exit)) {
+            struct msg_exit ex;
+            memcpy(&ex, payload, sizeof(ex));
+            int next = 0;
+            if ((ex.buffered & MSG_EXIT_STDOUT) && next < nbufs) {
+                copy_buffered(bufs[next++], STDOUT_FILENO);
+            }
+            if ((ex.buffered & MSG_EXIT_STDERR) && next < nbufs) {
+                copy_buffered(bufs[next++], STDERR_FILENO);
+            }
+            *status = ex.status;
+        }
+        for (int i = 0; i < nbufs; i++) {
+            close(bufs[i]);
+        }
+        free(payload);
+        if (hdr.type == MSG_EXIT) {
+            break;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
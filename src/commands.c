@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "commands.h"
+#include "image.h"
+#include "container.h"
+#include "pool.h"
+#include "stats.h"
+#include "bench.h"
+#include "queue.h"
+#include "budget.h"
+#include "compose.h"
+
+void mdock_print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--root <dir>] <command> [args]\n"
+            "\n"
+            "Global Options:\n"
+            "  --root <dir>       State directory (default: $MDOCK_ROOT or ~/.mdock)\n"
+            "\n"
+            "Commands:\n"
+            "  build  <image_name> <rootfs_dir>     Build a new image\n"
+            "  images                                List all images\n"
+            "  rmi    <image_name>                   Remove an image\n"
+            "  run    [OPTIONS] <image_name>         Run a container\n"
+            "  ps                                    List containers\n"
+            "  inspect [--format T] <id>...          Show containers with their resource usage\n"
+            "  stats  [--no-stream] [--json] [id...] Live CPU, memory and I/O of running containers\n"
+            "  stats  --history <id> [--since 10m]   Recorded metrics of a container run with --history\n"
+            "  top    [--no-stream] <id>             Threads of a container by CPU usage\n"
+            "  stop   [-t SEC] <id>...|--all          Stop containers (SIGTERM, SIGKILL after -t)\n"
+            "  rm     <container_id>                 Remove a stopped container\n"
+            "  logs   [-f] <container_id>            View container logs\n"
+            "  wait   <container_id>...              Wait for containers to exit\n"
+            "  pool   start|stop|status [image]      Manage warm pools of pre-forked containers\n"
+            "  bench  run [-n N] [-c C] <image>      Measure launch latency with real_programs/probe\n"
+            "  submit [--priority N] <image> [cmd]   Queue a batch job for the scheduler\n"
+            "  scheduler start|stop|status           Run queued jobs on a fixed set of workers\n"
+            "  jobs   [--state S] [--json] | prune   Show the job queue, wait times and throughput\n"
+            "  info   [--json]                       Host memory, memory budget and committed limits\n"
+            "  compose up|down|ps [-f FILE]         Start a manifest of containers in dependency waves\n"
+            "\n"
+            "Run Options:\n"
+            "  --mem <size>       Memory limit (e.g., 128M, 1G)\n"
+            "  --cpu <seconds>    CPU time limit in seconds\n"
+            "  -e KEY=VALUE       Set environment variable\n"
+            "  -d, --detach       Return once the container has started\n"
+            "  --replicas <n>     Start n containers in one invocation\n"
+            "  --wait             Queue until the memory budget has room instead of failing\n"
+            "\n"
+            "Data Directories:\n"
+            "  Images and logs are spread over $MDOCK_DATA_DIRS (dir1:dir2:...) or the\n"
+            "  directories listed in <root>/data_dirs, placed by $MDOCK_PLACEMENT\n"
+            "  (hash or space).\n"
+            "\n"
+            "Daemon:\n"
+            "  When mdockd is running for the state root, commands are sent to it over\n"
+            "  <root>/mdockd.sock. Set MDOCK_NO_DAEMON=1 to always run locally.\n"
+            "\n",
+            prog);
+}
+
+int mdock_dispatch(int argc, char **argv)
+{
+    if (argc < 2) {
+        mdock_print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *cmd = argv[1];
+
+    if (strcmp(cmd, "build") == 0) {
+        return cmd_build(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "images") == 0) {
+        return cmd_images(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "rmi") == 0) {
+        return cmd_rmi(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "run") == 0) {
+        return cmd_run(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "ps") == 0) {
+        return cmd_ps(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "inspect") == 0) {
+        return cmd_inspect(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "stats") == 0) {
+        return cmd_stats(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "top") == 0) {
+        return cmd_top(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "stop") == 0) {
+        return cmd_stop(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "rm") == 0) {
+        return cmd_rm(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "logs") == 0) {
+        return cmd_logs(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "wait") == 0) {
+        return cmd_wait(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "pool") == 0) {
+        return cmd_pool(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "bench") == 0) {
+        return cmd_bench(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "submit") == 0) {
+        return cmd_submit(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "scheduler") == 0) {
+        return cmd_scheduler(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "jobs") == 0) {
+        return cmd_jobs(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "info") == 0) {
+        return cmd_info(argc - 1, &argv[1]);
+    } else if (strcmp(cmd, "compose") == 0) {
+        return cmd_compose(argc - 1, &argv[1]);
+    } else {
+        fprintf(stderr, "Unknown command: %s\n\n", cmd);
+        mdock_print_usage(argv[0]);
+        return 1;
+    }
+}
+
+int mdock_command_is_local(int argc, char **argv)
+{
+    if (argc < 2) {
+        return 1;
+    }
+    const char *cmd = argv[1];
+
+    if (strcmp(cmd, "stop") == 0 || strcmp(cmd, "wait") == 0 || strcmp(cmd, "stats") == 0 ||
+        strcmp(cmd, "top") == 0 || strcmp(cmd, "bench") == 0 || strcmp(cmd, "compose") == 0) {
+        return 1;
+    }
+    if (strcmp(cmd, "logs") == 0) {
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--follow") == 0) {
+                return 1;
+            }
+        }
+    }
+    /* A foreground run waits for its containers and run --wait for memory: only run -d is served */
+    if (strcmp(cmd, "run") == 0) {
+        int detach = 0;
+        for (int i = 2; i < argc && argv[i][0] == '-'; i++) {
+            const struct run_option *opt = run_option_find(argv[i]);
+            if (!opt || strcmp(opt->name, "--wait") == 0) {
+                return 1;
+            }
+            detach |= strcmp(opt->name, "-d") == 0 || strcmp(opt->name, "--detach") == 0;
+            i += opt->takes_value;
+        }
+        return !detach;
+    }
+    return 0;
+}
@@ -0,0 +1,864 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/limits.h>
+
+#include "compose.h"
+#include "container.h"
+#include "image.h"
+#include "fsutil.h"
+#include "proc.h"
+#include "record.h"
+#include "timeutil.h"
+
+enum ready_kind {
+    READY_NONE,
+    READY_FILE,         /* the path exists; relative paths are in the image rootfs */
+    READY_PORT          /* 127.0.0.1:port accepts a connection */
+};
+
+struct compose_service {
+    char name[MDOCK_NAME_MAX];
+    char image[MDOCK_NAME_MAX];
+    char command[COMPOSE_LINE_MAX];
+    char options[COMPOSE_LINE_MAX];     /* run options, e.g. "--mem 64M --nice 5" */
+    char env[COMPOSE_LINE_MAX];         /* KEY=VALUE entries, each ending in a NUL */
+    size_t env_len;
+    int nenv;
+    char depends_on[COMPOSE_LINE_MAX];
+    int deps[COMPOSE_MAX_SERVICES];
+    int ndeps;
+    enum ready_kind ready;
+    char ready_arg[PATH_MAX];
+    int ready_timeout_s;
+    int line;                           /* of the section header */
+    int wave;
+
+    /* compose up */
+    char container[MDOCK_ID_MAX];
+    pid_t pid;
+    uint64_t pid_start;
+    pid_t runner;                       /* the forked mdock run */
+    int pending;                        /* readiness not seen yet */
+    int64_t started_ns;
+};
+
+struct compose_project {
+    char file[PATH_MAX];
+    char name[MDOCK_NAME_MAX];
+    char base_dir[PATH_MAX];
+    char dir[PATH_MAX];                 /* <root>/compose */
+    char state_path[PATH_MAX];
+    struct compose_service *svc;
+    int count;
+    int nwaves;
+};
+
+/* ----- Manifest ----- */
+
+static char *trim(char *s)
+{
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\n' || s[len - 1] == '\r')) {
+        s[--len] = '\0';
+    }
+    return s;
+}
+
+/* Service and project names end up in file names */
+static int valid_name(const char *name)
+{
+    if (!name[0] || name[0] == '.' || strlen(name) >= MDOCK_NAME_MAX) {
+        return 0;
+    }
+    for (const char *c = name; *c; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+              *c == '_' || *c == '-' || *c == '.')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Split s in place at blanks; '...' and "..." keep blanks inside a word.
+ * Returns the number of words, or -1 for an unclosed quote or more than max.
+ */
+static int split_words(char *s, char **out, int max)
+{
+    int n = 0;
+    char *r = s;
+    for (;;) {
+        while (*r == ' ' || *r == '\t') {
+            r++;
+        }
+        if (!*r) {
+            return n;
+        }
+        if (n == max) {
+            return -1;
+        }
+        char *w = r;
+        char quote = 0;
+        out[n++] = w;
+        while (*r && (quote || (*r != ' ' && *r != '\t'))) {
+            if (quote && *r == quote) {
+                quote = 0;
+                r++;
+            } else if (!quote && (*r == '\'' || *r == '"')) {
+                quote = *r++;
+            } else {
+                *w++ = *r++;
+            }
+        }
+        if (quote) {
+            return -1;
+        }
+        int more = *r != '\0';
+        *w = '\0';
+        if (more) {
+            r++;
+        }
+    }
+}
+
+static int count_words(const char *s)
+{
+    char copy[COMPOSE_LINE_MAX];
+    char *words[COMPOSE_MAX_ARGS];
+    snprintf(copy, sizeof(copy), "%s", s);
+    return split_words(copy, words, COMPOSE_MAX_ARGS);
+}
+
+static int find_service(const struct compose_project *p, const char *name)
+{
+    for (int i = 0; i < p->count; i++) {
+        if (strcmp(p->svc[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int set_value(char *dst, size_t size, const char *value)
+{
+    return snprintf(dst, size, "%s", value) >= (int)size ? -1 : 0;
+}
+
+static int parse_ready(struct compose_service *s, const char *value)
+{
+    if (strcmp(value, "none") == 0) {
+        s->ready = READY_NONE;
+        return 0;
+    }
+    if (strncmp(value, "file:", 5) == 0 && value[5]) {
+        s->ready = READY_FILE;
+        return set_value(s->ready_arg, sizeof(s->ready_arg), value + 5);
+    }
+    if (strncmp(value, "port:", 5) == 0) {
+        char *end;
+        long port = strtol(value + 5, &end, 10);
+        if (*end != '\0' || port < 1 || port > 65535) {
+            return -1;
+        }
+        s->ready = READY_PORT;
+        return set_value(s->ready_arg, sizeof(s->ready_arg), value + 5);
+    }
+    return -1;
+}
+
+/* Refuse run options that would change how compose starts the service */
+static int check_options(const char *file, int lineno, const char *options)
+{
+    char copy[COMPOSE_LINE_MAX];
+    char *words[COMPOSE_MAX_ARGS];
+    snprintf(copy, sizeof(copy), "%s", options);
+    int n = split_words(copy, words, COMPOSE_MAX_ARGS);
+    for (int i = 0; i < n; i++) {
+        const struct run_option *opt = run_option_find(words[i]);
+        if (strcmp(words[i], "-d") == 0 || strcmp(words[i], "--detach") == 0 ||
+            strcmp(words[i], "--replicas") == 0 || strcmp(words[i], "--cidfile") == 0) {
+            fprintf(stderr, "[mdock] %s:%d: %s cannot be used in options\n", file, lineno, words[i]);
+            return -1;
+        } else if (!opt) {
+            fprintf(stderr, "[mdock] %s:%d: unknown run option '%s'\n", file, lineno, words[i]);
+            return -1;
+        } else if (opt->takes_value && ++i >= n) {
+            fprintf(stderr, "[mdock] %s:%d: %s requires a value\n", file, lineno, words[i - 1]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* One "key = value" line of a service section; -2 for an unknown key */
+static int parse_key(struct compose_service *s, const char *key, const char *value)
+{
+    if (strcmp(key, "image") == 0) {
+        return set_value(s->image, sizeof(s->image), value);
+    } else if (strcmp(key, "command") == 0) {
+        return set_value(s->command, sizeof(s->command), value);
+    } else if (strcmp(key, "options") == 0) {
+        return set_value(s->options, sizeof(s->options), value);
+    } else if (strcmp(key, "env") == 0) {
+        size_t len = strlen(value) + 1;
+        if (!strchr(value, '=') || s->env_len + len > sizeof(s->env)) {
+            return -1;
+        }
+        memcpy(s->env + s->env_len, value, len);
+        s->env_len += len;
+        s->nenv++;
+        return 0;
+    } else if (strcmp(key, "depends_on") == 0) {
+        /* May be repeated: the lists add up */
+        size_t used = strlen(s->depends_on);
+        return snprintf(s->depends_on + used, sizeof(s->depends_on) - used, " %s", value) >=
+               (int)(sizeof(s->depends_on) - used) ? -1 : 0;
+    } else if (strcmp(key, "ready") == 0) {
+        return parse_ready(s, value);
+    } else if (strcmp(key, "ready_timeout") == 0) {
+        char *end;
+        long sec = strtol(value, &end, 10);
+        if (*end != '\0' || sec < 1 || sec > 86400) {
+            return -1;
+        }
+        s->ready_timeout_s = (int)sec;
+        return 0;
+    }
+    return -2;
+}
+
+static int parse_manifest(struct compose_project *p)
+{
+    FILE *f = fopen(p->file, "r");
+    if (!f) {
+        fprintf(stderr, "[mdock] compose file %s: %s\n", p->file, strerror(errno));
+        return -1;
+    }
+
+    char line[COMPOSE_LINE_MAX];
+    int lineno = 0;
+    struct compose_service *cur = NULL;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (!strchr(line, '\n') && !feof(f)) {
+            fprintf(stderr, "[mdock] %s:%d: line too long\n", p->file, lineno);
+            rc = -1;
+            break;
+        }
+        char *s = trim(line);
+        if (!*s || *s == '#' || *s == ';') {
+            continue;
+        }
+        if (*s == '[') {
+            char *end = strchr(s, ']');
+            if (!end || end[1]) {
+                fprintf(stderr, "[mdock] %s:%d: expected [service]\n", p->file, lineno);
+                rc = -1;
+                break;
+            }
+            *end = '\0';
+            char *name = trim(s + 1);
+            if (!valid_name(name)) {
+                fprintf(stderr, "[mdock] %s:%d: invalid service name '%s' (letters, digits, _ - .)\n",
+                        p->file, lineno, name);
+                rc = -1;
+            } else if (find_service(p, name) >= 0) {
+                fprintf(stderr, "[mdock] %s:%d: service '%s' defined twice\n", p->file, lineno, name);
+                rc = -1;
+            } else if (p->count == COMPOSE_MAX_SERVICES) {
+                fprintf(stderr, "[mdock] %s:%d: too many services (max %d)\n", p->file, lineno,
+                        COMPOSE_MAX_SERVICES);
+                rc = -1;
+            } else {
+                cur = &p->svc[p->count++];
+                memset(cur, 0, sizeof(*cur));
+                snprintf(cur->name, sizeof(cur->name), "%s", name);
+                cur->ready_timeout_s = COMPOSE_READY_TIMEOUT_S;
+                cur->line = lineno;
+            }
+            continue;
+        }
+        char *eq = strchr(s, '=');
+        if (!eq || !cur) {
+            fprintf(stderr, "[mdock] %s:%d: expected key = value inside a [service]\n", p->file, lineno);
+            rc = -1;
+            break;
+        }
+        *eq = '\0';
+        char *key = trim(s);
+        char *value = trim(eq + 1);
+        if (strcmp(key, "options") == 0 && check_options(p->file, lineno, value) != 0) {
+            rc = -1;
+            break;
+        }
+        int err = parse_key(cur, key, value);
+        if (err == -2) {
+            fprintf(stderr, "[mdock] %s:%d: unknown key '%s'\n", p->file, lineno, key);
+            rc = -1;
+        } else if (err != 0) {
+            fprintf(stderr, "[mdock] %s:%d: invalid %s '%s'\n", p->file, lineno, key, value);
+            rc = -1;
+        }
+    }
+    fclose(f);
+    if (rc != 0) {
+        return -1;
+    }
+    if (p->count == 0) {
+        fprintf(stderr, "[mdock] %s: no services\n", p->file);
+        return -1;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        struct compose_service *s = &p->svc[i];
+        int nopt = count_words(s->options);
+        int ncmd = count_words(s->command);
+        if (!s->image[0]) {
+            fprintf(stderr, "[mdock] %s:%d: service '%s' has no image\n", p->file, s->line, s->name);
+            return -1;
+        }
+        if (nopt < 0 || ncmd < 0 || 6 + nopt + 2 * s->nenv + ncmd > COMPOSE_MAX_ARGS) {
+            fprintf(stderr, "[mdock] %s:%d: service '%s': unclosed quote or too many arguments\n",
+                    p->file, s->line, s->name);
+            return -1;
+        }
+
+        char *names[COMPOSE_MAX_SERVICES];
+        for (char *c = s->depends_on; *c; c++) {
+            if (*c == ',') {
+                *c = ' ';
+            }
+        }
+        char deps[COMPOSE_LINE_MAX];
+        snprintf(deps, sizeof(deps), "%s", s->depends_on);
+        int n = split_words(deps, names, COMPOSE_MAX_SERVICES);
+        if (n < 0) {
+            fprintf(stderr, "[mdock] %s:%d: service '%s': invalid depends_on\n", p->file, s->line, s->name);
+            return -1;
+        }
+        for (int k = 0; k < n; k++) {
+            int dep = find_service(p, names[k]);
+            if (dep < 0 || dep == i) {
+                fprintf(stderr, "[mdock] %s:%d: service '%s' depends on %s '%s'\n", p->file, s->line,
+                        s->name, dep < 0 ? "unknown service" : "itself", names[k]);
+                return -1;
+            }
+            int seen = 0;
+            for (int j = 0; j < s->ndeps; j++) {
+                seen |= s->deps[j] == dep;
+            }
+            if (!seen) {
+                s->deps[s->ndeps++] = dep;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Wave of a service: one after the latest wave among its dependencies */
+static int compute_waves(struct compose_project *p)
+{
+    for (int i = 0; i < p->count; i++) {
+        p->svc[i].wave = -1;
+    }
+    int placed = 0;
+    p->nwaves = 0;
+    for (int w = 0; placed < p->count; w++) {
+        int progress = 0;
+        for (int i = 0; i < p->count; i++) {
+            struct compose_service *s = &p->svc[i];
+            if (s->wave >= 0) {
+                continue;
+            }
+            int ready = 1;
+            for (int k = 0; k < s->ndeps; k++) {
+                int dw = p->svc[s->deps[k]].wave;
+                ready &= dw >= 0 && dw < w;
+            }
+            if (ready) {
+                s->wave = w;
+                progress++;
+            }
+        }
+        if (progress == 0) {
+            fprintf(stderr, "[mdock] %s: dependency cycle among:", p->file);
+            const char *sep = " ";
+            for (int i = 0; i < p->count; i++) {
+                if (p->svc[i].wave < 0) {
+                    fprintf(stderr, "%s%s (line %d)", sep, p->svc[i].name, p->svc[i].line);
+                    sep = ", ";
+                }
+            }
+            fprintf(stderr, "\n");
+            return -1;
+        }
+        placed += progress;
+        p->nwaves = w + 1;
+    }
+    return 0;
+}
+
+/* ----- Project state ----- */
+
+/* <root>/compose/<project>.state: service|container per line; 0 when there is none */
+static int load_state(struct compose_project *p)
+{
+    FILE *f = fopen(p->state_path, "r");
+    if (!f) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        fprintf(stderr, "[mdock] compose state %s: %s\n", p->state_path, strerror(errno));
+        return -1;
+    }
+    char line[COMPOSE_LINE_MAX];
+    while (fgets(line, sizeof(line), f)) {
+        char *s = trim(line);
+        char *bar = strchr(s, '|');
+        if (!bar) {
+            continue;
+        }
+        *bar = '\0';
+        int i = find_service(p, s);
+        if (i < 0) {
+            fprintf(stderr, "[mdock] compose: service '%s' (%s) is no longer in %s, left running\n",
+                    s, bar + 1, p->file);
+            continue;
+        }
+        snprintf(p->svc[i].container, sizeof(p->svc[i].container), "%s", bar + 1);
+    }
+    fclose(f);
+    return 1;
+}
+
+static int save_state(const struct compose_project *p)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", p->state_path) >= (int)sizeof(tmp)) {
+        fprintf(stderr, "[mdock] compose state path too long\n");
+        return -1;
+    }
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "[mdock] compose state %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < p->count; i++) {
+        if (p->svc[i].container[0]) {
+            fprintf(f, "%s|%s\n", p->svc[i].name, p->svc[i].container);
+        }
+    }
+    if (fclose(f) != 0 || rename(tmp, p->state_path) != 0) {
+        fprintf(stderr, "[mdock] compose state %s: %s\n", p->state_path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* The service's container is running; fills rec */
+static int service_running(const struct compose_project *p, const struct compose_service *s,
+                           struct container_record *rec)
+{
+    return s->container[0] && find_container_record(p->base_dir, s->container, rec) == 0 &&
+           strcmp(rec->status, "running") == 0 && container_is_alive(rec);
+}
+
+/* ----- compose up ----- */
+
+static void read_cidfile(const char *path, char *id, size_t size)
+{
+    id[0] = '\0';
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+    if (fgets(id, (int)size, f)) {
+        id[strcspn(id, "\n")] = '\0';
+    }
+    fclose(f);
+}
+
+static int cid_path(const struct compose_project *p, const struct compose_service *s,
+                    char *buf, size_t size)
+{
+    if (snprintf(buf, size, "%s/%s.%s.cid", p->dir, p->name, s->name) >= (int)size) {
+        fprintf(stderr, "[mdock] compose cidfile path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Child of compose up: an ordinary run -d of the service */
+static void run_service(struct compose_service *s, char *cidfile)
+{
+    char *argv[COMPOSE_MAX_ARGS + 1];
+    int argc = 0;
+    argv[argc++] = "run";
+    argv[argc++] = "-d";
+    argv[argc++] = "--cidfile";
+    argv[argc++] = cidfile;
+    argc += split_words(s->options, &argv[argc], COMPOSE_MAX_ARGS - argc);
+    char *e = s->env;
+    for (int k = 0; k < s->nenv; k++) {
+        argv[argc++] = "-e";
+        argv[argc++] = e;
+        e += strlen(e) + 1;
+    }
+    argv[argc++] = s->image;
+    argc += split_words(s->command, &argv[argc], COMPOSE_MAX_ARGS - argc);
+    argv[argc] = NULL;
+
+    /* compose reports the start itself; errors still reach stderr */
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+    }
+    int rc = cmd_run(argc, argv);
+    fflush(NULL);
+    _exit(rc == 0 ? 0 : 1);
+}
+
+static int ready_check(const struct compose_project *p, const struct compose_service *s)
+{
+    if (s->ready == READY_FILE) {
+        char path[PATH_MAX];
+        char rootfs[PATH_MAX];
+        if (s->ready_arg[0] == '/') {
+            return access(s->ready_arg, F_OK) == 0;
+        }
+        if (find_image_rootfs(p->base_dir, s->image, rootfs, sizeof(rootfs)) != 0 ||
+            snprintf(path, sizeof(path), "%s/%s", rootfs, s->ready_arg) >= (int)sizeof(path)) {
+            return 0;
+        }
+        return access(path, F_OK) == 0;
+    }
+    if (s->ready == READY_PORT) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(s->ready_arg));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return 0;
+        }
+        int ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        close(fd);
+        return ok;
+    }
+    return 1;
+}
+
+/* Poll the readiness checks of wave w together; fails on the first that cannot pass */
+static int wait_wave_ready(const struct compose_project *p, int w)
+{
+    int rc = 0;
+    int pending = 0;
+    for (int i = 0; i < p->count; i++) {
+        pending += p->svc[i].wave == w && p->svc[i].pending;
+    }
+    while (pending > 0 && rc == 0) {
+        int64_t now = mdock_monotonic_ns();
+        for (int i = 0; i < p->count; i++) {
+            struct compose_service *s = &p->svc[i];
+            if (s->wave != w || !s->pending) {
+                continue;
+            }
+            if (ready_check(p, s)) {
+                printf("[mdock] compose: %s ready (%s:%s) after %.1f ms\n", s->name,
+                       s->ready == READY_FILE ? "file" : "port", s->ready_arg,
+                       (mdock_monotonic_ns() - s->started_ns) / 1e6);
+            } else if (!proc_alive(s->pid, s->pid_start)) {
+                fprintf(stderr, "[mdock] compose: %s (%s) exited before it was ready\n", s->name,
+                        s->container);
+                rc = -1;
+            } else if (now - s->started_ns > (int64_t)s->ready_timeout_s * 1000000000LL) {
+                fprintf(stderr, "[mdock] compose: %s (%s) not ready after %ds\n", s->name, s->container,
+                        s->ready_timeout_s);
+                rc = -1;
+            } else {
+                continue;
+            }
+            s->pending = 0;
+            pending--;
+        }
+        if (pending > 0 && rc == 0) {
+            poll(NULL, 0, COMPOSE_READY_POLL_MS);
+        }
+    }
+    return rc;
+}
+
+/* Start every service of wave w at once; returns how many were started or -1 */
+static int start_wave(struct compose_project *p, int w)
+{
+    int rc = 0;
+    int launched = 0;
+    fflush(NULL);
+    for (int i = 0; i < p->count; i++) {
+        struct compose_service *s = &p->svc[i];
+        struct container_record rec;
+        if (s->wave != w) {
+            continue;
+        }
+        s->runner = -1;
+        if (service_running(p, s, &rec)) {
+            printf("[mdock] compose: %s is already running as %s\n", s->name, s->container);
+            continue;
+        }
+        char cidfile[PATH_MAX];
+        if (cid_path(p, s, cidfile, sizeof(cidfile)) != 0) {
+            rc = -1;
+            break;
+        }
+        unlink(cidfile);
+        s->container[0] = '\0';
+        s->started_ns = mdock_monotonic_ns();
+        s->runner = fork();
+        if (s->runner == -1) {
+            perror("[mdock] fork");
+            rc = -1;
+            break;
+        }
+        if (s->runner == 0) {
+            run_service(s, cidfile);
+        }
+        launched++;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        struct compose_service *s = &p->svc[i];
+        if (s->wave != w || s->runner <= 0) {
+            continue;
+        }
+        int status = 0;
+        while (waitpid(s->runner, &status, 0) == -1 && errno == EINTR) {
+        }
+        s->runner = -1;
+
+        char cidfile[PATH_MAX];
+        struct container_record rec;
+        if (cid_path(p, s, cidfile, sizeof(cidfile)) == 0) {
+            read_cidfile(cidfile, s->container, sizeof(s->container));
+            unlink(cidfile);
+        }
+        if (!s->container[0] || find_container_record(p->base_dir, s->container, &rec) != 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "[mdock] compose: %s failed to start\n", s->name);
+            rc = -1;
+            continue;
+        }
+        s->pid = rec.pid;
+        s->pid_start = rec.pid_start;
+        s->pending = s->ready != READY_NONE;
+        printf("[mdock] compose: %s started as %s (PID %d)\n", s->name, s->container, s->pid);
+    }
+    return rc == 0 ? launched : -1;
+}
+
+static int compose_up(struct compose_project *p)
+{
+    if (ensure_dir_exists(p->dir, 0755) != 0 || load_state(p) < 0) {
+        return 1;
+    }
+
+    int64_t t0 = mdock_monotonic_ns();
+    int total = 0;
+    for (int w = 0; w < p->nwaves; w++) {
+        int64_t tw = mdock_monotonic_ns();
+        int started = start_wave(p, w);
+        if (save_state(p) != 0 || started < 0 || wait_wave_ready(p, w) != 0) {
+            fprintf(stderr, "[mdock] compose: project %s stopped at wave %d of %d\n", p->name, w + 1,
+                    p->nwaves);
+            fprintf(stderr, "[mdock] hint: 'mdock compose down -f %s' stops what was started\n", p->file);
+            return 1;
+        }
+        total += started;
+        printf("[mdock] compose: wave %d/%d: %d started in %.1f ms\n", w + 1, p->nwaves, started,
+               (mdock_monotonic_ns() - tw) / 1e6);
+    }
+    printf("[mdock] compose: project %s up, %d of %d services started in %.1f ms\n", p->name, total,
+           p->count, (mdock_monotonic_ns() - t0) / 1e6);
+    return 0;
+}
+
+/* ----- compose down / ps ----- */
+
+static int compose_down(struct compose_project *p, const char *timeout)
+{
+    int have = load_state(p);
+    if (have < 0) {
+        return 1;
+    }
+    if (have == 0) {
+        printf("[mdock] compose: project %s is not up\n", p->name);
+        return 0;
+    }
+
+    /* Dependents go first; each wave is stopped in parallel by one mdock stop */
+    int rc = 0;
+    char *argv[COMPOSE_MAX_SERVICES + 4];
+    for (int w = p->nwaves - 1; w >= 0; w--) {
+        int argc = 0;
+        argv[argc++] = "stop";
+        if (timeout) {
+            argv[argc++] = "-t";
+            argv[argc++] = (char *)timeout;
+        }
+        int first = argc;
+        for (int i = 0; i < p->count; i++) {
+            struct compose_service *s = &p->svc[i];
+            struct container_record rec;
+            if (s->wave == w && service_running(p, s, &rec)) {
+                argv[argc++] = s->container;
+            }
+        }
+        if (argc == first) {
+            continue;
+        }
+        argv[argc] = NULL;
+        fflush(NULL);
+        if (cmd_stop(argc, argv) != 0) {
+            rc = 1;
+        }
+    }
+    if (rc == 0) {
+        unlink(p->state_path);
+        printf("[mdock] compose: project %s down\n", p->name);
+    }
+    return rc;
+}
+
+static int compose_ps(struct compose_project *p)
+{
+    if (load_state(p) < 0) {
+        return 1;
+    }
+    printf("%-20s %-5s %-10s %-10s %s\n", "SERVICE", "WAVE", "CONTAINER", "STATUS", "DEPENDS_ON");
+    for (int w = 0; w < p->nwaves; w++) {
+        for (int i = 0; i < p->count; i++) {
+            struct compose_service *s = &p->svc[i];
+            struct container_record rec;
+            if (s->wave != w) {
+                continue;
+            }
+            const char *status = "-";
+            if (s->container[0] && find_container_record(p->base_dir, s->container, &rec) == 0) {
+                status = (strcmp(rec.status, "running") == 0 && !container_is_alive(&rec)) ? "dead"
+                                                                                            : rec.status;
+            }
+            char deps[COMPOSE_LINE_MAX] = "-";
+            size_t used = 0;
+            for (int k = 0; k < s->ndeps && used < sizeof(deps); k++) {
+                used += (size_t)snprintf(deps + used, sizeof(deps) - used, "%s%s", k ? "," : "",
+                                         p->svc[s->deps[k]].name);
+            }
+            printf("%-20s %-5d %-10s %-10s %s\n", s->name, w + 1, s->container[0] ? s->container : "-",
+                   status, deps);
+        }
+    }
+    return 0;
+}
+
+/* ----- mdock compose ----- */
+
+static void compose_usage(void)
+{
+    fprintf(stderr, "Usage: mdock compose up   [-f FILE] [-p PROJECT]\n");
+    fprintf(stderr, "       mdock compose down [-f FILE] [-p PROJECT] [-t SECONDS]\n");
+    fprintf(stderr, "       mdock compose ps   [-f FILE] [-p PROJECT]\n");
+    fprintf(stderr, "\nFILE (default %s) has one section per container:\n", COMPOSE_DEFAULT_FILE);
+    fprintf(stderr, "  [api]\n");
+    fprintf(stderr, "  image = demo\n");
+    fprintf(stderr, "  command = /bin/server --port 8080\n");
+    fprintf(stderr, "  options = --mem 256M --nice 5     # run options but -d, --replicas, --cidfile\n");
+    fprintf(stderr, "  env = MODE=prod                   # repeatable\n");
+    fprintf(stderr, "  depends_on = db, cache\n");
+    fprintf(stderr, "  ready = port:8080                 # or file:PATH, none\n");
+    fprintf(stderr, "  ready_timeout = %d\n", COMPOSE_READY_TIMEOUT_S);
+}
+
+int cmd_compose(int argc, char **argv)
+{
+    if (argc < 2) {
+        compose_usage();
+        return 1;
+    }
+    const char *sub = argv[1];
+    const char *file = COMPOSE_DEFAULT_FILE;
+    const char *project = NULL;
+    const char *timeout = NULL;
+    for (int i = 2; i < argc; i++) {
+        if ((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--file") == 0) && i + 1 < argc) {
+            file = argv[++i];
+        } else if ((strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--project") == 0) && i + 1 < argc) {
+            project = argv[++i];
+        } else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--timeout") == 0) && i + 1 < argc &&
+                   strcmp(sub, "down") == 0) {
+            timeout = argv[++i];
+        } else {
+            compose_usage();
+            return 1;
+        }
+    }
+    if (strcmp(sub, "up") != 0 && strcmp(sub, "down") != 0 && strcmp(sub, "ps") != 0) {
+        compose_usage();
+        return 1;
+    }
+
+    struct compose_project p;
+    memset(&p, 0, sizeof(p));
+    p.svc = calloc(COMPOSE_MAX_SERVICES, sizeof(*p.svc));
+    if (!p.svc) {
+        perror("[mdock] calloc");
+        return 1;
+    }
+    snprintf(p.file, sizeof(p.file), "%s", file);
+
+    /* The project is named after the manifest: app.conf -> app */
+    if (project) {
+        snprintf(p.name, sizeof(p.name), "%s", project);
+    } else {
+        const char *base = strrchr(file, '/');
+        snprintf(p.name, sizeof(p.name), "%s", base ? base + 1 : file);
+        char *dot = strrchr(p.name, '.');
+        if (dot && dot != p.name) {
+            *dot = '\0';
+        }
+    }
+    int rc = 1;
+    if (!valid_name(p.name)) {
+        fprintf(stderr, "[mdock] invalid project name '%s' (letters, digits, _ - .), use -p\n", p.name);
+    } else if (mdock_init_home(p.base_dir, sizeof(p.base_dir)) != 0) {
+        /* reported */
+    } else if (snprintf(p.dir, sizeof(p.dir), "%s/compose", p.base_dir) >= (int)sizeof(p.dir) ||
+               snprintf(p.state_path, sizeof(p.state_path), "%s/%s.state", p.dir, p.name) >=
+                   (int)sizeof(p.state_path)) {
+        fprintf(stderr, "[mdock] compose state path too long\n");
+    } else if (parse_manifest(&p) == 0 && compute_waves(&p) == 0) {
+        if (strcmp(sub, "up") == 0) {
+            rc = compose_up(&p);
+        } else if (strcmp(sub, "down") == 0) {
+            rc = compose_down(&p, timeout);
+        } else {
+            rc = compose_ps(&p);
+        }
+    }
+    free(p.svc);
+    return rc;
+}
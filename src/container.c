@@ -1,348 +1,385 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
-#include <sys/types.h>
 #include <sys/resource.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <errno.h>
 #include <signal.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
 #include <linux/limits.h>
 
 #include "container.h"
 #include "image.h"
 #include "log.h"
 #include "timeutil.h"
+#include "record.h"
+#include "proc.h"
+#include "shard.h"
+#include "fsutil.h"
+#include "launch.h"
+#include "monitor.h"
+#include "pool.h"
+#include "cgroup.h"
+#include "placement.h"
+#include "watchdog.h"
+#include "history.h"
+#include "trace.h"
+#include "budget.h"
+#include "report.h"
 
 /* ----- Issue #10 & #11: Helper functions ----- */
 
-int is_pid_alive(pid_t pid)
+int container_is_alive(const struct container_record *rec)
+{
+    /* A pidfd plus the recorded start time: a reused pid is not our container */
+    return proc_alive(rec->pid, rec->pid_start);
+}
+
+static int containers_db_path(const char *base_dir, char *buf, size_t size)
 {
-    /* Use kill with signal 0 to check if process exists */
-    if (kill(pid, 0) == 0) {
-        return 1; /* Process exists */
+    if (snprintf(buf, size, "%s/containers.db", base_dir) >= (int)size) {
+        fprintf(stderr, "[mdock] containers.db path too long\n");
+        return -1;
     }
-    return 0; /* Process doesn't exist or we don't have permission */
+    return 0;
 }
 
-int find_container_by_id(const char *base_dir,
-                         const char *container_id,
-                         int *out_pid,
-                         char *out_status,
-                         size_t status_size)
+int find_container_record(const char *base_dir,
+                          const char *container_id,
+                          struct container_record *out)
 {
     char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] containers.db path too long\n");
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
         return -1;
     }
 
-    FILE *f = fopen(db_path, "r");
-    if (!f) {
-        perror("[mdock] fopen containers.db");
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
+        perror("[mdock] open containers.db");
         return -1;
     }
 
-    char line[4096];
+    struct db_scanner s;
+    struct db_row row;
     int found = 0;
 
-    while (fgets(line, sizeof(line), f)) {
-        /* Parse: id|pid|image|status|start_time|end_time|exit_code */
-        char *p1 = strchr(line, '|');
-        if (!p1) continue;
-        *p1 = '\0';
-        char *id = line;
-
-        if (strcmp(id, container_id) == 0) {
-            char *p2 = strchr(p1 + 1, '|');
-            if (!p2) continue;
-            *p2 = '\0';
-            char *pid_str = p1 + 1;
-
-            char *p3 = strchr(p2 + 1, '|');
-            if (!p3) continue;
-            *p3 = '\0';
-
-            char *p4 = strchr(p3 + 1, '|');
-            if (!p4) continue;
-            *p4 = '\0';
-            char *status = p3 + 1;
-
-            *out_pid = atoi(pid_str);
-            if (strlen(status) + 1 > status_size) {
-                fprintf(stderr, "[mdock] status buffer too small\n");
-                fclose(f);
-                return -1;
-            }
-            strcpy(out_status, status);
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        if (db_field_eq(&row.fields[CF_ID], container_id) &&
+            container_record_parse(&row, out) == 0) {
             found = 1;
             break;
         }
     }
 
-    fclose(f);
+    db_map_close(&map);
     return found ? 0 : -1;
 }
 
-int update_container_status(const char *base_dir,
-                            const char *container_id,
-                            const char *new_status)
+int find_container_by_id(const char *base_dir,
+                         const char *container_id,
+                         int *out_pid,
+                         char *out_status,
+                         size_t status_size)
 {
-    char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] containers.db path too long\n");
-        return -1;
-    }
-
-    char tmp_path[PATH_MAX];
-    if (snprintf(tmp_path, sizeof(tmp_path), "%s/containers.db.tmp", base_dir) >= (int)sizeof(tmp_path)) {
-        fprintf(stderr, "[mdock] tmp path too long\n");
-        return -1;
-    }
-
-    FILE *f_in = fopen(db_path, "r");
-    if (!f_in) {
-        perror("[mdock] fopen containers.db");
+    struct container_record rec;
+    if (find_container_record(base_dir, container_id, &rec) != 0) {
         return -1;
     }
 
-    FILE *f_out = fopen(tmp_path, "w");
-    if (!f_out) {
-        perror("[mdock] fopen containers.db.tmp");
-        fclose(f_in);
+    if (strlen(rec.status) + 1 > status_size) {
+        fprintf(stderr, "[mdock] status buffer too small\n");
         return -1;
     }
+    *out_pid = rec.pid;
+    strcpy(out_status, rec.status);
+    return 0;
+}
 
-    char line[4096];
-    int updated = 0;
-
-    while (fgets(line, sizeof(line), f_in)) {
-        /* Parse: id|pid|image|status|start_time|end_time|exit_code */
-        char *p1 = strchr(line, '|');
-        if (!p1) {
-            fputs(line, f_out);
-            continue;
-        }
-        *p1 = '\0';
-        char *id = line;
-
-        if (strcmp(id, container_id) == 0) {
-            /* Found the container, rebuild the line with new status */
-            char *p2 = strchr(p1 + 1, '|');
-            if (!p2) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p2 = '\0';
-            char *pid_str = p1 + 1;
+/* Rewrite state shared by the update/remove helpers below */
+struct container_update {
+    const char *container_id;
+    const char *new_status;     /* NULL keeps the current status */
+    int64_t end_ns;             /* 0 keeps the current end time */
+    int64_t duration_ns;        /* 0 keeps the current duration */
+    int exit_code;
+    int set_exit;
+    int keep_stopped;           /* an exit keeps the "stopped"/"killed" set by stop */
+    const char *reason;         /* NULL keeps the current reason */
+    int cpu_used_milli;         /* 0 keeps the current achieved CPU rate */
+    const struct rusage *usage; /* NULL keeps the current usage */
+    int remove;
+};
+
+static int64_t timeval_us(const struct timeval *tv)
+{
+    return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
 
-            char *p3 = strchr(p2 + 1, '|');
-            if (!p3) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p3 = '\0';
-            char *image = p2 + 1;
+static void usage_from_rusage(struct container_usage *u, const struct rusage *ru)
+{
+    u->utime_us = timeval_us(&ru->ru_utime);
+    u->stime_us = timeval_us(&ru->ru_stime);
+    u->maxrss_kb = ru->ru_maxrss;
+    u->minflt = ru->ru_minflt;
+    u->majflt = ru->ru_majflt;
+    u->nvcsw = ru->ru_nvcsw;
+    u->nivcsw = ru->ru_nivcsw;
+    u->inblock = ru->ru_inblock;
+    u->oublock = ru->ru_oublock;
+}
 
-            char *p4 = strchr(p3 + 1, '|');
-            if (!p4) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p4 = '\0';
-            /* old status - we'll replace it */
+static int apply_container_update(const struct db_row *row, FILE *out, void *arg)
+{
+    const struct container_update *u = arg;
 
-            char *p5 = strchr(p4 + 1, '|');
-            if (!p5) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p5 = '\0';
-            char *start_time = p4 + 1;
+    if (!db_field_eq(&row->fields[CF_ID], u->container_id)) {
+        return 0;
+    }
 
-            char *p6 = strchr(p5 + 1, '|');
-            if (!p6) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p6 = '\0';
-            char *end_time = p5 + 1;
+    if (u->remove) {
+        return 1;
+    }
 
-            /* Remove trailing newline from exit_code */
-            char *exit_code = p6 + 1;
-            char *newline = strchr(exit_code, '\n');
-            if (newline) *newline = '\0';
+    struct container_record rec;
+    if (container_record_parse(row, &rec) != 0) {
+        return 0; /* Malformed: keep the line as-is */
+    }
 
-            /* Write updated record with new status */
-            fprintf(f_out, "%s|%s|%s|%s|%s|%s|%s\n",
-                    id, pid_str, image, new_status, start_time, end_time, exit_code);
-            updated = 1;
-        } else {
-            /* Restore the line and write as-is */
-            *p1 = '|';
-            fputs(line, f_out);
-        }
+    int stopped = strcmp(rec.status, "stopped") == 0 || strcmp(rec.status, "killed") == 0;
+    if (u->new_status && !(u->keep_stopped && stopped)) {
+        snprintf(rec.status, sizeof(rec.status), "%s", u->new_status);
+    }
+    if (u->end_ns) {
+        rec.end_ns = u->end_ns;
+    } else if (rec.end_ns == 0 && u->new_status && strcmp(u->new_status, "running") != 0) {
+        rec.end_ns = mdock_realtime_ns();
+    }
+    if (u->duration_ns) {
+        rec.duration_ns = u->duration_ns;
+    }
+    if (u->set_exit) {
+        rec.exit_code = u->exit_code;
+    }
+    if (u->reason) {
+        snprintf(rec.reason, sizeof(rec.reason), "%s", u->reason);
+    }
+    if (u->cpu_used_milli) {
+        rec.cpu_used_milli = u->cpu_used_milli;
+    }
+    if (u->usage) {
+        usage_from_rusage(&rec.usage, u->usage);
+        rec.has_usage = 1;
     }
 
-    fclose(f_in);
-    fclose(f_out);
+    container_record_write(out, &rec);
+    return 1;
+}
 
-    if (!updated) {
-        fprintf(stderr, "[mdock] container %s not found in containers.db\n", container_id);
-        unlink(tmp_path);
+static int rewrite_container(const char *base_dir, const struct container_update *u)
+{
+    char db_path[PATH_MAX];
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
         return -1;
     }
 
-    if (rename(tmp_path, db_path) != 0) {
-        perror("[mdock] rename containers.db");
+    int changed = db_rewrite(db_path, apply_container_update, (void *)u);
+    if (changed < 0) {
+        return -1;
+    }
+    if (changed == 0) {
+        fprintf(stderr, "[mdock] container %s not found in containers.db\n", u->container_id);
         return -1;
     }
-
     return 0;
 }
 
+int update_container_status(const char *base_dir,
+                            const char *container_id,
+                            const char *new_status)
+{
+    struct container_update u = {
+        .container_id = container_id,
+        .new_status = new_status,
+    };
+    return rewrite_container(base_dir, &u);
+}
+
+int remove_container_record(const char *base_dir,
+                            const char *container_id)
+{
+    struct container_update u = {
+        .container_id = container_id,
+        .remove = 1,
+    };
+    return rewrite_container(base_dir, &u);
+}
+
 /* ----- Issue #7: containers.db helpers ----- */
 
-/* Format: id|pid|image|status|start_time|end_time|exit_code */
+/* Format: see record.h */
 
-int add_container_record(const char *base_dir,
-                         const char *container_id,
-                         int pid,
-                         const char *image_name)
+/* Append records with a single write(); the caller holds the containers.db lock */
+static int append_container_records(const char *db_path, const struct container_record *recs, int count)
 {
-    char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] containers.db path too long\n");
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&buf, &len);
+    if (!mem) {
+        perror("[mdock] open_memstream");
         return -1;
     }
-
-    FILE *f = fopen(db_path, "a");
-    if (!f) {
-        perror("[mdock] fopen containers.db");
+    for (int i = 0; i < count; i++) {
+        container_record_write(mem, &recs[i]);
+    }
+    if (fclose(mem) != 0) {
+        free(buf);
         return -1;
     }
 
-    char start_time[32];
-    if (mdock_current_timestamp(start_time, sizeof(start_time)) != 0) {
-        snprintf(start_time, sizeof(start_time), "0000-00-00T00:00:00");
+    int rc = -1;
+    int fd = open(db_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("[mdock] open containers.db");
+    } else {
+        ssize_t n = write(fd, buf, len);
+        if (n == (ssize_t)len) {
+            rc = 0;
+        } else {
+            perror("[mdock] write containers.db");
+        }
+        close(fd);
     }
+    free(buf);
+    return rc;
+}
 
-    /* id|pid|image|status|start_time|end_time|exit_code */
-    fprintf(f, "%s|%d|%s|running|%s||-1\n", container_id, pid, image_name, start_time);
-    fclose(f);
-    return 0;
+static void init_running_record(struct container_record *rec, const char *container_id,
+                                int pid, const char *image_name, const char *shard)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->pid = pid;
+    rec->exit_code = -1;
+    snprintf(rec->id, sizeof(rec->id), "%s", container_id);
+    snprintf(rec->image, sizeof(rec->image), "%s", image_name);
+    snprintf(rec->status, sizeof(rec->status), "running");
+    snprintf(rec->shard, sizeof(rec->shard), "%s", shard);
+    rec->start_ns = mdock_realtime_ns();
+    rec->pid_start = proc_starttime(pid);
+    rec->numa_node = -1;
+    rec->nice = MDOCK_UNSET;
+    rec->oom_score_adj = MDOCK_UNSET;
 }
 
-int update_container_exit(const char *base_dir,
-                          const char *container_id,
-                          int exit_code)
+int add_container_record(const char *base_dir,
+                         const char *container_id,
+                         int pid,
+                         const char *image_name,
+                         const char *shard)
 {
     char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] containers.db path too long\n");
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
         return -1;
     }
 
-    char tmp_path[PATH_MAX];
-    if (snprintf(tmp_path, sizeof(tmp_path), "%s/containers.db.tmp", base_dir) >= (int)sizeof(tmp_path)) {
-        fprintf(stderr, "[mdock] tmp path too long\n");
-        return -1;
-    }
+    struct container_record rec;
+    init_running_record(&rec, container_id, pid, image_name, shard);
 
-    FILE *f_in = fopen(db_path, "r");
-    if (!f_in) {
-        perror("[mdock] fopen containers.db");
+    int lock = db_lock(db_path);
+    if (lock < 0) {
         return -1;
     }
+    int rc = append_container_records(db_path, &rec, 1);
+    db_unlock(lock);
+    return rc;
+}
 
-    FILE *f_out = fopen(tmp_path, "w");
-    if (!f_out) {
-        perror("[mdock] fopen containers.db.tmp");
-        fclose(f_in);
-        return -1;
-    }
+int update_container_exit(const char *base_dir,
+                          const char *container_id,
+                          int exit_code,
+                          const char *reason,
+                          int64_t duration_ns)
+{
+    struct container_update u = {
+        .container_id = container_id,
+        .new_status = "exited",
+        .end_ns = mdock_realtime_ns(),
+        .duration_ns = duration_ns,
+        .exit_code = exit_code,
+        .set_exit = 1,
+        .keep_stopped = 1,
+        .reason = reason ? reason : "",
+    };
+    return rewrite_container(base_dir, &u);
+}
 
-    char end_time[32];
-    if (mdock_current_timestamp(end_time, sizeof(end_time)) != 0) {
-        snprintf(end_time, sizeof(end_time), "0000-00-00T00:00:00");
+/*
+ * The process is gone but whoever reaps it may not have written the exit
+ * yet: watch for the next rename of containers.db for up to a second.
+ */
+static void wait_for_exit_record(const char *base_dir, struct container_record *rec)
+{
+    int ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (ino >= 0) {
+        inotify_add_watch(ino, base_dir, IN_MOVED_TO | IN_CLOSE_WRITE);
     }
 
-    char line[4096];
-    int updated = 0;
-
-    while (fgets(line, sizeof(line), f_in)) {
-        /* Parse: id|pid|image|status|start_time|end_time|exit_code */
-        char *p1 = strchr(line, '|');
-        if (!p1) {
-            fputs(line, f_out);
-            continue;
+    int64_t deadline = mdock_monotonic_ns() + 1000000000LL;
+    char id[MDOCK_ID_MAX];
+    snprintf(id, sizeof(id), "%s", rec->id);
+    while (strcmp(rec->status, "running") == 0) {
+        int64_t left = deadline - mdock_monotonic_ns();
+        if (left <= 0 || ino < 0) {
+            break;
         }
-        *p1 = '\0';
-        char *id = line;
-
-        if (strcmp(id, container_id) == 0) {
-            /* Found the container, rebuild the line with updated fields */
-            char *p2 = strchr(p1 + 1, '|');
-            if (!p2) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p2 = '\0';
-            char *pid_str = p1 + 1;
-
-            char *p3 = strchr(p2 + 1, '|');
-            if (!p3) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p3 = '\0';
-            char *image = p2 + 1;
-
-            char *p4 = strchr(p3 + 1, '|');
-            if (!p4) {
-                fputs(line, f_out);
-                continue;
+        struct pollfd pfd = { .fd = ino, .events = POLLIN };
+        if (poll(&pfd, 1, (int)(left / 1000000) + 1) > 0) {
+            char buf[4096];
+            while (read(ino, buf, sizeof(buf)) > 0) {
             }
-            *p4 = '\0';
-            /* status field - we'll replace it */
-
-            char *p5 = strchr(p4 + 1, '|');
-            if (!p5) {
-                fputs(line, f_out);
-                continue;
-            }
-            *p5 = '\0';
-            char *start_time = p4 + 1;
-
-            /* Now write updated record */
-            fprintf(f_out, "%s|%s|%s|exited|%s|%s|%d\n",
-                    id, pid_str, image, start_time, end_time, exit_code);
-            updated = 1;
-        } else {
-            /* Restore the line and write as-is */
-            *p1 = '|';
-            fputs(line, f_out);
+        }
+        if (find_container_record(base_dir, id, rec) != 0) {
+            break;
         }
     }
-
-    fclose(f_in);
-    fclose(f_out);
-
-    if (!updated) {
-        fprintf(stderr, "[mdock] container %s not found in containers.db\n", container_id);
-        unlink(tmp_path);
-        return -1;
+    if (ino >= 0) {
+        close(ino);
     }
+}
 
-    if (rename(tmp_path, db_path) != 0) {
-        perror("[mdock] rename containers.db");
-        return -1;
+/* Highest cN in containers.db plus one */
+static int next_container_number(const char *db_path)
+{
+    /* If the file doesn't exist, start with c1 */
+    struct db_map map;
+    int max_num = 0;
+    if (db_map_open(db_path, &map) == 0) {
+        struct db_scanner s;
+        struct db_row row;
+
+        db_scanner_init(&s, &map);
+        while (db_scanner_next(&s, &row)) {
+            /* Parse id field (format: cN) */
+            const struct db_field *id = &row.fields[CF_ID];
+            if (row.nfields > 1 && id->len > 1 && id->ptr[0] == 'c') {
+                struct db_field num_field = { id->ptr + 1, id->len - 1 };
+                int num = (int)db_field_long(&num_field);
+                if (num > max_num) {
+                    max_num = num;
+                }
+            }
+        }
+        db_map_close(&map);
     }
-
-    return 0;
+    return max_num + 1;
 }
 
 int generate_container_id(const char *base_dir,
@@ -350,41 +387,11 @@ int generate_container_id(const char *base_dir,
                           size_t out_size)
 {
     char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] containers.db path too long\n");
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
         return -1;
     }
 
-    FILE *f = fopen(db_path, "r");
-    if (!f) {
-        /* If file doesn't exist, start with c1 */
-        if (snprintf(out_id, out_size, "c1") >= (int)out_size) {
-            fprintf(stderr, "[mdock] container id buffer too small\n");
-            return -1;
-        }
-        return 0;
-    }
-
-    int max_num = 0;
-    char line[4096];
-
-    while (fgets(line, sizeof(line), f)) {
-        /* Parse id field (format: cN) */
-        char *p = strchr(line, '|');
-        if (!p) continue;
-        *p = '\0';
-
-        if (line[0] == 'c') {
-            int num = atoi(&line[1]);
-            if (num > max_num) {
-                max_num = num;
-            }
-        }
-    }
-
-    fclose(f);
-
-    if (snprintf(out_id, out_size, "c%d", max_num + 1) >= (int)out_size) {
+    if (snprintf(out_id, out_size, "c%d", next_container_number(db_path)) >= (int)out_size) {
         fprintf(stderr, "[mdock] container id buffer too small\n");
         return -1;
     }
@@ -394,7 +401,7 @@ int generate_container_id(const char *base_dir,
 
 /* ----- Issue #13: Resource limit parsing ----- */
 
-static long parse_memory_limit(const char *str)
+long parse_memory_limit(const char *str)
 {
     char *endptr;
     long value = strtol(str, &endptr, 10);
@@ -418,7 +425,7 @@ static long parse_memory_limit(const char *str)
     return -1;
 }
 
-static long parse_cpu_limit(const char *str)
+long parse_cpu_limit(const char *str)
 {
     char *endptr;
     long value = strtol(str, &endptr, 10);
@@ -431,310 +438,2017 @@ static long parse_cpu_limit(const char *str)
     return value;
 }
 
-/* ----- Issue #8 & #9: mdock run command ----- */
+/*
+ * Exit code for a wait status, and why the container ended if it was a
+ * signal. cgroup_reason is what the container's cgroup says about it.
+ */
+static int describe_exit(int status, const char *cgroup_reason, const char **reason)
+{
+    *reason = NULL;
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (!WIFSIGNALED(status)) {
+        return 0;
+    }
 
-int cmd_run(int argc, char **argv)
+    /* Detect resource limit signals */
+    int sig = WTERMSIG(status);
+    if (sig == SIGKILL && cgroup_reason) {
+        *reason = cgroup_reason;
+    } else if (sig == SIGXCPU) {
+        *reason = "CPU time limit exceeded";
+    } else if (sig == SIGKILL) {
+        *reason = "killed by SIGKILL";
+    } else {
+        *reason = "terminated by signal";
+    }
+    return 128 + sig;
+}
+
+static void log_container_exit(const char *container_id, pid_t pid, int exit_code,
+                               const char *exit_reason, int64_t duration_ns)
 {
-    const char *image_name = NULL;
-    long mem_limit = -1;
-    long cpu_limit = -1;
-    char *env_vars[128];  /* Store -e KEY=VALUE pairs */
-    int env_count = 0;
-    
-    /* Parse arguments */
-    int i;
-    for (i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--mem") == 0) {
-            if (i + 1 >= argc) {
-                fprintf(stderr, "[mdock] error: --mem requires a value\n");
-                fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name>\n");
-                return 1;
-            }
-            mem_limit = parse_memory_limit(argv[++i]);
-            if (mem_limit < 0) {
-                fprintf(stderr, "[mdock] error: invalid memory limit '%s'\n", argv[i]);
-                fprintf(stderr, "[mdock] hint: use format like 128M, 1G, or 512M\n");
-                return 1;
-            }
-        } else if (strcmp(argv[i], "--cpu") == 0) {
-            if (i + 1 >= argc) {
-                fprintf(stderr, "[mdock] error: --cpu requires a value\n");
-                fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name>\n");
-                return 1;
-            }
-            cpu_limit = parse_cpu_limit(argv[++i]);
-            if (cpu_limit < 0) {
-                fprintf(stderr, "[mdock] error: invalid CPU limit '%s'\n", argv[i]);
-                fprintf(stderr, "[mdock] hint: specify seconds (e.g., 10 for 10 seconds)\n");
-                return 1;
-            }
-        } else if (strcmp(argv[i], "-e") == 0) {
-            if (i + 1 >= argc) {
-                fprintf(stderr, "[mdock] error: -e requires KEY=VALUE\n");
-                return 1;
-            }
-            if (env_count >= 127) {
-                fprintf(stderr, "[mdock] error: too many environment variables (max 127)\n");
-                return 1;
-            }
-            env_vars[env_count++] = argv[++i];
-        } else if (argv[i][0] == '-') {
-            fprintf(stderr, "[mdock] error: unknown option '%s'\n", argv[i]);
-            fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name>\n");
-            return 1;
+    if (exit_reason) {
+        mdock_logf("EXIT container_id=%s pid=%d exit_code=%d duration=%.3fs reason=%s",
+                   container_id, pid, exit_code, duration_ns / 1e9, exit_reason);
+    } else {
+        mdock_logf("EXIT container_id=%s pid=%d exit_code=%d duration=%.3fs",
+                   container_id, pid, exit_code, duration_ns / 1e9);
+    }
+}
+
+/* Exit code and reason; a limit enforced by signals is the reason whatever the program made of them */
+static int describe_container_exit(const char *base_dir, const struct container_exit *e,
+                                   const char **reason)
+{
+    int exit_code = describe_exit(e->status, cgroup_release(base_dir, e->container_id), reason);
+    if (e->limit_reason) {
+        *reason = e->limit_reason;
+    }
+    return exit_code;
+}
+
+void record_container_exit(const char *base_dir, const struct container_exit *e)
+{
+    const char *exit_reason;
+    int exit_code = describe_container_exit(base_dir, e, &exit_reason);
+
+    struct container_update u = {
+        .container_id = e->container_id,
+        .new_status = "exited",
+        .end_ns = mdock_realtime_ns(),
+        .duration_ns = e->duration_ns,
+        .exit_code = exit_code,
+        .set_exit = 1,
+        .keep_stopped = 1,
+        .reason = exit_reason ? exit_reason : "",
+        .cpu_used_milli = e->cpu_milli,
+        .usage = e->usage,
+    };
+    if (rewrite_container(base_dir, &u) != 0) {
+        fprintf(stderr, "[mdock] failed to update container exit status\n");
+    }
+
+    log_container_exit(e->container_id, e->pid, exit_code, exit_reason, e->duration_ns);
+}
+
+struct exit_batch {
+    const struct container_exit *exits;
+    const int *codes;
+    const char **reasons;
+    int count;
+    int64_t end_ns;
+};
+
+static int apply_exit_batch(const struct db_row *row, FILE *out, void *arg)
+{
+    const struct exit_batch *b = arg;
+
+    for (int i = 0; i < b->count; i++) {
+        const struct container_exit *e = &b->exits[i];
+        if (!db_field_eq(&row->fields[CF_ID], e->container_id)) {
+            continue;
+        }
+        struct container_update u = {
+            .container_id = e->container_id,
+            .new_status = "exited",
+            .end_ns = b->end_ns,
+            .duration_ns = e->duration_ns,
+            .exit_code = b->codes[i],
+            .set_exit = 1,
+            .keep_stopped = 1,
+            .reason = b->reasons[i] ? b->reasons[i] : "",
+            .cpu_used_milli = e->cpu_milli,
+            .usage = e->usage,
+        };
+        return apply_container_update(row, out, &u);
+    }
+    return 0;
+}
+
+int record_container_exits_locked(const char *base_dir,
+                                  const struct container_exit *exits,
+                                  int count)
+{
+    char db_path[PATH_MAX];
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
+        return -1;
+    }
+
+    int *codes = calloc((size_t)count, sizeof(*codes));
+    const char **reasons = calloc((size_t)count, sizeof(*reasons));
+    if (!codes || !reasons) {
+        free(codes);
+        free(reasons);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        codes[i] = describe_container_exit(base_dir, &exits[i], &reasons[i]);
+    }
+
+    struct exit_batch b = { exits, codes, reasons, count, mdock_realtime_ns() };
+    int changed = db_rewrite_locked(db_path, apply_exit_batch, &b);
+
+    for (int i = 0; i < count; i++) {
+        log_container_exit(exits[i].container_id, exits[i].pid, codes[i], reasons[i],
+                           exits[i].duration_ns);
+    }
+    free(codes);
+    free(reasons);
+    return changed < 0 ? -1 : 0;
+}
+
+#define MDOCK_MAX_REPLICAS 1024
+
+struct run_replica {
+    char id[MDOCK_ID_MAX];
+    char log_path[PATH_MAX];
+    pid_t pid;
+    int64_t mono_start;
+    int failed;             /* run -d: the program could not be exec'd */
+    int pooled;             /* started by the image's zygote, which records the exit */
+    int monitored;          /* foreground run under a monitor, which records the exit */
+    pid_t monitor;          /* that monitor, a child of ours */
+    int watched;            /* foreground run whose limits this process enforces itself */
+    char cpuset[MDOCK_CPUSET_MAX];
+    int numa_node;
+};
+
+/* Memory admission of one run; budget 0 admits everything */
+struct run_admission {
+    int64_t mem_commit;     /* per container */
+    int64_t budget;
+    int64_t committed;      /* set when the run is refused */
+};
+
+#define RUN_OVER_BUDGET  (-2)
+
+static void record_priority(struct container_record *rec, const struct launch_priority *prio,
+                            const struct launch_memory *mem)
+{
+    if (mem) {
+        if (mem->thp != LAUNCH_THP_INHERIT) {
+            snprintf(rec->thp, sizeof(rec->thp), "%s", launch_thp_name(mem->thp));
+        }
+        rec->ksm = mem->ksm;
+        rec->mlock_all = mem->mlock_all;
+    }
+    if (!prio) {
+        return;
+    }
+    rec->nice = prio->nice != LAUNCH_UNSET ? prio->nice : MDOCK_UNSET;
+    rec->oom_score_adj = prio->oom_score_adj != LAUNCH_UNSET ? prio->oom_score_adj : MDOCK_UNSET;
+    if (prio->policy >= 0) {
+        snprintf(rec->sched, sizeof(rec->sched), "%s", launch_sched_name(prio->policy));
+    }
+    if (prio->ioprio >= 0) {
+        launch_format_ioprio(prio->ioprio, rec->ioprio, sizeof(rec->ioprio));
+    }
+}
+
+/* Child setup phases of one launch; a phase the child never reached has no end */
+static void trace_launch_phases(const struct launch_trace *t, const char *id)
+{
+    int64_t start = t->start_ns;
+    for (int p = 0; p < LAUNCH_PHASE_COUNT; p++) {
+        if (t->end_ns[p] == 0) {
+            continue;
+        }
+        trace_span(launch_phase_names[p], id, start, t->end_ns[p]);
+        start = t->end_ns[p];
+    }
+}
+
+/*
+ * Start count containers from one spec. IDs are allocated, the containers
+ * started and all their records appended in one write while the
+ * containers.db lock is held, so concurrent runs never hand out the same
+ * ID. Containers go to the image's warm pool while it can serve them.
+ * Returns how many containers have a record, -1, or RUN_OVER_BUDGET when
+ * the containers would not fit the memory budget and none was started.
+ */
+static int launch_replicas(const char *base_dir, const char *image_name,
+                           const struct shard_set *shards, struct launch_spec *spec,
+                           const struct cgroup_limits *cg, const struct placement_request *place,
+                           const struct watchdog_limits *wd, struct run_admission *adm,
+                           struct pool_conn *pool, int detach, struct run_replica *reps, int count)
+{
+    char db_path[PATH_MAX];
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
+        return -1;
+    }
+
+    struct container_record *recs = calloc((size_t)count, sizeof(*recs));
+    if (!recs) {
+        perror("[mdock] calloc");
+        return -1;
+    }
+
+    TRACE_BEGIN(t_lock);
+    int lock = db_lock(db_path);
+    if (lock < 0) {
+        free(recs);
+        return -1;
+    }
+    TRACE_END(t_lock, "db_lock", NULL);
+
+    /* Admission sees every running container's commit while we hold the lock */
+    if (adm->budget > 0 && adm->mem_commit > 0) {
+        struct mem_commit held;
+        if (budget_committed(db_path, &held) != 0) {
+            db_unlock(lock);
+            free(recs);
+            return -1;
+        }
+        if (held.committed + count * adm->mem_commit > adm->budget) {
+            adm->committed = held.committed;
+            db_unlock(lock);
+            free(recs);
+            return RUN_OVER_BUDGET;
+        }
+    }
+
+    /* CPU placement sees the pinning of every running container while we hold the lock */
+    struct placement_map *cpu_map = NULL;
+    if (placement_any(place)) {
+        cpu_map = malloc(sizeof(*cpu_map));
+        if (!cpu_map || placement_load(db_path, cpu_map) != 0) {
+            fprintf(stderr, "[mdock] failed to load CPU placement\n");
+            free(cpu_map);
+            db_unlock(lock);
+            free(recs);
+            return -1;
+        }
+    }
+
+    TRACE_BEGIN(t_id);
+    int next = next_container_number(db_path);
+    TRACE_END(t_id, "generate_container_id", NULL);
+    int started = 0;
+    for (int k = 0; k < count; k++) {
+        struct run_replica *r = &reps[k];
+        if (snprintf(r->id, sizeof(r->id), "c%d", next + k) >= (int)sizeof(r->id)) {
+            break;
+        }
+
+        const char *shard = shard_place(shards, r->id);
+        if (!shard) {
+            break;
+        }
+        char logs_dir[PATH_MAX];
+        if (snprintf(logs_dir, sizeof(logs_dir), "%s/logs", shard) >= (int)sizeof(logs_dir) ||
+            snprintf(r->log_path, sizeof(r->log_path), "%s/%s.log", logs_dir, r->id) >= (int)sizeof(r->log_path)) {
+            fprintf(stderr, "[mdock] log path too long\n");
+            break;
+        }
+        if (ensure_dir_exists(logs_dir, 0755) != 0) {
+            break;
+        }
+
+        /* Each container gets its own cgroup leaf, joined by the child before exec */
+        char cgroup_procs[PATH_MAX];
+        spec->cgroup_procs = NULL;
+        if (cgroup_limits_any(cg)) {
+            TRACE_BEGIN(t_cg);
+            if (cgroup_create(base_dir, r->id, cg, cgroup_procs, sizeof(cgroup_procs)) != 0) {
+                break;
+            }
+            spec->cgroup_procs = cgroup_procs;
+            TRACE_END(t_cg, "cgroup_create", r->id);
+        }
+
+        cpu_set_t cpus;
+        unsigned long mem_nodes[PLACEMENT_NODEMASK_LONGS];
+        int bind_memory = 0;
+        r->numa_node = -1;
+        spec->cpuset = NULL;
+        spec->mem_nodes = NULL;
+        if (cpu_map) {
+            TRACE_BEGIN(t_place);
+            if (placement_choose(cpu_map, place, &cpus, mem_nodes, &bind_memory) != 0 ||
+                cpulist_format(&cpus, r->cpuset, sizeof(r->cpuset)) != 0) {
+                cgroup_release(base_dir, r->id);
+                break;
+            }
+            spec->cpuset = &cpus;
+            if (bind_memory) {
+                spec->mem_nodes = mem_nodes;
+                spec->mem_maxnode = PLACEMENT_MAX_NODES;
+                r->numa_node = place->numa_node;
+            }
+            TRACE_END(t_place, "placement", r->id);
+        }
+
+        /* The run time is measured on the monotonic clock */
+        spec->log_path = r->log_path;
+        spec->own_pgrp = wd->cpu_milli > 0;
+        r->mono_start = mdock_monotonic_ns();
+        r->pid = -1;
+        TRACE_BEGIN(t_launch);
+        if (pool->fd >= 0) {
+            int exec_errno;
+            int rc = pool_launch(pool, r->id, spec, &r->pid, &exec_errno);
+            if (rc == 0) {
+                r->pooled = 1;
+                if (detach && exec_errno != 0) {
+                    fprintf(stderr, "[mdock] error: container %s failed to start: %s\n",
+                            r->id, strerror(exec_errno));
+                    r->failed = 1;
+                }
+            } else {
+                /* This pool cannot serve the spec: start the rest locally */
+                pool_disconnect(pool);
+                r->pid = -1;
+            }
+        }
+        /* One process can enforce the limits of one container: more replicas need monitors */
+        int monitored = detach || (watchdog_active(wd) && count > 1);
+        if (r->pooled) {
+            /* started by the zygote */
+        } else if (monitored) {
+            /* The monitor records the exit; a failed exec still leaves a pid to record */
+            r->failed = monitor_start(base_dir, r->id, spec, wd, detach, &r->pid, &r->monitor) != 0;
+            r->monitored = !detach;
+        } else {
+            /* Only a child started here can report its setup phases */
+            struct launch_trace child_trace;
+            spec->trace = trace_enabled ? &child_trace : NULL;
+            int exec_errno;
+            r->pid = launch_container(spec, &exec_errno);
+            r->watched = watchdog_active(wd);
+            if (spec->trace) {
+                trace_launch_phases(&child_trace, r->id);
+                spec->trace = NULL;
+            }
+        }
+        TRACE_END(t_launch, r->pooled ? "pool_launch" : monitored ? "monitor_start" : "launch", r->id);
+        if (r->pid <= 0) {
+            cgroup_release(base_dir, r->id);
+            break;
+        }
+
+        init_running_record(&recs[started], r->id, r->pid, image_name, shard_label(base_dir, shard));
+        snprintf(recs[started].cpuset, sizeof(recs[started].cpuset), "%s", r->cpuset);
+        recs[started].numa_node = r->numa_node;
+        recs[started].cpu_rate_milli = wd->cpu_milli;
+        recs[started].mem_commit = adm->mem_commit;
+        record_priority(&recs[started], spec->prio, spec->memory);
+        started++;
+    }
+
+    TRACE_BEGIN(t_write);
+    if (started > 0 && append_container_records(db_path, recs, started) != 0) {
+        fprintf(stderr, "[mdock] failed to add container records\n");
+        /* Continue anyway, we'll try to wait for the children */
+    }
+    TRACE_END(t_write, "db_write", NULL);
+    db_unlock(lock);
+    free(cpu_map);
+    free(recs);
+    return started;
+}
+
+/* ----- Issue #8 & #9: mdock run command ----- */
+
+/* Every option of run; the parser below handles each, submit and the client only skip them */
+const struct run_option run_options[] = {
+    { "--mem", 1 },
+    { "--cpu", 1 },
+    { "--mem-rss", 1 },
+    { "--mem-rss-interval", 1 },
+    { "--cpu-rate", 1 },
+    { "--cpu-period", 1 },
+    { "--cpu-burst", 1 },
+    { "--history", 0 },
+    { "--history-size", 1 },
+    { "--history-interval", 1 },
+    { "--memory", 1 },
+    { "--cpus", 1 },
+    { "--pids-limit", 1 },
+    { "--io-weight", 1 },
+    { "--io-max", 1 },
+    { "--cpuset", 1 },
+    { "--numa-node", 1 },
+    { "--placement", 1 },
+    { "--cpu-count", 1 },
+    { "--nice", 1 },
+    { "--oom-score-adj", 1 },
+    { "--sched", 1 },
+    { "--ioprio", 1 },
+    { "--thp", 1 },
+    { "--ksm", 0 },
+    { "--mlock-all", 0 },
+    { "-e", 1 },
+    { "-d", 0 },
+    { "--detach", 0 },
+    { "--cidfile", 1 },
+    { "--wait", 0 },
+    { "--trace", 0 },
+    { "--trace=", 0 },
+    { "--replicas", 1 },
+    { NULL, 0 }
+};
+
+const struct run_option *run_option_find(const char *arg)
+{
+    for (const struct run_option *o = run_options; o->name; o++) {
+        size_t len = strlen(o->name);
+        if (o->name[len - 1] == '=' ? strncmp(arg, o->name, len) == 0 : strcmp(arg, o->name) == 0) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+/* --cidfile: the IDs of the started containers, one per line */
+static int write_cidfile(const char *path, const struct run_replica *reps, int count)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "[mdock] cidfile %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    for (int k = 0; k < count; k++) {
+        fprintf(f, "%s\n", reps[k].id);
+    }
+    if (fclose(f) != 0) {
+        fprintf(stderr, "[mdock] cidfile %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* ksmd only scans while /sys/kernel/mm/ksm/run is 1 */
+static int ksm_running(void)
+{
+    char buf[4] = "";
+    int fd = open("/sys/kernel/mm/ksm/run", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    return n > 0 && buf[0] == '1';
+}
+
+static int run_command(int argc, char **argv)
+{
+    const char *image_name = NULL;
+    long mem_limit = -1;
+    long cpu_limit = -1;
+    char *env_vars[128];  /* Store -e KEY=VALUE pairs */
+    int env_count = 0;
+    int detach = 0;
+    int replicas = 1;
+    struct cgroup_limits cg;
+    memset(&cg, 0, sizeof(cg));
+    struct placement_request place;
+    placement_request_init(&place);
+    struct watchdog_limits wd = {
+        .interval_ms = WATCHDOG_INTERVAL_MS,
+        .history_interval_ms = HISTORY_INTERVAL_MS,
+    };
+    struct launch_priority prio;
+    launch_priority_init(&prio);
+    struct launch_memory mem = { LAUNCH_THP_INHERIT, 0, 0 };
+    const char *trace_dest = getenv("MDOCK_TRACE");
+    const char *cidfile = NULL;
+    int wait_budget = 0;
+    
+    /* Parse arguments; run_options[] says which options take a value */
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            /* This is the image name */
+            image_name = argv[i];
+            i++;  /* Move past image name to capture program args */
+            break;
+        }
+        const struct run_option *opt = run_option_find(argv[i]);
+        if (!opt) {
+            fprintf(stderr, "[mdock] error: unknown option '%s'\n", argv[i]);
+            fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name>\n");
+            return 1;
+        }
+        const char *arg = argv[i];
+        char *val = NULL;
+        if (opt->takes_value) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[mdock] error: %s requires a value\n", arg);
+                fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name>\n");
+                return 1;
+            }
+            val = argv[++i];
+        }
+        if (strcmp(arg, "--mem") == 0) {
+            mem_limit = parse_memory_limit(val);
+            if (mem_limit < 0) {
+                fprintf(stderr, "[mdock] error: invalid memory limit '%s'\n", val);
+                fprintf(stderr, "[mdock] hint: use format like 128M, 1G, or 512M\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--cpu") == 0) {
+            cpu_limit = parse_cpu_limit(val);
+            if (cpu_limit < 0) {
+                fprintf(stderr, "[mdock] error: invalid CPU limit '%s'\n", val);
+                fprintf(stderr, "[mdock] hint: specify seconds (e.g., 10 for 10 seconds)\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--mem-rss") == 0) {
+            wd.rss_max = parse_memory_limit(val);
+            if (wd.rss_max <= 0) {
+                fprintf(stderr, "[mdock] error: invalid memory limit '%s'\n", val);
+                fprintf(stderr, "[mdock] hint: use format like 128M, 1G, or 512M\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--mem-rss-interval") == 0) {
+            char *end;
+            long ms = strtol(val, &end, 10);
+            if (*end != '\0' || ms < 10 || ms > 60000) {
+                fprintf(stderr, "[mdock] error: invalid interval '%s' (10-60000 ms)\n", val);
+                return 1;
+            }
+            wd.interval_ms = (int)ms;
+        } else if (strcmp(arg, "--cpu-rate") == 0) {
+            wd.cpu_milli = watchdog_parse_rate(val);
+            if (wd.cpu_milli < 0) {
+                fprintf(stderr, "[mdock] error: invalid CPU rate '%s' (CPUs, e.g. 0.5)\n", val);
+                return 1;
+            }
+        } else if (strcmp(arg, "--cpu-period") == 0 || strcmp(arg, "--cpu-burst") == 0) {
+            char *end;
+            long ms = strtol(val, &end, 10);
+            if (*end != '\0' || ms < 10 || ms > 10000) {
+                fprintf(stderr, "[mdock] error: invalid %s '%s' (10-10000 ms)\n", arg, val);
+                return 1;
+            }
+            if (strcmp(arg, "--cpu-period") == 0) {
+                wd.cpu_period_ms = (int)ms;
+            } else {
+                wd.cpu_burst_ms = (int)ms;
+            }
+        } else if (strcmp(arg, "--history") == 0) {
+            if (wd.history_size == 0) {
+                wd.history_size = HISTORY_DEFAULT_SIZE;
+            }
+        } else if (strcmp(arg, "--history-size") == 0) {
+            wd.history_size = parse_memory_limit(val);
+            if (wd.history_size < HISTORY_MIN_SIZE || wd.history_size > HISTORY_MAX_SIZE) {
+                fprintf(stderr, "[mdock] error: invalid history size '%s' (4K-64M)\n", val);
+                return 1;
+            }
+        } else if (strcmp(arg, "--history-interval") == 0) {
+            char *end;
+            long ms = strtol(val, &end, 10);
+            if (*end != '\0' || ms < 100 || ms > 60000) {
+                fprintf(stderr, "[mdock] error: invalid interval '%s' (100-60000 ms)\n", val);
+                return 1;
+            }
+            wd.history_interval_ms = (int)ms;
+        } else if (strcmp(arg, "--memory") == 0) {
+            cg.memory_max = parse_memory_limit(val);
+            if (cg.memory_max <= 0) {
+                fprintf(stderr, "[mdock] error: invalid memory limit '%s'\n", val);
+                fprintf(stderr, "[mdock] hint: use format like 128M, 1G, or 512M\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--cpus") == 0) {
+            cg.cpu_quota_us = cgroup_parse_cpus(val);
+            if (cg.cpu_quota_us < 0) {
+                fprintf(stderr, "[mdock] error: invalid CPU count '%s'\n", val);
+                fprintf(stderr, "[mdock] hint: specify CPUs, fractions allowed (e.g., 0.5 or 1.5)\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--pids-limit") == 0) {
+            char *end;
+            cg.pids_max = strtol(val, &end, 10);
+            if (*end != '\0' || cg.pids_max < 1) {
+                fprintf(stderr, "[mdock] error: invalid pids limit '%s'\n", val);
+                return 1;
+            }
+        } else if (strcmp(arg, "--io-weight") == 0) {
+            char *end;
+            long w = strtol(val, &end, 10);
+            if (*end != '\0' || w < 1 || w > 10000) {
+                fprintf(stderr, "[mdock] error: invalid I/O weight '%s' (1-10000)\n", val);
+                return 1;
+            }
+            cg.io_weight = (int)w;
+        } else if (strcmp(arg, "--io-max") == 0) {
+            if (cg.io_max_count >= CGROUP_IO_MAX_RULES) {
+                fprintf(stderr, "[mdock] error: too many --io-max rules (max %d)\n", CGROUP_IO_MAX_RULES);
+                return 1;
+            }
+            cg.io_max[cg.io_max_count++] = val;
+        } else if (strcmp(arg, "--cpuset") == 0) {
+            if (cpulist_parse(val, &place.cpus) != 0) {
+                fprintf(stderr, "[mdock] error: invalid CPU list '%s' (e.g. 0-7 or 0,2,4)\n", val);
+                return 1;
+            }
+            place.have_cpus = 1;
+        } else if (strcmp(arg, "--numa-node") == 0) {
+            char *end;
+            long node = strtol(val, &end, 10);
+            cpu_set_t node_cpus;
+            if (*end != '\0' || node < 0 || node >= PLACEMENT_MAX_NODES ||
+                numa_node_cpus((int)node, &node_cpus) != 0) {
+                fprintf(stderr, "[mdock] error: NUMA node '%s' does not exist\n", val);
+                return 1;
+            }
+            place.numa_node = (int)node;
+        } else if (strcmp(arg, "--placement") == 0) {
+            if (placement_parse_policy(val, &place.policy) != 0) {
+                fprintf(stderr, "[mdock] error: --placement requires pack or spread\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--cpu-count") == 0) {
+            char *end;
+            long n = strtol(val, &end, 10);
+            if (*end != '\0' || n < 1 || n > CPU_SETSIZE) {
+                fprintf(stderr, "[mdock] error: invalid CPU count '%s'\n", val);
+                return 1;
+            }
+            place.count = (int)n;
+        } else if (strcmp(arg, "--nice") == 0 || strcmp(arg, "--oom-score-adj") == 0) {
+            int is_nice = strcmp(arg, "--nice") == 0;
+            char *end;
+            long v = strtol(val, &end, 10);
+            long lo = is_nice ? -20 : -1000;
+            long hi = is_nice ? 19 : 1000;
+            if (*end != '\0' || end == val || v < lo || v > hi) {
+                fprintf(stderr, "[mdock] error: invalid %s '%s' (%ld to %ld)\n", arg, val, lo, hi);
+                return 1;
+            }
+            if (is_nice) {
+                prio.nice = (int)v;
+            } else {
+                prio.oom_score_adj = (int)v;
+            }
+        } else if (strcmp(arg, "--sched") == 0) {
+            if ((prio.policy = launch_parse_sched(val)) < 0) {
+                fprintf(stderr, "[mdock] error: --sched requires other, batch or idle\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--ioprio") == 0) {
+            prio.ioprio = launch_parse_ioprio(val);
+            if (prio.ioprio < 0) {
+                fprintf(stderr, "[mdock] error: invalid I/O priority '%s' (rt:N, be:N or idle; N 0-7)\n",
+                        val);
+                return 1;
+            }
+        } else if (strcmp(arg, "--thp") == 0) {
+            int thp = launch_parse_thp(val);
+            if (thp < 0) {
+                fprintf(stderr, "[mdock] error: --thp requires never, madvise or always\n");
+                return 1;
+            }
+            mem.thp = (enum launch_thp)thp;
+        } else if (strcmp(arg, "--ksm") == 0) {
+            mem.ksm = 1;
+        } else if (strcmp(arg, "--mlock-all") == 0) {
+            mem.mlock_all = 1;
+        } else if (strcmp(arg, "-e") == 0) {
+            if (env_count >= 127) {
+                fprintf(stderr, "[mdock] error: too many environment variables (max 127)\n");
+                return 1;
+            }
+            env_vars[env_count++] = val;
+        } else if (strcmp(arg, "-d") == 0 || strcmp(arg, "--detach") == 0) {
+            detach = 1;
+        } else if (strcmp(arg, "--cidfile") == 0) {
+            cidfile = val;
+        } else if (strcmp(arg, "--wait") == 0) {
+            wait_budget = 1;
+        } else if (strcmp(arg, "--trace") == 0) {
+            trace_dest = "1";
+        } else if (strncmp(arg, "--trace=", 8) == 0) {
+            trace_dest = arg + 8;
+        } else if (strcmp(arg, "--replicas") == 0) {
+            char *end;
+            long n = strtol(val, &end, 10);
+            if (*end != '\0' || n < 1 || n > MDOCK_MAX_REPLICAS) {
+                fprintf(stderr, "[mdock] error: invalid replica count '%s' (1-%d)\n",
+                        val, MDOCK_MAX_REPLICAS);
+                return 1;
+            }
+            replicas = (int)n;
+        }
+    }
+    
+    /* Capture program and its arguments (everything after image name) */
+    int prog_argc = argc - i;
+    char **prog_argv = (prog_argc > 0) ? &argv[i] : NULL;
+    
+    if (!image_name) {
+        fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name> [program] [args...]\n");
+        fprintf(stderr, "\nOptions:\n");
+        fprintf(stderr, "  --mem <size>      Memory limit (e.g., 128M, 1G)\n");
+        fprintf(stderr, "  --cpu <seconds>   CPU time limit in seconds\n");
+        fprintf(stderr, "  --mem-rss <size>  Resident memory limit of the process tree (watchdog)\n");
+        fprintf(stderr, "  --mem-rss-interval <ms>  Watchdog sampling interval (default %d)\n",
+                WATCHDOG_INTERVAL_MS);
+        fprintf(stderr, "  --cpu-rate <n>    Hold to n CPUs by stopping and resuming (e.g. 0.5)\n");
+        fprintf(stderr, "  --cpu-period <ms> --cpu-rate sampling period (default %d)\n",
+                WATCHDOG_CPU_PERIOD_MS);
+        fprintf(stderr, "  --cpu-burst <ms>  CPU time --cpu-rate lets a container save up\n");
+        fprintf(stderr, "  --history         Record a metrics history (mdock stats --history)\n");
+        fprintf(stderr, "  --history-size <size>  Disk space of the history (default 64K)\n");
+        fprintf(stderr, "  --history-interval <ms>  History sampling interval (default %d)\n",
+                HISTORY_INTERVAL_MS);
+        fprintf(stderr, "  --memory <size>   cgroup memory.max (resident memory)\n");
+        fprintf(stderr, "  --cpus <n>        cgroup cpu.max, e.g. 1.5 CPUs\n");
+        fprintf(stderr, "  --pids-limit <n>  cgroup pids.max\n");
+        fprintf(stderr, "  --io-weight <n>   cgroup io.weight (1-10000)\n");
+        fprintf(stderr, "  --io-max <rule>   cgroup io.max line, e.g. '8:0 wbps=1048576'\n");
+        fprintf(stderr, "  --cpuset <list>   Pin to CPUs, e.g. 0-7 or 0,2,4\n");
+        fprintf(stderr, "  --numa-node <n>   Run on and allocate from NUMA node n\n");
+        fprintf(stderr, "  --placement <p>   Choose CPUs automatically: pack or spread\n");
+        fprintf(stderr, "  --cpu-count <n>   CPUs per container for --placement (default 1)\n");
+        fprintf(stderr, "  --nice <n>        Nice value, -20 (favoured) to 19\n");
+        fprintf(stderr, "  --sched <policy>  Scheduling policy: other, batch or idle\n");
+        fprintf(stderr, "  --ioprio <prio>   I/O priority: rt:N, be:N (N 0-7, 0 highest) or idle\n");
+        fprintf(stderr, "  --oom-score-adj <n>  OOM killer preference, -1000 (never) to 1000\n");
+        fprintf(stderr, "  --thp <policy>    Transparent huge pages: never, madvise or always\n");
+        fprintf(stderr, "  --ksm             Let KSM merge identical anonymous pages across containers\n");
+        fprintf(stderr, "  --mlock-all       Lift RLIMIT_MEMLOCK and set MDOCK_MLOCK_ALL=1 for mlockall()\n");
+        fprintf(stderr, "  -e KEY=VALUE      Set environment variable\n");
+        fprintf(stderr, "  -d, --detach      Return once the container has started\n");
+        fprintf(stderr, "  --replicas N      Start N containers from the same command\n");
+        fprintf(stderr, "  --cidfile <file>  Write the IDs of the started containers to file\n");
+        fprintf(stderr, "  --wait            Queue until the memory budget has room instead of failing\n");
+        fprintf(stderr, "  --trace[=FILE]    Time each launch phase; FILE gets Chrome trace JSON\n");
+        fprintf(stderr, "\nExamples:\n");
+        fprintf(stderr, "  mdock run myimage\n");
+        fprintf(stderr, "  mdock run myimage hello\n");
+        fprintf(stderr, "  mdock run --mem 128M myimage stress mem 100\n");
+        fprintf(stderr, "  mdock run -e DEBUG=1 -e PORT=8080 myimage webserver\n");
+        fprintf(stderr, "  mdock run --mem 256M --cpu 10 -e APP_ENV=prod myimage\n");
+        fprintf(stderr, "  mdock run -d myimage counter\n");
+        fprintf(stderr, "  mdock run -d --replicas 50 myimage worker\n");
+        fprintf(stderr, "  mdock run --memory 256M --cpus 0.5 myimage worker\n");
+        fprintf(stderr, "  mdock run -d --replicas 8 --placement spread --cpu-count 2 myimage worker\n");
+        fprintf(stderr, "  mdock run -d --sched idle --ioprio idle myimage batch-job\n");
+        fprintf(stderr, "  mdock run --trace=/tmp/run.json myimage true\n");
+        return 1;
+    }
+    if (trace_dest && strcmp(trace_dest, "0") != 0 && trace_start(trace_dest) != 0) {
+        return 1;
+    }
+    TRACE_BEGIN(t_run);
+
+    /* Initialize ~/.mdock */
+    char base_dir[PATH_MAX];
+    TRACE_BEGIN(t_home);
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        fprintf(stderr, "[mdock] failed to initialize home directory\n");
+        return 1;
+    }
+    TRACE_END(t_home, "init_home", NULL);
+
+    /* Lookup image rootfs */
+    char rootfs_path[PATH_MAX];
+    TRACE_BEGIN(t_image);
+    if (find_image_rootfs(base_dir, image_name, rootfs_path, sizeof(rootfs_path)) != 0) {
+        fprintf(stderr, "[mdock] error: image '%s' not found\n", image_name);
+        fprintf(stderr, "[mdock] hint: use 'mdock build %s <rootfs_dir>' to create it\n", image_name);
+        return 1;
+    }
+    TRACE_END(t_image, "find_image_rootfs", NULL);
+
+    /* Verify rootfs directory still exists */
+    struct stat st;
+    if (stat(rootfs_path, &st) == -1) {
+        fprintf(stderr, "[mdock] error: rootfs directory '%s' no longer exists\n", rootfs_path);
+        fprintf(stderr, "[mdock] hint: the image may be corrupted, try rebuilding it\n");
+        return 1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "[mdock] error: rootfs path '%s' is not a directory\n", rootfs_path);
+        return 1;
+    }
+
+    /* Build the container's environment and argv up front; every replica shares them */
+    char *envp[256];
+    int env_idx = 0;
+
+    /* Add default environment variables */
+    envp[env_idx++] = "PATH=/bin:/usr/bin:/sbin:/usr/sbin";
+    envp[env_idx++] = "HOME=/root";
+    envp[env_idx++] = "TERM=xterm";
+    if (mem.mlock_all) {
+        /* mlockall() does not survive exec: the program has to lock itself */
+        envp[env_idx++] = "MDOCK_MLOCK_ALL=1";
+    }
+
+    /* Add user-specified environment variables */
+    for (int j = 0; j < env_count && env_idx < 255; j++) {
+        envp[env_idx++] = env_vars[j];
+    }
+    envp[env_idx] = NULL;
+
+    struct launch_spec spec = {
+        .rootfs = rootfs_path,
+        .envp = envp,
+        .mem_limit = mem_limit,
+        .cpu_limit = cpu_limit,
+        .prio = launch_priority_any(&prio) ? &prio : NULL,
+        .memory = launch_memory_any(&mem) ? &mem : NULL,
+    };
+    if (mem.ksm && !ksm_running()) {
+        fprintf(stderr, "[mdock] warning: KSM is not running, nothing will be merged "
+                        "(echo 1 > /sys/kernel/mm/ksm/run)\n");
+    }
+
+    /* Execute the specified program (relative to the rootfs) or /bin/sh */
+    char prog_path[PATH_MAX];
+    char *default_args[] = {"/bin/sh", NULL};
+    if (prog_argc > 0 && prog_argv) {
+        const char *fmt = (prog_argv[0][0] == '/') ? ".%s" : "./%s";
+        if (snprintf(prog_path, sizeof(prog_path), fmt, prog_argv[0]) >= (int)sizeof(prog_path)) {
+            fprintf(stderr, "[mdock] program path too long\n");
+            return 1;
+        }
+        spec.path = prog_path;
+        spec.fallback_path = prog_argv[0];  /* try without the ./ prefix */
+        spec.argv = prog_argv;
+    } else {
+        spec.path = "/bin/sh";
+        spec.argv = default_args;
+    }
+
+    /* Place each container's log on one of the configured data directories */
+    struct shard_set shards;
+    TRACE_BEGIN(t_shard);
+    if (shard_load(base_dir, &shards) != 0) {
+        return 1;
+    }
+    TRACE_END(t_shard, "shard_load", NULL);
+
+    struct run_replica *reps = calloc((size_t)replicas, sizeof(*reps));
+    if (!reps) {
+        perror("[mdock] calloc");
+        return 1;
+    }
+
+    /* A warm pool for the image skips the fork and setup on this side; its children have no limits */
+    struct pool_conn pool = { .fd = -1 };
+    if (!cgroup_limits_any(&cg) && !placement_any(&place) && !watchdog_active(&wd) && !spec.prio &&
+        !spec.memory) {
+        TRACE_BEGIN(t_pool);
+        pool_connect(base_dir, image_name, &pool);
+        TRACE_END(t_pool, "pool_connect", NULL);
+    }
+
+    /* The largest memory limit is what the container may take from the host */
+    struct run_admission adm = { 0, 0, 0 };
+    adm.mem_commit = mem_limit > 0 ? mem_limit : 0;
+    if (cg.memory_max > adm.mem_commit) {
+        adm.mem_commit = cg.memory_max;
+    }
+    if (wd.rss_max > adm.mem_commit) {
+        adm.mem_commit = wd.rss_max;
+    }
+    if (adm.mem_commit > 0) {
+        struct mem_budget budget;
+        if (budget_load(base_dir, &budget) != 0) {
+            pool_disconnect(&pool);
+            free(reps);
+            return 1;
+        }
+        adm.budget = budget.budget;
+    }
+
+    int started;
+    int waited = 0;
+    while ((started = launch_replicas(base_dir, image_name, &shards, &spec, &cg, &place, &wd, &adm,
+                                      &pool, detach, reps, replicas)) == RUN_OVER_BUDGET) {
+        char want[32], held[32], budget[32];
+        budget_format(replicas * adm.mem_commit, want, sizeof(want));
+        budget_format(adm.committed, held, sizeof(held));
+        budget_format(adm.budget, budget, sizeof(budget));
+        if (!wait_budget || replicas * adm.mem_commit > adm.budget) {
+            fprintf(stderr, "[mdock] error: %s more would exceed the memory budget (%s of %s committed)\n",
+                    want, held, budget);
+            fprintf(stderr, "[mdock] hint: %s\n", replicas * adm.mem_commit > adm.budget
+                    ? "the run is larger than the whole budget, see mdock info"
+                    : "use --wait to queue until running containers free their memory");
+            pool_disconnect(&pool);
+            free(reps);
+            return 1;
+        }
+        if (!waited) {
+            fprintf(stderr, "[mdock] Waiting for memory budget: %s wanted, %s of %s committed\n",
+                    want, held, budget);
+            mdock_logf("RUN_WAIT image=%s mem_commit=%lld committed=%lld budget=%lld", image_name,
+                       (long long)(replicas * adm.mem_commit), (long long)adm.committed,
+                       (long long)adm.budget);
+            waited = 1;
+        }
+        budget_wait_change(base_dir, BUDGET_RECHECK_MS);
+    }
+    if (started < 0) {
+        pool_disconnect(&pool);
+        free(reps);
+        return 1;
+    }
+    int rc = (started < replicas) ? 1 : 0;
+    TRACE_END(t_run, "run_to_started", NULL);
+    if (cidfile && started > 0 && write_cidfile(cidfile, reps, started) != 0) {
+        rc = 1;
+    }
+
+    for (int k = 0; k < started; k++) {
+        const char *container_id = reps[k].id;
+        pid_t pid = reps[k].pid;
+        if (reps[k].failed) {
+            rc = 1;
+            continue;
+        }
+
+        /* Log RUN event with resource limits if set */
+        if (mem_limit > 0 && cpu_limit > 0) {
+            mdock_logf("RUN container_id=%s pid=%d image=%s mem_limit=%ldM cpu_limit=%lds", 
+                       container_id, pid, image_name, mem_limit / (1024*1024), cpu_limit);
+        } else if (mem_limit > 0) {
+            mdock_logf("RUN container_id=%s pid=%d image=%s mem_limit=%ldM", 
+                       container_id, pid, image_name, mem_limit / (1024*1024));
+        } else if (cpu_limit > 0) {
+            mdock_logf("RUN container_id=%s pid=%d image=%s cpu_limit=%lds", 
+                       container_id, pid, image_name, cpu_limit);
+        } else {
+            mdock_logf("RUN container_id=%s pid=%d image=%s", container_id, pid, image_name);
+        }
+
+        if (cgroup_limits_any(&cg)) {
+            mdock_logf("CGROUP container_id=%s memory_max=%lld cpu_quota_us=%lld pids_max=%lld io_weight=%d io_max_rules=%d",
+                       container_id, (long long)cg.memory_max, (long long)cg.cpu_quota_us,
+                       (long long)cg.pids_max, cg.io_weight, cg.io_max_count);
+        }
+
+        printf("[mdock] Container %s started (PID %d)", container_id, pid);
+        if (mem_limit > 0) {
+            printf(" [mem: %ldM]", mem_limit / (1024*1024));
+        }
+        if (cpu_limit > 0) {
+            printf(" [cpu: %lds]", cpu_limit);
+        }
+        if (cg.memory_max > 0) {
+            printf(" [memory.max: %lldM]", (long long)cg.memory_max / (1024*1024));
+        }
+        if (cg.cpu_quota_us > 0) {
+            printf(" [cpus: %.2f]", (double)cg.cpu_quota_us / CGROUP_CPU_PERIOD_US);
+        }
+        if (cg.pids_max > 0) {
+            printf(" [pids: %lld]", (long long)cg.pids_max);
+        }
+        if (wd.rss_max > 0) {
+            printf(" [rss: %lldM]", (long long)wd.rss_max / (1024*1024));
+            mdock_logf("WATCHDOG container_id=%s rss_max=%lld interval_ms=%d",
+                       container_id, (long long)wd.rss_max, wd.interval_ms);
+        }
+        if (wd.cpu_milli > 0) {
+            printf(" [cpu-rate: %.2f]", wd.cpu_milli / 1000.0);
+        }
+        if (reps[k].cpuset[0]) {
+            printf(" [cpuset: %s]", reps[k].cpuset);
+            mdock_logf("PLACE container_id=%s cpuset=%s numa_node=%d",
+                       container_id, reps[k].cpuset, reps[k].numa_node);
+        }
+        printf("\n");
+    }
+
+    /* ===== Issue #9: Wait for container exit ===== */
+
+    if (detach) {
+        pool_disconnect(&pool);
+        free(reps);
+        return rc;
+    }
+
+    /* Pooled replicas are the zygote's children; it records them and tells us */
+    int remaining = 0;
+    for (int k = 0; k < started; k++) {
+        remaining += reps[k].pooled;
+    }
+    while (remaining > 0) {
+        pid_t pid;
+        int status;
+        if (pool_wait(&pool, &pid, &status) != 0) {
+            fprintf(stderr, "[mdock] lost the connection to the pool for image '%s'\n", image_name);
+            rc = 1;
+            break;
+        }
+        for (int k = 0; k < started; k++) {
+            if (reps[k].pooled && reps[k].pid == pid) {
+                reps[k].pid = 0;
+                remaining--;
+                break;
+            }
+        }
+    }
+    pool_disconnect(&pool);
+
+    /* A lone container under --mem-rss, --cpu-rate or --history is watched right here */
+    for (int k = 0; k < started; k++) {
+        if (!reps[k].watched) {
+            continue;
+        }
+        struct watchdog_result res;
+        if (monitor_watch(base_dir, reps[k].id, reps[k].pid, reps[k].mono_start, &wd, &res) != 0) {
+            perror("[mdock] wait4");
+            rc = 1;
+        } else if (wd.cpu_milli > 0 && res.cpu_milli > 0) {
+            printf("[mdock] Container %s ran at %.2f CPUs (--cpu-rate %.2f)\n", reps[k].id,
+                   res.cpu_milli / 1000.0, wd.cpu_milli / 1000.0);
+        }
+        reps[k].pid = 0;
+    }
+
+    /* Monitors of more replicas record their containers and exit */
+    for (int k = 0; k < started; k++) {
+        if (!reps[k].monitored) {
+            continue;
+        }
+        while (waitpid(reps[k].monitor, NULL, 0) == -1 && errno == EINTR) {
+        }
+        struct container_record rec;
+        if (!reps[k].failed && find_container_record(base_dir, reps[k].id, &rec) == 0 &&
+            rec.cpu_rate_milli > 0 && rec.cpu_used_milli > 0) {
+            printf("[mdock] Container %s ran at %.2f CPUs (--cpu-rate %.2f)\n", rec.id,
+                   rec.cpu_used_milli / 1000.0, rec.cpu_rate_milli / 1000.0);
+        }
+    }
+
+    /* Collect replicas in the order they finish so each duration is accurate */
+    remaining = 0;
+    for (int k = 0; k < started; k++) {
+        remaining += !reps[k].pooled && !reps[k].monitored && !reps[k].watched;
+    }
+    while (remaining > 0) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-1, &status, 0, &ru);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[mdock] wait4");
+            rc = 1;
+            break;
+        }
+        for (int k = 0; k < started; k++) {
+            if (!reps[k].pooled && !reps[k].monitored && !reps[k].watched && reps[k].pid == pid) {
+                struct container_exit e = {
+                    .container_id = reps[k].id,
+                    .pid = pid,
+                    .status = status,
+                    .duration_ns = mdock_monotonic_ns() - reps[k].mono_start,
+                    .usage = &ru,
+                };
+                TRACE_BEGIN(t_exit);
+                record_container_exit(base_dir, &e);
+                TRACE_END(t_exit, "record_exit", reps[k].id);
+                reps[k].pid = 0;
+                remaining--;
+                break;
+            }
+        }
+    }
+
+    free(reps);
+    return rc;
+}
+
+int cmd_run(int argc, char **argv)
+{
+    int rc = run_command(argc, argv);
+    trace_finish();
+    return rc;
+}
+
+/* ----- Issue #10: mdock ps command ----- */
+
+enum ps_field {
+    PS_ID,
+    PS_PID,
+    PS_IMAGE,
+    PS_STATUS,
+    PS_UPTIME,
+    PS_STARTED,
+    PS_ENDED,
+    PS_EXIT_CODE,
+    PS_STARTED_NS,
+    PS_ENDED_NS,
+    PS_DURATION_NS,
+    PS_REASON,
+    PS_CPUSET,
+    PS_NUMA_NODE,
+    PS_CPU_RATE,
+    PS_CPU_USED,
+    PS_USER_TIME_US,
+    PS_SYS_TIME_US,
+    PS_MAX_RSS_KB,
+    PS_MINOR_FAULTS,
+    PS_MAJOR_FAULTS,
+    PS_VOL_CTX,
+    PS_INVOL_CTX,
+    PS_BLOCK_IN,
+    PS_BLOCK_OUT,
+    PS_NICE,
+    PS_SCHED,
+    PS_IOPRIO,
+    PS_OOM_SCORE_ADJ,
+    PS_THP,
+    PS_KSM,
+    PS_MLOCK_ALL,
+    PS_MEM_COMMIT,
+    PS_FIELD_COUNT
+};
+
+/* Placeholder name for --format ({{.Name}}) and key for --json */
+static const struct {
+    const char *name;
+    const char *json_key;
+    int numeric;
+} ps_fields[PS_FIELD_COUNT] = {
+    [PS_ID]          = { "ID",         "id",          0 },
+    [PS_PID]         = { "PID",        "pid",         1 },
+    [PS_IMAGE]       = { "Image",      "image",       0 },
+    [PS_STATUS]      = { "Status",     "status",      0 },
+    [PS_UPTIME]      = { "Uptime",     "uptime",      0 },
+    [PS_STARTED]     = { "Started",    "started",     0 },
+    [PS_ENDED]       = { "Ended",      "ended",       0 },
+    [PS_EXIT_CODE]   = { "ExitCode",   "exit_code",   1 },
+    [PS_STARTED_NS]  = { "StartedNs",  "started_ns",  1 },
+    [PS_ENDED_NS]    = { "EndedNs",    "ended_ns",    1 },
+    [PS_DURATION_NS] = { "DurationNs", "duration_ns", 1 },
+    [PS_REASON]      = { "Reason",     "reason",      0 },
+    [PS_CPUSET]      = { "CPUSet",     "cpuset",      0 },
+    [PS_NUMA_NODE]   = { "NumaNode",   "numa_node",   1 },
+    [PS_CPU_RATE]    = { "CPURate",    "cpu_rate",    1 },
+    [PS_CPU_USED]    = { "CPUUsed",    "cpu_used",    1 },
+    [PS_USER_TIME_US] = { "UserTimeUs",      "user_time_us",       1 },
+    [PS_SYS_TIME_US]  = { "SysTimeUs",       "sys_time_us",        1 },
+    [PS_MAX_RSS_KB]   = { "MaxRSSKb",        "max_rss_kb",         1 },
+    [PS_MINOR_FAULTS] = { "MinorFaults",     "minor_faults",       1 },
+    [PS_MAJOR_FAULTS] = { "MajorFaults",     "major_faults",       1 },
+    [PS_VOL_CTX]      = { "VolCtxSwitches",  "vol_ctx_switches",   1 },
+    [PS_INVOL_CTX]    = { "InvolCtxSwitches", "invol_ctx_switches", 1 },
+    [PS_BLOCK_IN]     = { "BlockIn",         "block_in",           1 },
+    [PS_BLOCK_OUT]    = { "BlockOut",        "block_out",          1 },
+    [PS_NICE]          = { "Nice",        "nice",            1 },
+    [PS_SCHED]         = { "Sched",       "sched",           0 },
+    [PS_IOPRIO]        = { "IOPrio",      "ioprio",          0 },
+    [PS_OOM_SCORE_ADJ] = { "OOMScoreAdj", "oom_score_adj",   1 },
+    [PS_THP]           = { "THP",         "thp",             0 },
+    [PS_KSM]           = { "KSM",         "ksm",             1 },
+    [PS_MLOCK_ALL]     = { "MlockAll",    "mlock_all",       1 },
+    [PS_MEM_COMMIT]    = { "MemCommit",   "mem_commit",      1 },
+};
+
+#define PS_MAX_FILTERS  16
+#define PS_MAX_SEGMENTS 64
+
+struct ps_filter {
+    enum ps_field field;
+    const char *value;
+};
+
+/* A --format template is compiled into literal text and field segments */
+struct ps_segment {
+    const char *text;
+    size_t len;
+    int field;          /* -1 for literal text */
+};
+
+struct ps_options {
+    struct ps_filter filters[PS_MAX_FILTERS];
+    int nfilters;
+    int quiet;
+    int json;
+    long last;          /* 0 = every matching container */
+    char *format;       /* owns the storage the segments point into */
+    struct ps_segment segments[PS_MAX_SEGMENTS];
+    int nsegments;
+
+    /* Live PIDs, read from /proc once on first use */
+    struct pid_set live;
+    int live_loaded;
+    long printed;
+    int64_t now_ns;     /* one clock read for every uptime of this listing */
+};
+
+static void ps_usage(void)
+{
+    fprintf(stderr, "Usage: mdock ps [OPTIONS]\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -q, --quiet              Only print container IDs\n");
+    fprintf(stderr, "  -f, --filter KEY=VALUE   Filter on id, image or status (comma-separated)\n");
+    fprintf(stderr, "  -n, --last N             Show only the N most recent matching containers\n");
+    fprintf(stderr, "  --format TEMPLATE        Format rows, e.g. '{{.ID}}\\t{{.Status}}'\n");
+    fprintf(stderr, "  --json                   Print containers as a JSON array\n");
+    fprintf(stderr, "\nFormat fields:");
+    for (int i = 0; i < PS_FIELD_COUNT; i++) {
+        fprintf(stderr, " .%s", ps_fields[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+static int ps_add_filters(struct ps_options *opts, char *spec)
+{
+    for (char *tok = strtok(spec, ","); tok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (!eq || eq == tok || eq[1] == '\0') {
+            fprintf(stderr, "[mdock] error: invalid filter '%s' (expected KEY=VALUE)\n", tok);
+            return -1;
+        }
+        *eq = '\0';
+
+        enum ps_field field;
+        if (strcmp(tok, "id") == 0) {
+            field = PS_ID;
+        } else if (strcmp(tok, "image") == 0) {
+            field = PS_IMAGE;
+        } else if (strcmp(tok, "status") == 0) {
+            field = PS_STATUS;
+        } else {
+            fprintf(stderr, "[mdock] error: unknown filter key '%s' (use id, image or status)\n", tok);
+            return -1;
+        }
+
+        if (opts->nfilters >= PS_MAX_FILTERS) {
+            fprintf(stderr, "[mdock] error: too many filters (max %d)\n", PS_MAX_FILTERS);
+            return -1;
+        }
+        opts->filters[opts->nfilters].field = field;
+        opts->filters[opts->nfilters].value = eq + 1;
+        opts->nfilters++;
+    }
+    return 0;
+}
+
+static int ps_add_segment(struct ps_options *opts, const char *text, size_t len, int field)
+{
+    if (opts->nsegments >= PS_MAX_SEGMENTS) {
+        fprintf(stderr, "[mdock] error: format template too long\n");
+        return -1;
+    }
+    opts->segments[opts->nsegments].text = text;
+    opts->segments[opts->nsegments].len = len;
+    opts->segments[opts->nsegments].field = field;
+    opts->nsegments++;
+    return 0;
+}
+
+/* Compile "{{.ID}} {{.Status}}" into segments; \t and \n are unescaped */
+static int ps_compile_format(struct ps_options *opts, const char *template)
+{
+    opts->format = strdup(template);
+    if (!opts->format) {
+        perror("[mdock] strdup");
+        return -1;
+    }
+
+    /* Unescape in place */
+    char *w = opts->format;
+    for (const char *r = opts->format; *r; r++) {
+        if (r[0] == '\\' && (r[1] == 't' || r[1] == 'n')) {
+            *w++ = (r[1] == 't') ? '\t' : '\n';
+            r++;
+        } else {
+            *w++ = *r;
+        }
+    }
+    *w = '\0';
+
+    const char *p = opts->format;
+    while (*p) {
+        const char *open = strstr(p, "{{");
+        if (!open) {
+            return ps_add_segment(opts, p, strlen(p), -1);
+        }
+        if (open > p && ps_add_segment(opts, p, (size_t)(open - p), -1) != 0) {
+            return -1;
+        }
+
+        const char *close = strstr(open, "}}");
+        if (!close) {
+            fprintf(stderr, "[mdock] error: unterminated '{{' in format\n");
+            return -1;
+        }
+
+        const char *name = open + 2;
+        while (*name == ' ') name++;
+        if (*name == '.') name++;
+        const char *name_end = close;
+        while (name_end > name && name_end[-1] == ' ') name_end--;
+
+        int field = -1;
+        for (int i = 0; i < PS_FIELD_COUNT; i++) {
+            if (strlen(ps_fields[i].name) == (size_t)(name_end - name) &&
+                strncmp(ps_fields[i].name, name, (size_t)(name_end - name)) == 0) {
+                field = i;
+                break;
+            }
+        }
+        if (field < 0) {
+            fprintf(stderr, "[mdock] error: unknown format field '%.*s'\n",
+                    (int)(close - open - 2), open + 2);
+            return -1;
+        }
+        if (ps_add_segment(opts, NULL, 0, field) != 0) {
+            return -1;
+        }
+        p = close + 2;
+    }
+    return 0;
+}
+
+/* Recorded status, corrected for containers whose process has gone away */
+static const char *ps_actual_status(struct ps_options *opts, const struct container_record *rec)
+{
+    if (strcmp(rec->status, "running") != 0) {
+        return rec->status;
+    }
+
+    if (!opts->live_loaded) {
+        opts->live_loaded = 1;
+        if (pid_set_scan(&opts->live) != 0) {
+            opts->live_loaded = -1;
+        }
+    }
+
+    int alive = (opts->live_loaded > 0)
+                    ? pid_set_contains(&opts->live, rec->pid) &&
+                      (rec->pid_start == 0 || proc_starttime(rec->pid) == rec->pid_start)
+                    : container_is_alive(rec);
+    return alive ? "running" : "exited";
+}
+
+static int ps_matches(struct ps_options *opts, const struct container_record *rec)
+{
+    /* Filters on the same key are OR'd, different keys are AND'd */
+    static const enum ps_field keys[] = { PS_ID, PS_IMAGE, PS_STATUS };
+
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        int seen = 0;
+        int matched = 0;
+
+        for (int i = 0; i < opts->nfilters && !matched; i++) {
+            const struct ps_filter *flt = &opts->filters[i];
+            if (flt->field != keys[k]) {
+                continue;
+            }
+            seen = 1;
+
+            const char *value = (keys[k] == PS_ID) ? rec->id :
+                                (keys[k] == PS_IMAGE) ? rec->image :
+                                ps_actual_status(opts, rec);
+            matched = (strcmp(value, flt->value) == 0);
+        }
+
+        if (seen && !matched) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Cheap check on the raw row so most non-matching rows are never parsed */
+static int ps_row_may_match(const struct ps_options *opts, const struct db_row *row)
+{
+    if (row->nfields < CF_REQUIRED) {
+        return 0;
+    }
+
+    static const struct { enum ps_field key; int column; } cols[] = {
+        { PS_ID, CF_ID }, { PS_IMAGE, CF_IMAGE }, { PS_STATUS, CF_STATUS },
+    };
+
+    for (size_t k = 0; k < sizeof(cols) / sizeof(cols[0]); k++) {
+        const struct db_field *f = &row->fields[cols[k].column];
+        int seen = 0;
+        int possible = 0;
+
+        for (int i = 0; i < opts->nfilters && !possible; i++) {
+            if (opts->filters[i].field != cols[k].key) {
+                continue;
+            }
+            seen = 1;
+            /* A recorded "running" may turn out to be "exited" */
+            possible = db_field_eq(f, opts->filters[i].value) ||
+                       (cols[k].key == PS_STATUS && db_field_eq(f, "running"));
+        }
+
+        if (seen && !possible) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Measured run time if the runtime recorded one, else wall-clock since start */
+static int64_t ps_duration_ns(struct ps_options *opts, const struct container_record *rec)
+{
+    if (rec->duration_ns > 0) {
+        return rec->duration_ns;
+    }
+    if (rec->start_ns == 0) {
+        return 0;
+    }
+    if (rec->end_ns > 0) {
+        return rec->end_ns - rec->start_ns;
+    }
+    if (opts->now_ns == 0) {
+        opts->now_ns = mdock_realtime_ns();
+    }
+    return opts->now_ns - rec->start_ns;
+}
+
+static const char *ps_field_value(struct ps_options *opts, const struct container_record *rec,
+                                  int field, char *buf, size_t size)
+{
+    switch (field) {
+    case PS_ID:
+        return rec->id;
+    case PS_PID:
+        snprintf(buf, size, "%d", rec->pid);
+        return buf;
+    case PS_IMAGE:
+        return rec->image;
+    case PS_STATUS:
+        return ps_actual_status(opts, rec);
+    case PS_UPTIME:
+        mdock_format_duration(ps_duration_ns(opts, rec), buf, size);
+        return buf;
+    case PS_STARTED:
+        if (rec->start_ns == 0 || mdock_format_time(rec->start_ns, buf, size) != 0) {
+            return "";
+        }
+        return buf;
+    case PS_ENDED:
+        if (rec->end_ns == 0 || mdock_format_time(rec->end_ns, buf, size) != 0) {
+            return "";
+        }
+        return buf;
+    case PS_EXIT_CODE:
+        snprintf(buf, size, "%d", rec->exit_code);
+        return buf;
+    case PS_STARTED_NS:
+        snprintf(buf, size, "%lld", (long long)rec->start_ns);
+        return buf;
+    case PS_ENDED_NS:
+        snprintf(buf, size, "%lld", (long long)rec->end_ns);
+        return buf;
+    case PS_DURATION_NS:
+        snprintf(buf, size, "%lld", (long long)ps_duration_ns(opts, rec));
+        return buf;
+    case PS_REASON:
+        return rec->reason;
+    case PS_CPUSET:
+        return rec->cpuset;
+    case PS_NUMA_NODE:
+        snprintf(buf, size, "%d", rec->numa_node);
+        return buf;
+    case PS_CPU_RATE:
+        snprintf(buf, size, "%.3f", rec->cpu_rate_milli / 1000.0);
+        return buf;
+    case PS_CPU_USED:
+        snprintf(buf, size, "%.3f", rec->cpu_used_milli / 1000.0);
+        return buf;
+    case PS_SCHED:
+        return rec->sched;
+    case PS_IOPRIO:
+        return rec->ioprio;
+    case PS_THP:
+        return rec->thp;
+    case PS_KSM:
+        return rec->ksm ? "1" : "0";
+    case PS_MLOCK_ALL:
+        return rec->mlock_all ? "1" : "0";
+    case PS_MEM_COMMIT:
+        snprintf(buf, size, "%lld", (long long)rec->mem_commit);
+        return buf;
+    case PS_NICE:
+    case PS_OOM_SCORE_ADJ: {
+        /* Empty when the container inherited it */
+        int value = field == PS_NICE ? rec->nice : rec->oom_score_adj;
+        if (value == MDOCK_UNSET) {
+            return "";
+        }
+        snprintf(buf, size, "%d", value);
+        return buf;
+    }
+    }
+
+    /* Resource usage from wait4(), 0 until the container has been reaped */
+    int64_t value;
+    switch (field) {
+    case PS_USER_TIME_US: value = rec->usage.utime_us; break;
+    case PS_SYS_TIME_US:  value = rec->usage.stime_us; break;
+    case PS_MAX_RSS_KB:   value = rec->usage.maxrss_kb; break;
+    case PS_MINOR_FAULTS: value = rec->usage.minflt; break;
+    case PS_MAJOR_FAULTS: value = rec->usage.majflt; break;
+    case PS_VOL_CTX:      value = rec->usage.nvcsw; break;
+    case PS_INVOL_CTX:    value = rec->usage.nivcsw; break;
+    case PS_BLOCK_IN:     value = rec->usage.inblock; break;
+    case PS_BLOCK_OUT:    value = rec->usage.oublock; break;
+    default:
+        return "";
+    }
+    snprintf(buf, size, "%lld", (long long)value);
+    return buf;
+}
+
+static void ps_print(struct ps_options *opts, const struct container_record *rec)
+{
+    char buf[64];
+
+    if (opts->quiet) {
+        printf("%s\n", rec->id);
+    } else if (opts->json) {
+        printf("%s\n  {", opts->printed ? "," : "");
+        for (int i = 0; i < PS_FIELD_COUNT; i++) {
+            const char *value = ps_field_value(opts, rec, i, buf, sizeof(buf));
+            printf("%s\"%s\": ", i ? ", " : "", ps_fields[i].json_key);
+            if (ps_fields[i].numeric) {
+                fputs(value[0] ? value : "null", stdout);
+            } else {
+                mdock_json_string(stdout, value);
+            }
+        }
+        putchar('}');
+    } else if (opts->nsegments > 0) {
+        for (int i = 0; i < opts->nsegments; i++) {
+            const struct ps_segment *seg = &opts->segments[i];
+            if (seg->field < 0) {
+                fwrite(seg->text, 1, seg->len, stdout);
+            } else {
+                fputs(ps_field_value(opts, rec, seg->field, buf, sizeof(buf)), stdout);
+            }
+        }
+        putchar('\n');
+    } else {
+        printf("%-8s %-8d %-12s %-10s %-14s %s\n", rec->id, rec->pid, rec->image,
+               ps_actual_status(opts, rec),
+               ps_field_value(opts, rec, PS_UPTIME, buf, sizeof(buf)),
+               rec->cpuset[0] ? rec->cpuset : "-");
+    }
+    opts->printed++;
+}
+
+/* Newest-first scan that stops once --last matches are found */
+static int ps_scan_last(struct ps_options *opts, const struct db_map *map)
+{
+    struct container_record *recs = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+
+    struct db_scanner s;
+    struct db_row row;
+    struct container_record rec;
+
+    db_scanner_init(&s, map);
+    while (count < (size_t)opts->last && db_scanner_prev(&s, &row)) {
+        if (!ps_row_may_match(opts, &row) || container_record_parse(&row, &rec) != 0 ||
+            !ps_matches(opts, &rec)) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            struct container_record *grown = realloc(recs, cap * sizeof(*recs));
+            if (!grown) {
+                perror("[mdock] realloc");
+                free(recs);
+                return -1;
+            }
+            recs = grown;
+        }
+        recs[count++] = rec;
+    }
+
+    /* Print oldest first, like the full listing */
+    while (count > 0) {
+        ps_print(opts, &recs[--count]);
+    }
+    free(recs);
+    return 0;
+}
+
+static int ps_scan_all(struct ps_options *opts, const struct db_map *map)
+{
+    struct db_scanner s;
+    struct db_row row;
+    struct container_record rec;
+
+    db_scanner_init(&s, map);
+    while (db_scanner_next(&s, &row)) {
+        if (ps_row_may_match(opts, &row) && container_record_parse(&row, &rec) == 0 &&
+            ps_matches(opts, &rec)) {
+            ps_print(opts, &rec);
+        }
+    }
+    return 0;
+}
+
+int cmd_ps(int argc, char **argv)
+{
+    struct ps_options opts;
+    memset(&opts, 0, sizeof(opts));
+    int ret = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0) {
+            opts.quiet = 1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            opts.json = 1;
+        } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--filter") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[mdock] error: %s requires KEY=VALUE\n", argv[i]);
+                goto out;
+            }
+            if (ps_add_filters(&opts, argv[++i]) != 0) {
+                goto out;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--last") == 0) {
+            char *endptr;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[mdock] error: %s requires a number\n", argv[i]);
+                goto out;
+            }
+            opts.last = strtol(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || opts.last <= 0) {
+                fprintf(stderr, "[mdock] error: invalid count '%s'\n", argv[i]);
+                goto out;
+            }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[mdock] error: --format requires a template\n");
+                goto out;
+            }
+            if (opts.format || ps_compile_format(&opts, argv[++i]) != 0) {
+                goto out;
+            }
         } else {
-            /* This is the image name */
-            image_name = argv[i];
-            i++;  /* Move past image name to capture program args */
-            break;
+            fprintf(stderr, "[mdock] error: unknown option '%s'\n", argv[i]);
+            ps_usage();
+            goto out;
         }
     }
-    
-    /* Capture program and its arguments (everything after image name) */
-    int prog_argc = argc - i;
-    char **prog_argv = (prog_argc > 0) ? &argv[i] : NULL;
-    
-    if (!image_name) {
-        fprintf(stderr, "Usage: mdock run [OPTIONS] <image_name> [program] [args...]\n");
-        fprintf(stderr, "\nOptions:\n");
-        fprintf(stderr, "  --mem <size>      Memory limit (e.g., 128M, 1G)\n");
-        fprintf(stderr, "  --cpu <seconds>   CPU time limit in seconds\n");
-        fprintf(stderr, "  -e KEY=VALUE      Set environment variable\n");
-        fprintf(stderr, "\nExamples:\n");
-        fprintf(stderr, "  mdock run myimage\n");
-        fprintf(stderr, "  mdock run myimage hello\n");
-        fprintf(stderr, "  mdock run --mem 128M myimage stress mem 100\n");
-        fprintf(stderr, "  mdock run -e DEBUG=1 -e PORT=8080 myimage webserver\n");
-        fprintf(stderr, "  mdock run --mem 256M --cpu 10 -e APP_ENV=prod myimage\n");
-        return 1;
+
+    if (opts.quiet) {
+        opts.json = 0;
     }
 
     /* Initialize ~/.mdock */
     char base_dir[PATH_MAX];
     if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
         fprintf(stderr, "[mdock] failed to initialize home directory\n");
-        return 1;
+        goto out;
     }
 
-    /* Lookup image rootfs */
-    char rootfs_path[PATH_MAX];
-    if (find_image_rootfs(base_dir, image_name, rootfs_path, sizeof(rootfs_path)) != 0) {
-        fprintf(stderr, "[mdock] error: image '%s' not found\n", image_name);
-        fprintf(stderr, "[mdock] hint: use 'mdock build %s <rootfs_dir>' to create it\n", image_name);
-        return 1;
+    char db_path[PATH_MAX];
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
+        goto out;
     }
 
-    /* Verify rootfs directory still exists */
-    struct stat st;
-    if (stat(rootfs_path, &st) == -1) {
-        fprintf(stderr, "[mdock] error: rootfs directory '%s' no longer exists\n", rootfs_path);
-        fprintf(stderr, "[mdock] hint: the image may be corrupted, try rebuilding it\n");
-        return 1;
+    /* Print header */
+    if (opts.json) {
+        putchar('[');
+    } else if (!opts.quiet && !opts.format) {
+        printf("%-8s %-8s %-12s %-10s %-14s %s\n", "ID", "PID", "IMAGE", "STATUS", "UPTIME", "CPUSET");
+    }
+
+    /* If the file doesn't exist, there are no containers to show */
+    struct db_map map;
+    if (db_map_open(db_path, &map) == 0) {
+        ret = (opts.last > 0) ? ps_scan_last(&opts, &map) : ps_scan_all(&opts, &map);
+        ret = ret ? 1 : 0;
+        db_map_close(&map);
+    } else {
+        ret = 0;
     }
-    if (!S_ISDIR(st.st_mode)) {
-        fprintf(stderr, "[mdock] error: rootfs path '%s' is not a directory\n", rootfs_path);
-        return 1;
+
+    if (opts.json) {
+        printf("%s]\n", opts.printed ? "\n" : "");
     }
 
-    /* Generate unique container ID */
-    char container_id[64];
-    if (generate_container_id(base_dir, container_id, sizeof(container_id)) != 0) {
-        fprintf(stderr, "[mdock] failed to generate container ID\n");
-        return 1;
+out:
+    if (opts.live_loaded > 0) {
+        pid_set_free(&opts.live);
+    }
+    free(opts.format);
+    return ret;
+}
+
+/* ----- mdock inspect ----- */
+
+int cmd_inspect(int argc, char **argv)
+{
+    struct ps_options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.json = 1;
+    int ret = 1;
+
+    int i = 1;
+    if (i + 1 < argc && strcmp(argv[i], "--format") == 0) {
+        if (ps_compile_format(&opts, argv[i + 1]) != 0) {
+            goto out;
+        }
+        opts.json = 0;
+        i += 2;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: mdock inspect [--format TEMPLATE] <container_id>...\n");
+        goto out;
     }
 
-    /* Fork child process */
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("[mdock] fork");
-        return 1;
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        fprintf(stderr, "[mdock] failed to initialize home directory\n");
+        goto out;
     }
 
-    if (pid == 0) {
-        /* ===== Child process ===== */
-        
-        /* Create logs directory if it doesn't exist */
-        char logs_dir[PATH_MAX];
-        if (snprintf(logs_dir, sizeof(logs_dir), "%s/logs", base_dir) < (int)sizeof(logs_dir)) {
-            mkdir(logs_dir, 0755);  /* Ignore errors if already exists */
-            
-            /* Redirect stdout and stderr to log file */
-            char log_path[PATH_MAX];
-            if (snprintf(log_path, sizeof(log_path), "%s/%s.log", logs_dir, container_id) < (int)sizeof(log_path)) {
-                int log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-                if (log_fd >= 0) {
-                    dup2(log_fd, STDOUT_FILENO);
-                    dup2(log_fd, STDERR_FILENO);
-                    close(log_fd);
-                }
-            }
+    ret = 0;
+    if (opts.json) {
+        putchar('[');
+    }
+    for (; i < argc; i++) {
+        struct container_record rec;
+        if (find_container_record(base_dir, argv[i], &rec) != 0) {
+            fprintf(stderr, "[mdock] container '%s' not found\n", argv[i]);
+            ret = 1;
+            continue;
         }
-        
-        /* Set resource limits if specified */
-        if (mem_limit > 0) {
-            struct rlimit mem_rlimit;
-            mem_rlimit.rlim_cur = mem_limit;
-            mem_rlimit.rlim_max = mem_limit;
-            if (setrlimit(RLIMIT_AS, &mem_rlimit) != 0) {
-                perror("[mdock] setrlimit RLIMIT_AS");
-                fprintf(stderr, "[mdock] warning: failed to set memory limit, continuing anyway\n");
-            }
+        ps_print(&opts, &rec);
+    }
+    if (opts.json) {
+        printf("%s]\n", opts.printed ? "\n" : "");
+    }
+
+out:
+    if (opts.live_loaded > 0) {
+        pid_set_free(&opts.live);
+    }
+    free(opts.format);
+    return ret;
+}
+
+/* ----- Issue #11: mdock stop command ----- */
+
+#define STOP_DEFAULT_TIMEOUT 5      /* seconds between SIGTERM and SIGKILL */
+#define STOP_KILL_WAIT_NS    (2 * 1000000000LL)
+
+struct stop_target {
+    struct container_record rec;
+    int pidfd;
+    int killed;                 /* SIGKILL was needed */
+    int done;
+    const char *final_status;   /* written to containers.db at the end, NULL for none */
+};
+
+struct stop_batch {
+    const struct stop_target *targets;
+    int count;
+};
+
+static int apply_stop_batch(const struct db_row *row, FILE *out, void *arg)
+{
+    const struct stop_batch *b = arg;
+
+    for (int i = 0; i < b->count; i++) {
+        const struct stop_target *t = &b->targets[i];
+        if (!t->final_status || !db_field_eq(&row->fields[CF_ID], t->rec.id)) {
+            continue;
         }
-        
-        if (cpu_limit > 0) {
-            struct rlimit cpu_rlimit;
-            cpu_rlimit.rlim_cur = cpu_limit;
-            cpu_rlimit.rlim_max = cpu_limit;
-            if (setrlimit(RLIMIT_CPU, &cpu_rlimit) != 0) {
-                perror("[mdock] setrlimit RLIMIT_CPU");
-                fprintf(stderr, "[mdock] warning: failed to set CPU limit, continuing anyway\n");
-            }
-        }
-        
-        /* Change directory to rootfs */
-        if (chdir(rootfs_path) != 0) {
-            perror("[mdock] chdir");
-            exit(1);
-        }
-
-        /* Optional: chroot to rootfs (requires root privileges) */
-        /* Uncomment if running as root:
-         * if (chroot(rootfs_path) != 0) {
-         *     perror("[mdock] chroot");
-         *     exit(1);
-         * }
-         */
+        struct container_update u = {
+            .container_id = t->rec.id,
+            .new_status = t->final_status,
+        };
+        return apply_container_update(row, out, &u);
+    }
+    return 0;
+}
 
-        /* Build environment array */
-        char *envp[256];
-        int env_idx = 0;
-        
-        /* Add default environment variables */
-        envp[env_idx++] = "PATH=/bin:/usr/bin:/sbin:/usr/sbin";
-        envp[env_idx++] = "HOME=/root";
-        envp[env_idx++] = "TERM=xterm";
-        
-        /* Add user-specified environment variables */
-        for (int j = 0; j < env_count && env_idx < 255; j++) {
-            envp[env_idx++] = env_vars[j];
-        }
-        
-        envp[env_idx] = NULL;
-
-        /* Execute the specified program or /bin/sh */
-        if (prog_argc > 0 && prog_argv) {
-            /* Execute specified program with its arguments */
-            /* Build full path to program (it's relative to rootfs) */
-            char prog_path[PATH_MAX];
-            if (prog_argv[0][0] == '/') {
-                /* Absolute path in container */
-                snprintf(prog_path, sizeof(prog_path), ".%s", prog_argv[0]);
-            } else {
-                /* Relative path */
-                snprintf(prog_path, sizeof(prog_path), "./%s", prog_argv[0]);
-            }
-            
-            execve(prog_path, prog_argv, envp);
-            
-            /* If that fails, try without the ./ prefix */
-            execve(prog_argv[0], prog_argv, envp);
-        } else {
-            /* No program specified, execute /bin/sh */
-            char *args[] = {"/bin/sh", NULL};
-            execve("/bin/sh", args, envp);
-        }
-        
-        /* If execve fails */
-        perror("[mdock] execve");
-        exit(1);
-    }
-
-    /* ===== Parent process ===== */
-
-    /* Record container in containers.db with status=running */
-    if (add_container_record(base_dir, container_id, pid, image_name) != 0) {
-        fprintf(stderr, "[mdock] failed to add container record\n");
-        /* Continue anyway, we'll try to wait for the child */
-    }
-
-    /* Log RUN event with resource limits if set */
-    if (mem_limit > 0 && cpu_limit > 0) {
-        mdock_logf("RUN container_id=%s pid=%d image=%s mem_limit=%ldM cpu_limit=%lds", 
-                   container_id, pid, image_name, mem_limit / (1024*1024), cpu_limit);
-    } else if (mem_limit > 0) {
-        mdock_logf("RUN container_id=%s pid=%d image=%s mem_limit=%ldM", 
-                   container_id, pid, image_name, mem_limit / (1024*1024));
-    } else if (cpu_limit > 0) {
-        mdock_logf("RUN container_id=%s pid=%d image=%s cpu_limit=%lds", 
-                   container_id, pid, image_name, cpu_limit);
-    } else {
-        mdock_logf("RUN container_id=%s pid=%d image=%s", container_id, pid, image_name);
+/* Every container recorded as running, for stop --all */
+static int stop_collect_running(const char *base_dir, struct stop_target **out, int *count)
+{
+    char db_path[PATH_MAX];
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
+        return -1;
+    }
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
+        perror("[mdock] open containers.db");
+        return -1;
     }
 
-    if (mem_limit > 0 || cpu_limit > 0) {
-        printf("[mdock] Container %s started (PID %d)", container_id, pid);
-        if (mem_limit > 0) {
-            printf(" [mem: %ldM]", mem_limit / (1024*1024));
+    int cap = 0;
+    struct db_scanner s;
+    struct db_row row;
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        if (row.nfields < CF_REQUIRED || !db_field_eq(&row.fields[CF_STATUS], "running")) {
+            continue;
         }
-        if (cpu_limit > 0) {
-            printf(" [cpu: %lds]", cpu_limit);
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 16;
+            struct stop_target *grown = realloc(*out, (size_t)cap * sizeof(*grown));
+            if (!grown) {
+                perror("[mdock] realloc");
+                db_map_close(&map);
+                return -1;
+            }
+            *out = grown;
+        }
+        if (container_record_parse(&row, &(*out)[*count].rec) == 0) {
+            (*count)++;
         }
-        printf("\n");
-    } else {
-        printf("[mdock] Container %s started (PID %d)\n", container_id, pid);
     }
+    db_map_close(&map);
+    return 0;
+}
 
-    /* ===== Issue #9: Wait for container exit ===== */
+static void stop_finish(struct stop_target *t)
+{
+    t->done = 1;
+    close(t->pidfd);
+    t->pidfd = -1;
+    t->final_status = t->killed ? "killed" : "stopped";
+    mdock_logf("STOP container_id=%s pid=%d signal=%s", t->rec.id, t->rec.pid,
+               t->killed ? "SIGKILL" : "SIGTERM");
+    if (t->killed) {
+        printf("[mdock] Container %s killed (PID %d)\n", t->rec.id, t->rec.pid);
+    } else {
+        printf("[mdock] Container %s stopped gracefully (PID %d)\n", t->rec.id, t->rec.pid);
+    }
+    fflush(stdout);
+}
 
-    int status;
-    if (waitpid(pid, &status, 0) == -1) {
-        perror("[mdock] waitpid");
+/*
+ * Send SIGTERM to every target, then wait on all their pidfds in one epoll
+ * set: a container that exits is done at once, and whatever is left when
+ * the grace period ends gets SIGKILL together.
+ */
+static int stop_targets(struct stop_target *targets, int count, int timeout_sec)
+{
+    int rc = 0;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep == -1) {
+        perror("[mdock] epoll_create1");
         return 1;
     }
 
-    /* Extract exit code and detect resource limit violations */
-    int exit_code = 0;
-    const char *exit_reason = NULL;
-    
-    if (WIFEXITED(status)) {
-        exit_code = WEXITSTATUS(status);
-    } else if (WIFSIGNALED(status)) {
-        int sig = WTERMSIG(status);
-        exit_code = 128 + sig;
-        
-        /* Detect resource limit signals */
-        if (sig == SIGXCPU) {
-            exit_reason = "CPU time limit exceeded";
-        } else if (sig == SIGKILL) {
-            exit_reason = "killed (possibly memory limit exceeded)";
-        } else {
-            exit_reason = "terminated by signal";
+    int pending = 0;
+    for (int i = 0; i < count; i++) {
+        struct stop_target *t = &targets[i];
+        if (t->pidfd < 0) {
+            continue;
+        }
+        printf("[mdock] Sending SIGTERM to container %s (PID %d)...\n", t->rec.id, t->rec.pid);
+        if (proc_signal(t->pidfd, SIGTERM) != 0 && errno != ESRCH) {
+            perror("[mdock] kill SIGTERM");
+            close(t->pidfd);
+            t->pidfd = -1;
+            rc = 1;
+            continue;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, t->pidfd, &ev) != 0) {
+            perror("[mdock] epoll_ctl");
+            close(t->pidfd);
+            t->pidfd = -1;
+            rc = 1;
+            continue;
         }
+        pending++;
     }
-
-    /* Update container record with exit info */
-    if (update_container_exit(base_dir, container_id, exit_code) != 0) {
-        fprintf(stderr, "[mdock] failed to update container exit status\n");
+    if (pending > 0) {
+        printf("[mdock] Waiting up to %d seconds for graceful shutdown...\n", timeout_sec);
+        fflush(stdout);
     }
 
-    /* Log EXIT event */
-    if (exit_reason) {
-        mdock_logf("EXIT container_id=%s pid=%d exit_code=%d reason=%s", 
-                   container_id, pid, exit_code, exit_reason);
-    } else {
-        mdock_logf("EXIT container_id=%s pid=%d exit_code=%d", container_id, pid, exit_code);
+    int64_t deadline = mdock_monotonic_ns() + (int64_t)timeout_sec * 1000000000LL;
+    int killing = 0;
+    while (pending > 0) {
+        int64_t left = deadline - mdock_monotonic_ns();
+        int wait_ms = left > 0 ? (int)((left + 999999) / 1000000) : 0;
+
+        struct epoll_event evs[64];
+        int n = epoll_wait(ep, evs, 64, wait_ms);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[mdock] epoll_wait");
+            rc = 1;
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            stop_finish(&targets[evs[k].data.u32]);
+            pending--;
+        }
+        if (n > 0 || mdock_monotonic_ns() < deadline) {
+            continue;
+        }
+
+        if (killing) {
+            for (int i = 0; i < count; i++) {
+                if (targets[i].pidfd >= 0 && !targets[i].done) {
+                    fprintf(stderr, "[mdock] error: container %s (PID %d) survived SIGKILL\n",
+                            targets[i].rec.id, targets[i].rec.pid);
+                }
+            }
+            rc = 1;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            struct stop_target *t = &targets[i];
+            if (t->pidfd < 0 || t->done) {
+                continue;
+            }
+            printf("[mdock] Container %s still running, sending SIGKILL...\n", t->rec.id);
+            if (proc_signal(t->pidfd, SIGKILL) != 0 && errno != ESRCH) {
+                perror("[mdock] kill SIGKILL");
+                rc = 1;
+            }
+            t->killed = 1;
+        }
+        fflush(stdout);
+        killing = 1;
+        deadline = mdock_monotonic_ns() + STOP_KILL_WAIT_NS;
     }
 
-    /* Container runs in detached mode - return immediately */
-    return 0;
+    for (int i = 0; i < count; i++) {
+        if (targets[i].pidfd >= 0) {
+            close(targets[i].pidfd);
+            targets[i].pidfd = -1;
+        }
+    }
+    close(ep);
+    return rc;
 }
 
-/* ----- Issue #10: mdock ps command ----- */
+static void stop_usage(void)
+{
+    fprintf(stderr, "Usage: mdock stop [--timeout SECONDS] <container_id>...\n");
+    fprintf(stderr, "       mdock stop [--timeout SECONDS] --all\n");
+}
 
-int cmd_ps(int argc, char **argv)
+int cmd_stop(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
+    int timeout_sec = STOP_DEFAULT_TIMEOUT;
+    int all = 0;
+    int nids = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--timeout") == 0 || strcmp(argv[i], "-t") == 0) {
+            if (i + 1 >= argc) {
+                stop_usage();
+                return 1;
+            }
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 0 || n > 86400) {
+                fprintf(stderr, "[mdock] error: invalid timeout '%s'\n", argv[i]);
+                return 1;
+            }
+            timeout_sec = (int)n;
+        } else if (strcmp(argv[i], "--all") == 0 || strcmp(argv[i], "-a") == 0) {
+            all = 1;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "[mdock] error: unknown option '%s'\n", argv[i]);
+            stop_usage();
+            return 1;
+        } else {
+            argv[++nids] = argv[i];     /* compact the IDs into argv[1..nids] */
+        }
+    }
+    if (all == (nids > 0)) {
+        stop_usage();
+        return 1;
+    }
 
     /* Initialize ~/.mdock */
     char base_dir[PATH_MAX];
@@ -743,167 +2457,158 @@ int cmd_ps(int argc, char **argv)
         return 1;
     }
 
-    char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] containers.db path too long\n");
-        return 1;
+    int rc = 0;
+    struct stop_target *targets = NULL;
+    int count = 0;
+    if (all) {
+        if (stop_collect_running(base_dir, &targets, &count) != 0) {
+            free(targets);
+            return 1;
+        }
+    } else {
+        targets = calloc((size_t)nids, sizeof(*targets));
+        if (!targets) {
+            perror("[mdock] calloc");
+            return 1;
+        }
+        for (int i = 1; i <= nids; i++) {
+            if (find_container_record(base_dir, argv[i], &targets[count].rec) != 0) {
+                fprintf(stderr, "[mdock] container '%s' not found\n", argv[i]);
+                rc = 1;
+                continue;
+            }
+            count++;
+        }
     }
 
-    FILE *f = fopen(db_path, "r");
-    if (!f) {
-        /* If file doesn't exist, just show header with no containers */
-        printf("%-8s %-8s %-12s %-10s %s\n", "ID", "PID", "IMAGE", "STATUS", "UPTIME");
-        return 0;
-    }
+    for (int i = 0; i < count; i++) {
+        struct stop_target *t = &targets[i];
+        t->pidfd = -1;
+        t->killed = 0;
+        t->done = 0;
+        t->final_status = NULL;
 
-    /* Print header */
-    printf("%-8s %-8s %-12s %-10s %s\n", "ID", "PID", "IMAGE", "STATUS", "UPTIME");
-
-    char line[4096];
-    while (fgets(line, sizeof(line), f)) {
-        /* Parse: id|pid|image|status|start_time|end_time|exit_code */
-        char *p1 = strchr(line, '|');
-        if (!p1) continue;
-        *p1 = '\0';
-        char *id = line;
-
-        char *p2 = strchr(p1 + 1, '|');
-        if (!p2) continue;
-        *p2 = '\0';
-        char *pid_str = p1 + 1;
-        int pid = atoi(pid_str);
-
-        char *p3 = strchr(p2 + 1, '|');
-        if (!p3) continue;
-        *p3 = '\0';
-        char *image = p2 + 1;
-
-        char *p4 = strchr(p3 + 1, '|');
-        if (!p4) continue;
-        *p4 = '\0';
-        char *status = p3 + 1;
-
-        char *p5 = strchr(p4 + 1, '|');
-        if (!p5) continue;
-        *p5 = '\0';
-        char *start_time = p4 + 1;
-
-        char *p6 = strchr(p5 + 1, '|');
-        if (!p6) continue;
-        *p6 = '\0';
-        char *end_time = p5 + 1;
-
-        /* Check if PID is still alive */
-        char actual_status[32];
-        if (strcmp(status, "running") == 0) {
-            if (is_pid_alive(pid)) {
-                strcpy(actual_status, "running");
-            } else {
-                strcpy(actual_status, "exited");
+        /* Check if already stopped */
+        const char *status = t->rec.status;
+        if (strcmp(status, "exited") == 0 || strcmp(status, "stopped") == 0 || strcmp(status, "killed") == 0) {
+            printf("[mdock] Container %s is already stopped (status: %s)\n", t->rec.id, status);
+            continue;
+        }
+
+        /* Hold the process by pidfd so the signals cannot reach a reused pid */
+        t->pidfd = proc_open(t->rec.pid, t->rec.pid_start);
+        if (t->pidfd < 0 && errno != ESRCH) {
+            fprintf(stderr, "[mdock] pidfd_open %d: %s\n", t->rec.pid, strerror(errno));
+            rc = 1;
+            continue;
+        }
+        if (t->pidfd < 0 || proc_exited(t->pidfd)) {
+            printf("[mdock] Container %s process (PID %d) is not running\n", t->rec.id, t->rec.pid);
+            if (t->pidfd >= 0) {
+                close(t->pidfd);
+                t->pidfd = -1;
+            }
+            if (strcmp(status, "running") == 0) {
+                /* Update status to exited if db says running but process is dead */
+                t->final_status = "exited";
             }
-        } else {
-            strcpy(actual_status, status);
         }
+    }
 
-        /* Calculate uptime */
-        char uptime[32];
-        calculate_uptime(start_time, end_time, uptime, sizeof(uptime));
+    if (stop_targets(targets, count, timeout_sec) != 0) {
+        rc = 1;
+    }
 
-        /* Print formatted output */
-        printf("%-8s %-8d %-12s %-10s %s\n", id, pid, image, actual_status, uptime);
+    /* One rewrite of containers.db for every container that changed */
+    char db_path[PATH_MAX];
+    struct stop_batch batch = { targets, count };
+    if (containers_db_path(base_dir, db_path, sizeof(db_path)) != 0 ||
+        db_rewrite(db_path, apply_stop_batch, &batch) < 0) {
+        fprintf(stderr, "[mdock] failed to update container status\n");
+        rc = 1;
     }
 
-    fclose(f);
-    return 0;
+    free(targets);
+    return rc;
 }
 
-/* ----- Issue #11: mdock stop command ----- */
+/* ----- mdock wait ----- */
 
-int cmd_stop(int argc, char **argv)
+int cmd_wait(int argc, char **argv)
 {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: mdock stop <container_id>\n");
+    if (argc < 2) {
+        fprintf(stderr, "Usage: mdock wait <container_id>...\n");
         return 1;
     }
 
-    const char *container_id = argv[1];
-
-    /* Initialize ~/.mdock */
     char base_dir[PATH_MAX];
     if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
-        fprintf(stderr, "[mdock] failed to initialize home directory\n");
         return 1;
     }
 
-    /* Find container */
-    int pid;
-    char status[64];
-    if (find_container_by_id(base_dir, container_id, &pid, status, sizeof(status)) != 0) {
-        fprintf(stderr, "[mdock] container '%s' not found\n", container_id);
+    int count = argc - 1;
+    struct container_record *recs = calloc((size_t)count, sizeof(*recs));
+    struct pollfd *fds = calloc((size_t)count, sizeof(*fds));
+    if (!recs || !fds) {
+        perror("[mdock] calloc");
+        free(recs);
+        free(fds);
         return 1;
     }
 
-    /* Check if already stopped */
-    if (strcmp(status, "exited") == 0 || strcmp(status, "stopped") == 0 || strcmp(status, "killed") == 0) {
-        printf("[mdock] Container %s is already stopped (status: %s)\n", container_id, status);
-        return 0;
-    }
-
-    /* Check if PID is alive */
-    if (!is_pid_alive(pid)) {
-        printf("[mdock] Container %s process (PID %d) is not running\n", container_id, pid);
-        if (strcmp(status, "running") == 0) {
-            /* Update status to exited if db says running but process is dead */
-            update_container_status(base_dir, container_id, "exited");
+    int rc = 0;
+    int pending = 0;
+    for (int i = 0; i < count; i++) {
+        fds[i].fd = -1;
+        fds[i].events = POLLIN;
+        if (find_container_record(base_dir, argv[i + 1], &recs[i]) != 0) {
+            fprintf(stderr, "[mdock] container '%s' not found\n", argv[i + 1]);
+            recs[i].id[0] = '\0';
+            rc = 1;
+            continue;
+        }
+        if (strcmp(recs[i].status, "running") == 0) {
+            fds[i].fd = proc_open(recs[i].pid, recs[i].pid_start);
+            pending += fds[i].fd >= 0;
         }
-        return 0;
     }
 
-    /* Send SIGTERM */
-    printf("[mdock] Sending SIGTERM to container %s (PID %d)...\n", container_id, pid);
-    if (kill(pid, SIGTERM) != 0) {
-        perror("[mdock] kill SIGTERM");
-        return 1;
+    /* poll() skips negative fds, so finished containers simply drop out */
+    while (pending > 0) {
+        if (poll(fds, (nfds_t)count, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[mdock] poll");
+            rc = 1;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (fds[i].fd >= 0 && fds[i].revents) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                pending--;
+            }
+        }
     }
 
-    /* Wait 5 seconds for graceful shutdown */
-    printf("[mdock] Waiting for graceful shutdown (5 seconds)...\n");
-    sleep(5);
-
-    /* Check if still alive */
-    if (is_pid_alive(pid)) {
-        /* Still alive, send SIGKILL */
-        printf("[mdock] Process still running, sending SIGKILL...\n");
-        if (kill(pid, SIGKILL) != 0) {
-            perror("[mdock] kill SIGKILL");
-            return 1;
+    for (int i = 0; i < count; i++) {
+        if (fds[i].fd >= 0) {
+            close(fds[i].fd);
         }
-
-        /* Wait a bit more */
-        sleep(2);
-
-        /* Update status to killed */
-        if (update_container_status(base_dir, container_id, "killed") != 0) {
-            fprintf(stderr, "[mdock] failed to update container status\n");
+        if (recs[i].id[0] == '\0') {
+            continue;
         }
-
-        /* Log STOP event with SIGKILL */
-        mdock_logf("STOP container_id=%s pid=%d signal=SIGKILL", container_id, pid);
-
-        printf("[mdock] Container %s killed (PID %d)\n", container_id, pid);
-    } else {
-        /* Stopped gracefully */
-        if (update_container_status(base_dir, container_id, "stopped") != 0) {
-            fprintf(stderr, "[mdock] failed to update container status\n");
+        if (strcmp(recs[i].status, "running") == 0) {
+            find_container_record(base_dir, recs[i].id, &recs[i]);
+            wait_for_exit_record(base_dir, &recs[i]);
         }
-
-        /* Log STOP event with SIGTERM */
-        mdock_logf("STOP container_id=%s pid=%d signal=SIGTERM", container_id, pid);
-
-        printf("[mdock] Container %s stopped gracefully (PID %d)\n", container_id, pid);
+        printf("%s %d\n", recs[i].id, recs[i].exit_code);
     }
 
-    return 0;
+    free(recs);
+    free(fds);
+    return rc;
 }
 
 int cmd_rm(int argc, char *argv[])
@@ -921,69 +2626,26 @@ int cmd_rm(int argc, char *argv[])
     }
 
     /* Check if container exists and get its status */
-    int pid;
-    char status[32];
-    if (find_container_by_id(base_dir, container_id, &pid, status, sizeof(status)) != 0) {
+    struct container_record rec;
+    if (find_container_record(base_dir, container_id, &rec) != 0) {
         fprintf(stderr, "Error: Container '%s' not found.\n", container_id);
         return 1;
     }
 
     /* Check if container is still running */
-    if (strcmp(status, "running") == 0 || is_pid_alive(pid)) {
+    if (strcmp(rec.status, "running") == 0 || container_is_alive(&rec)) {
         fprintf(stderr, "Error: Container '%s' is still running.\n", container_id);
         fprintf(stderr, "Hint: Stop it first with 'mdock stop %s'\n", container_id);
         return 1;
     }
 
-    /* Read all containers, remove the target one */
-    char db_path[PATH_MAX];
-    if (snprintf(db_path, sizeof(db_path), "%s/containers.db", base_dir) >= (int)sizeof(db_path)) {
-        fprintf(stderr, "[mdock] db path too long\n");
-        return 1;
-    }
-
-    FILE *fp = fopen(db_path, "r");
-    if (!fp) {
-        perror("[mdock] fopen containers.db");
-        return 1;
-    }
-
-    char lines[1000][4096];
-    int line_count = 0;
-    int found = 0;
-
-    char line[4096];
-    while (fgets(line, sizeof(line), fp) && line_count < 1000) {
-        char current_id[64];
-        if (sscanf(line, "%63[^|]", current_id) == 1) {
-            if (strcmp(current_id, container_id) == 0) {
-                found = 1;
-                continue;  // Skip this line (delete it)
-            }
-        }
-        strncpy(lines[line_count], line, sizeof(lines[line_count]) - 1);
-        lines[line_count][sizeof(lines[line_count]) - 1] = '\0';
-        line_count++;
-    }
-    fclose(fp);
-
-    if (!found) {
+    /* Rewrite containers.db without the target one */
+    if (remove_container_record(base_dir, container_id) != 0) {
         fprintf(stderr, "Error: Container '%s' not found in database.\n", container_id);
         return 1;
     }
 
-    /* Write back without the deleted container */
-    fp = fopen(db_path, "w");
-    if (!fp) {
-        perror("[mdock] fopen for writing");
-        return 1;
-    }
-
-    for (int i = 0; i < line_count; i++) {
-        fputs(lines[i], fp);
-    }
-    fclose(fp);
-
+    history_remove(base_dir, container_id);
     mdock_logf("RM container_id=%s", container_id);
     printf("Removed container '%s'\n", container_id);
 
@@ -1021,16 +2683,17 @@ int cmd_logs(int argc, char *argv[])
     }
 
     /* Verify container exists */
-    int pid;
-    char status[32];
-    if (find_container_by_id(base_dir, container_id, &pid, status, sizeof(status)) != 0) {
+    struct container_record rec;
+    if (find_container_record(base_dir, container_id, &rec) != 0) {
         fprintf(stderr, "Error: Container '%s' not found.\n", container_id);
         return 1;
     }
+    int pid = rec.pid;
 
-    /* Build log file path */
+    /* Build log file path on the data directory that holds it */
     char log_path[PATH_MAX];
-    if (snprintf(log_path, sizeof(log_path), "%s/logs/%s.log", base_dir, container_id) >= (int)sizeof(log_path)) {
+    if (snprintf(log_path, sizeof(log_path), "%s/logs/%s.log",
+                 shard_resolve(base_dir, rec.shard), container_id) >= (int)sizeof(log_path)) {
         fprintf(stderr, "[mdock] log path too long\n");
         return 1;
     }
@@ -1050,33 +2713,51 @@ int cmd_logs(int argc, char *argv[])
             return 1;
         }
 
-        /* Read existing content first */
-        char line[4096];
-        while (fgets(line, sizeof(line), fp)) {
-            fputs(line, stdout);
+        /*
+         * Sleep until the log grows (inotify) or the container exits (its
+         * pidfd becomes readable); without inotify, check every 100ms.
+         */
+        int pidfd = strcmp(rec.status, "running") == 0 ? proc_open(pid, rec.pid_start) : -1;
+        int ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (ino >= 0 && inotify_add_watch(ino, log_path, IN_MODIFY) == -1) {
+            close(ino);
+            ino = -1;
         }
-        fflush(stdout);
 
-        /* Now follow new content */
-        while (1) {
+        char line[4096];
+        for (;;) {
             while (fgets(line, sizeof(line), fp)) {
                 fputs(line, stdout);
-                fflush(stdout);
             }
-            
+            fflush(stdout);
             clearerr(fp);  /* Clear EOF flag */
-            usleep(100000);  /* Sleep 100ms */
-            
-            /* Check if container is still running */
-            if (!is_pid_alive(pid)) {
-                /* Container stopped, read any final output and exit */
-                while (fgets(line, sizeof(line), fp)) {
-                    fputs(line, stdout);
-                }
+
+            if (pidfd < 0) {
+                break;
+            }
+            struct pollfd fds[2] = {
+                { .fd = pidfd, .events = POLLIN },
+                { .fd = ino, .events = POLLIN },
+            };
+            if (poll(fds, 2, ino >= 0 ? -1 : 100) == -1 && errno != EINTR) {
+                perror("[mdock] poll");
                 break;
             }
+            if (fds[0].revents) {
+                /* Container stopped: read any final output and exit */
+                close(pidfd);
+                pidfd = -1;
+            }
+            if (fds[1].revents) {
+                char buf[4096];
+                while (read(ino, buf, sizeof(buf)) > 0) {
+                }
+            }
+        }
+
+        if (ino >= 0) {
+            close(ino);
         }
-        
         fclose(fp);
     } else {
         /* Normal mode: cat the file */
@@ -73,6 +73,40 @@ int mdock_get_home(char *buf, size_t size)
     return 0;
 }
 
+static const char *root_override;
+
+void mdock_set_root(const char *path)
+{
+    root_override = path;
+}
+
+int mdock_get_root(char *buf, size_t size)
+{
+    const char *root = root_override;
+    if (!root || root[0] == '\0') {
+        root = getenv("MDOCK_ROOT");
+    }
+
+    if (root && root[0] != '\0') {
+        if (strlen(root) + 1 > size) {
+            fprintf(stderr, "[mdock] state root path too long\n");
+            return -1;
+        }
+        strcpy(buf, root);
+        return 0;
+    }
+
+    char home[PATH_MAX];
+    if (mdock_get_home(home, sizeof(home)) != 0) {
+        return -1;
+    }
+    if (snprintf(buf, size, "%s/.mdock", home) >= (int)size) {
+        fprintf(stderr, "[mdock] base dir path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
 int ensure_dir_exists(const char *path, mode_t mode)
 {
     struct stat st;
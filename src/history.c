@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+
+#include "history.h"
+#include "fsutil.h"
+#include "stats.h"
+
+#define HISTORY_MAGIC        "MDHIST1"
+#define HISTORY_READ_TRIES   100
+
+static int history_path(const char *base_dir, const char *container_id, char *buf, size_t size)
+{
+    if (snprintf(buf, size, "%s/history/%s.hist", base_dir, container_id) >= (int)size) {
+        fprintf(stderr, "[mdock] history path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* ----- Writer ----- */
+
+int history_create(const char *base_dir, const char *container_id, int64_t size,
+                   int interval_ms, struct history *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->fd = -1;
+
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    if (snprintf(dir, sizeof(dir), "%s/history", base_dir) >= (int)sizeof(dir) ||
+        history_path(base_dir, container_id, path, sizeof(path)) != 0 ||
+        ensure_dir_exists(dir, 0755) != 0) {
+        return -1;
+    }
+
+    size_t slots = ((size_t)size - sizeof(struct history_header)) / sizeof(struct history_sample);
+    uint32_t capacity = (uint32_t)(slots / HISTORY_TIERS);
+    if (capacity == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    h->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (h->fd == -1) {
+        return -1;
+    }
+    h->size = (size_t)size;
+    if (ftruncate(h->fd, (off_t)size) == -1) {
+        history_close(h);
+        return -1;
+    }
+    h->map = mmap(NULL, h->size, PROT_READ | PROT_WRITE, MAP_SHARED, h->fd, 0);
+    if (h->map == MAP_FAILED) {
+        h->map = NULL;
+        history_close(h);
+        return -1;
+    }
+
+    h->hdr = h->map;
+    h->hdr->sample_size = sizeof(struct history_sample);
+    h->hdr->ntiers = HISTORY_TIERS;
+    uint32_t step = (uint32_t)interval_ms;
+    for (int k = 0; k < HISTORY_TIERS; k++) {
+        h->hdr->tiers[k].step_ms = step;
+        h->hdr->tiers[k].capacity = capacity;
+        h->hdr->tiers[k].offset = sizeof(struct history_header) +
+                                  (uint64_t)k * capacity * sizeof(struct history_sample);
+        step *= HISTORY_FACTOR;
+    }
+    /* The magic goes last: a reader never sees a half-initialized header as valid */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(h->hdr->magic, HISTORY_MAGIC, sizeof(h->hdr->magic));
+    return 0;
+}
+
+static void tier_append(struct history *h, int k, const struct history_sample *s)
+{
+    struct history_tier *t = &h->hdr->tiers[k];
+    memcpy((char *)h->map + t->offset + (t->written % t->capacity) * sizeof(*s), s, sizeof(*s));
+    t->written++;
+    if (k + 1 >= HISTORY_TIERS) {
+        return;
+    }
+
+    /* rss and cpu_milli are summed here and averaged when the slot is full */
+    struct history_sample *p = &h->pending[k];
+    if (h->npending[k] == 0) {
+        *p = *s;
+    } else {
+        int64_t rss = p->rss + s->rss;
+        int64_t rss_max = p->rss_max > s->rss_max ? p->rss_max : s->rss_max;
+        int32_t cpu_milli = p->cpu_milli + s->cpu_milli;
+        int32_t threads = p->threads > s->threads ? p->threads : s->threads;
+        int32_t pids = p->pids > s->pids ? p->pids : s->pids;
+        *p = *s;
+        p->rss = rss;
+        p->rss_max = rss_max;
+        p->cpu_milli = cpu_milli;
+        p->threads = threads;
+        p->pids = pids;
+    }
+    if (++h->npending[k] == HISTORY_FACTOR) {
+        p->rss /= HISTORY_FACTOR;
+        p->cpu_milli /= HISTORY_FACTOR;
+        h->npending[k] = 0;
+        tier_append(h, k + 1, p);
+    }
+}
+
+void history_append(struct history *h, const struct stats_sample *s)
+{
+    if (!h->hdr) {
+        return;
+    }
+    struct history_sample hs = {
+        .time_ns = s->time_ns,
+        .cpu_ns = s->cpu_ns,
+        .rss = s->rss,
+        .rss_max = s->rss,
+        .minflt = s->minflt,
+        .majflt = s->majflt,
+        .read_bytes = s->read_bytes,
+        .write_bytes = s->write_bytes,
+        .cpu_milli = s->cpu_milli,
+        .threads = s->threads,
+        .pids = s->pids,
+    };
+
+    /* Sequence count: odd while the rings change */
+    uint64_t seq = h->hdr->seq;
+    __atomic_store_n(&h->hdr->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    tier_append(h, 0, &hs);
+    __atomic_store_n(&h->hdr->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void history_close(struct history *h)
+{
+    if (h->map) {
+        munmap(h->map, h->size);
+        h->map = NULL;
+        h->hdr = NULL;
+    }
+    if (h->fd >= 0) {
+        close(h->fd);
+        h->fd = -1;
+    }
+}
+
+void history_remove(const char *base_dir, const char *container_id)
+{
+    char path[PATH_MAX];
+    if (history_path(base_dir, container_id, path, sizeof(path)) == 0) {
+        unlink(path);
+    }
+}
+
+/* ----- Reader ----- */
+
+/* A consistent copy of the file, taken while no append is in progress */
+static void *snapshot(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct history_header)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    void *map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *copy = malloc(*size);
+    const struct history_header *hdr = map;
+    for (int tries = 0; copy && tries < HISTORY_READ_TRIES; tries++) {
+        uint64_t before = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+        if ((before & 1) == 0) {
+            memcpy(copy, map, *size);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == before) {
+                munmap(map, *size);
+                return copy;
+            }
+        }
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+    }
+    munmap(map, *size);
+    free(copy);
+    errno = EAGAIN;
+    return NULL;
+}
+
+int history_read(const char *base_dir, const char *container_id, int64_t since_ns,
+                 struct history_sample **out)
+{
+    char path[PATH_MAX];
+    if (history_path(base_dir, container_id, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    size_t size;
+    char *data = snapshot(path, &size);
+    if (!data) {
+        return -1;
+    }
+
+    const struct history_header *hdr = (const struct history_header *)data;
+    int valid = memcmp(hdr->magic, HISTORY_MAGIC, sizeof(hdr->magic)) == 0 &&
+                hdr->sample_size == sizeof(struct history_sample) && hdr->ntiers == HISTORY_TIERS;
+    size_t total = 0;
+    for (int k = 0; valid && k < HISTORY_TIERS; k++) {
+        const struct history_tier *t = &hdr->tiers[k];
+        valid = t->capacity > 0 &&
+                t->offset + (uint64_t)t->capacity * sizeof(struct history_sample) <= size;
+        total += t->capacity;
+    }
+    if (!valid) {
+        free(data);
+        errno = EINVAL;
+        return -1;
+    }
+
+    *out = malloc((total ? total : 1) * sizeof(**out));
+    if (!*out) {
+        free(data);
+        return -1;
+    }
+
+    /*
+     * Each tier fills the stretch before the oldest sample of the finer
+     * ones; the coarsest goes first so the result is in time order.
+     */
+    int64_t covered[HISTORY_TIERS + 1];
+    covered[0] = INT64_MAX;
+    for (int k = 0; k < HISTORY_TIERS; k++) {
+        const struct history_tier *t = &hdr->tiers[k];
+        uint64_t first = t->written > t->capacity ? t->written - t->capacity : 0;
+        const struct history_sample *oldest = (const struct history_sample *)
+            (data + t->offset + (first % t->capacity) * sizeof(struct history_sample));
+        covered[k + 1] = (t->written > 0 && oldest->time_ns < covered[k]) ? oldest->time_ns : covered[k];
+    }
+
+    int count = 0;
+    for (int k = HISTORY_TIERS - 1; k >= 0; k--) {
+        const struct history_tier *t = &hdr->tiers[k];
+        uint64_t first = t->written > t->capacity ? t->written - t->capacity : 0;
+        for (uint64_t i = first; i < t->written; i++) {
+            const struct history_sample *s = (const struct history_sample *)
+                (data + t->offset + (i % t->capacity) * sizeof(struct history_sample));
+            if (s->time_ns >= since_ns && s->time_ns < covered[k]) {
+                (*out)[count++] = *s;
+            }
+        }
+    }
+    free(data);
+    return count;
+}
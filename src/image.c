@@ -10,6 +10,8 @@
 #include "fsutil.h"
 #include "timeutil.h"
 #include "log.h"
+#include "record.h"
+#include "shard.h"
 #include <linux/limits.h>
 
 
@@ -24,18 +26,18 @@ static int ensure_file_exists(const char *path)
     return 0;
 }
 
+/* State root this process has already set up; mdockd serves many commands from one */
+static char home_ready[PATH_MAX];
+
 int mdock_init_home(char *out_base_dir, size_t size)
 {
-    char home[PATH_MAX];
-    if (mdock_get_home(home, sizeof(home)) != 0) {
-        return -1;
-    }
-
     char base_dir[PATH_MAX];
-    if (snprintf(base_dir, sizeof(base_dir), "%s/.mdock", home) >= (int)sizeof(base_dir)) {
-        fprintf(stderr, "[mdock] base dir path too long\n");
+    if (mdock_get_root(base_dir, sizeof(base_dir)) != 0) {
         return -1;
     }
+    if (strcmp(base_dir, home_ready) == 0) {
+        goto done;
+    }
 
     if (ensure_dir_exists(base_dir, 0755) != 0) {
         return -1;
@@ -66,7 +68,9 @@ int mdock_init_home(char *out_base_dir, size_t size)
     if (ensure_file_exists(images_db) != 0) return -1;
     if (ensure_file_exists(containers_db) != 0) return -1;
     if (ensure_file_exists(log_file) != 0) return -1;
+    strcpy(home_ready, base_dir);
 
+done:
     /* Return base_dir to caller */
     if (strlen(base_dir) + 1 > size) {
         fprintf(stderr, "[mdock] out_base_dir buffer too small\n");
@@ -80,7 +84,8 @@ int mdock_init_home(char *out_base_dir, size_t size)
 
 static int add_image_record(const char *base_dir,
                             const char *image_name,
-                            const char *rootfs_path)
+                            const char *rootfs_path,
+                            const char *shard)
 {
     char db_path[PATH_MAX];
     if (snprintf(db_path, sizeof(db_path), "%s/images.db", base_dir) >= (int)sizeof(db_path)) {
@@ -88,19 +93,27 @@ static int add_image_record(const char *base_dir,
         return -1;
     }
 
+    int lock = db_lock(db_path);
+    if (lock < 0) {
+        return -1;
+    }
+
     FILE *f = fopen(db_path, "a");
     if (!f) {
         perror("[mdock] fopen images.db");
+        db_unlock(lock);
         return -1;
     }
 
-    char ts[32];
-    if (mdock_current_timestamp(ts, sizeof(ts)) != 0) {
-        snprintf(ts, sizeof(ts), "0000-00-00T00:00:00");
-    }
+    struct image_record rec;
+    snprintf(rec.name, sizeof(rec.name), "%s", image_name);
+    snprintf(rec.rootfs, sizeof(rec.rootfs), "%s", rootfs_path);
+    snprintf(rec.shard, sizeof(rec.shard), "%s", shard);
+    rec.created_ns = mdock_realtime_ns();
 
-    fprintf(f, "%s|%s|%s\n", image_name, rootfs_path, ts);
+    image_record_write(f, &rec);
     fclose(f);
+    db_unlock(lock);
     return 0;
 }
 
@@ -115,40 +128,35 @@ int find_image_rootfs(const char *base_dir,
         return -1;
     }
 
-    FILE *f = fopen(db_path, "r");
-    if (!f) {
-        perror("[mdock] fopen images.db");
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
+        perror("[mdock] open images.db");
         return -1;
     }
 
-    char line[4096];
+    struct db_scanner s;
+    struct db_row row;
     int found = 0;
 
-    while (fgets(line, sizeof(line), f)) {
-        /* Format: image_name|rootfs_path|created_at */
-        char *p1 = strchr(line, '|');
-        if (!p1) continue;
-        *p1 = '\0';
-        char *name = line;
-
-        char *p2 = strchr(p1 + 1, '|');
-        if (!p2) continue;
-        *p2 = '\0';
-        char *rootfs = p1 + 1;
-
-        if (strcmp(name, image_name) == 0) {
-            if (strlen(rootfs) + 1 > out_size) {
-                fprintf(stderr, "[mdock] rootfs path too long for buffer\n");
-                fclose(f);
-                return -1;
-            }
-            strcpy(out_path, rootfs);
-            found = 1;
-            break;
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        /* Format: image_name|rootfs_path|created_ns */
+        if (row.nfields < IF_REQUIRED || !db_field_eq(&row.fields[IF_NAME], image_name)) {
+            continue;
+        }
+
+        const struct db_field *rootfs = &row.fields[IF_ROOTFS];
+        if (rootfs->len + 1 > out_size) {
+            fprintf(stderr, "[mdock] rootfs path too long for buffer\n");
+            db_map_close(&map);
+            return -1;
         }
+        db_field_copy(rootfs, out_path, out_size);
+        found = 1;
+        break;
     }
 
-    fclose(f);
+    db_map_close(&map);
     return found ? 0 : -1;
 }
 
@@ -196,24 +204,25 @@ static int image_exists(const char *base_dir, const char *image_name)
         return 0;
     }
 
-    FILE *f = fopen(db_path, "r");
-    if (!f) {
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
         return 0;
     }
 
-    char line[4096];
-    while (fgets(line, sizeof(line), f)) {
-        char *p = strchr(line, '|');
-        if (!p) continue;
-        *p = '\0';
-        if (strcmp(line, image_name) == 0) {
-            fclose(f);
-            return 1;
+    struct db_scanner s;
+    struct db_row row;
+    int exists = 0;
+
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        if (row.nfields > 1 && db_field_eq(&row.fields[IF_NAME], image_name)) {
+            exists = 1;
+            break;
         }
     }
 
-    fclose(f);
-    return 0;
+    db_map_close(&map);
+    return exists;
 }
 
 int cmd_build(int argc, char **argv)
@@ -257,8 +266,27 @@ int cmd_build(int argc, char **argv)
         return 1;
     }
 
+    /* Place the rootfs on one of the configured data directories */
+    struct shard_set shards;
+    if (shard_load(base_dir, &shards) != 0) {
+        return 1;
+    }
+    const char *shard = shard_place(&shards, image_name);
+    if (!shard) {
+        return 1;
+    }
+
+    char images_dir[PATH_MAX];
+    if (snprintf(images_dir, sizeof(images_dir), "%s/images", shard) >= (int)sizeof(images_dir)) {
+        fprintf(stderr, "[mdock] images dir path too long\n");
+        return 1;
+    }
+    if (ensure_dir_exists(images_dir, 0755) != 0) {
+        return 1;
+    }
+
     char image_dir[PATH_MAX];
-    if (snprintf(image_dir, sizeof(image_dir), "%s/images/%s", base_dir, image_name) >= (int)sizeof(image_dir)) {
+    if (snprintf(image_dir, sizeof(image_dir), "%s/%s", images_dir, image_name) >= (int)sizeof(image_dir)) {
         fprintf(stderr, "[mdock] image dir path too long\n");
         return 1;
     }
@@ -277,7 +305,7 @@ int cmd_build(int argc, char **argv)
         return 1;
     }
 
-    if (add_image_record(base_dir, image_name, dest_rootfs) != 0) {
+    if (add_image_record(base_dir, image_name, dest_rootfs, shard_label(base_dir, shard)) != 0) {
         fprintf(stderr, "[mdock] failed to update images.db\n");
         return 1;
     }
@@ -304,13 +332,13 @@ int cmd_images(int argc, char *argv[])
         return 1;
     }
 
-    FILE *fp = fopen(db_path, "r");
-    if (!fp) {
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
         if (errno == ENOENT) {
             printf("No images found.\n");
             return 0;
         }
-        perror("[mdock] fopen images.db");
+        perror("[mdock] open images.db");
         return 1;
     }
 
@@ -318,16 +346,18 @@ int cmd_images(int argc, char *argv[])
     printf("%-20s %-15s %-20s\n", "IMAGE", "SIZE", "CREATED");
     printf("%-20s %-15s %-20s\n", "-----", "----", "-------");
 
-    char line[1024];
-    while (fgets(line, sizeof(line), fp)) {
-        // Parse: image_name|rootfs_path|timestamp
-        char image_name[256];
-        char rootfs_path[PATH_MAX];
-        char timestamp[64];
+    struct db_scanner s;
+    struct db_row row;
+    struct image_record rec;
 
-        if (sscanf(line, "%255[^|]|%4095[^|]|%63[^\n]", image_name, rootfs_path, timestamp) != 3) {
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        // Parse: image_name|rootfs_path|created_ns
+        if (image_record_parse(&row, &rec) != 0) {
             continue;  // Skip malformed lines
         }
+        const char *image_name = rec.name;
+        const char *rootfs_path = rec.rootfs;
 
         // Calculate image size
         char size_str[32] = "N/A";
@@ -344,20 +374,18 @@ int cmd_images(int argc, char *argv[])
             }
         }
 
-        // Format timestamp (just show date part for brevity)
-        char created_str[32];
-        if (strlen(timestamp) >= 19) {
-            // Extract date from "2024-12-24T10:30:15"
+        // Format timestamp (drop the milliseconds for brevity)
+        char timestamp[MDOCK_TIME_MAX];
+        char created_str[32] = "N/A";
+        if (rec.created_ns > 0 && mdock_format_time(rec.created_ns, timestamp, sizeof(timestamp)) == 0) {
+            // Split "2024-12-24T10:30:15.123" into date and time
             snprintf(created_str, sizeof(created_str), "%.10s %.8s", timestamp, timestamp + 11);
-        } else {
-            strncpy(created_str, timestamp, sizeof(created_str) - 1);
-            created_str[sizeof(created_str) - 1] = '\0';
         }
 
         printf("%-20s %-15s %-20s\n", image_name, size_str, created_str);
     }
 
-    fclose(fp);
+    db_map_close(&map);
     return 0;
 }
 
@@ -368,25 +396,43 @@ int image_in_use(const char *base_dir, const char *image_name)
         return 0;  // Assume not in use if path too long
     }
 
-    FILE *fp = fopen(db_path, "r");
-    if (!fp) {
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0) {
         return 0;  // No containers exist
     }
 
-    char line[1024];
-    while (fgets(line, sizeof(line), fp)) {
+    struct db_scanner s;
+    struct db_row row;
+    int in_use = 0;
+
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
         // Parse: container_id|pid|image|status|start_time|end_time|exit_code
-        char container_image[256];
-        if (sscanf(line, "%*[^|]|%*[^|]|%255[^|]", container_image) == 1) {
-            if (strcmp(container_image, image_name) == 0) {
-                fclose(fp);
-                return 1;  // Image is in use
-            }
+        if (row.nfields > CF_IMAGE && db_field_eq(&row.fields[CF_IMAGE], image_name)) {
+            in_use = 1;  // Image is in use
+            break;
         }
     }
 
-    fclose(fp);
-    return 0;  // Not in use
+    db_map_close(&map);
+    return in_use;
+}
+
+struct image_removal {
+    const char *image_name;
+    char rootfs[PATH_MAX];
+};
+
+static int drop_image_row(const struct db_row *row, FILE *out, void *arg)
+{
+    struct image_removal *r = arg;
+    (void)out;
+
+    if (row->nfields < IF_REQUIRED || !db_field_eq(&row->fields[IF_NAME], r->image_name)) {
+        return 0;
+    }
+    db_field_copy(&row->fields[IF_ROOTFS], r->rootfs, sizeof(r->rootfs));
+    return 1;  // Skip this line (delete it)
 }
 
 int cmd_rmi(int argc, char *argv[])
@@ -417,49 +463,18 @@ int cmd_rmi(int argc, char *argv[])
         return 1;
     }
 
-    FILE *fp = fopen(db_path, "r");
-    if (!fp) {
+    // Rewrite images.db without the target image
+    struct image_removal removal = { .image_name = image_name };
+    int removed = db_rewrite(db_path, drop_image_row, &removal);
+    if (removed < 0) {
         fprintf(stderr, "Error: No images database found.\n");
         return 1;
     }
-
-    // Read all lines, find and remove the target image
-    char lines[1000][1024];
-    int line_count = 0;
-    int found = 0;
-    char rootfs_to_delete[PATH_MAX] = "";
-
-    while (fgets(lines[line_count], sizeof(lines[line_count]), fp) && line_count < 1000) {
-        char current_name[256];
-        char current_rootfs[PATH_MAX];
-        if (sscanf(lines[line_count], "%255[^|]|%4095[^|]", current_name, current_rootfs) == 2) {
-            if (strcmp(current_name, image_name) == 0) {
-                found = 1;
-                strncpy(rootfs_to_delete, current_rootfs, sizeof(rootfs_to_delete) - 1);
-                rootfs_to_delete[sizeof(rootfs_to_delete) - 1] = '\0';
-                continue;  // Skip this line (delete it)
-            }
-        }
-        line_count++;
-    }
-    fclose(fp);
-
-    if (!found) {
+    if (removed == 0) {
         fprintf(stderr, "Error: Image '%s' not found.\n", image_name);
         return 1;
     }
-
-    // Write back without the deleted image
-    fp = fopen(db_path, "w");
-    if (!fp) {
-        perror("[mdock] fopen for writing");
-        return 1;
-    }
-
-    for (int i = 0; i < line_count; i++) {
-        fputs(lines[i], fp);
-    }
-    fclose(fp);
+    const char *rootfs_to_delete = removal.rootfs;
 
     // Delete the rootfs directory
     if (strlen(rootfs_to_delete) > 0) {
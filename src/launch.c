@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "launch.h"
+#include "timeutil.h"
+
+/*
+ * The default path is clone(CLONE_VM | CLONE_VFORK): the child borrows the
+ * parent's address space until it execs, so nothing is copied no matter
+ * how large the caller is, and the parent resumes only after the exec (or
+ * the failure) has happened. The child therefore runs on its own stack,
+ * with every signal blocked until it has reset the handlers it inherited,
+ * and reports a failure through shared memory instead of a pipe.
+ */
+#define LAUNCH_STACK_SIZE (64 * 1024)
+
+static char launch_stack[LAUNCH_STACK_SIZE] __attribute__((aligned(16)));
+
+struct launch_child {
+    const struct launch_spec *spec;
+    const sigset_t *parent_mask;
+    int status_fd;          /* fork path: CLOEXEC pipe to the parent */
+    volatile int err;       /* clone path: written by the child before _exit */
+    struct launch_trace *trace;     /* memory the parent sees, NULL when not tracing */
+};
+
+const char *const launch_phase_names[LAUNCH_PHASE_COUNT] = {
+    [LAUNCH_PHASE_CLONE]    = "clone",
+    [LAUNCH_PHASE_SIGNALS]  = "child_signals",
+    [LAUNCH_PHASE_CGROUP]   = "child_cgroup_join",
+    [LAUNCH_PHASE_BIND]     = "child_cpu_numa_bind",
+    [LAUNCH_PHASE_PRIORITY] = "child_priority",
+    [LAUNCH_PHASE_MEMORY]   = "child_memory",
+    [LAUNCH_PHASE_LOG]      = "child_log_redirect",
+    [LAUNCH_PHASE_RLIMIT]   = "child_setrlimit",
+    [LAUNCH_PHASE_CHDIR]    = "child_chdir",
+    [LAUNCH_PHASE_EXECVE]   = "execve",
+};
+
+static inline void launch_mark(struct launch_child *c, enum launch_phase phase)
+{
+    if (c->trace) {
+        c->trace->end_ns[phase] = mdock_monotonic_ns();
+    }
+}
+
+/* ioprio_set() has no glibc wrapper; these mirror linux/ioprio.h */
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_CLASS_RT     1
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_WHO_PROCESS  1
+
+void launch_priority_init(struct launch_priority *prio)
+{
+    prio->nice = LAUNCH_UNSET;
+    prio->policy = -1;
+    prio->ioprio = -1;
+    prio->oom_score_adj = LAUNCH_UNSET;
+}
+
+int launch_priority_any(const struct launch_priority *prio)
+{
+    return prio->nice != LAUNCH_UNSET || prio->policy >= 0 || prio->ioprio >= 0 ||
+           prio->oom_score_adj != LAUNCH_UNSET;
+}
+
+int launch_parse_sched(const char *name)
+{
+    if (strcmp(name, "other") == 0) {
+        return SCHED_OTHER;
+    } else if (strcmp(name, "batch") == 0) {
+        return SCHED_BATCH;
+    } else if (strcmp(name, "idle") == 0) {
+        return SCHED_IDLE;
+    }
+    return -1;
+}
+
+const char *launch_sched_name(int policy)
+{
+    switch (policy) {
+    case SCHED_OTHER: return "other";
+    case SCHED_BATCH: return "batch";
+    case SCHED_IDLE:  return "idle";
+    }
+    return "";
+}
+
+int launch_parse_ioprio(const char *str)
+{
+    int class;
+    const char *level = NULL;
+    if (strncmp(str, "rt:", 3) == 0) {
+        class = IOPRIO_CLASS_RT;
+        level = str + 3;
+    } else if (strncmp(str, "be:", 3) == 0) {
+        class = IOPRIO_CLASS_BE;
+        level = str + 3;
+    } else if (strcmp(str, "idle") == 0 || strcmp(str, "idle:0") == 0) {
+        return IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    } else {
+        return -1;
+    }
+    if (level[0] < '0' || level[0] > '7' || level[1] != '\0') {
+        return -1;
+    }
+    return (class << IOPRIO_CLASS_SHIFT) | (level[0] - '0');
+}
+
+int launch_format_ioprio(int ioprio, char *buf, size_t size)
+{
+    int class = ioprio >> IOPRIO_CLASS_SHIFT;
+    int level = ioprio & ((1 << IOPRIO_CLASS_SHIFT) - 1);
+    int n;
+    if (class == IOPRIO_CLASS_RT) {
+        n = snprintf(buf, size, "rt:%d", level);
+    } else if (class == IOPRIO_CLASS_BE) {
+        n = snprintf(buf, size, "be:%d", level);
+    } else if (class == IOPRIO_CLASS_IDLE) {
+        n = snprintf(buf, size, "idle");
+    } else {
+        return -1;
+    }
+    return n >= (int)size ? -1 : 0;
+}
+
+/* Newer than some installed headers */
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE 67
+#endif
+#ifndef PR_THP_DISABLE_EXCEPT_ADVISED
+#define PR_THP_DISABLE_EXCEPT_ADVISED (1 << 1)
+#endif
+
+int launch_memory_any(const struct launch_memory *mem)
+{
+    return mem->thp != LAUNCH_THP_INHERIT || mem->ksm || mem->mlock_all;
+}
+
+int launch_parse_thp(const char *name)
+{
+    if (strcmp(name, "never") == 0) {
+        return LAUNCH_THP_NEVER;
+    } else if (strcmp(name, "madvise") == 0) {
+        return LAUNCH_THP_MADVISE;
+    } else if (strcmp(name, "always") == 0) {
+        return LAUNCH_THP_ALWAYS;
+    }
+    return -1;
+}
+
+const char *launch_thp_name(enum launch_thp thp)
+{
+    switch (thp) {
+    case LAUNCH_THP_NEVER:   return "never";
+    case LAUNCH_THP_MADVISE: return "madvise";
+    case LAUNCH_THP_ALWAYS:  return "always";
+    case LAUNCH_THP_INHERIT: break;
+    }
+    return "";
+}
+
+/* Tell the parent why the container never started, then give up */
+static void launch_fail(struct launch_child *c, const char *what)
+{
+    int err = errno;
+    perror(what);
+    if (c->status_fd >= 0) {
+        ssize_t n = write(c->status_fd, &err, sizeof(err));
+        (void)n;
+    } else {
+        c->err = err;
+    }
+    _exit(1);
+}
+
+static int launch_child_main(void *arg)
+{
+    struct launch_child *c = arg;
+    const struct launch_spec *spec = c->spec;
+    launch_mark(c, LAUNCH_PHASE_CLONE);
+
+    if (c->parent_mask) {
+        /* Handlers of the parent must not run on its memory from here */
+        for (int sig = 1; sig < NSIG; sig++) {
+            struct sigaction sa;
+            if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL) {
+                sa.sa_handler = SIG_DFL;
+                sa.sa_flags = 0;
+                sigaction(sig, &sa, NULL);
+            }
+        }
+        sigprocmask(SIG_SETMASK, c->parent_mask, NULL);
+    }
+
+    if (spec->own_pgrp && setpgid(0, 0) != 0) {
+        launch_fail(c, "[mdock] setpgid");
+    }
+    launch_mark(c, LAUNCH_PHASE_SIGNALS);
+
+    /* Join the container's cgroup before anything is charged to the caller's */
+    if (spec->cgroup_procs) {
+        int cg_fd = open(spec->cgroup_procs, O_WRONLY | O_CLOEXEC);
+        if (cg_fd == -1 || write(cg_fd, "0", 1) != 1) {
+            launch_fail(c, "[mdock] join cgroup");
+        }
+        close(cg_fd);
+    }
+    launch_mark(c, LAUNCH_PHASE_CGROUP);
+
+    /* Pin before exec so the program's first allocations land on the right node */
+    if (spec->cpuset && sched_setaffinity(0, sizeof(*spec->cpuset), spec->cpuset) != 0) {
+        launch_fail(c, "[mdock] sched_setaffinity");
+    }
+    if (spec->mem_nodes &&
+        syscall(SYS_set_mempolicy, MPOL_BIND, spec->mem_nodes, spec->mem_maxnode + 1) != 0) {
+        launch_fail(c, "[mdock] set_mempolicy");
+    }
+    launch_mark(c, LAUNCH_PHASE_BIND);
+
+    /* Scheduling, I/O and OOM priority; everything the program forks inherits them */
+    const struct launch_priority *prio = spec->prio;
+    if (prio && prio->oom_score_adj != LAUNCH_UNSET) {
+        char value[16];
+        int len = snprintf(value, sizeof(value), "%d", prio->oom_score_adj);
+        int oom_fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+        if (oom_fd == -1 || write(oom_fd, value, (size_t)len) != len) {
+            launch_fail(c, "[mdock] oom_score_adj");
+        }
+        close(oom_fd);
+    }
+    if (prio && prio->policy >= 0) {
+        struct sched_param param = { 0 };
+        if (sched_setscheduler(0, prio->policy, &param) != 0) {
+            launch_fail(c, "[mdock] sched_setscheduler");
+        }
+    }
+    if (prio && prio->nice != LAUNCH_UNSET && setpriority(PRIO_PROCESS, 0, prio->nice) != 0) {
+        launch_fail(c, "[mdock] setpriority");
+    }
+    if (prio && prio->ioprio >= 0 &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio->ioprio) != 0) {
+        launch_fail(c, "[mdock] ioprio_set");
+    }
+    launch_mark(c, LAUNCH_PHASE_PRIORITY);
+
+    const struct launch_memory *mem = spec->memory;
+    if (mem && mem->thp != LAUNCH_THP_INHERIT) {
+        unsigned long disable = mem->thp != LAUNCH_THP_ALWAYS;
+        unsigned long flags = mem->thp == LAUNCH_THP_MADVISE ? PR_THP_DISABLE_EXCEPT_ADVISED : 0;
+        if (prctl(PR_SET_THP_DISABLE, disable, flags, 0, 0) != 0) {
+            launch_fail(c, "[mdock] prctl PR_SET_THP_DISABLE");
+        }
+    }
+    if (mem && mem->ksm && prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0) != 0) {
+        launch_fail(c, "[mdock] prctl PR_SET_MEMORY_MERGE");
+    }
+    if (mem && mem->mlock_all) {
+        struct rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY };
+        if (setrlimit(RLIMIT_MEMLOCK, &unlimited) != 0) {
+            launch_fail(c, "[mdock] setrlimit RLIMIT_MEMLOCK");
+        }
+    }
+    launch_mark(c, LAUNCH_PHASE_MEMORY);
+
+    /* Redirect stdout and stderr to log file */
+    int log_fd = open(spec->log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd >= 0) {
+        dup2(log_fd, STDOUT_FILENO);
+        dup2(log_fd, STDERR_FILENO);
+        close(log_fd);
+    }
+    launch_mark(c, LAUNCH_PHASE_LOG);
+
+    /* Set resource limits if specified */
+    if (spec->mem_limit > 0) {
+        struct rlimit mem_rlimit = { (rlim_t)spec->mem_limit, (rlim_t)spec->mem_limit };
+        if (setrlimit(RLIMIT_AS, &mem_rlimit) != 0) {
+            perror("[mdock] setrlimit RLIMIT_AS");
+            fprintf(stderr, "[mdock] warning: failed to set memory limit, continuing anyway\n");
+        }
+    }
+    if (spec->cpu_limit > 0) {
+        struct rlimit cpu_rlimit = { (rlim_t)spec->cpu_limit, (rlim_t)spec->cpu_limit };
+        if (setrlimit(RLIMIT_CPU, &cpu_rlimit) != 0) {
+            perror("[mdock] setrlimit RLIMIT_CPU");
+            fprintf(stderr, "[mdock] warning: failed to set CPU limit, continuing anyway\n");
+        }
+    }
+    launch_mark(c, LAUNCH_PHASE_RLIMIT);
+
+    /* Change directory to rootfs */
+    if (chdir(spec->rootfs) != 0) {
+        launch_fail(c, "[mdock] chdir");
+    }
+    launch_mark(c, LAUNCH_PHASE_CHDIR);
+
+    execve(spec->path, spec->argv, spec->envp);
+    if (spec->fallback_path) {
+        execve(spec->fallback_path, spec->argv, spec->envp);
+    }
+    launch_fail(c, "[mdock] execve");
+    return 1;
+}
+
+static pid_t launch_clone(const struct launch_spec *spec, int *exec_errno)
+{
+    sigset_t all, old;
+    sigfillset(&all);
+    sigprocmask(SIG_SETMASK, &all, &old);
+
+    struct launch_child c = { spec, &old, -1, 0, spec->trace };
+    pid_t pid = clone(launch_child_main, launch_stack + sizeof(launch_stack),
+                      CLONE_VM | CLONE_VFORK | SIGCHLD, &c);
+    int saved = errno;
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    errno = saved;
+    if (pid != -1) {
+        *exec_errno = c.err;
+    }
+    return pid;
+}
+
+static pid_t launch_fork(const struct launch_spec *spec, int *exec_errno)
+{
+    /* The write end closes on a successful exec, so EOF means "running" */
+    int status_pipe[2];
+    if (pipe2(status_pipe, O_CLOEXEC) == -1) {
+        perror("[mdock] pipe2");
+        return -1;
+    }
+
+    /* The child's copy of the trace would be lost: it writes to a shared page */
+    struct launch_trace *shared = NULL;
+    if (spec->trace) {
+        shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (shared == MAP_FAILED) {
+            shared = NULL;
+        }
+    }
+
+    fflush(NULL);   /* don't let the child inherit buffered output */
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("[mdock] fork");
+        close(status_pipe[0]);
+        close(status_pipe[1]);
+        if (shared) {
+            munmap(shared, sizeof(*shared));
+        }
+        return -1;
+    }
+    if (pid == 0) {
+        struct launch_child c = { spec, NULL, status_pipe[1], 0, shared };
+        close(status_pipe[0]);
+        launch_child_main(&c);
+    }
+
+    close(status_pipe[1]);
+    int err = 0;
+    ssize_t n;
+    while ((n = read(status_pipe[0], &err, sizeof(err))) == -1 && errno == EINTR) {
+    }
+    close(status_pipe[0]);
+    if (shared) {
+        memcpy(spec->trace->end_ns, shared->end_ns, sizeof(shared->end_ns));
+        munmap(shared, sizeof(*shared));
+    }
+
+    *exec_errno = (n == (ssize_t)sizeof(err)) ? err : 0;
+    return pid;
+}
+
+static pid_t launch_start(const struct launch_spec *spec, int *exec_errno)
+{
+    if (spec->mode == LAUNCH_FORK) {
+        return launch_fork(spec, exec_errno);
+    }
+
+    pid_t pid = launch_clone(spec, exec_errno);
+    if (pid == -1 && (errno == ENOSYS || errno == EPERM || errno == EINVAL)) {
+        /* Sandboxes that filter clone() flags still allow a plain fork */
+        return launch_fork(spec, exec_errno);
+    }
+    if (pid == -1) {
+        perror("[mdock] clone");
+    }
+    return pid;
+}
+
+pid_t launch_container(const struct launch_spec *spec, int *exec_errno)
+{
+    *exec_errno = 0;
+    if (!spec->trace) {
+        return launch_start(spec, exec_errno);
+    }
+
+    memset(spec->trace, 0, sizeof(*spec->trace));
+    spec->trace->start_ns = mdock_monotonic_ns();
+    pid_t pid = launch_start(spec, exec_errno);
+    if (pid != -1 && *exec_errno == 0) {
+        spec->trace->end_ns[LAUNCH_PHASE_EXECVE] = mdock_monotonic_ns();
+    }
+    return pid;
+}
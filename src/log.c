@@ -9,13 +9,13 @@
 
 int mdock_logf(const char *fmt, ...)
 {
-    char home[PATH_MAX];
-    if (mdock_get_home(home, sizeof(home)) != 0) {
+    char root[PATH_MAX];
+    if (mdock_get_root(root, sizeof(root)) != 0) {
         return -1;
     }
 
     char log_path[PATH_MAX];
-    if (snprintf(log_path, sizeof(log_path), "%s/.mdock/log.txt", home) >= (int)sizeof(log_path)) {
+    if (snprintf(log_path, sizeof(log_path), "%s/log.txt", root) >= (int)sizeof(log_path)) {
         fprintf(stderr, "[mdock] log path too long\n");
         return -1;
     }
@@ -27,9 +27,9 @@ int mdock_logf(const char *fmt, ...)
     }
 
     char ts[32];
-    if (mdock_current_timestamp(ts, sizeof(ts)) != 0) {
+    if (mdock_format_time(mdock_realtime_ns(), ts, sizeof(ts)) != 0) {
         /* fallback timestamp */
-        snprintf(ts, sizeof(ts), "0000-00-00T00:00:00");
+        snprintf(ts, sizeof(ts), "0000-00-00T00:00:00.000");
     }
 
     fprintf(f, "[%s] ", ts);
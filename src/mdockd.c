@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "commands.h"
+#include "container.h"
+#include "fsutil.h"
+#include "image.h"
+#include "log.h"
+#include "protocol.h"
+#include "record.h"
+
+/*
+ * mdockd: serves mdock commands over <root>/mdockd.sock.
+ *
+ * Quick commands run one at a time inside this process, reusing the state
+ * root setup and the .db mappings between commands. Commands that can
+ * take long (build, rmi, pool, scheduler, jobs prune) run in a forked
+ * worker instead so they never hold up the others. Either way the command
+ * writes to the client's own stdout and stderr, passed along with the
+ * request, and sees the client's MDOCK_* variables instead of the
+ * daemon's. Output of an in-process command to a pipe or socket goes to a
+ * memfd that the client copies out after MSG_EXIT, so a reader that stops
+ * draining never blocks the daemon.
+ * A foreground `run` waits for its containers, so it always runs in the
+ * client; what the daemon forks itself is reaped here on SIGCHLD.
+ */
+
+#define CLIENT_TIMEOUT_SEC 5
+
+static int wake_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    int saved = errno;
+    if (sig != SIGCHLD) {
+        stop_requested = 1;
+    }
+    ssize_t n = write(wake_pipe[1], "x", 1);
+    (void)n;
+    errno = saved;
+}
+
+static int install_signals(void)
+{
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("[mdockd] pipe2");
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1 ||
+        sigaction(SIGINT, &sa, NULL) == -1 ||
+        sigaction(SIGTERM, &sa, NULL) == -1) {
+        perror("[mdockd] sigaction");
+        return -1;
+    }
+    return 0;
+}
+
+/* Collect the daemon's own children, e.g. the first fork of a monitor or zygote */
+static void reap_children(void)
+{
+    char buf[64];
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+    }
+}
+
+static int open_listener(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "[mdockd] socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("[mdockd] socket");
+        return -1;
+    }
+
+    /* A socket file nobody answers on is left over from a daemon that died */
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "[mdockd] another daemon is already serving %s\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    /* Only the owner may send commands */
+    mode_t old_mask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc == -1 || listen(fd, 128) == -1) {
+        fprintf(stderr, "[mdockd] bind %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* ----- Running a command ----- */
+
+static int send_error(int client, const char *msg)
+{
+    struct msg_exit ex = { .status = 1, .buffered = 0 };
+    if (msg_send(client, MSG_STDERR, msg, strlen(msg)) != 0) {
+        return -1;
+    }
+    return msg_send(client, MSG_EXIT, &ex, sizeof(ex));
+}
+
+struct saved_stdio {
+    int out;    /* the daemon's own stdout/stderr */
+    int err;
+};
+
+static int save_stdio(struct saved_stdio *saved)
+{
+    saved->out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    saved->err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (saved->out == -1 || saved->err == -1) {
+        perror("[mdockd] dup stdio");
+        return -1;
+    }
+    return 0;
+}
+
+extern char **environ;
+
+/* The daemon's own MDOCK_* variables, put back after each in-process command */
+static char **daemon_env;
+static int daemon_env_count;
+
+/* Make vars the only MDOCK_* variables of this process */
+static void set_mdock_env(char **vars, int count)
+{
+    for (;;) {
+        char **e = environ;
+        while (*e && strncmp(*e, "MDOCK_", 6) != 0) {
+            e++;
+        }
+        if (!*e) {
+            break;
+        }
+        char name[256];
+        size_t len = strcspn(*e, "=");
+        if (len >= sizeof(name)) {
+            len = sizeof(name) - 1;
+        }
+        memcpy(name, *e, len);
+        name[len] = '\0';
+        if (unsetenv(name) != 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        char *eq = strchr(vars[i], '=');
+        if (eq && strncmp(vars[i], "MDOCK_", 6) == 0) {
+            *eq = '\0';
+            setenv(vars[i], eq + 1, 1);
+            *eq = '=';
+        }
+    }
+}
+
+static int save_daemon_env(void)
+{
+    for (char **e = environ; *e; e++) {
+        daemon_env_count += strncmp(*e, "MDOCK_", 6) == 0;
+    }
+    daemon_env = calloc((size_t)daemon_env_count + 1, sizeof(char *));
+    if (!daemon_env) {
+        perror("[mdockd] calloc");
+        return -1;
+    }
+    int n = 0;
+    for (char **e = environ; *e && n < daemon_env_count; e++) {
+        if (strncmp(*e, "MDOCK_", 6) == 0 && !(daemon_env[n++] = strdup(*e))) {
+            perror("[mdockd] strdup");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Commands that can take long get a worker so they do not hold up other clients */
+static int command_runs_long(int argc, char **argv)
+{
+    const char *cmd = argv[1];
+    return strcmp(cmd, "build") == 0 || strcmp(cmd, "rmi") == 0 || strcmp(cmd, "pool") == 0 ||
+           strcmp(cmd, "scheduler") == 0 ||
+           (strcmp(cmd, "jobs") == 0 && argc > 2 && strcmp(argv[2], "prune") == 0);
+}
+
+/* Writing to a pipe or socket nobody drains would block the daemon */
+static int output_may_block(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) != 0 || S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+}
+
+/*
+ * Run the command here, keeping the warm state. A stream that could block
+ * goes to a memfd instead, passed back with MSG_EXIT for the client to copy.
+ */
+static void run_in_process(int client, int argc, char **argv, char **env, int nenv,
+                           const int *out, const struct saved_stdio *saved)
+{
+    static const char *const names[2] = { "mdock-stdout", "mdock-stderr" };
+    struct msg_exit ex = { .status = 1, .buffered = 0 };
+    int target[2] = { out[0], out[1] };
+    int bufs[2];
+    int nbufs = 0;
+    for (int i = 0; i < 2; i++) {
+        if (!output_may_block(out[i])) {
+            continue;
+        }
+        int fd = memfd_create(names[i], MFD_CLOEXEC);
+        if (fd == -1) {
+            perror("[mdockd] memfd_create");
+            send_error(client, "[mdockd] cannot buffer the output\n");
+            goto done;
+        }
+        bufs[nbufs++] = fd;
+        target[i] = fd;
+        ex.buffered |= i == 0 ? MSG_EXIT_STDOUT : MSG_EXIT_STDERR;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(target[0], STDOUT_FILENO);
+    dup2(target[1], STDERR_FILENO);
+    set_mdock_env(env, nenv);
+    ex.status = mdock_dispatch(argc, argv);
+    set_mdock_env(daemon_env, daemon_env_count);
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved->out, STDOUT_FILENO);
+    dup2(saved->err, STDERR_FILENO);
+    msg_send_fds(client, MSG_EXIT, &ex, sizeof(ex), bufs, nbufs);
+
+done:
+    for (int i = 0; i < nbufs; i++) {
+        close(bufs[i]);
+    }
+}
+
+/* Run the command in a forked worker; reap_children() collects it */
+static void run_in_worker(int client, int listener, int argc, char **argv, char **env, int nenv,
+                          const int *out)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("[mdockd] fork");
+        send_error(client, "[mdockd] cannot start a worker\n");
+        return;
+    }
+    if (pid > 0) {
+        return;
+    }
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    close(listener);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    dup2(out[0], STDOUT_FILENO);
+    dup2(out[1], STDERR_FILENO);
+    set_mdock_env(env, nenv);
+    struct msg_exit ex = { .status = mdock_dispatch(argc, argv), .buffered = 0 };
+    fflush(NULL);
+    msg_send(client, MSG_EXIT, &ex, sizeof(ex));
+    _exit(0);
+}
+
+/* ----- Requests ----- */
+
+static void serve_client(int client, int listener, const struct saved_stdio *saved)
+{
+    struct timeval tv = { .tv_sec = CLIENT_TIMEOUT_SEC, .tv_usec = 0 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    struct msg_header hdr;
+    char *payload;
+    int out[MDOCK_PROTO_MAX_FDS];
+    int nout = 0;
+    if (msg_recv_fds(client, &hdr, &payload, out, &nout) != 1) {
+        for (int i = 0; i < nout; i++) {
+            close(out[i]);
+        }
+        return;
+    }
+    char **argv = NULL;
+    if (hdr.type != MSG_CMD || nout != 2) {
+        send_error(client, "[mdockd] unexpected message\n");
+        goto done;
+    }
+
+    /* payload = cwd\0env...\0\0argv...: split it in place */
+    if (hdr.len == 0 || payload[hdr.len - 1] != '\0') {
+        send_error(client, "[mdockd] malformed request\n");
+        goto done;
+    }
+    const char *cwd = payload;
+    const char *end = payload + hdr.len;
+    char *p = payload + strlen(payload) + 1;
+    char *env_start = p;
+    int nenv = 0;
+    while (p < end && *p) {
+        p += strlen(p) + 1;
+        nenv++;
+    }
+    char *argv_start = p + 1;
+    int argc = 0;
+    for (p = argv_start; p < end; p += strlen(p) + 1) {
+        argc++;
+    }
+    /* One array: env entries, NULL, argv entries, NULL */
+    argv = calloc((size_t)nenv + (size_t)argc + 2, sizeof(char *));
+    if (argc < 2 || !argv) {
+        send_error(client, "[mdockd] malformed request\n");
+        goto done;
+    }
+    char **env = argv;
+    p = env_start;
+    for (int i = 0; i < nenv; i++) {
+        env[i] = p;
+        p += strlen(p) + 1;
+    }
+    char **args = argv + nenv + 1;
+    p = argv_start;
+    for (int i = 0; i < argc; i++) {
+        args[i] = p;
+        p += strlen(p) + 1;
+    }
+
+    if (chdir(cwd) != 0) {
+        send_error(client, "[mdockd] cannot enter the client's working directory\n");
+        goto done;
+    }
+    if (command_runs_long(argc, args)) {
+        run_in_worker(client, listener, argc, args, env, nenv, out);
+    } else {
+        run_in_process(client, argc, args, env, nenv, out, saved);
+    }
+    chdir("/");
+
+done:
+    for (int i = 0; i < nout; i++) {
+        close(out[i]);
+    }
+    free(argv);
+    free(payload);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--root <dir>]\n"
+            "\n"
+            "Serve mdock commands for the state root over <root>/%s.\n"
+            "The mdock CLI uses the daemon automatically while it is running.\n",
+            prog, MDOCK_SOCKET_NAME);
+}
+
+int main(int argc, char **argv)
+{
+    static char root[PATH_MAX];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            mdock_set_root(argv[++i]);
+        } else if (strncmp(argv[i], "--root=", 7) == 0) {
+            mdock_set_root(argv[i] + 7);
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        fprintf(stderr, "[mdockd] failed to initialize home directory\n");
+        return 1;
+    }
+
+    /* Requests chdir to the client's cwd, so pin the root to an absolute path */
+    if (!realpath(base_dir, root)) {
+        perror("[mdockd] realpath");
+        return 1;
+    }
+    mdock_set_root(root);
+
+    char sock_path[PATH_MAX];
+    if (mdock_socket_path(sock_path, sizeof(sock_path)) != 0) {
+        return 1;
+    }
+
+    struct saved_stdio saved;
+    if (install_signals() != 0 || save_stdio(&saved) != 0 || save_daemon_env() != 0) {
+        return 1;
+    }
+
+    int listener = open_listener(sock_path);
+    if (listener < 0) {
+        return 1;
+    }
+    if (chdir("/") != 0) {
+        perror("[mdockd] chdir");
+    }
+
+    db_map_cache_enable();
+
+    mdock_logf("DAEMON start pid=%d socket=%s", (int)getpid(), sock_path);
+    fprintf(stderr, "[mdockd] serving %s (pid %d)\n", root, (int)getpid());
+
+    struct pollfd fds[2] = {
+        { .fd = listener, .events = POLLIN },
+        { .fd = wake_pipe[0], .events = POLLIN },
+    };
+
+    while (!stop_requested) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[mdockd] poll");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            reap_children();
+        }
+        if (stop_requested) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+            if (client == -1) {
+                if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                    perror("[mdockd] accept");
+                }
+                continue;
+            }
+            serve_client(client, listener, &saved);
+            close(client);
+        }
+    }
+
+    unlink(sock_path);
+    close(listener);
+    mdock_logf("DAEMON stop pid=%d", (int)getpid());
+    fprintf(stderr, "[mdockd] stopped\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "monitor.h"
+#include "container.h"
+#include "history.h"
+#include "proc.h"
+#include "log.h"
+#include "timeutil.h"
+#include "watchdog.h"
+
+/* Sent once from the monitor to the caller over the report pipe */
+struct monitor_report {
+    int32_t pid;
+    int32_t err;    /* 0 when the container exec'd */
+};
+
+static void send_report(int fd, pid_t pid, int err)
+{
+    struct monitor_report rep = { (int32_t)pid, (int32_t)err };
+    ssize_t n = write(fd, &rep, sizeof(rep));
+    (void)n;
+    close(fd);
+}
+
+int monitor_watch(const char *base_dir, const char *container_id, pid_t pid, int64_t mono_start,
+                  const struct watchdog_limits *wd, struct watchdog_result *res)
+{
+    /*
+     * The caller appends the running record under the containers.db lock,
+     * which record_container_exit() also takes, so the exit always lands
+     * after it.
+     */
+    struct history hist;
+    struct history *hp = NULL;
+    if (wd && wd->history_size > 0) {
+        if (history_create(base_dir, container_id, wd->history_size,
+                           wd->history_interval_ms, &hist) == 0) {
+            hp = &hist;
+        } else {
+            mdock_logf("MONITOR container_id=%s error=history: %s", container_id, strerror(errno));
+        }
+    }
+
+    struct container_exit e = { .container_id = container_id, .pid = pid };
+    int rc = watchdog_wait(container_id, pid, wd, hp, &e.status, res);
+    if (rc != 0) {
+        mdock_logf("MONITOR container_id=%s error=wait4: %s", container_id, strerror(errno));
+    } else {
+        e.duration_ns = mdock_monotonic_ns() - mono_start;
+        e.limit_reason = res->reason;
+        e.cpu_milli = res->cpu_milli;
+        e.usage = &res->ru;
+        record_container_exit(base_dir, &e);
+    }
+    if (hp) {
+        history_close(hp);
+    }
+    return rc;
+}
+
+static void monitor_main(const char *base_dir, const char *container_id,
+                         const struct launch_spec *spec, const struct watchdog_limits *wd,
+                         int detach, int report_fd)
+{
+    if (detach) {
+        proc_detach("mdock-monitor", report_fd);
+    } else {
+        /* The containers.db lock of the caller must not stay held through us */
+        prctl(PR_SET_NAME, "mdock-monitor", 0, 0, 0);
+        proc_close_fds(report_fd);
+    }
+
+    int64_t mono_start = mdock_monotonic_ns();
+    int exec_errno = 0;
+    pid_t pid = launch_container(spec, &exec_errno);
+    if (pid == -1) {
+        send_report(report_fd, -1, errno ? errno : ECHILD);
+        _exit(1);
+    }
+
+    send_report(report_fd, pid, exec_errno);
+
+    struct watchdog_result res;
+    _exit(monitor_watch(base_dir, container_id, pid, mono_start, wd, &res) == 0 ? 0 : 1);
+}
+
+int monitor_start(const char *base_dir,
+                  const char *container_id,
+                  const struct launch_spec *spec,
+                  const struct watchdog_limits *wd,
+                  int detach,
+                  pid_t *out_pid,
+                  pid_t *out_monitor)
+{
+    int report[2];
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        perror("[mdock] pipe2");
+        return -1;
+    }
+
+    fflush(NULL);
+    pid_t middle = fork();
+    if (middle == -1) {
+        perror("[mdock] fork");
+        close(report[0]);
+        close(report[1]);
+        return -1;
+    }
+
+    if (middle == 0) {
+        close(report[0]);
+        if (!detach) {
+            /* A foreground monitor keeps the caller's session and stdin */
+            monitor_main(base_dir, container_id, spec, wd, 0, report[1]);
+        }
+        /* Fork again and exit so the monitor is reparented and never a zombie of ours */
+        pid_t monitor = fork();
+        if (monitor == -1) {
+            send_report(report[1], -1, errno);
+            _exit(1);
+        }
+        if (monitor == 0) {
+            monitor_main(base_dir, container_id, spec, wd, 1, report[1]);
+        }
+        _exit(0);
+    }
+
+    close(report[1]);
+    if (detach) {
+        while (waitpid(middle, NULL, 0) == -1 && errno == EINTR) {
+        }
+    } else {
+        *out_monitor = middle;
+    }
+
+    struct monitor_report rep;
+    ssize_t n;
+    while ((n = read(report[0], &rep, sizeof(rep))) == -1 && errno == EINTR) {
+    }
+    close(report[0]);
+
+    if (n != (ssize_t)sizeof(rep)) {
+        fprintf(stderr, "[mdock] container monitor exited before starting %s\n", container_id);
+        return -1;
+    }
+    *out_pid = rep.pid;
+    if (rep.err != 0) {
+        fprintf(stderr, "[mdock] error: container %s failed to start: %s\n",
+                container_id, strerror(rep.err));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "placement.h"
+#include "proc.h"
+#include "record.h"
+
+void placement_request_init(struct placement_request *req)
+{
+    memset(req, 0, sizeof(*req));
+    req->numa_node = -1;
+    req->count = 1;
+}
+
+int placement_any(const struct placement_request *req)
+{
+    return req->have_cpus || req->numa_node >= 0 || req->policy != PLACE_NONE;
+}
+
+int placement_parse_policy(const char *str, enum placement_policy *out)
+{
+    if (strcmp(str, "pack") == 0) {
+        *out = PLACE_PACK;
+    } else if (strcmp(str, "spread") == 0) {
+        *out = PLACE_SPREAD;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* ----- CPU lists ----- */
+
+int cpulist_parse(const char *str, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *p = str;
+    while (*p && *p != '\n') {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0 || lo >= CPU_SETSIZE) {
+            return -1;
+        }
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo || hi >= CPU_SETSIZE) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            CPU_SET((int)cpu, set);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            return -1;
+        }
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+int cpulist_format(const cpu_set_t *set, char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, set)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) {
+            last++;
+        }
+        int n = (last == cpu) ? snprintf(buf + len, size - len, "%s%d", len ? "," : "", cpu)
+                              : snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", cpu, last);
+        if (n < 0 || (size_t)n >= size - len) {
+            return -1;
+        }
+        len += (size_t)n;
+        cpu = last;
+    }
+    return 0;
+}
+
+int numa_node_cpus(int node, cpu_set_t *set)
+{
+    char path[128];
+    char buf[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *f = fopen(path, "re");
+    if (!f) {
+        return -1;
+    }
+    int rc = fgets(buf, sizeof(buf), f) ? cpulist_parse(buf, set) : -1;
+    fclose(f);
+    return rc;
+}
+
+/* ----- Placement ----- */
+
+int placement_load(const char *db_path, struct placement_map *map)
+{
+    memset(map, 0, sizeof(*map));
+    if (sched_getaffinity(0, sizeof(map->online), &map->online) != 0) {
+        CPU_ZERO(&map->online);
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < n && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET((int)cpu, &map->online);
+        }
+    }
+
+    /* Without sysfs NUMA information every CPU is on node 0 */
+    map->nnodes = 1;
+    DIR *dir = opendir("/sys/devices/system/node");
+    struct dirent *ent;
+    while (dir && (ent = readdir(dir)) != NULL) {
+        int node;
+        cpu_set_t cpus;
+        if (sscanf(ent->d_name, "node%d", &node) != 1 || node < 0 || node >= PLACEMENT_MAX_NODES ||
+            numa_node_cpus(node, &cpus) != 0) {
+            continue;
+        }
+        if (node >= map->nnodes) {
+            map->nnodes = node + 1;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                map->node[cpu] = node;
+            }
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+
+    struct db_map db;
+    if (db_map_open(db_path, &db) != 0) {
+        return -1;
+    }
+    struct db_scanner s;
+    struct db_row row;
+    db_scanner_init(&s, &db);
+    while (db_scanner_next(&s, &row)) {
+        struct container_record rec;
+        if (row.nfields <= CF_CPUSET || row.fields[CF_CPUSET].len == 0 ||
+            !db_field_eq(&row.fields[CF_STATUS], "running") ||
+            container_record_parse(&row, &rec) != 0 ||
+            !proc_alive(rec.pid, rec.pid_start)) {
+            continue;
+        }
+        cpu_set_t cpus;
+        if (cpulist_parse(rec.cpuset, &cpus) != 0) {
+            continue;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                map->load[cpu]++;
+            }
+        }
+    }
+    db_map_close(&db);
+    return 0;
+}
+
+/* Take the count candidates that sort first by (load, node when by_node, cpu) */
+static void pick_least_loaded(const struct placement_map *map, const cpu_set_t *cand,
+                              int count, int by_node, cpu_set_t *out)
+{
+    cpu_set_t left = *cand;
+    CPU_ZERO(out);
+    for (int k = 0; k < count; k++) {
+        int best = -1;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &left)) {
+                continue;
+            }
+            if (best < 0 || map->load[cpu] < map->load[best] ||
+                (map->load[cpu] == map->load[best] && by_node && map->node[cpu] < map->node[best])) {
+                best = cpu;
+            }
+        }
+        CPU_CLR(best, &left);
+        CPU_SET(best, out);
+    }
+}
+
+int placement_choose(struct placement_map *map, const struct placement_request *req,
+                     cpu_set_t *out, unsigned long *nodemask, int *bind_memory)
+{
+    cpu_set_t cand;
+    CPU_AND(&cand, &map->online, req->have_cpus ? &req->cpus : &map->online);
+
+    *bind_memory = 0;
+    memset(nodemask, 0, PLACEMENT_NODEMASK_LONGS * sizeof(unsigned long));
+    if (req->numa_node >= 0) {
+        cpu_set_t node_cpus;
+        if (numa_node_cpus(req->numa_node, &node_cpus) != 0) {
+            fprintf(stderr, "[mdock] error: NUMA node %d does not exist\n", req->numa_node);
+            return -1;
+        }
+        /* An explicit --cpuset wins; the node then only binds memory */
+        if (!req->have_cpus) {
+            CPU_AND(&cand, &cand, &node_cpus);
+        }
+        nodemask[req->numa_node / (8 * sizeof(unsigned long))] |=
+            1UL << (req->numa_node % (8 * sizeof(unsigned long)));
+        *bind_memory = 1;
+    }
+
+    if (CPU_COUNT(&cand) == 0) {
+        fprintf(stderr, "[mdock] error: none of the requested CPUs is available\n");
+        return -1;
+    }
+    if (req->policy == PLACE_NONE) {
+        *out = cand;
+        return 0;
+    }
+    if (req->count > CPU_COUNT(&cand)) {
+        fprintf(stderr, "[mdock] error: --cpu-count %d exceeds the %d CPUs available\n",
+                req->count, CPU_COUNT(&cand));
+        return -1;
+    }
+
+    if (req->policy == PLACE_PACK) {
+        /* Lowest load first, then the lowest node: node 0 fills up before node 1 */
+        pick_least_loaded(map, &cand, req->count, 1, out);
+    } else {
+        /* The node with the least load per candidate CPU that can hold the container */
+        int best_node = -1;
+        double best_avg = 0;
+        for (int node = 0; node < map->nnodes; node++) {
+            int ncpu = 0;
+            long load = 0;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &cand) && map->node[cpu] == node) {
+                    ncpu++;
+                    load += map->load[cpu];
+                }
+            }
+            if (ncpu >= req->count && (best_node < 0 || (double)load / ncpu < best_avg)) {
+                best_node = node;
+                best_avg = (double)load / ncpu;
+            }
+        }
+        if (best_node >= 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (map->node[cpu] != best_node) {
+                    CPU_CLR(cpu, &cand);
+                }
+            }
+        }
+        pick_least_loaded(map, &cand, req->count, 0, out);
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, out)) {
+            map->load[cpu]++;
+        }
+    }
+    return 0;
+}
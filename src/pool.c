@@ -0,0 +1,1047 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "pool.h"
+#include "container.h"
+#include "fsutil.h"
+#include "image.h"
+#include "log.h"
+#include "proc.h"
+#include "protocol.h"
+#include "record.h"
+#include "timeutil.h"
+
+#define POOL_MAX_CLIENTS   64
+#define POOL_JOB_MAX       (256 * 1024)     /* one SEQPACKET message to a warm child */
+#define POOL_RETRY_MS      5                /* containers.db busy: try the exits again */
+
+/*
+ * MSG_POOL_SPAWN payload: this header, then NUL-terminated strings
+ * id, log_path, path, fallback ("" for none), argv[nargv], envp[nenv].
+ * The zygote forwards it unchanged to the warm child.
+ */
+struct pool_job_header {
+    int64_t mem_limit;
+    int64_t cpu_limit;
+    uint32_t nargv;
+    uint32_t nenv;
+};
+
+struct pool_job {
+    struct pool_job_header hdr;
+    const char *id;
+    const char *log_path;
+    const char *path;
+    const char *fallback;
+    char **argv;    /* malloc'ed, NULL-terminated; strings point into the payload */
+    char **envp;
+};
+
+/* ----- Paths ----- */
+
+static int pool_socket_path(const char *base_dir, const char *image_name, char *buf, size_t size)
+{
+    if (snprintf(buf, size, "%s/pools/%s.sock", base_dir, image_name) >= (int)size) {
+        fprintf(stderr, "[mdock] pool socket path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int pool_fill_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int pool_connect_path(const char *path)
+{
+    struct sockaddr_un addr;
+    if (pool_fill_addr(&addr, path) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* ----- Jobs ----- */
+
+static int pool_job_parse(char *buf, size_t len, struct pool_job *job)
+{
+    memset(job, 0, sizeof(*job));
+    if (len < sizeof(job->hdr) || buf[len - 1] != '\0') {
+        return -1;
+    }
+    memcpy(&job->hdr, buf, sizeof(job->hdr));
+    if (job->hdr.nargv == 0 || job->hdr.nargv > 4096 || job->hdr.nenv > 4096) {
+        return -1;
+    }
+
+    size_t nstrings = 4 + job->hdr.nargv + job->hdr.nenv;
+    const char *strs[4];
+    job->argv = calloc(job->hdr.nargv + 1, sizeof(char *));
+    job->envp = calloc(job->hdr.nenv + 1, sizeof(char *));
+    if (!job->argv || !job->envp) {
+        free(job->argv);
+        free(job->envp);
+        return -1;
+    }
+
+    char *p = buf + sizeof(job->hdr);
+    char *end = buf + len;
+    for (size_t i = 0; i < nstrings; i++) {
+        if (p >= end) {
+            free(job->argv);
+            free(job->envp);
+            return -1;
+        }
+        if (i < 4) {
+            strs[i] = p;
+        } else if (i < 4 + job->hdr.nargv) {
+            job->argv[i - 4] = p;
+        } else {
+            job->envp[i - 4 - job->hdr.nargv] = p;
+        }
+        p += strlen(p) + 1;
+    }
+
+    job->id = strs[0];
+    job->log_path = strs[1];
+    job->path = strs[2];
+    job->fallback = strs[3][0] ? strs[3] : NULL;
+    return 0;
+}
+
+static void pool_job_free(struct pool_job *job)
+{
+    free(job->argv);
+    free(job->envp);
+}
+
+static char *pool_job_build(const char *container_id, const struct launch_spec *spec, size_t *out_len)
+{
+    struct pool_job_header hdr = {
+        .mem_limit = spec->mem_limit > 0 ? spec->mem_limit : 0,
+        .cpu_limit = spec->cpu_limit > 0 ? spec->cpu_limit : 0,
+    };
+    const char *fixed[4] = {
+        container_id, spec->log_path, spec->path, spec->fallback_path ? spec->fallback_path : "",
+    };
+
+    size_t len = sizeof(hdr);
+    for (int i = 0; i < 4; i++) {
+        len += strlen(fixed[i]) + 1;
+    }
+    for (char **a = spec->argv; *a; a++, hdr.nargv++) {
+        len += strlen(*a) + 1;
+    }
+    for (char **e = spec->envp; *e; e++, hdr.nenv++) {
+        len += strlen(*e) + 1;
+    }
+    if (len > POOL_JOB_MAX) {
+        return NULL;
+    }
+
+    char *buf = malloc(len);
+    if (!buf) {
+        return NULL;
+    }
+    char *p = buf;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    for (int i = 0; i < 4; i++) {
+        size_t n = strlen(fixed[i]) + 1;
+        memcpy(p, fixed[i], n);
+        p += n;
+    }
+    for (char **a = spec->argv; *a; a++) {
+        size_t n = strlen(*a) + 1;
+        memcpy(p, *a, n);
+        p += n;
+    }
+    for (char **e = spec->envp; *e; e++) {
+        size_t n = strlen(*e) + 1;
+        memcpy(p, *e, n);
+        p += n;
+    }
+    *out_len = len;
+    return buf;
+}
+
+/* ----- Client side (run) ----- */
+
+int pool_connect(const char *base_dir, const char *image_name, struct pool_conn *conn)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = -1;
+
+    char path[PATH_MAX];
+    if (pool_socket_path(base_dir, image_name, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    conn->fd = pool_connect_path(path);
+    return conn->fd >= 0 ? 0 : -1;
+}
+
+void pool_disconnect(struct pool_conn *conn)
+{
+    if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    free(conn->exited);
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = -1;
+}
+
+static int pool_stash_exit(struct pool_conn *conn, const char *payload)
+{
+    if (conn->nexited == conn->cap) {
+        size_t cap = conn->cap ? conn->cap * 2 : 16;
+        void *grown = realloc(conn->exited, cap * sizeof(*conn->exited));
+        if (!grown) {
+            return -1;
+        }
+        conn->exited = grown;
+        conn->cap = cap;
+    }
+    int32_t v[2];
+    memcpy(v, payload, sizeof(v));
+    conn->exited[conn->nexited].pid = v[0];
+    conn->exited[conn->nexited].status = v[1];
+    conn->nexited++;
+    return 0;
+}
+
+/* Next frame of the given type; EXITED frames that arrive first are kept for pool_wait() */
+static int pool_expect(struct pool_conn *conn, enum msg_type type, int32_t out[2])
+{
+    for (;;) {
+        struct msg_header hdr;
+        char *payload;
+        if (msg_recv(conn->fd, &hdr, &payload) != 1) {
+            return -1;
+        }
+        if (hdr.len != 2 * sizeof(int32_t)) {
+            free(payload);
+            return -1;
+        }
+        if (hdr.type == type) {
+            memcpy(out, payload, 2 * sizeof(int32_t));
+            free(payload);
+            return 0;
+        }
+        if (hdr.type == MSG_POOL_EXITED) {
+            pool_stash_exit(conn, payload);
+        }
+        free(payload);
+    }
+}
+
+int pool_launch(struct pool_conn *conn, const char *container_id,
+                const struct launch_spec *spec, pid_t *out_pid, int *exec_errno)
+{
+    size_t len;
+    char *job = pool_job_build(container_id, spec, &len);
+    if (!job) {
+        return 1;
+    }
+    int rc = msg_send(conn->fd, MSG_POOL_SPAWN, job, len);
+    free(job);
+    if (rc != 0) {
+        return -1;
+    }
+
+    int32_t reply[2];
+    if (pool_expect(conn, MSG_POOL_STARTED, reply) != 0) {
+        return -1;
+    }
+    if (reply[0] <= 0) {
+        return reply[1] == POOL_MISMATCH ? 1 : -1;
+    }
+    *out_pid = reply[0];
+    *exec_errno = reply[1];
+    return 0;
+}
+
+int pool_wait(struct pool_conn *conn, pid_t *pid, int *status)
+{
+    if (conn->nexited > 0) {
+        conn->nexited--;
+        *pid = conn->exited[conn->nexited].pid;
+        *status = conn->exited[conn->nexited].status;
+        return 0;
+    }
+    int32_t v[2];
+    if (pool_expect(conn, MSG_POOL_EXITED, v) != 0) {
+        return -1;
+    }
+    *pid = v[0];
+    *status = v[1];
+    return 0;
+}
+
+/* ----- Zygote ----- */
+
+struct warm_child {
+    pid_t pid;
+    int fd;         /* SEQPACKET to the child: job in, exec errno or EOF out */
+};
+
+struct pool_running {
+    pid_t pid;
+    char id[MDOCK_ID_MAX];
+    int client;     /* connection to notify on exit, -1 once it is gone */
+    int64_t mono_start;
+};
+
+struct pool_exit {
+    char id[MDOCK_ID_MAX];
+    pid_t pid;
+    int status;
+    int64_t duration_ns;
+    struct rusage ru;
+    int client;
+};
+
+struct zygote {
+    char base_dir[PATH_MAX];
+    char db_path[PATH_MAX];
+    char image[MDOCK_NAME_MAX];
+    char rootfs[PATH_MAX];
+    char sock_path[PATH_MAX];
+    int listener;
+    int draining;
+
+    struct warm_child idle[POOL_MAX_SIZE];
+    int nidle;
+
+    struct pool_running *running;
+    size_t nrunning;
+    size_t running_cap;
+
+    /* Exits waiting for the containers.db lock */
+    struct pool_exit *exits;
+    size_t nexits;
+    size_t exits_cap;
+
+    int clients[POOL_MAX_CLIENTS];
+    int nclients;
+
+    struct pool_stats stats;
+};
+
+static int zygote_wake[2] = { -1, -1 };
+static volatile sig_atomic_t zygote_stop;
+
+static void zygote_signal(int sig)
+{
+    int saved = errno;
+    if (sig != SIGCHLD) {
+        zygote_stop = 1;
+    }
+    ssize_t n = write(zygote_wake[1], "x", 1);
+    (void)n;
+    errno = saved;
+}
+
+static int grow(void **items, size_t *cap, size_t need, size_t size)
+{
+    if (need <= *cap) {
+        return 0;
+    }
+    size_t cap2 = *cap ? *cap * 2 : 16;
+    void *p = realloc(*items, cap2 * size);
+    if (!p) {
+        return -1;
+    }
+    *items = p;
+    *cap = cap2;
+    return 0;
+}
+
+/* Body of a warm child: everything but the exec is done before a job arrives */
+static void warm_child_main(struct zygote *z, int fd)
+{
+    /* Nothing of the zygote's event loop belongs to the container */
+    close(z->listener);
+    close(zygote_wake[0]);
+    close(zygote_wake[1]);
+    for (int i = 0; i < z->nidle; i++) {
+        close(z->idle[i].fd);
+    }
+    for (int i = 0; i < z->nclients; i++) {
+        close(z->clients[i]);
+    }
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    prctl(PR_SET_NAME, "mdock-warm", 0, 0, 0);
+
+    char *buf = malloc(POOL_JOB_MAX);
+    int err = 0;
+    if (!buf) {
+        err = errno;
+    } else if (chdir(z->rootfs) != 0) {
+        err = errno;
+    }
+
+    if (err == 0 && z->stats.mem_limit > 0) {
+        struct rlimit rl = { (rlim_t)z->stats.mem_limit, (rlim_t)z->stats.mem_limit };
+        setrlimit(RLIMIT_AS, &rl);
+    }
+    if (err == 0 && z->stats.cpu_limit > 0) {
+        struct rlimit rl = { (rlim_t)z->stats.cpu_limit, (rlim_t)z->stats.cpu_limit };
+        setrlimit(RLIMIT_CPU, &rl);
+    }
+
+    /* Wait for a job; EOF means the zygote is gone */
+    ssize_t n;
+    while ((n = recv(fd, buf, buf ? POOL_JOB_MAX : 0, 0)) == -1 && errno == EINTR) {
+    }
+    if (n <= 0) {
+        _exit(0);
+    }
+
+    struct pool_job job;
+    if (err == 0 && pool_job_parse(buf, (size_t)n, &job) != 0) {
+        err = EINVAL;
+    }
+    if (err == 0) {
+        int log_fd = open(job.log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (log_fd >= 0) {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+            close(log_fd);
+        }
+        execve(job.path, job.argv, job.envp);
+        if (job.fallback) {
+            execve(job.fallback, job.argv, job.envp);
+        }
+        err = errno;
+        perror("[mdock] execve");
+    }
+
+    send(fd, &err, sizeof(err), MSG_NOSIGNAL);
+    _exit(1);
+}
+
+static int zygote_fork_child(struct zygote *z, struct warm_child *out)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        return -1;
+    }
+
+    int64_t t0 = mdock_monotonic_ns();
+    pid_t pid = fork();
+    if (pid == -1) {
+        int saved = errno;
+        close(sv[0]);
+        close(sv[1]);
+        errno = saved;
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        warm_child_main(z, sv[1]);
+    }
+    close(sv[1]);
+
+    z->stats.spawned++;
+    z->stats.spawn_ns += (uint64_t)(mdock_monotonic_ns() - t0);
+    out->pid = pid;
+    out->fd = sv[0];
+    return 0;
+}
+
+static void zygote_reply(int client, enum msg_type type, int32_t a, int32_t b)
+{
+    if (client < 0) {
+        return;
+    }
+    int32_t v[2] = { a, b };
+    msg_send(client, type, v, sizeof(v));
+}
+
+static void zygote_spawn(struct zygote *z, int client, char *payload, size_t len)
+{
+    struct pool_job job;
+    if (pool_job_parse(payload, len, &job) != 0) {
+        zygote_reply(client, MSG_POOL_STARTED, -1, EINVAL);
+        return;
+    }
+    if (job.hdr.mem_limit != z->stats.mem_limit || job.hdr.cpu_limit != z->stats.cpu_limit ||
+        z->draining || len > POOL_JOB_MAX) {
+        pool_job_free(&job);
+        zygote_reply(client, MSG_POOL_STARTED, -1, POOL_MISMATCH);
+        return;
+    }
+
+    struct warm_child child;
+    if (z->nidle > 0) {
+        child = z->idle[--z->nidle];
+        z->stats.hits++;
+    } else if (zygote_fork_child(z, &child) == 0) {
+        z->stats.misses++;
+    } else {
+        pool_job_free(&job);
+        zygote_reply(client, MSG_POOL_STARTED, -1, errno);
+        return;
+    }
+
+    int64_t mono_start = mdock_monotonic_ns();
+    int err = 0;
+    if (send(child.fd, payload, len, MSG_NOSIGNAL) != (ssize_t)len) {
+        err = errno ? errno : EPIPE;
+    } else {
+        /* EOF: the CLOEXEC socket closed on a successful exec */
+        ssize_t n;
+        while ((n = recv(child.fd, &err, sizeof(err), 0)) == -1 && errno == EINTR) {
+        }
+        if (n == 0) {
+            err = 0;
+        } else if (n != (ssize_t)sizeof(err)) {
+            err = n < 0 ? errno : EPROTO;
+        }
+    }
+    close(child.fd);
+
+    if (grow((void **)&z->running, &z->running_cap, z->nrunning + 1, sizeof(*z->running)) == 0) {
+        struct pool_running *r = &z->running[z->nrunning++];
+        r->pid = child.pid;
+        snprintf(r->id, sizeof(r->id), "%s", job.id);
+        r->client = client;
+        r->mono_start = mono_start;
+    }
+    pool_job_free(&job);
+
+    zygote_reply(client, MSG_POOL_STARTED, child.pid, err);
+}
+
+static void zygote_reap(struct zygote *z)
+{
+    char buf[64];
+    while (read(zygote_wake[0], buf, sizeof(buf)) > 0) {
+    }
+
+    int status;
+    struct rusage ru;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+        for (size_t i = 0; i < z->nrunning; i++) {
+            if (z->running[i].pid != pid) {
+                continue;
+            }
+            struct pool_running r = z->running[i];
+            z->running[i] = z->running[--z->nrunning];
+            if (grow((void **)&z->exits, &z->exits_cap, z->nexits + 1, sizeof(*z->exits)) == 0) {
+                struct pool_exit *e = &z->exits[z->nexits++];
+                snprintf(e->id, sizeof(e->id), "%s", r.id);
+                e->pid = pid;
+                e->status = status;
+                e->duration_ns = mdock_monotonic_ns() - r.mono_start;
+                e->ru = ru;
+                e->client = r.client;
+            }
+            break;
+        }
+        for (int i = 0; i < z->nidle; i++) {
+            if (z->idle[i].pid == pid) {
+                close(z->idle[i].fd);
+                z->idle[i] = z->idle[--z->nidle];
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * A run holds the containers.db lock while it waits for our STARTED reply,
+ * so blocking on the lock here could deadlock: exits are recorded in one
+ * batch whenever the lock is free, then reported to their clients.
+ */
+static void zygote_flush_exits(struct zygote *z)
+{
+    int lock = db_trylock(z->db_path);
+    if (lock < 0) {
+        return;
+    }
+
+    struct container_exit *batch = calloc(z->nexits, sizeof(*batch));
+    if (batch) {
+        for (size_t i = 0; i < z->nexits; i++) {
+            batch[i].container_id = z->exits[i].id;
+            batch[i].pid = z->exits[i].pid;
+            batch[i].status = z->exits[i].status;
+            batch[i].duration_ns = z->exits[i].duration_ns;
+            batch[i].usage = &z->exits[i].ru;
+        }
+        record_container_exits_locked(z->base_dir, batch, (int)z->nexits);
+        free(batch);
+    }
+    db_unlock(lock);
+
+    for (size_t i = 0; i < z->nexits; i++) {
+        zygote_reply(z->exits[i].client, MSG_POOL_EXITED, z->exits[i].pid, z->exits[i].status);
+    }
+    z->nexits = 0;
+}
+
+static void zygote_drop_client(struct zygote *z, int idx)
+{
+    int fd = z->clients[idx];
+    close(fd);
+    z->clients[idx] = z->clients[--z->nclients];
+    for (size_t i = 0; i < z->nrunning; i++) {
+        if (z->running[i].client == fd) {
+            z->running[i].client = -1;
+        }
+    }
+    for (size_t i = 0; i < z->nexits; i++) {
+        if (z->exits[i].client == fd) {
+            z->exits[i].client = -1;
+        }
+    }
+}
+
+static void zygote_begin_drain(struct zygote *z)
+{
+    if (z->draining) {
+        return;
+    }
+    z->draining = 1;
+    unlink(z->sock_path);
+    for (int i = 0; i < z->nidle; i++) {
+        kill(z->idle[i].pid, SIGKILL);
+    }
+    mdock_logf("POOL stop image=%s pid=%d", z->image, (int)getpid());
+}
+
+static void zygote_client_request(struct zygote *z, int idx)
+{
+    int fd = z->clients[idx];
+    struct msg_header hdr;
+    char *payload;
+    if (msg_recv(fd, &hdr, &payload) != 1) {
+        zygote_drop_client(z, idx);
+        return;
+    }
+
+    if (hdr.type == MSG_POOL_SPAWN) {
+        zygote_spawn(z, fd, payload, hdr.len);
+    } else if (hdr.type == MSG_POOL_STATUS) {
+        z->stats.idle = z->nidle;
+        z->stats.running = (int32_t)z->nrunning;
+        msg_send(fd, MSG_POOL_STATUS, &z->stats, sizeof(z->stats));
+    } else if (hdr.type == MSG_POOL_STOP) {
+        zygote_begin_drain(z);
+        msg_send(fd, MSG_POOL_STOP, NULL, 0);
+    }
+    free(payload);
+}
+
+static void zygote_run(struct zygote *z)
+{
+    struct pollfd fds[2 + POOL_MAX_CLIENTS];
+
+    for (;;) {
+        if (zygote_stop) {
+            zygote_begin_drain(z);
+        }
+        if (z->draining && z->nrunning == 0 && z->nidle == 0 && z->nexits == 0) {
+            break;
+        }
+
+        int nfds = 0;
+        fds[nfds++] = (struct pollfd){ .fd = zygote_wake[0], .events = POLLIN };
+        if (!z->draining) {
+            fds[nfds++] = (struct pollfd){ .fd = z->listener, .events = POLLIN };
+        }
+        int first_client = nfds;
+        for (int i = 0; i < z->nclients; i++) {
+            fds[nfds++] = (struct pollfd){ .fd = z->clients[i], .events = POLLIN };
+        }
+
+        /* Refill one child at a time between events so requests never wait for it */
+        int timeout = -1;
+        if (z->nexits > 0) {
+            timeout = POOL_RETRY_MS;
+        } else if (!z->draining && z->nidle < z->stats.size) {
+            timeout = 0;
+        }
+
+        int ready = poll(fds, (nfds_t)nfds, timeout);
+        if (ready == -1 && errno != EINTR) {
+            break;
+        }
+        if (ready <= 0) {
+            if (z->nexits > 0) {
+                zygote_flush_exits(z);
+            }
+            if (!z->draining && z->nidle < z->stats.size &&
+                zygote_fork_child(z, &z->idle[z->nidle]) == 0) {
+                z->nidle++;
+            }
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            zygote_reap(z);
+            if (z->nexits > 0) {
+                zygote_flush_exits(z);
+            }
+        }
+
+        /* Walk clients from the end: dropping one moves the last into its slot */
+        for (int i = nfds - 1; i >= first_client; i--) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                zygote_client_request(z, i - first_client);
+            }
+        }
+
+        if (!z->draining && (fds[1].revents & POLLIN)) {
+            int client = accept4(z->listener, NULL, NULL, SOCK_CLOEXEC);
+            if (client >= 0 && z->nclients < POOL_MAX_CLIENTS) {
+                struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                z->clients[z->nclients++] = client;
+            } else if (client >= 0) {
+                close(client);
+            }
+        }
+    }
+
+    for (int i = 0; i < z->nclients; i++) {
+        close(z->clients[i]);
+    }
+    close(z->listener);
+}
+
+/* Runs in the detached zygote; reports its pid (or an errno) on report_fd */
+static void zygote_main(struct zygote *z, int report_fd)
+{
+    proc_detach("mdock-zygote", report_fd);
+
+    int32_t reply[2] = { 0, 0 };
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = zygote_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
+    struct sockaddr_un addr;
+    z->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (pipe2(zygote_wake, O_CLOEXEC | O_NONBLOCK) == -1 || z->listener == -1 ||
+        sigaction(SIGCHLD, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1 ||
+        pool_fill_addr(&addr, z->sock_path) != 0) {
+        reply[1] = errno ? errno : ENAMETOOLONG;
+        goto fail;
+    }
+
+    unlink(z->sock_path);
+    mode_t old_mask = umask(077);
+    int rc = bind(z->listener, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc == -1 || listen(z->listener, 128) == -1) {
+        reply[1] = errno;
+        goto fail;
+    }
+
+    /* The first run after `pool start` already finds a warm child */
+    while (z->nidle < z->stats.size && zygote_fork_child(z, &z->idle[z->nidle]) == 0) {
+        z->nidle++;
+    }
+
+    z->stats.zygote_pid = getpid();
+    mdock_logf("POOL start image=%s size=%d pid=%d", z->image, z->stats.size, (int)getpid());
+    reply[0] = getpid();
+    if (write(report_fd, reply, sizeof(reply)) != (ssize_t)sizeof(reply)) {
+        _exit(1);
+    }
+    close(report_fd);
+
+    zygote_run(z);
+    _exit(0);
+
+fail:
+    if (write(report_fd, reply, sizeof(reply)) < 0) {
+        _exit(1);
+    }
+    _exit(1);
+}
+
+/* ----- mdock pool ----- */
+
+static void pool_usage(void)
+{
+    fprintf(stderr, "Usage: mdock pool start [--size N] [--mem SIZE] [--cpu SECONDS] <image>\n");
+    fprintf(stderr, "       mdock pool stop <image>\n");
+    fprintf(stderr, "       mdock pool status [--json]\n");
+}
+
+static int pool_start(const char *base_dir, int argc, char **argv)
+{
+    static struct zygote z;
+    memset(&z, 0, sizeof(z));
+    z.stats.size = POOL_DEFAULT_SIZE;
+    const char *image_name = NULL;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 1 || n > POOL_MAX_SIZE) {
+                fprintf(stderr, "[mdock] error: invalid pool size '%s' (1-%d)\n", argv[i], POOL_MAX_SIZE);
+                return 1;
+            }
+            z.stats.size = (int32_t)n;
+        } else if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            z.stats.mem_limit = parse_memory_limit(argv[++i]);
+            if (z.stats.mem_limit < 0) {
+                fprintf(stderr, "[mdock] error: invalid memory limit '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            z.stats.cpu_limit = parse_cpu_limit(argv[++i]);
+            if (z.stats.cpu_limit < 0) {
+                fprintf(stderr, "[mdock] error: invalid CPU limit '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-' || image_name) {
+            pool_usage();
+            return 1;
+        } else {
+            image_name = argv[i];
+        }
+    }
+    if (!image_name) {
+        pool_usage();
+        return 1;
+    }
+
+    if (find_image_rootfs(base_dir, image_name, z.rootfs, sizeof(z.rootfs)) != 0) {
+        fprintf(stderr, "[mdock] error: image '%s' not found\n", image_name);
+        return 1;
+    }
+
+    char pools_dir[PATH_MAX];
+    if (snprintf(pools_dir, sizeof(pools_dir), "%s/pools", base_dir) >= (int)sizeof(pools_dir) ||
+        ensure_dir_exists(pools_dir, 0755) != 0 ||
+        pool_socket_path(base_dir, image_name, z.sock_path, sizeof(z.sock_path)) != 0) {
+        return 1;
+    }
+
+    int existing = pool_connect_path(z.sock_path);
+    if (existing >= 0) {
+        close(existing);
+        fprintf(stderr, "[mdock] error: a pool for image '%s' is already running\n", image_name);
+        return 1;
+    }
+
+    snprintf(z.base_dir, sizeof(z.base_dir), "%s", base_dir);
+    snprintf(z.image, sizeof(z.image), "%s", image_name);
+    if (snprintf(z.db_path, sizeof(z.db_path), "%s/containers.db", base_dir) >= (int)sizeof(z.db_path)) {
+        fprintf(stderr, "[mdock] containers.db path too long\n");
+        return 1;
+    }
+
+    int report[2];
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        perror("[mdock] pipe2");
+        return 1;
+    }
+
+    fflush(NULL);
+    pid_t middle = fork();
+    if (middle == -1) {
+        perror("[mdock] fork");
+        close(report[0]);
+        close(report[1]);
+        return 1;
+    }
+    if (middle == 0) {
+        /* Double fork: the zygote is reparented and outlives this command */
+        close(report[0]);
+        pid_t zygote = fork();
+        if (zygote == 0) {
+            zygote_main(&z, report[1]);
+        }
+        _exit(zygote == -1 ? 1 : 0);
+    }
+
+    close(report[1]);
+    while (waitpid(middle, NULL, 0) == -1 && errno == EINTR) {
+    }
+    int32_t reply[2];
+    ssize_t n;
+    while ((n = read(report[0], reply, sizeof(reply))) == -1 && errno == EINTR) {
+    }
+    close(report[0]);
+
+    if (n != (ssize_t)sizeof(reply) || reply[0] <= 0) {
+        fprintf(stderr, "[mdock] error: pool for image '%s' failed to start: %s\n", image_name,
+                n == (ssize_t)sizeof(reply) ? strerror(reply[1]) : "zygote exited");
+        return 1;
+    }
+
+    printf("Pool for image '%s' started (zygote PID %d, %d warm)\n", image_name, reply[0], z.stats.size);
+    return 0;
+}
+
+static int pool_stop(const char *base_dir, const char *image_name)
+{
+    char path[PATH_MAX];
+    if (pool_socket_path(base_dir, image_name, path, sizeof(path)) != 0) {
+        return 1;
+    }
+    int fd = pool_connect_path(path);
+    if (fd < 0) {
+        fprintf(stderr, "[mdock] error: no pool is running for image '%s'\n", image_name);
+        return 1;
+    }
+
+    struct msg_header hdr;
+    char *payload = NULL;
+    int ok = msg_send(fd, MSG_POOL_STOP, NULL, 0) == 0 && msg_recv(fd, &hdr, &payload) == 1;
+    free(payload);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "[mdock] error: pool for image '%s' did not answer\n", image_name);
+        return 1;
+    }
+    printf("Pool for image '%s' stopped\n", image_name);
+    return 0;
+}
+
+static int pool_query(const char *path, struct pool_stats *stats)
+{
+    int fd = pool_connect_path(path);
+    if (fd < 0) {
+        return -1;
+    }
+    struct msg_header hdr;
+    char *payload = NULL;
+    int rc = -1;
+    if (msg_send(fd, MSG_POOL_STATUS, NULL, 0) == 0 && msg_recv(fd, &hdr, &payload) == 1 &&
+        hdr.type == MSG_POOL_STATUS && hdr.len == sizeof(*stats)) {
+        memcpy(stats, payload, sizeof(*stats));
+        rc = 0;
+    }
+    free(payload);
+    close(fd);
+    return rc;
+}
+
+static int pool_status(const char *base_dir, int json)
+{
+    char pools_dir[PATH_MAX];
+    if (snprintf(pools_dir, sizeof(pools_dir), "%s/pools", base_dir) >= (int)sizeof(pools_dir)) {
+        return 1;
+    }
+
+    if (json) {
+        printf("[");
+    } else {
+        printf("%-20s %-8s %-6s %-6s %-8s %-8s %-8s %-8s %s\n",
+               "IMAGE", "PID", "SIZE", "IDLE", "RUNNING", "HITS", "MISSES", "HIT%", "SPAWN_US");
+    }
+
+    DIR *dir = opendir(pools_dir);
+    int count = 0;
+    struct dirent *ent;
+    while (dir && (ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len <= 5 || strcmp(ent->d_name + len - 5, ".sock") != 0) {
+            continue;
+        }
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", pools_dir, ent->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        struct pool_stats st;
+        if (pool_query(path, &st) != 0) {
+            continue;   /* left over from a zygote that died */
+        }
+
+        char image[MDOCK_NAME_MAX];
+        snprintf(image, sizeof(image), "%.*s", (int)(len - 5), ent->d_name);
+        uint64_t served = st.hits + st.misses;
+        double hit_pct = served ? 100.0 * (double)st.hits / (double)served : 0.0;
+        double spawn_us = st.spawned ? (double)st.spawn_ns / (double)st.spawned / 1e3 : 0.0;
+
+        if (json) {
+            printf("%s\n  {\"image\": \"%s\", \"pid\": %d, \"size\": %d, \"idle\": %d, \"running\": %d, "
+                   "\"mem_limit\": %lld, \"cpu_limit\": %lld, \"hits\": %llu, \"misses\": %llu, "
+                   "\"spawned\": %llu, \"avg_spawn_us\": %.1f}",
+                   count ? "," : "", image, st.zygote_pid, st.size, st.idle, st.running,
+                   (long long)st.mem_limit, (long long)st.cpu_limit,
+                   (unsigned long long)st.hits, (unsigned long long)st.misses,
+                   (unsigned long long)st.spawned, spawn_us);
+        } else {
+            printf("%-20s %-8d %-6d %-6d %-8d %-8llu %-8llu %-8.1f %.1f\n",
+                   image, st.zygote_pid, st.size, st.idle, st.running,
+                   (unsigned long long)st.hits, (unsigned long long)st.misses, hit_pct, spawn_us);
+        }
+        count++;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+
+    if (json) {
+        printf("%s]\n", count ? "\n" : "");
+    }
+    return 0;
+}
+
+int cmd_pool(int argc, char **argv)
+{
+    if (argc < 2) {
+        pool_usage();
+        return 1;
+    }
+
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        return 1;
+    }
+
+    const char *sub = argv[1];
+    if (strcmp(sub, "start") == 0) {
+        return pool_start(base_dir, argc, argv);
+    } else if (strcmp(sub, "stop") == 0 && argc == 3) {
+        return pool_stop(base_dir, argv[2]);
+    } else if (strcmp(sub, "status") == 0) {
+        return pool_status(base_dir, argc == 3 && strcmp(argv[2], "--json") == 0);
+    }
+    pool_usage();
+    return 1;
+}
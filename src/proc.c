@@ -0,0 +1,490 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "proc.h"
+
+static int cmp_pid(const void *a, const void *b)
+{
+    pid_t x = *(const pid_t *)a;
+    pid_t y = *(const pid_t *)b;
+    return (x > y) - (x < y);
+}
+
+int pid_set_scan(struct pid_set *set)
+{
+    set->pids = NULL;
+    set->count = 0;
+    set->cap = 0;
+
+    DIR *dir = opendir("/proc");
+    if (!dir) {
+        perror("[mdock] opendir /proc");
+        return -1;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char *name = ent->d_name;
+        if (name[0] < '0' || name[0] > '9') {
+            continue;
+        }
+
+        if (set->count == set->cap) {
+            size_t cap = set->cap ? set->cap * 2 : 256;
+            pid_t *pids = realloc(set->pids, cap * sizeof(*pids));
+            if (!pids) {
+                perror("[mdock] realloc");
+                closedir(dir);
+                pid_set_free(set);
+                return -1;
+            }
+            set->pids = pids;
+            set->cap = cap;
+        }
+        set->pids[set->count++] = (pid_t)atoi(name);
+    }
+
+    closedir(dir);
+    qsort(set->pids, set->count, sizeof(*set->pids), cmp_pid);
+    return 0;
+}
+
+int pid_set_contains(const struct pid_set *set, pid_t pid)
+{
+    return set->count > 0 &&
+           bsearch(&pid, set->pids, set->count, sizeof(*set->pids), cmp_pid) != NULL;
+}
+
+void pid_set_free(struct pid_set *set)
+{
+    free(set->pids);
+    set->pids = NULL;
+    set->count = 0;
+    set->cap = 0;
+}
+
+/* ----- Process handles ----- */
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+uint64_t proc_starttime(pid_t pid)
+{
+    char path[64];
+    char buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return 0;
+    }
+    buf[n] = '\0';
+
+    /* comm may contain spaces: count fields from the last ')', which ends field 2 */
+    char *p = strrchr(buf, ')');
+    for (int field = 2; p && field < 22; field++) {
+        p = strchr(p, ' ');
+        if (p) {
+            p++;
+        }
+    }
+    return p ? strtoull(p, NULL, 10) : 0;
+}
+
+int proc_open(pid_t pid, uint64_t starttime)
+{
+    if (pid <= 0) {
+        errno = ESRCH;
+        return -1;
+    }
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    /* Checked after opening: a pid reused before that has another start time */
+    if (starttime != 0 && proc_starttime(pid) != starttime) {
+        close(fd);
+        errno = ESRCH;
+        return -1;
+    }
+    return fd;
+}
+
+int proc_exited(int pidfd)
+{
+    struct pollfd pfd = { .fd = pidfd, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLIN | POLLHUP));
+}
+
+int proc_signal(int pidfd, int sig)
+{
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+int proc_alive(pid_t pid, uint64_t starttime)
+{
+    int fd = proc_open(pid, starttime);
+    if (fd == -1) {
+        /* Kernels before 5.3 have no pidfds */
+        return errno == ENOSYS && kill(pid, 0) == 0;
+    }
+    int alive = !proc_exited(fd);
+    close(fd);
+    return alive;
+}
+
+/* ----- Process trees ----- */
+
+static int read_small_file(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+static int tree_add(pid_t *pids, int count, int max, pid_t pid)
+{
+    for (int i = 0; i < count; i++) {
+        if (pids[i] == pid) {
+            return count;
+        }
+    }
+    if (count < max) {
+        pids[count++] = pid;
+    }
+    return count;
+}
+
+/* Add the pids of a children file to the list */
+static int add_pid_list(const char *buf, pid_t *pids, int count, int max)
+{
+    for (const char *p = buf; *p;) {
+        char *end;
+        long child = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        count = tree_add(pids, count, max, (pid_t)child);
+        p = end;
+    }
+    return count;
+}
+
+/* Children of every thread of pid */
+static int add_children(pid_t pid, pid_t *pids, int count, int max)
+{
+    char path[320];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return count;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] < '0' || ent->d_name[0] > '9') {
+            continue;
+        }
+        char buf[4096];
+        snprintf(path, sizeof(path), "/proc/%d/task/%s/children", (int)pid, ent->d_name);
+        if (read_small_file(path, buf, sizeof(buf)) == 0) {
+            count = add_pid_list(buf, pids, count, max);
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+/* Field 4 of /proc/<pid>/stat */
+static pid_t proc_ppid(pid_t pid)
+{
+    char path[64];
+    char buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (read_small_file(path, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    char *p = strrchr(buf, ')');
+    int ppid;
+    return (p && sscanf(p, ") %*c %d", &ppid) == 1) ? (pid_t)ppid : -1;
+}
+
+/* Without children files (CONFIG_PROC_CHILDREN): scan until no new descendant turns up */
+static int scan_descendants(pid_t *pids, int count, int max)
+{
+    struct pid_set all;
+    if (pid_set_scan(&all) != 0) {
+        return count;
+    }
+    int grew = 1;
+    while (grew) {
+        grew = 0;
+        for (size_t k = 0; k < all.count; k++) {
+            pid_t ppid = proc_ppid(all.pids[k]);
+            for (int j = 0; j < count; j++) {
+                if (pids[j] == ppid) {
+                    int before = count;
+                    count = tree_add(pids, count, max, all.pids[k]);
+                    grew |= count != before;
+                    break;
+                }
+            }
+        }
+    }
+    pid_set_free(&all);
+    return count;
+}
+
+int proc_have_children(void)
+{
+    static int have_children = -1;
+    if (have_children < 0) {
+        have_children = access("/proc/thread-self/children", R_OK) == 0;
+    }
+    return have_children;
+}
+
+int proc_children(pid_t pid, pid_t *pids, int max)
+{
+    return add_children(pid, pids, 0, max);
+}
+
+int proc_children_open(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)pid, (int)pid);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int proc_children_fd(int fd, pid_t *pids, int max)
+{
+    char buf[16384];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return add_pid_list(buf, pids, 0, max);
+}
+
+int proc_tree(pid_t root, pid_t *pids, int max)
+{
+    if (max < 1) {
+        return 0;
+    }
+    int count = 1;
+    pids[0] = root;
+    if (!proc_have_children()) {
+        return scan_descendants(pids, count, max);
+    }
+    for (int i = 0; i < count; i++) {
+        count = add_children(pids[i], pids, count, max);
+    }
+    return count;
+}
+
+int64_t proc_rss(pid_t pid)
+{
+    char path[64];
+    char buf[256];
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+    long long size;
+    long long resident;
+    if (read_small_file(path, buf, sizeof(buf)) != 0 ||
+        sscanf(buf, "%lld %lld", &size, &resident) != 2) {
+        return -1;
+    }
+    return (int64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+int proc_stat_open(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int64_t proc_cputime(pid_t pid)
+{
+    int fd = proc_stat_open(pid);
+    if (fd == -1) {
+        return -1;
+    }
+    int64_t ns = proc_cputime_fd(fd);
+    close(fd);
+    return ns;
+}
+
+int64_t proc_cputime_fd(int fd)
+{
+    struct proc_stat st;
+    return proc_stat_read(fd, &st) == 0 ? st.cpu_ns + st.child_cpu_ns : -1;
+}
+
+int proc_stat_read(int fd, struct proc_stat *st)
+{
+    static long ticks_per_sec;
+    static long page_size;
+    if (ticks_per_sec <= 0) {
+        ticks_per_sec = sysconf(_SC_CLK_TCK);
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    char buf[1024];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    /* Fields from 3 on follow the ')' that ends field 2 */
+    char *open_paren = strchr(buf, '(');
+    char *p = strrchr(buf, ')');
+    if (open_paren && p > open_paren) {
+        snprintf(st->comm, sizeof(st->comm), "%.*s", (int)(p - open_paren - 1), open_paren + 1);
+    } else {
+        st->comm[0] = '\0';
+    }
+    int ppid;
+    unsigned long long minflt, cminflt, majflt, cmajflt, utime, stime;
+    long long cutime, cstime, rss;
+    if (!p || sscanf(p, ") %c %d %*d %*d %*d %*d %*u %llu %llu %llu %llu %llu %llu %lld %lld "
+                        "%*d %*d %d %*d %*u %*u %lld %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u "
+                        "%*u %*u %*u %*d %d",
+                     &st->state, &ppid, &minflt, &cminflt, &majflt, &cmajflt, &utime, &stime,
+                     &cutime, &cstime, &st->threads, &rss, &st->processor) != 13) {
+        return -1;
+    }
+    int64_t tick_ns = 1000000000LL / ticks_per_sec;
+    st->ppid = (pid_t)ppid;
+    st->cpu_ns = (int64_t)(utime + stime) * tick_ns;
+    st->child_cpu_ns = (int64_t)(cutime + cstime) * tick_ns;
+    st->minflt = minflt + cminflt;
+    st->majflt = majflt + cmajflt;
+    st->rss = (int64_t)rss * page_size;
+    return 0;
+}
+
+int proc_task_open(pid_t pid, pid_t tid, const char *name)
+{
+    char path[128];
+    if (snprintf(path, sizeof(path), "/proc/%d/task/%d/%s", (int)pid, (int)tid, name) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int proc_wchan_read(int fd, char *buf, size_t size)
+{
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    /* "0" for a running task, or for every task without kallsyms access */
+    if (strcmp(buf, "0") == 0) {
+        buf[0] = '\0';
+    }
+    return 0;
+}
+
+int proc_io_open(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int proc_io_read(int fd, uint64_t *read_bytes, uint64_t *write_bytes)
+{
+    char buf[512];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    const char *r = strstr(buf, "\nread_bytes: ");
+    const char *w = strstr(buf, "\nwrite_bytes: ");
+    if (!r || !w) {
+        return -1;
+    }
+    *read_bytes = strtoull(r + 13, NULL, 10);
+    *write_bytes = strtoull(w + 14, NULL, 10);
+    return 0;
+}
+
+/* ----- Background helpers ----- */
+
+/*
+ * Leave the caller's session behind: no terminal, no inherited pipes (a
+ * `$(mdock run -d ...)` must see EOF right away) and none of the fds or
+ * signal handlers of the process that forked us.
+ */
+void proc_detach(const char *name, int keep_fd)
+{
+    setsid();
+    prctl(PR_SET_NAME, name, 0, 0, 0);
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGHUP, SIG_IGN);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO) {
+            close(null_fd);
+        }
+    }
+    proc_close_fds(keep_fd);
+}
+
+void proc_close_fds(int keep_fd)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return;
+    }
+    int fds[256];
+    int count = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && count < (int)(sizeof(fds) / sizeof(fds[0]))) {
+        int fd = atoi(ent->d_name);
+        if (fd > STDERR_FILENO && fd != keep_fd && fd != dirfd(dir)) {
+            fds[count++] = fd;
+        }
+    }
+    closedir(dir);
+    for (int i = 0; i < count; i++) {
+        close(fds[i]);
+    }
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/limits.h>
+
+#include "protocol.h"
+#include "fsutil.h"
+
+int mdock_socket_path(char *buf, size_t size)
+{
+    char root[PATH_MAX];
+    if (mdock_get_root(root, sizeof(root)) != 0) {
+        return -1;
+    }
+    if (snprintf(buf, size, "%s/%s", root, MDOCK_SOCKET_NAME) >= (int)size) {
+        fprintf(stderr, "[mdock] socket path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+int msg_send(int fd, enum msg_type type, const void *payload, size_t len)
+{
+    return msg_send_fds(fd, type, payload, len, NULL, 0);
+}
+
+int msg_send_fds(int fd, enum msg_type type, const void *payload, size_t len,
+                 const int *fds, int nfds)
+{
+    if (len > MDOCK_PROTO_MAX || nfds < 0 || nfds > MDOCK_PROTO_MAX_FDS) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    struct msg_header hdr = {
+        .magic = MDOCK_PROTO_MAGIC,
+        .version = MDOCK_PROTO_VERSION,
+        .type = (uint16_t)type,
+        .len = (uint32_t)len,
+    };
+    struct iovec iov[2] = {
+        { &hdr, sizeof(hdr) },
+        { (void *)payload, len },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = len ? 2 : 1 };
+
+    /* The descriptors ride along with the first byte of the header */
+    union {
+        char buf[CMSG_SPACE(MDOCK_PROTO_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    if (nfds > 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE((size_t)nfds * sizeof(int));
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN((size_t)nfds * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds, (size_t)nfds * sizeof(int));
+    }
+
+    /* Header and payload go out in one syscall; loop only on short writes */
+    while (msg.msg_iovlen > 0) {
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= (ssize_t)msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/* Returns 1 when all len bytes were read, 0 on EOF before the first byte, -1 otherwise */
+static int read_full(int fd, void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, (char *)buf + done, len - done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            if (done == 0) {
+                return 0;
+            }
+            errno = EPROTO;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+/* The first part of the header, with any descriptors sent along with it */
+static int recv_head(int fd, struct msg_header *hdr, int *fds, int *nfds)
+{
+    union {
+        char buf[CMSG_SPACE(MDOCK_PROTO_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { hdr, sizeof(*hdr) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    ssize_t n;
+    do {
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return (int)n;
+    }
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int count = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int *passed = (int *)CMSG_DATA(cm);
+        for (int i = 0; i < count; i++) {
+            if (fds && *nfds < MDOCK_PROTO_MAX_FDS) {
+                fds[(*nfds)++] = passed[i];
+            } else {
+                close(passed[i]);
+            }
+        }
+    }
+    if ((size_t)n < sizeof(*hdr) && read_full(fd, (char *)hdr + n, sizeof(*hdr) - (size_t)n) != 1) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 1;
+}
+
+int msg_recv(int fd, struct msg_header *hdr, char **payload)
+{
+    return msg_recv_fds(fd, hdr, payload, NULL, NULL);
+}
+
+int msg_recv_fds(int fd, struct msg_header *hdr, char **payload, int *fds, int *nfds)
+{
+    *payload = NULL;
+    if (nfds) {
+        *nfds = 0;
+    }
+
+    int rc = recv_head(fd, hdr, fds, nfds);
+    if (rc <= 0) {
+        return rc;
+    }
+    if (hdr->magic != MDOCK_PROTO_MAGIC || hdr->version != MDOCK_PROTO_VERSION ||
+        hdr->len > MDOCK_PROTO_MAX) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    char *buf = malloc(hdr->len + 1);
+    if (!buf) {
+        return -1;
+    }
+    if (hdr->len > 0 && (rc = read_full(fd, buf, hdr->len)) != 1) {
+        if (rc == 0) {
+            errno = EPROTO;
+        }
+        free(buf);
+        return -1;
+    }
+    buf[hdr->len] = '\0';
+    *payload = buf;
+    return 1;
+}
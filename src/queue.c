@@ -0,0 +1,1370 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "queue.h"
+#include "container.h"
+#include "fsutil.h"
+#include "image.h"
+#include "log.h"
+#include "proc.h"
+#include "protocol.h"
+#include "record.h"
+#include "report.h"
+#include "timeutil.h"
+
+#define QUEUE_MAX_ARGS  1024    /* arguments of one job's run */
+
+/* Worker -> scheduler, once the job's run has returned */
+struct job_result {
+    int32_t exit_code;      /* the container's, or run's own status when none started */
+    int32_t started;        /* a container ran */
+    char container[MDOCK_ID_MAX];
+};
+
+/* ----- Paths ----- */
+
+static int jobs_db_path(const char *base_dir, char *buf, size_t size)
+{
+    if (snprintf(buf, size, "%s/jobs.db", base_dir) >= (int)size) {
+        fprintf(stderr, "[mdock] jobs.db path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int sched_socket_path(const char *base_dir, char *buf, size_t size)
+{
+    if (snprintf(buf, size, "%s/scheduler.sock", base_dir) >= (int)size) {
+        fprintf(stderr, "[mdock] scheduler socket path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int sched_fill_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int sched_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    if (sched_fill_addr(&addr, path) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* ----- Job arguments ----- */
+
+/* '%', '|' and whitespace are written as %XX; an empty argument as %00 */
+static int job_args_encode(char **args, int count, char *buf, size_t size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        const unsigned char *p = (const unsigned char *)args[i];
+        if (i > 0) {
+            if (n + 1 >= size) {
+                return -1;
+            }
+            buf[n++] = ' ';
+        }
+        if (*p == '\0') {
+            if (n + 3 >= size) {
+                return -1;
+            }
+            memcpy(buf + n, "%00", 3);
+            n += 3;
+        }
+        for (; *p; p++) {
+            if (n + 3 >= size) {
+                return -1;
+            }
+            if (*p <= ' ' || *p == '%' || *p == '|' || *p == 0x7f) {
+                buf[n++] = '%';
+                buf[n++] = hex[*p >> 4];
+                buf[n++] = hex[*p & 0xf];
+            } else {
+                buf[n++] = (char)*p;
+            }
+        }
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/* Decode into buf (as large as enc); args point into it. Returns the count or -1. */
+static int job_args_decode(const char *enc, char *buf, char **args, int max)
+{
+    int count = 0;
+    char *out = buf;
+    while (*enc) {
+        if (count == max) {
+            return -1;
+        }
+        args[count++] = out;
+        for (; *enc && *enc != ' '; enc++) {
+            if (*enc == '%') {
+                int hi = hex_value(enc[1]);
+                int lo = hi < 0 ? -1 : hex_value(enc[2]);
+                if (lo < 0) {
+                    return -1;
+                }
+                *out++ = (char)(hi << 4 | lo);
+                enc += 2;
+            } else {
+                *out++ = *enc;
+            }
+        }
+        *out++ = '\0';
+        if (*enc == ' ') {
+            enc++;
+        }
+    }
+    return count;
+}
+
+/* ----- mdock submit ----- */
+
+/* Highest jN in jobs.db plus one */
+static int next_job_number(const char *db_path)
+{
+    struct db_map map;
+    int max_num = 0;
+    if (db_map_open(db_path, &map) == 0) {
+        struct db_scanner s;
+        struct db_row row;
+        db_scanner_init(&s, &map);
+        while (db_scanner_next(&s, &row)) {
+            const struct db_field *id = &row.fields[JF_ID];
+            if (row.nfields > 1 && id->len > 1 && id->ptr[0] == 'j') {
+                struct db_field num_field = { id->ptr + 1, id->len - 1 };
+                int num = (int)db_field_long(&num_field);
+                if (num > max_num) {
+                    max_num = num;
+                }
+            }
+        }
+        db_map_close(&map);
+    }
+    return max_num + 1;
+}
+
+static int append_job(const char *db_path, struct job_record *rec)
+{
+    int lock = db_lock(db_path);
+    if (lock < 0) {
+        return -1;
+    }
+    snprintf(rec->id, sizeof(rec->id), "j%d", next_job_number(db_path));
+
+    int rc = -1;
+    FILE *f = fopen(db_path, "a");
+    if (!f) {
+        perror("[mdock] open jobs.db");
+    } else {
+        rc = job_record_write(f, rec);
+        if (fclose(f) != 0) {
+            rc = -1;
+        }
+        if (rc != 0) {
+            fprintf(stderr, "[mdock] failed to write jobs.db\n");
+        }
+    }
+    db_unlock(lock);
+    return rc;
+}
+
+static void submit_usage(void)
+{
+    fprintf(stderr, "Usage: mdock submit [--priority N] [RUN OPTIONS] <image> [program] [args...]\n");
+    fprintf(stderr, "\nQueues a job for the scheduler (mdock scheduler start). RUN OPTIONS are\n");
+    fprintf(stderr, "those of mdock run, except -d and --replicas. Higher priorities run first\n");
+    fprintf(stderr, "when the scheduler uses --order priority.\n");
+}
+
+int cmd_submit(int argc, char **argv)
+{
+    struct job_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.exit_code = MDOCK_UNSET;
+
+    /* Everything but --priority is kept for the run that executes the job */
+    char **args = malloc((size_t)argc * sizeof(*args));
+    if (!args) {
+        perror("[mdock] malloc");
+        return 1;
+    }
+    int nargs = 0;
+    const char *image_name = NULL;
+    int i;
+    for (i = 1; i < argc && !image_name; i++) {
+        if (strcmp(argv[i], "--priority") == 0) {
+            char *end = NULL;
+            long n = (i + 1 < argc) ? strtol(argv[++i], &end, 10) : 0;
+            if (!end || *end != '\0' || n < -1000 || n > 1000) {
+                fprintf(stderr, "[mdock] error: --priority needs a number from -1000 to 1000\n");
+                free(args);
+                return 1;
+            }
+            rec.priority = (int)n;
+        } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--detach") == 0 ||
+                   strcmp(argv[i], "--replicas") == 0 || strcmp(argv[i], "--cidfile") == 0) {
+            fprintf(stderr, "[mdock] error: %s cannot be used with submit\n", argv[i]);
+            free(args);
+            return 1;
+        } else if (argv[i][0] == '-') {
+            const struct run_option *opt = run_option_find(argv[i]);
+            if (!opt) {
+                fprintf(stderr, "[mdock] error: unknown option '%s'\n", argv[i]);
+                free(args);
+                return 1;
+            }
+            args[nargs++] = argv[i];
+            if (opt->takes_value) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "[mdock] error: %s requires a value\n", argv[i]);
+                    free(args);
+                    return 1;
+                }
+                args[nargs++] = argv[++i];
+            }
+        } else {
+            image_name = argv[i];
+            args[nargs++] = argv[i];
+        }
+    }
+    for (; i < argc; i++) {
+        args[nargs++] = argv[i];
+    }
+    if (!image_name) {
+        submit_usage();
+        free(args);
+        return 1;
+    }
+
+    char base_dir[PATH_MAX];
+    char db_path[PATH_MAX];
+    char rootfs[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0 ||
+        jobs_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
+        free(args);
+        return 1;
+    }
+    if (find_image_rootfs(base_dir, image_name, rootfs, sizeof(rootfs)) != 0) {
+        fprintf(stderr, "[mdock] error: image '%s' not found\n", image_name);
+        free(args);
+        return 1;
+    }
+    int rc = job_args_encode(args, nargs, rec.args, sizeof(rec.args));
+    free(args);
+    if (rc != 0) {
+        fprintf(stderr, "[mdock] error: job arguments too long (max %d bytes)\n", MDOCK_JOB_ARGS_MAX - 1);
+        return 1;
+    }
+
+    snprintf(rec.state, sizeof(rec.state), "queued");
+    snprintf(rec.image, sizeof(rec.image), "%s", image_name);
+    rec.submit_ns = mdock_realtime_ns();
+    if (append_job(db_path, &rec) != 0) {
+        return 1;
+    }
+    mdock_logf("JOB submit id=%s image=%s priority=%d", rec.id, rec.image, rec.priority);
+    printf("[mdock] Job %s queued\n", rec.id);
+
+    /* Wake the scheduler; without one the job waits for the next start */
+    char sock_path[PATH_MAX];
+    int fd = sched_socket_path(base_dir, sock_path, sizeof(sock_path)) == 0 ? sched_connect(sock_path) : -1;
+    if (fd < 0) {
+        fprintf(stderr, "[mdock] note: no scheduler is running, start one with 'mdock scheduler start'\n");
+        return 0;
+    }
+    msg_send(fd, MSG_SCHED_WAKE, NULL, 0);
+    close(fd);
+    return 0;
+}
+
+/* ----- Scheduler ----- */
+
+struct sched_worker {
+    pid_t pid;                      /* 0 for an empty slot */
+    int fd;                         /* SEQPACKET to the worker, -1 once it is gone */
+    char job[MDOCK_ID_MAX];         /* empty while idle */
+    char image[MDOCK_NAME_MAX];
+};
+
+struct scheduler {
+    char base_dir[PATH_MAX];
+    char db_path[PATH_MAX];
+    char sock_path[PATH_MAX];
+    char jobs_dir[PATH_MAX];        /* workers' --cidfile files */
+    int listener;
+    struct sched_worker workers[QUEUE_MAX_CONCURRENCY];
+    struct sched_stats stats;       /* workers, order and caps are the configuration */
+};
+
+static int sched_wake[2] = { -1, -1 };
+static volatile sig_atomic_t sched_stop;
+
+static void sched_signal(int sig)
+{
+    int saved = errno;
+    if (sig != SIGCHLD) {
+        sched_stop = 1;
+    }
+    ssize_t n = write(sched_wake[1], "x", 1);
+    (void)n;
+    errno = saved;
+}
+
+/* First line of the --cidfile written by run, empty when none started */
+static void read_cidfile(const char *path, char *id, size_t size)
+{
+    id[0] = '\0';
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+    if (fgets(id, (int)size, f)) {
+        id[strcspn(id, "\n")] = '\0';
+    }
+    fclose(f);
+}
+
+/* Body of a worker: runs one job after another until the scheduler closes fd */
+static void worker_main(struct scheduler *s, int fd)
+{
+    close(s->listener);
+    close(sched_wake[0]);
+    close(sched_wake[1]);
+    for (int i = 0; i < s->stats.workers; i++) {
+        if (s->workers[i].fd >= 0) {
+            close(s->workers[i].fd);
+        }
+    }
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    prctl(PR_SET_NAME, "mdock-worker", 0, 0, 0);
+
+    char cid_path[PATH_MAX];
+    if (snprintf(cid_path, sizeof(cid_path), "%s/worker-%d.cid", s->jobs_dir, (int)getpid()) >=
+        (int)sizeof(cid_path)) {
+        _exit(1);
+    }
+    size_t size = MDOCK_ID_MAX + MDOCK_JOB_ARGS_MAX + 2;
+    char *msg = malloc(size);
+    char *decoded = malloc(MDOCK_JOB_ARGS_MAX);
+    char **argv = malloc((QUEUE_MAX_ARGS + 4) * sizeof(*argv));
+    if (!msg || !decoded || !argv) {
+        _exit(1);
+    }
+
+    for (;;) {
+        ssize_t n;
+        while ((n = recv(fd, msg, size - 1, 0)) == -1 && errno == EINTR) {
+        }
+        if (n <= 0) {
+            break;
+        }
+        msg[n] = '\0';
+        const char *enc = msg + strlen(msg) + 1;
+
+        struct job_result res;
+        memset(&res, 0, sizeof(res));
+        res.exit_code = -1;
+        int argc = 0;
+        argv[argc++] = "run";
+        argv[argc++] = "--cidfile";
+        argv[argc++] = cid_path;
+        int nargs = enc < msg + n ? job_args_decode(enc, decoded, &argv[argc], QUEUE_MAX_ARGS) : -1;
+        if (nargs > 0) {
+            argc += nargs;
+            argv[argc] = NULL;
+            unlink(cid_path);
+            int rc = cmd_run(argc, argv);
+            fflush(NULL);
+
+            /* A foreground run has recorded the exit by the time it returns */
+            struct container_record rec;
+            read_cidfile(cid_path, res.container, sizeof(res.container));
+            if (res.container[0] && find_container_record(s->base_dir, res.container, &rec) == 0) {
+                res.started = 1;
+                res.exit_code = rec.exit_code;
+            } else {
+                res.exit_code = rc;
+            }
+        }
+        if (send(fd, &res, sizeof(res), MSG_NOSIGNAL) != (ssize_t)sizeof(res)) {
+            break;
+        }
+    }
+    unlink(cid_path);
+    _exit(0);
+}
+
+static int sched_spawn_worker(struct scheduler *s, struct sched_worker *w)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        return -1;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == -1) {
+        int saved = errno;
+        close(sv[0]);
+        close(sv[1]);
+        errno = saved;
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        worker_main(s, sv[1]);
+    }
+    close(sv[1]);
+    memset(w, 0, sizeof(*w));
+    w->pid = pid;
+    w->fd = sv[0];
+    return 0;
+}
+
+static int sched_cap_index(const struct scheduler *s, const char *image)
+{
+    for (int i = 0; i < s->stats.ncaps; i++) {
+        if (strcmp(s->stats.caps[i].image, image) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int sched_busy(const struct scheduler *s)
+{
+    int busy = 0;
+    for (int i = 0; i < s->stats.workers; i++) {
+        busy += s->workers[i].job[0] != '\0';
+    }
+    return busy;
+}
+
+/* A queued row of jobs.db; the fields point into the mapping */
+struct sched_candidate {
+    long seq;               /* position in jobs.db, i.e. submit order */
+    int priority;
+    struct db_field id;
+    struct db_field image;
+};
+
+static int cmp_candidate(const void *a, const void *b)
+{
+    const struct sched_candidate *x = a;
+    const struct sched_candidate *y = b;
+    if (x->priority != y->priority) {
+        return x->priority > y->priority ? -1 : 1;
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+struct sched_pick {
+    char id[MDOCK_ID_MAX];
+    int worker;             /* index into workers */
+    char *args;             /* copied from the row when it is marked running */
+};
+
+struct sched_mark {
+    const struct scheduler *s;
+    struct sched_pick *picks;
+    int count;
+    int64_t now;
+};
+
+static int mark_running(const struct db_row *row, FILE *out, void *arg)
+{
+    struct sched_mark *m = arg;
+    if (row->nfields < JF_REQUIRED || !db_field_eq(&row->fields[JF_STATE], "queued")) {
+        return 0;
+    }
+    for (int i = 0; i < m->count; i++) {
+        struct sched_pick *p = &m->picks[i];
+        if (p->args || !db_field_eq(&row->fields[JF_ID], p->id)) {
+            continue;
+        }
+        struct job_record rec;
+        job_record_parse(row, &rec);
+        snprintf(rec.state, sizeof(rec.state), "running");
+        rec.start_ns = m->now;
+        rec.worker = m->s->workers[p->worker].pid;
+        p->args = strdup(rec.args);
+        job_record_write(out, &rec);
+        return 1;
+    }
+    return 0;
+}
+
+struct sched_finish {
+    const char *id;
+    const struct job_result *res;
+    int64_t now;
+};
+
+static int mark_finished(const struct db_row *row, FILE *out, void *arg)
+{
+    const struct sched_finish *f = arg;
+    if (row->nfields < JF_REQUIRED || !db_field_eq(&row->fields[JF_ID], f->id)) {
+        return 0;
+    }
+    struct job_record rec;
+    job_record_parse(row, &rec);
+    snprintf(rec.state, sizeof(rec.state), "%s", f->res->started ? "exited" : "failed");
+    rec.end_ns = f->now;
+    snprintf(rec.container, sizeof(rec.container), "%s", f->res->container);
+    rec.exit_code = f->res->exit_code;
+    job_record_write(out, &rec);
+    return 1;
+}
+
+static void sched_finish(struct scheduler *s, struct sched_worker *w, const struct job_result *res)
+{
+    struct sched_finish f = { w->job, res, mdock_realtime_ns() };
+    if (db_rewrite(s->db_path, mark_finished, &f) < 0) {
+        mdock_logf("JOB error id=%s failed to record the result", w->job);
+    }
+    mdock_logf("JOB end id=%s container=%s exit_code=%d", w->job,
+               res->container[0] ? res->container : "-", res->exit_code);
+    s->stats.finished++;
+    s->stats.failed += !res->started;
+    w->job[0] = '\0';
+    w->image[0] = '\0';
+}
+
+/* The worker went away: its job (if any) failed and the slot is refilled once reaped */
+static void sched_worker_lost(struct scheduler *s, struct sched_worker *w)
+{
+    if (w->fd >= 0) {
+        close(w->fd);
+        w->fd = -1;
+    }
+    if (w->job[0]) {
+        struct job_result res;
+        memset(&res, 0, sizeof(res));
+        res.exit_code = -1;
+        sched_finish(s, w, &res);
+    }
+}
+
+static void sched_worker_result(struct scheduler *s, struct sched_worker *w)
+{
+    struct job_result res;
+    ssize_t n;
+    while ((n = recv(w->fd, &res, sizeof(res), 0)) == -1 && errno == EINTR) {
+    }
+    if (n != (ssize_t)sizeof(res)) {
+        sched_worker_lost(s, w);
+        return;
+    }
+    res.container[sizeof(res.container) - 1] = '\0';
+    if (w->job[0]) {
+        sched_finish(s, w, &res);
+    }
+}
+
+static void sched_reap(struct scheduler *s)
+{
+    char buf[64];
+    while (read(sched_wake[0], buf, sizeof(buf)) > 0) {
+    }
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < s->stats.workers; i++) {
+            struct sched_worker *w = &s->workers[i];
+            if (w->pid == pid) {
+                sched_worker_lost(s, w);
+                w->pid = 0;
+                break;
+            }
+        }
+    }
+}
+
+/* Hand queued jobs to idle workers, in order, within the per-image caps */
+static void sched_dispatch(struct scheduler *s)
+{
+    int idle[QUEUE_MAX_CONCURRENCY];
+    int nidle = 0;
+    for (int i = 0; i < s->stats.workers; i++) {
+        if (s->workers[i].fd >= 0 && s->workers[i].job[0] == '\0') {
+            idle[nidle++] = i;
+        }
+    }
+    if (nidle == 0) {
+        return;
+    }
+
+    int lock = db_lock(s->db_path);
+    if (lock < 0) {
+        return;
+    }
+    struct db_map map;
+    if (db_map_open(s->db_path, &map) != 0) {
+        db_unlock(lock);
+        return;
+    }
+
+    struct sched_candidate *cands = NULL;
+    size_t ncands = 0;
+    size_t cap = 0;
+    struct db_scanner sc;
+    struct db_row row;
+    db_scanner_init(&sc, &map);
+    for (long seq = 0; db_scanner_next(&sc, &row); seq++) {
+        if (row.nfields < JF_REQUIRED || !db_field_eq(&row.fields[JF_STATE], "queued")) {
+            continue;
+        }
+        if (ncands == cap) {
+            size_t cap2 = cap ? cap * 2 : 64;
+            struct sched_candidate *grown = realloc(cands, cap2 * sizeof(*grown));
+            if (!grown) {
+                break;
+            }
+            cands = grown;
+            cap = cap2;
+        }
+        struct sched_candidate *c = &cands[ncands++];
+        c->seq = seq;
+        c->priority = (int)db_field_long(&row.fields[JF_PRIORITY]);
+        c->id = row.fields[JF_ID];
+        c->image = row.fields[JF_IMAGE];
+    }
+    if (s->stats.order == QUEUE_PRIORITY && ncands > 1) {
+        qsort(cands, ncands, sizeof(*cands), cmp_candidate);
+    }
+
+    /* Containers per capped image, counting the ones picked in this pass */
+    int running[QUEUE_MAX_IMAGE_CAPS] = { 0 };
+    for (int i = 0; i < s->stats.workers; i++) {
+        int c = s->workers[i].job[0] ? sched_cap_index(s, s->workers[i].image) : -1;
+        if (c >= 0) {
+            running[c]++;
+        }
+    }
+
+    struct sched_pick picks[QUEUE_MAX_CONCURRENCY];
+    int npicks = 0;
+    for (size_t k = 0; k < ncands && npicks < nidle; k++) {
+        char image[MDOCK_NAME_MAX];
+        db_field_copy(&cands[k].image, image, sizeof(image));
+        int c = sched_cap_index(s, image);
+        if (c >= 0 && running[c] >= s->stats.caps[c].max) {
+            continue;
+        }
+        if (c >= 0) {
+            running[c]++;
+        }
+        struct sched_pick *p = &picks[npicks++];
+        db_field_copy(&cands[k].id, p->id, sizeof(p->id));
+        p->worker = idle[npicks - 1];
+        p->args = NULL;
+        snprintf(s->workers[p->worker].image, sizeof(s->workers[p->worker].image), "%s", image);
+    }
+    free(cands);
+    db_map_close(&map);
+
+    struct sched_mark m = { s, picks, npicks, mdock_realtime_ns() };
+    if (npicks > 0 && db_rewrite_locked(s->db_path, mark_running, &m) < 0) {
+        mdock_logf("JOB error failed to mark %d jobs running", npicks);
+    }
+    db_unlock(lock);
+
+    for (int k = 0; k < npicks; k++) {
+        struct sched_pick *p = &picks[k];
+        struct sched_worker *w = &s->workers[p->worker];
+        if (!p->args) {
+            w->image[0] = '\0';     /* taken by someone else meanwhile */
+            continue;
+        }
+        memcpy(w->job, p->id, sizeof(w->job));
+        s->stats.started++;
+        mdock_logf("JOB start id=%s image=%s worker=%d", p->id, w->image, (int)w->pid);
+
+        /* id\0args\0 */
+        size_t id_len = strlen(p->id) + 1;
+        size_t args_len = strlen(p->args) + 1;
+        char *msg = malloc(id_len + args_len);
+        ssize_t sent = -1;
+        if (msg) {
+            memcpy(msg, p->id, id_len);
+            memcpy(msg + id_len, p->args, args_len);
+            sent = send(w->fd, msg, id_len + args_len, MSG_NOSIGNAL);
+            free(msg);
+        }
+        free(p->args);
+        if (sent != (ssize_t)(id_len + args_len)) {
+            sched_worker_lost(s, w);
+        }
+    }
+}
+
+/* Jobs left "running" by a scheduler that died go back to the queue */
+static int requeue_running(const struct db_row *row, FILE *out, void *arg)
+{
+    (void)arg;
+    if (row->nfields < JF_REQUIRED || !db_field_eq(&row->fields[JF_STATE], "running")) {
+        return 0;
+    }
+    struct job_record rec;
+    job_record_parse(row, &rec);
+    snprintf(rec.state, sizeof(rec.state), "queued");
+    rec.start_ns = 0;
+    rec.worker = 0;
+    job_record_write(out, &rec);
+    return 1;
+}
+
+static void sched_begin_drain(struct scheduler *s)
+{
+    if (s->stats.draining) {
+        return;
+    }
+    s->stats.draining = 1;
+    unlink(s->sock_path);
+    mdock_logf("SCHED stop pid=%d running=%d", (int)getpid(), sched_busy(s));
+}
+
+static void sched_client(struct scheduler *s, int fd)
+{
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct msg_header hdr;
+    char *payload = NULL;
+    if (msg_recv(fd, &hdr, &payload) == 1) {
+        if (hdr.type == MSG_SCHED_STATUS) {
+            s->stats.busy = sched_busy(s);
+            for (int c = 0; c < s->stats.ncaps; c++) {
+                s->stats.caps[c].running = 0;
+            }
+            for (int i = 0; i < s->stats.workers; i++) {
+                int c = s->workers[i].job[0] ? sched_cap_index(s, s->workers[i].image) : -1;
+                if (c >= 0) {
+                    s->stats.caps[c].running++;
+                }
+            }
+            msg_send(fd, MSG_SCHED_STATUS, &s->stats, sizeof(s->stats));
+        } else if (hdr.type == MSG_SCHED_STOP) {
+            sched_begin_drain(s);
+            msg_send(fd, MSG_SCHED_STOP, NULL, 0);
+        }
+        /* MSG_SCHED_WAKE: the loop dispatches before it polls again */
+    }
+    free(payload);
+    close(fd);
+}
+
+static void sched_run(struct scheduler *s)
+{
+    struct pollfd fds[2 + QUEUE_MAX_CONCURRENCY];
+    int owner[2 + QUEUE_MAX_CONCURRENCY];
+
+    for (;;) {
+        if (sched_stop) {
+            sched_begin_drain(s);
+        }
+        if (s->stats.draining && sched_busy(s) == 0) {
+            break;
+        }
+        if (!s->stats.draining) {
+            for (int i = 0; i < s->stats.workers; i++) {
+                if (s->workers[i].pid == 0 && sched_spawn_worker(s, &s->workers[i]) != 0) {
+                    break;  /* retried on the next pass */
+                }
+            }
+            sched_dispatch(s);
+        }
+
+        int nfds = 0;
+        fds[nfds++] = (struct pollfd){ .fd = sched_wake[0], .events = POLLIN };
+        if (!s->stats.draining) {
+            fds[nfds++] = (struct pollfd){ .fd = s->listener, .events = POLLIN };
+        }
+        int first_worker = nfds;
+        for (int i = 0; i < s->stats.workers; i++) {
+            if (s->workers[i].fd >= 0 && s->workers[i].job[0]) {
+                owner[nfds] = i;
+                fds[nfds++] = (struct pollfd){ .fd = s->workers[i].fd, .events = POLLIN };
+            }
+        }
+
+        int ready = poll(fds, (nfds_t)nfds, s->stats.draining ? -1 : QUEUE_POLL_MS);
+        if (ready == -1 && errno != EINTR) {
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        for (int i = first_worker; i < nfds; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                sched_worker_result(s, &s->workers[owner[i]]);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            sched_reap(s);
+        }
+        if (!s->stats.draining && (fds[1].revents & POLLIN)) {
+            int client = accept4(s->listener, NULL, NULL, SOCK_CLOEXEC);
+            if (client >= 0) {
+                sched_client(s, client);
+            }
+        }
+    }
+
+    /* Idle workers exit when their socket closes */
+    for (int i = 0; i < s->stats.workers; i++) {
+        if (s->workers[i].fd >= 0) {
+            close(s->workers[i].fd);
+            s->workers[i].fd = -1;
+        }
+    }
+    close(s->listener);
+}
+
+/* Runs in the detached scheduler; reports its pid (or an errno) on report_fd */
+static void sched_main(struct scheduler *s, int report_fd)
+{
+    proc_detach("mdock-sched", report_fd);
+
+    int32_t reply[2] = { 0, 0 };
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sched_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
+    struct sockaddr_un addr;
+    s->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (pipe2(sched_wake, O_CLOEXEC | O_NONBLOCK) == -1 || s->listener == -1 ||
+        sigaction(SIGCHLD, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1 ||
+        sched_fill_addr(&addr, s->sock_path) != 0) {
+        reply[1] = errno ? errno : ENAMETOOLONG;
+        goto fail;
+    }
+
+    unlink(s->sock_path);
+    mode_t old_mask = umask(077);
+    int rc = bind(s->listener, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc == -1 || listen(s->listener, 128) == -1) {
+        reply[1] = errno;
+        goto fail;
+    }
+
+    int requeued = db_rewrite(s->db_path, requeue_running, NULL);
+    for (int i = 0; i < s->stats.workers; i++) {
+        s->workers[i].fd = -1;
+    }
+    for (int i = 0; i < s->stats.workers; i++) {
+        if (sched_spawn_worker(s, &s->workers[i]) != 0) {
+            reply[1] = errno;
+            goto fail;
+        }
+    }
+
+    s->stats.pid = getpid();
+    mdock_logf("SCHED start pid=%d workers=%d order=%s requeued=%d", (int)getpid(), s->stats.workers,
+               s->stats.order == QUEUE_PRIORITY ? "priority" : "fifo", requeued > 0 ? requeued : 0);
+    reply[0] = getpid();
+    if (write(report_fd, reply, sizeof(reply)) != (ssize_t)sizeof(reply)) {
+        _exit(1);
+    }
+    close(report_fd);
+
+    sched_run(s);
+    _exit(0);
+
+fail:
+    if (write(report_fd, reply, sizeof(reply)) < 0) {
+        _exit(1);
+    }
+    _exit(1);
+}
+
+/* ----- mdock scheduler ----- */
+
+static void scheduler_usage(void)
+{
+    fprintf(stderr, "Usage: mdock scheduler start [--max-concurrent N] [--image-max IMAGE=N]... "
+                    "[--order fifo|priority]\n");
+    fprintf(stderr, "       mdock scheduler stop\n");
+    fprintf(stderr, "       mdock scheduler status\n");
+}
+
+static int scheduler_start(const char *base_dir, int argc, char **argv)
+{
+    static struct scheduler s;
+    memset(&s, 0, sizeof(s));
+    s.stats.workers = QUEUE_DEFAULT_CONCURRENCY;
+    s.stats.order = QUEUE_FIFO;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--max-concurrent") == 0 && i + 1 < argc) {
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 1 || n > QUEUE_MAX_CONCURRENCY) {
+                fprintf(stderr, "[mdock] error: invalid concurrency '%s' (1-%d)\n", argv[i],
+                        QUEUE_MAX_CONCURRENCY);
+                return 1;
+            }
+            s.stats.workers = (int32_t)n;
+        } else if (strcmp(argv[i], "--image-max") == 0 && i + 1 < argc) {
+            const char *spec = argv[++i];
+            const char *eq = strrchr(spec, '=');
+            char *end;
+            long n = eq ? strtol(eq + 1, &end, 10) : 0;
+            if (!eq || eq == spec || (size_t)(eq - spec) >= MDOCK_NAME_MAX || *end != '\0' || n < 1 ||
+                s.stats.ncaps == QUEUE_MAX_IMAGE_CAPS) {
+                fprintf(stderr, "[mdock] error: invalid --image-max '%s' (IMAGE=N, at most %d images)\n",
+                        spec, QUEUE_MAX_IMAGE_CAPS);
+                return 1;
+            }
+            snprintf(s.stats.caps[s.stats.ncaps].image, MDOCK_NAME_MAX, "%.*s", (int)(eq - spec), spec);
+            s.stats.caps[s.stats.ncaps].max = (int32_t)n;
+            s.stats.ncaps++;
+        } else if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "fifo") == 0) {
+                s.stats.order = QUEUE_FIFO;
+            } else if (strcmp(argv[i], "priority") == 0) {
+                s.stats.order = QUEUE_PRIORITY;
+            } else {
+                fprintf(stderr, "[mdock] error: invalid order '%s' (fifo or priority)\n", argv[i]);
+                return 1;
+            }
+        } else {
+            scheduler_usage();
+            return 1;
+        }
+    }
+
+    snprintf(s.base_dir, sizeof(s.base_dir), "%s", base_dir);
+    if (jobs_db_path(base_dir, s.db_path, sizeof(s.db_path)) != 0 ||
+        sched_socket_path(base_dir, s.sock_path, sizeof(s.sock_path)) != 0) {
+        return 1;
+    }
+    if (snprintf(s.jobs_dir, sizeof(s.jobs_dir), "%s/jobs", base_dir) >= (int)sizeof(s.jobs_dir) ||
+        ensure_dir_exists(s.jobs_dir, 0755) != 0) {
+        return 1;
+    }
+
+    int existing = sched_connect(s.sock_path);
+    if (existing >= 0) {
+        close(existing);
+        fprintf(stderr, "[mdock] error: a scheduler is already running\n");
+        return 1;
+    }
+
+    int report[2];
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        perror("[mdock] pipe2");
+        return 1;
+    }
+
+    fflush(NULL);
+    pid_t middle = fork();
+    if (middle == -1) {
+        perror("[mdock] fork");
+        close(report[0]);
+        close(report[1]);
+        return 1;
+    }
+    if (middle == 0) {
+        /* Double fork: the scheduler is reparented and outlives this command */
+        close(report[0]);
+        pid_t sched = fork();
+        if (sched == 0) {
+            sched_main(&s, report[1]);
+        }
+        _exit(sched == -1 ? 1 : 0);
+    }
+
+    close(report[1]);
+    while (waitpid(middle, NULL, 0) == -1 && errno == EINTR) {
+    }
+    int32_t reply[2];
+    ssize_t n;
+    while ((n = read(report[0], reply, sizeof(reply))) == -1 && errno == EINTR) {
+    }
+    close(report[0]);
+
+    if (n != (ssize_t)sizeof(reply) || reply[0] <= 0) {
+        fprintf(stderr, "[mdock] error: scheduler failed to start: %s\n",
+                n == (ssize_t)sizeof(reply) ? strerror(reply[1]) : "scheduler exited");
+        return 1;
+    }
+
+    printf("Scheduler started (PID %d, %d workers, %s order)\n", reply[0], s.stats.workers,
+           s.stats.order == QUEUE_PRIORITY ? "priority" : "fifo");
+    return 0;
+}
+
+static int scheduler_request(const char *base_dir, enum msg_type type, struct msg_header *hdr, char **payload)
+{
+    char path[PATH_MAX];
+    if (sched_socket_path(base_dir, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    int fd = sched_connect(path);
+    if (fd < 0) {
+        fprintf(stderr, "[mdock] error: no scheduler is running\n");
+        return -1;
+    }
+    *payload = NULL;
+    int rc = (msg_send(fd, type, NULL, 0) == 0 && msg_recv(fd, hdr, payload) == 1 &&
+              hdr->type == type) ? 0 : -1;
+    close(fd);
+    if (rc != 0) {
+        free(*payload);
+        *payload = NULL;
+        fprintf(stderr, "[mdock] error: the scheduler did not answer\n");
+    }
+    return rc;
+}
+
+static int scheduler_stop(const char *base_dir)
+{
+    struct msg_header hdr;
+    char *payload;
+    if (scheduler_request(base_dir, MSG_SCHED_STOP, &hdr, &payload) != 0) {
+        return 1;
+    }
+    free(payload);
+    printf("Scheduler stopping once its running jobs finish\n");
+    return 0;
+}
+
+static int scheduler_status(const char *base_dir)
+{
+    struct msg_header hdr;
+    char *payload;
+    if (scheduler_request(base_dir, MSG_SCHED_STATUS, &hdr, &payload) != 0) {
+        return 1;
+    }
+    if (hdr.len != sizeof(struct sched_stats)) {
+        free(payload);
+        fprintf(stderr, "[mdock] error: unexpected scheduler status\n");
+        return 1;
+    }
+    struct sched_stats *st = (struct sched_stats *)payload;
+    printf("Scheduler PID %d: %d workers, %d busy, %s order%s\n", st->pid, st->workers, st->busy,
+           st->order == QUEUE_PRIORITY ? "priority" : "fifo", st->draining ? ", stopping" : "");
+    printf("Jobs started %llu, finished %llu, failed to start %llu\n", (unsigned long long)st->started,
+           (unsigned long long)st->finished, (unsigned long long)st->failed);
+    if (st->ncaps > 0) {
+        printf("%-20s %-6s %s\n", "IMAGE", "MAX", "RUNNING");
+        for (int i = 0; i < st->ncaps && i < QUEUE_MAX_IMAGE_CAPS; i++) {
+            printf("%-20s %-6d %d\n", st->caps[i].image, st->caps[i].max, st->caps[i].running);
+        }
+    }
+    free(payload);
+    return 0;
+}
+
+int cmd_scheduler(int argc, char **argv)
+{
+    if (argc < 2) {
+        scheduler_usage();
+        return 1;
+    }
+
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        return 1;
+    }
+
+    const char *sub = argv[1];
+    if (strcmp(sub, "start") == 0) {
+        return scheduler_start(base_dir, argc, argv);
+    } else if (strcmp(sub, "stop") == 0 && argc == 2) {
+        return scheduler_stop(base_dir);
+    } else if (strcmp(sub, "status") == 0 && argc == 2) {
+        return scheduler_status(base_dir);
+    }
+    scheduler_usage();
+    return 1;
+}
+
+/* ----- mdock jobs ----- */
+
+struct jobs_summary {
+    long queued;
+    long running;
+    long exited;
+    long failed;
+    double *waits;          /* submit to start of every started job, ms */
+    size_t nwaits;
+    size_t cap;
+    int64_t first_submit;
+    int64_t last_end;
+    long recent;            /* finished within QUEUE_RATE_WINDOW_S */
+    int64_t now;
+};
+
+static void jobs_account(struct jobs_summary *sum, const struct job_record *rec)
+{
+    if (strcmp(rec->state, "queued") == 0) {
+        sum->queued++;
+    } else if (strcmp(rec->state, "running") == 0) {
+        sum->running++;
+    } else if (strcmp(rec->state, "exited") == 0) {
+        sum->exited++;
+    } else if (strcmp(rec->state, "failed") == 0) {
+        sum->failed++;
+    }
+    if (rec->start_ns > 0) {
+        if (sum->nwaits == sum->cap) {
+            size_t cap = sum->cap ? sum->cap * 2 : 256;
+            double *grown = realloc(sum->waits, cap * sizeof(*grown));
+            if (!grown) {
+                return;
+            }
+            sum->waits = grown;
+            sum->cap = cap;
+        }
+        sum->waits[sum->nwaits++] = (double)(rec->start_ns - rec->submit_ns) / 1e6;
+    }
+    if (sum->first_submit == 0 || rec->submit_ns < sum->first_submit) {
+        sum->first_submit = rec->submit_ns;
+    }
+    if (rec->end_ns > sum->last_end) {
+        sum->last_end = rec->end_ns;
+    }
+    if (rec->end_ns > 0 && sum->now - rec->end_ns <= QUEUE_RATE_WINDOW_S * 1000000000LL) {
+        sum->recent++;
+    }
+}
+
+/* The run arguments after the image, as a shell-like string for the table */
+static void jobs_command(const struct job_record *rec, char *out, size_t size, char **args, int *nargs)
+{
+    static char decoded[MDOCK_JOB_ARGS_MAX];
+    *nargs = job_args_decode(rec->args, decoded, args, QUEUE_MAX_ARGS);
+    out[0] = '\0';
+    size_t len = 0;
+    for (int i = 0; i < *nargs && len + 1 < size; i++) {
+        int n = snprintf(out + len, size - len, "%s%s", len ? " " : "", args[i]);
+        if (n < 0) {
+            break;
+        }
+        len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+    }
+}
+
+static int drop_finished(const struct db_row *row, FILE *out, void *arg)
+{
+    (void)out;
+    (void)arg;
+    if (row->nfields < JF_REQUIRED) {
+        return 0;
+    }
+    return db_field_eq(&row->fields[JF_STATE], "exited") || db_field_eq(&row->fields[JF_STATE], "failed");
+}
+
+static void jobs_usage(void)
+{
+    fprintf(stderr, "Usage: mdock jobs [--state queued|running|exited|failed] [--json]\n");
+    fprintf(stderr, "       mdock jobs prune\n");
+}
+
+int cmd_jobs(int argc, char **argv)
+{
+    const char *state = NULL;
+    int json = 0;
+    int prune = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--state") == 0 && i + 1 < argc) {
+            state = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "prune") == 0 && argc == 2) {
+            prune = 1;
+        } else {
+            jobs_usage();
+            return 1;
+        }
+    }
+
+    char base_dir[PATH_MAX];
+    char db_path[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0 ||
+        jobs_db_path(base_dir, db_path, sizeof(db_path)) != 0) {
+        return 1;
+    }
+    if (prune) {
+        int n = db_rewrite(db_path, drop_finished, NULL);
+        if (n < 0) {
+            return 1;
+        }
+        printf("Removed %d finished jobs\n", n);
+        return 0;
+    }
+
+    /* Nothing submitted yet: an empty queue */
+    struct db_map map;
+    if (db_map_open(db_path, &map) != 0 && errno != ENOENT) {
+        perror("[mdock] open jobs.db");
+        return 1;
+    }
+
+    struct job_record rec;
+    struct jobs_summary sum;
+    memset(&sum, 0, sizeof(sum));
+    sum.now = mdock_realtime_ns();
+    char **args = malloc(QUEUE_MAX_ARGS * sizeof(*args));
+    if (!args) {
+        perror("[mdock] malloc");
+        db_map_close(&map);
+        return 1;
+    }
+    if (json) {
+        printf("{\"jobs\": [");
+    } else {
+        printf("%-8s %-8s %-5s %-16s %-10s %-5s %-14s %-14s %s\n",
+               "ID", "STATE", "PRIO", "IMAGE", "CONTAINER", "EXIT", "WAIT", "RUN", "ARGS");
+    }
+
+    int printed = 0;
+    struct db_scanner s;
+    struct db_row row;
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        if (job_record_parse(&row, &rec) != 0) {
+            continue;
+        }
+        jobs_account(&sum, &rec);
+        if (state && strcmp(rec.state, state) != 0) {
+            continue;
+        }
+
+        char command[256];
+        int nargs;
+        jobs_command(&rec, command, sizeof(command), args, &nargs);
+        int64_t wait_ns = (rec.start_ns > 0 ? rec.start_ns : sum.now) - rec.submit_ns;
+        int64_t run_ns = rec.start_ns > 0 ? (rec.end_ns > 0 ? rec.end_ns : sum.now) - rec.start_ns : 0;
+
+        if (json) {
+            printf("%s\n  {\"id\": \"%s\", \"state\": \"%s\", \"priority\": %d, \"image\": ",
+                   printed ? "," : "", rec.id, rec.state, rec.priority);
+            mdock_json_string(stdout, rec.image);
+            printf(", \"container\": ");
+            if (rec.container[0]) {
+                mdock_json_string(stdout, rec.container);
+            } else {
+                printf("null");
+            }
+            printf(", \"exit_code\": ");
+            if (rec.exit_code != MDOCK_UNSET) {
+                printf("%d", rec.exit_code);
+            } else {
+                printf("null");
+            }
+            printf(", \"submit_ns\": %lld, \"wait_ms\": %.3f, \"run_ms\": %.3f, \"args\": [",
+                   (long long)rec.submit_ns, (double)wait_ns / 1e6, (double)run_ns / 1e6);
+            for (int i = 0; i < nargs; i++) {
+                if (i > 0) {
+                    printf(", ");
+                }
+                mdock_json_string(stdout, args[i]);
+            }
+            printf("]}");
+        } else {
+            char wait_buf[32];
+            char run_buf[32];
+            char exit_buf[16] = "-";
+            mdock_format_duration(wait_ns, wait_buf, sizeof(wait_buf));
+            mdock_format_duration(run_ns, run_buf, sizeof(run_buf));
+            if (rec.exit_code != MDOCK_UNSET) {
+                snprintf(exit_buf, sizeof(exit_buf), "%d", rec.exit_code);
+            }
+            printf("%-8s %-8s %-5d %-16s %-10s %-5s %-14s %-14s %s\n", rec.id, rec.state, rec.priority,
+                   rec.image, rec.container[0] ? rec.container : "-", exit_buf,
+                   wait_buf, rec.start_ns > 0 ? run_buf : "-", command);
+        }
+        printed++;
+    }
+    db_map_close(&map);
+    free(args);
+
+    mdock_sort_samples(sum.waits, sum.nwaits);
+    long finished = sum.exited + sum.failed;
+    /* From the first submit, so time spent queued counts against the rate */
+    double span_s = (sum.last_end > sum.first_submit && sum.first_submit > 0)
+                        ? (double)(sum.last_end - sum.first_submit) / 1e9 : 0.0;
+    double per_sec = span_s > 0 ? (double)finished / span_s : 0.0;
+    double recent_per_sec = (double)sum.recent / QUEUE_RATE_WINDOW_S;
+    double p50 = mdock_percentile(sum.waits, sum.nwaits, 0.50);
+    double p90 = mdock_percentile(sum.waits, sum.nwaits, 0.90);
+    double p99 = mdock_percentile(sum.waits, sum.nwaits, 0.99);
+    double max = sum.nwaits ? sum.waits[sum.nwaits - 1] : 0.0;
+
+    if (json) {
+        printf("%s], \"queued\": %ld, \"running\": %ld, \"exited\": %ld, \"failed\": %ld, "
+               "\"wait_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+               "\"jobs_per_sec\": %.3f, \"jobs_per_sec_recent\": %.3f, \"recent_window_s\": %d}\n",
+               printed ? "\n" : "", sum.queued, sum.running, sum.exited, sum.failed,
+               p50, p90, p99, max, per_sec, recent_per_sec, QUEUE_RATE_WINDOW_S);
+    } else {
+        printf("\nQueue: %ld queued, %ld running, %ld exited, %ld failed\n",
+               sum.queued, sum.running, sum.exited, sum.failed);
+        printf("Wait:  p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms (%zu started)\n",
+               p50, p90, p99, max, sum.nwaits);
+        printf("Rate:  %.2f jobs/s over the last %d s, %.2f jobs/s overall (%ld finished in %.1f s)\n",
+               recent_per_sec, QUEUE_RATE_WINDOW_S, per_sec, finished, span_s);
+    }
+    free(sum.waits);
+    return 0;
+}
@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "record.h"
+#include "timeutil.h"
+
+/* ----- Mapping ----- */
+
+/*
+ * Optional cache of read-only mappings for long-lived processes (mdockd).
+ * A mapping is reused while the file keeps its inode, size and mtime:
+ * writers either append (size changes) or rename a rewrite over the file
+ * (inode changes), so a stale mapping is never served.
+ */
+#define DB_CACHE_SLOTS 4
+
+struct db_cache_entry {
+    char path[PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    const char *data;
+    int refs;
+};
+
+static struct db_cache_entry db_cache[DB_CACHE_SLOTS];
+static int db_cache_enabled;
+
+void db_map_cache_enable(void)
+{
+    db_cache_enabled = 1;
+}
+
+static int db_cache_matches(const struct db_cache_entry *e, const char *path, const struct stat *st)
+{
+    return e->data && e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+           strcmp(e->path, path) == 0;
+}
+
+static void db_cache_store(const char *path, const struct stat *st, const char *data)
+{
+    if (strlen(path) >= sizeof(db_cache[0].path)) {
+        return;
+    }
+
+    /* Prefer the slot of an older version of the same file, then any idle one */
+    struct db_cache_entry *slot = NULL;
+    for (int i = 0; i < DB_CACHE_SLOTS; i++) {
+        struct db_cache_entry *e = &db_cache[i];
+        if (e->refs > 0) {
+            continue;
+        }
+        if (!e->data || strcmp(e->path, path) == 0) {
+            slot = e;
+            break;
+        }
+        if (!slot) {
+            slot = e;
+        }
+    }
+    if (!slot) {
+        return;
+    }
+
+    if (slot->data) {
+        munmap((void *)slot->data, (size_t)slot->size);
+    }
+    strcpy(slot->path, path);
+    slot->dev = st->st_dev;
+    slot->ino = st->st_ino;
+    slot->size = st->st_size;
+    slot->mtime = st->st_mtim;
+    slot->data = data;
+    slot->refs = 1;
+}
+
+int db_map_open(const char *path, struct db_map *map)
+{
+    map->data = NULL;
+    map->size = 0;
+
+    struct stat st;
+    if (db_cache_enabled) {
+        if (stat(path, &st) == -1) {
+            return -1;
+        }
+        for (int i = 0; i < DB_CACHE_SLOTS; i++) {
+            if (db_cache_matches(&db_cache[i], path, &st)) {
+                db_cache[i].refs++;
+                map->data = db_cache[i].data;
+                map->size = (size_t)st.st_size;
+                return 0;
+            }
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        errno = saved;
+        return -1;
+    }
+
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    map->data = data;
+    map->size = (size_t)st.st_size;
+
+    if (db_cache_enabled) {
+        db_cache_store(path, &st, data);
+    }
+    return 0;
+}
+
+void db_map_close(struct db_map *map)
+{
+    if (map->data) {
+        int cached = 0;
+        for (int i = 0; i < DB_CACHE_SLOTS; i++) {
+            if (db_cache[i].data == map->data) {
+                db_cache[i].refs--;
+                cached = 1;
+                break;
+            }
+        }
+        if (!cached) {
+            munmap((void *)map->data, map->size);
+        }
+    }
+    map->data = NULL;
+    map->size = 0;
+}
+
+/* ----- Scanning ----- */
+
+void db_scanner_init(struct db_scanner *s, const struct db_map *map)
+{
+    s->pos = map->data;
+    s->end = map->data ? map->data + map->size : NULL;
+}
+
+/* Close the field [start, delim) and return where the next one begins.
+ * Once the row is full, remaining delimiters stay inside the last field. */
+static inline const char *split_field(struct db_row *row, const char *start, const char *delim)
+{
+    if (row->nfields >= DB_MAX_FIELDS - 1) {
+        return start;
+    }
+    row->fields[row->nfields].ptr = start;
+    row->fields[row->nfields].len = (size_t)(delim - start);
+    row->nfields++;
+    return delim + 1;
+}
+
+#if defined(__SSE2__)
+/* Bitmask of the '|' and '\n' bytes among the 16 bytes at p */
+static inline unsigned delim_mask16(const char *p)
+{
+    const __m128i bar = _mm_set1_epi8('|');
+    const __m128i nl = _mm_set1_epi8('\n');
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(v, bar), _mm_cmpeq_epi8(v, nl));
+    return (unsigned)_mm_movemask_epi8(hits);
+}
+#endif
+
+int db_scanner_next(struct db_scanner *s, struct db_row *row)
+{
+    const char *p = s->pos;
+    const char *end = s->end;
+    if (!p || p >= end) {
+        return 0;
+    }
+
+    const char *field = p;
+    const char *eol = NULL;
+
+    row->line = p;
+    row->nfields = 0;
+
+#if defined(__SSE2__)
+    /* Find every delimiter of a 16-byte block with one compare */
+    while (!eol && end - p >= 16) {
+        unsigned mask = delim_mask16(p);
+        while (mask) {
+            const char *d = p + __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (*d == '\n') {
+                eol = d;
+                break;
+            }
+            field = split_field(row, field, d);
+        }
+        if (!eol) {
+            p += 16;
+        }
+    }
+#endif
+
+    for (; !eol && p < end; p++) {
+        if (*p == '\n') {
+            eol = p;
+        } else if (*p == '|') {
+            field = split_field(row, field, p);
+        }
+    }
+
+    const char *line_end = eol ? eol : end;
+    row->fields[row->nfields].ptr = field;
+    row->fields[row->nfields].len = (size_t)(line_end - field);
+    row->nfields++;
+
+    s->pos = eol ? eol + 1 : end;
+    row->len = (size_t)(s->pos - row->line);
+    return 1;
+}
+
+int db_scanner_prev(struct db_scanner *s, struct db_row *row)
+{
+    const char *start = s->pos;
+    const char *end = s->end;
+    if (!start || end <= start) {
+        return 0;
+    }
+
+    /* Skip the newline that terminates the last line, then find the one before it */
+    const char *p = end;
+    if (p[-1] == '\n') {
+        p--;
+    }
+    while (p > start && p[-1] != '\n') {
+        p--;
+    }
+
+    struct db_scanner line = { p, end };
+    db_scanner_next(&line, row);
+    s->end = p;
+    return 1;
+}
+
+/* ----- Field helpers ----- */
+
+int db_field_eq(const struct db_field *f, const char *s)
+{
+    size_t len = strlen(s);
+    return f->len == len && memcmp(f->ptr, s, len) == 0;
+}
+
+long db_field_long(const struct db_field *f)
+{
+    const char *p = f->ptr;
+    const char *end = f->ptr + f->len;
+    int neg = 0;
+    long value = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (*p - '0');
+    }
+    return neg ? -value : value;
+}
+
+void db_field_copy(const struct db_field *f, char *buf, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    size_t n = f->len < size - 1 ? f->len : size - 1;
+    memcpy(buf, f->ptr, n);
+    buf[n] = '\0';
+}
+
+int64_t db_field_time(const struct db_field *f)
+{
+    for (size_t i = 0; i < f->len; i++) {
+        if (f->ptr[i] < '0' || f->ptr[i] > '9') {
+            /* Written by an older version as a local-time string */
+            char legacy[MDOCK_TIME_MAX];
+            db_field_copy(f, legacy, sizeof(legacy));
+            return mdock_parse_timestamp(legacy);
+        }
+    }
+    return (int64_t)db_field_long(f);
+}
+
+/* Unset times are written as empty fields */
+static void write_time(FILE *f, int64_t ns)
+{
+    if (ns > 0) {
+        fprintf(f, "%lld", (long long)ns);
+    }
+}
+
+/* ----- Locking ----- */
+
+int db_lock(const char *path)
+{
+    char lock_path[PATH_MAX];
+    if (snprintf(lock_path, sizeof(lock_path), "%s.lock", path) >= (int)sizeof(lock_path)) {
+        fprintf(stderr, "[mdock] lock path too long\n");
+        return -1;
+    }
+
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "[mdock] open %s: %s\n", lock_path, strerror(errno));
+        return -1;
+    }
+
+    while (flock(fd, LOCK_EX) == -1) {
+        if (errno != EINTR) {
+            fprintf(stderr, "[mdock] flock %s: %s\n", lock_path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+int db_trylock(const char *path)
+{
+    char lock_path[PATH_MAX];
+    if (snprintf(lock_path, sizeof(lock_path), "%s.lock", path) >= (int)sizeof(lock_path)) {
+        fprintf(stderr, "[mdock] lock path too long\n");
+        return -1;
+    }
+
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "[mdock] open %s: %s\n", lock_path, strerror(errno));
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+void db_unlock(int fd)
+{
+    if (fd >= 0) {
+        close(fd); /* releases the flock */
+    }
+}
+
+/* ----- Rewriting ----- */
+
+int db_rewrite_locked(const char *path, db_rewrite_fn fn, void *arg)
+{
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        fprintf(stderr, "[mdock] tmp path too long\n");
+        return -1;
+    }
+
+    struct db_map map;
+    if (db_map_open(path, &map) != 0) {
+        fprintf(stderr, "[mdock] open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        fprintf(stderr, "[mdock] fopen %s: %s\n", tmp_path, strerror(errno));
+        db_map_close(&map);
+        return -1;
+    }
+
+    struct db_scanner s;
+    struct db_row row;
+    int changed = 0;
+
+    db_scanner_init(&s, &map);
+    while (db_scanner_next(&s, &row)) {
+        if (fn(&row, out, arg)) {
+            changed++;
+        } else {
+            fwrite(row.line, 1, row.len, out);
+        }
+    }
+
+    db_map_close(&map);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "[mdock] write %s: %s\n", tmp_path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    if (changed == 0) {
+        unlink(tmp_path);
+        return 0;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        fprintf(stderr, "[mdock] rename %s: %s\n", tmp_path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return changed;
+}
+
+int db_rewrite(const char *path, db_rewrite_fn fn, void *arg)
+{
+    int lock = db_lock(path);
+    if (lock < 0) {
+        return -1;
+    }
+    int changed = db_rewrite_locked(path, fn, arg);
+    db_unlock(lock);
+    return changed;
+}
+
+/* ----- containers.db ----- */
+
+int container_record_parse(const struct db_row *row, struct container_record *rec)
+{
+    if (row->nfields < CF_REQUIRED) {
+        return -1;
+    }
+
+    const struct db_field *f = row->fields;
+    db_field_copy(&f[CF_ID], rec->id, sizeof(rec->id));
+    rec->pid = (int)db_field_long(&f[CF_PID]);
+    db_field_copy(&f[CF_IMAGE], rec->image, sizeof(rec->image));
+    db_field_copy(&f[CF_STATUS], rec->status, sizeof(rec->status));
+    rec->start_ns = db_field_time(&f[CF_START]);
+    rec->end_ns = db_field_time(&f[CF_END]);
+    rec->exit_code = (int)db_field_long(&f[CF_EXIT]);
+
+    rec->shard[0] = '\0';
+    if (row->nfields > CF_SHARD) {
+        db_field_copy(&f[CF_SHARD], rec->shard, sizeof(rec->shard));
+    }
+    rec->duration_ns = (row->nfields > CF_DURATION) ? db_field_time(&f[CF_DURATION]) : 0;
+    rec->pid_start = (row->nfields > CF_PID_START) ? (uint64_t)db_field_long(&f[CF_PID_START]) : 0;
+    rec->reason[0] = '\0';
+    if (row->nfields > CF_REASON) {
+        db_field_copy(&f[CF_REASON], rec->reason, sizeof(rec->reason));
+    }
+    rec->cpuset[0] = '\0';
+    if (row->nfields > CF_CPUSET) {
+        db_field_copy(&f[CF_CPUSET], rec->cpuset, sizeof(rec->cpuset));
+    }
+    rec->numa_node = (row->nfields > CF_NUMA_NODE && f[CF_NUMA_NODE].len > 0)
+                         ? (int)db_field_long(&f[CF_NUMA_NODE]) : -1;
+    rec->cpu_rate_milli = (row->nfields > CF_CPU_RATE) ? (int)db_field_long(&f[CF_CPU_RATE]) : 0;
+    rec->cpu_used_milli = (row->nfields > CF_CPU_USED) ? (int)db_field_long(&f[CF_CPU_USED]) : 0;
+
+    int64_t *usage[] = {
+        &rec->usage.utime_us, &rec->usage.stime_us, &rec->usage.maxrss_kb,
+        &rec->usage.minflt, &rec->usage.majflt, &rec->usage.nvcsw,
+        &rec->usage.nivcsw, &rec->usage.inblock, &rec->usage.oublock,
+    };
+    rec->has_usage = row->nfields > CF_OUBLOCK && f[CF_UTIME].len > 0;
+    for (int i = 0; i < (int)(sizeof(usage) / sizeof(usage[0])); i++) {
+        *usage[i] = rec->has_usage ? (int64_t)db_field_long(&f[CF_UTIME + i]) : 0;
+    }
+
+    rec->nice = (row->nfields > CF_NICE && f[CF_NICE].len > 0)
+                    ? (int)db_field_long(&f[CF_NICE]) : MDOCK_UNSET;
+    rec->sched[0] = '\0';
+    if (row->nfields > CF_SCHED) {
+        db_field_copy(&f[CF_SCHED], rec->sched, sizeof(rec->sched));
+    }
+    rec->ioprio[0] = '\0';
+    if (row->nfields > CF_IOPRIO) {
+        db_field_copy(&f[CF_IOPRIO], rec->ioprio, sizeof(rec->ioprio));
+    }
+    rec->oom_score_adj = (row->nfields > CF_OOM_SCORE_ADJ && f[CF_OOM_SCORE_ADJ].len > 0)
+                             ? (int)db_field_long(&f[CF_OOM_SCORE_ADJ]) : MDOCK_UNSET;
+    rec->thp[0] = '\0';
+    if (row->nfields > CF_THP) {
+        db_field_copy(&f[CF_THP], rec->thp, sizeof(rec->thp));
+    }
+    rec->ksm = (row->nfields > CF_KSM) ? (int)db_field_long(&f[CF_KSM]) : 0;
+    rec->mlock_all = (row->nfields > CF_MLOCK_ALL) ? (int)db_field_long(&f[CF_MLOCK_ALL]) : 0;
+    rec->mem_commit = (row->nfields > CF_MEM_COMMIT) ? (int64_t)db_field_long(&f[CF_MEM_COMMIT]) : 0;
+    return 0;
+}
+
+int container_record_write(FILE *f, const struct container_record *rec)
+{
+    fprintf(f, "%s|%d|%s|%s|", rec->id, rec->pid, rec->image, rec->status);
+    write_time(f, rec->start_ns);
+    fputc('|', f);
+    write_time(f, rec->end_ns);
+    fprintf(f, "|%d|%s|", rec->exit_code, rec->shard);
+    write_time(f, rec->duration_ns);
+    fprintf(f, "|%llu|%s|%s|", (unsigned long long)rec->pid_start, rec->reason, rec->cpuset);
+    if (rec->numa_node >= 0) {
+        fprintf(f, "%d", rec->numa_node);
+    }
+    fprintf(f, "|%d|%d", rec->cpu_rate_milli, rec->cpu_used_milli);
+    if (rec->has_usage) {
+        const struct container_usage *u = &rec->usage;
+        fprintf(f, "|%lld|%lld|%lld|%lld|%lld|%lld|%lld|%lld|%lld",
+                (long long)u->utime_us, (long long)u->stime_us, (long long)u->maxrss_kb,
+                (long long)u->minflt, (long long)u->majflt, (long long)u->nvcsw,
+                (long long)u->nivcsw, (long long)u->inblock, (long long)u->oublock);
+    } else {
+        fputs("|||||||||", f);
+    }
+    fputc('|', f);
+    if (rec->nice != MDOCK_UNSET) {
+        fprintf(f, "%d", rec->nice);
+    }
+    fprintf(f, "|%s|%s|", rec->sched, rec->ioprio);
+    if (rec->oom_score_adj != MDOCK_UNSET) {
+        fprintf(f, "%d", rec->oom_score_adj);
+    }
+    fprintf(f, "|%s|%d|%d|", rec->thp, rec->ksm, rec->mlock_all);
+    if (rec->mem_commit > 0) {
+        fprintf(f, "%lld", (long long)rec->mem_commit);
+    }
+    return fputc('\n', f) == EOF ? -1 : 0;
+}
+
+/* ----- images.db ----- */
+
+int image_record_parse(const struct db_row *row, struct image_record *rec)
+{
+    if (row->nfields < IF_REQUIRED) {
+        return -1;
+    }
+
+    db_field_copy(&row->fields[IF_NAME], rec->name, sizeof(rec->name));
+    db_field_copy(&row->fields[IF_ROOTFS], rec->rootfs, sizeof(rec->rootfs));
+    rec->created_ns = db_field_time(&row->fields[IF_CREATED]);
+
+    rec->shard[0] = '\0';
+    if (row->nfields > IF_SHARD) {
+        db_field_copy(&row->fields[IF_SHARD], rec->shard, sizeof(rec->shard));
+    }
+    return 0;
+}
+
+int image_record_write(FILE *f, const struct image_record *rec)
+{
+    int n = fprintf(f, "%s|%s|%lld|%s\n", rec->name, rec->rootfs,
+                    (long long)rec->created_ns, rec->shard);
+    return n < 0 ? -1 : 0;
+}
+
+/* ----- jobs.db ----- */
+
+int job_record_parse(const struct db_row *row, struct job_record *rec)
+{
+    if (row->nfields < JF_REQUIRED) {
+        return -1;
+    }
+
+    const struct db_field *f = row->fields;
+    db_field_copy(&f[JF_ID], rec->id, sizeof(rec->id));
+    db_field_copy(&f[JF_STATE], rec->state, sizeof(rec->state));
+    rec->priority = (int)db_field_long(&f[JF_PRIORITY]);
+    db_field_copy(&f[JF_IMAGE], rec->image, sizeof(rec->image));
+    rec->submit_ns = db_field_time(&f[JF_SUBMIT]);
+    rec->start_ns = db_field_time(&f[JF_START]);
+    rec->end_ns = db_field_time(&f[JF_END]);
+    db_field_copy(&f[JF_CONTAINER], rec->container, sizeof(rec->container));
+    rec->exit_code = f[JF_EXIT].len > 0 ? (int)db_field_long(&f[JF_EXIT]) : MDOCK_UNSET;
+    rec->worker = (int)db_field_long(&f[JF_WORKER]);
+    db_field_copy(&f[JF_ARGS], rec->args, sizeof(rec->args));
+    return 0;
+}
+
+int job_record_write(FILE *f, const struct job_record *rec)
+{
+    fprintf(f, "%s|%s|%d|%s|", rec->id, rec->state, rec->priority, rec->image);
+    write_time(f, rec->submit_ns);
+    fputc('|', f);
+    write_time(f, rec->start_ns);
+    fputc('|', f);
+    write_time(f, rec->end_ns);
+    fprintf(f, "|%s|", rec->container);
+    if (rec->exit_code != MDOCK_UNSET) {
+        fprintf(f, "%d", rec->exit_code);
+    }
+    fputc('|', f);
+    if (rec->worker > 0) {
+        fprintf(f, "%d", rec->worker);
+    }
+    fprintf(f, "|%s", rec->args);
+    return fputc('\n', f) == EOF ? -1 : 0;
+}
@@ -0,0 +1,40 @@
+#include <stdlib.h>
+
+#include "report.h"
+
+void mdock_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void mdock_sort_samples(double *samples, size_t n)
+{
+    qsort(samples, n, sizeof(*samples), cmp_double);
+}
+
+double mdock_percentile(const double *sorted, size_t n, double p)
+{
+    if (n == 0) {
+        return 0.0;
+    }
+    size_t idx = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[idx];
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/statvfs.h>
+
+#include "shard.h"
+#include "fsutil.h"
+
+static int shard_add(struct shard_set *set, const char *dir, size_t len)
+{
+    while (len > 1 && dir[len - 1] == '/') {
+        len--;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (set->count >= MDOCK_MAX_SHARDS) {
+        fprintf(stderr, "[mdock] too many data directories (max %d)\n", MDOCK_MAX_SHARDS);
+        return -1;
+    }
+    if (len + 1 > sizeof(set->dirs[0])) {
+        fprintf(stderr, "[mdock] data directory path too long\n");
+        return -1;
+    }
+    memcpy(set->dirs[set->count], dir, len);
+    set->dirs[set->count][len] = '\0';
+    set->count++;
+    return 0;
+}
+
+static int shard_set_policy(struct shard_set *set, const char *name)
+{
+    if (strcmp(name, "hash") == 0) {
+        set->policy = SHARD_HASH;
+    } else if (strcmp(name, "space") == 0) {
+        set->policy = SHARD_SPACE;
+    } else {
+        fprintf(stderr, "[mdock] unknown placement policy '%s' (use hash or space)\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static int shard_load_file(const char *base_dir, struct shard_set *set)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/data_dirs", base_dir) >= (int)sizeof(path)) {
+        return 0;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0; /* not configured */
+    }
+
+    char line[PATH_MAX + 32];
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        if (strncmp(p, "placement=", 10) == 0) {
+            ret = shard_set_policy(set, p + 10);
+        } else {
+            ret = shard_add(set, p, strlen(p));
+        }
+    }
+
+    fclose(f);
+    return ret;
+}
+
+int shard_load(const char *base_dir, struct shard_set *set)
+{
+    set->count = 0;
+    set->policy = SHARD_HASH;
+
+    const char *env = getenv("MDOCK_DATA_DIRS");
+    if (env && env[0] != '\0') {
+        const char *p = env;
+        while (*p) {
+            size_t len = strcspn(p, ":");
+            if (shard_add(set, p, len) != 0) {
+                return -1;
+            }
+            p += len;
+            if (*p == ':') p++;
+        }
+    } else if (shard_load_file(base_dir, set) != 0) {
+        return -1;
+    }
+
+    const char *policy = getenv("MDOCK_PLACEMENT");
+    if (policy && policy[0] != '\0' && shard_set_policy(set, policy) != 0) {
+        return -1;
+    }
+
+    /* Unconfigured: everything lives under the state root */
+    if (set->count == 0) {
+        return shard_add(set, base_dir, strlen(base_dir));
+    }
+    return 0;
+}
+
+/* FNV-1a, so the same name always maps to the same directory */
+static uint32_t shard_hash(const char *key)
+{
+    uint32_t h = 2166136261u;
+    for (; *key; key++) {
+        h ^= (unsigned char)*key;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+const char *shard_place(const struct shard_set *set, const char *key)
+{
+    int idx = 0;
+
+    if (set->count > 1 && set->policy == SHARD_HASH) {
+        idx = (int)(shard_hash(key) % (uint32_t)set->count);
+    } else if (set->count > 1) {
+        unsigned long long best = 0;
+        for (int i = 0; i < set->count; i++) {
+            struct statvfs vfs;
+            if (statvfs(set->dirs[i], &vfs) != 0) {
+                continue;
+            }
+            unsigned long long avail = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+            if (avail > best) {
+                best = avail;
+                idx = i;
+            }
+        }
+    }
+
+    if (ensure_dir_exists(set->dirs[idx], 0755) != 0) {
+        return NULL;
+    }
+    return set->dirs[idx];
+}
+
+const char *shard_label(const char *base_dir, const char *dir)
+{
+    return strcmp(base_dir, dir) == 0 ? "" : dir;
+}
+
+const char *shard_resolve(const char *base_dir, const char *recorded)
+{
+    return (recorded && recorded[0] != '\0') ? recorded : base_dir;
+}
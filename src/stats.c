@@ -0,0 +1,829 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+#include "container.h"
+#include "history.h"
+#include "image.h"
+#include "proc.h"
+#include "timeutil.h"
+
+/* Breadth-first queue of the tree being sampled */
+static pid_t tree_queue[STATS_MAX_PIDS];
+
+/* ----- Process handles ----- */
+
+static void proc_close(struct stats_proc *p)
+{
+    int *fds[] = { &p->stat_fd, &p->io_fd, &p->children_fd };
+    for (int i = 0; i < 3; i++) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+        }
+        *fds[i] = -1;
+    }
+}
+
+static int proc_reopen(struct stats_proc *p, pid_t pid)
+{
+    p->pid = pid;
+    p->stat_fd = proc_stat_open(pid);
+    if (p->stat_fd < 0) {
+        return -1;
+    }
+    /* Other users' io files need ptrace access; the sum then lacks them */
+    p->io_fd = proc_io_open(pid);
+    p->children_fd = -1;
+    return 0;
+}
+
+/* The cached handles of pid; hint is where it was on the last tick */
+static struct stats_proc *find_proc(struct stats_container *c, pid_t pid, int hint)
+{
+    if (hint < c->nprocs && c->procs[hint].pid == pid) {
+        return &c->procs[hint];
+    }
+    for (int i = 0; i < c->nprocs; i++) {
+        if (c->procs[i].pid == pid) {
+            return &c->procs[i];
+        }
+    }
+    if (c->nprocs == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 4;
+        struct stats_proc *grown = realloc(c->procs, (size_t)cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        c->procs = grown;
+        c->cap = cap;
+    }
+    struct stats_proc *p = &c->procs[c->nprocs];
+    if (proc_reopen(p, pid) != 0) {
+        return NULL;
+    }
+    p->seen = 0;
+    c->nprocs++;
+    return p;
+}
+
+/* ----- Sampling ----- */
+
+/*
+ * Walk the tree breadth first through the cached children files and sum
+ * what its processes use. A stat file whose process has exited fails to
+ * read, so a pid reused inside the tree is detected and reopened.
+ */
+int stats_container_sample(struct stats_container *c)
+{
+    struct stats_sample sum;
+    memset(&sum, 0, sizeof(sum));
+
+    pid_t *queue = tree_queue;
+    int n = 1;
+    queue[0] = c->pid;
+    if (!proc_have_children()) {
+        n = proc_tree(c->pid, queue, STATS_MAX_PIDS);
+    }
+    for (int i = 0; i < c->nprocs; i++) {
+        c->procs[i].seen = 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct stats_proc *p = find_proc(c, queue[i], i);
+        if (!p) {
+            continue;
+        }
+        struct proc_stat st;
+        if (proc_stat_read(p->stat_fd, &st) != 0) {
+            proc_close(p);
+            if (i == 0 || proc_reopen(p, queue[i]) != 0 || proc_stat_read(p->stat_fd, &st) != 0) {
+                continue;   /* gone: the entry is dropped below */
+            }
+        }
+        if (i == 0 && (st.state == 'Z' || st.state == 'X')) {
+            break;
+        }
+        p->seen = 1;
+
+        sum.cpu_ns += st.cpu_ns + st.child_cpu_ns;
+        sum.rss += st.rss;
+        sum.minflt += st.minflt;
+        sum.majflt += st.majflt;
+        sum.threads += st.threads;
+        sum.pids++;
+        uint64_t rd, wr;
+        if (p->io_fd >= 0 && proc_io_read(p->io_fd, &rd, &wr) == 0) {
+            sum.read_bytes += rd;
+            sum.write_bytes += wr;
+        }
+
+        if (!proc_have_children() || n >= STATS_MAX_PIDS) {
+            continue;
+        }
+        /* Threads have children files of their own, which come and go with them */
+        int k;
+        if (st.threads == 1 &&
+            (p->children_fd >= 0 || (p->children_fd = proc_children_open(p->pid)) >= 0)) {
+            k = proc_children_fd(p->children_fd, queue + n, STATS_MAX_PIDS - n);
+        } else {
+            k = proc_children(p->pid, queue + n, STATS_MAX_PIDS - n);
+        }
+        n += k > 0 ? k : 0;
+    }
+
+    /* Close what has left the tree */
+    int kept = 0;
+    for (int i = 0; i < c->nprocs; i++) {
+        if (c->procs[i].seen) {
+            c->procs[kept++] = c->procs[i];
+        } else {
+            proc_close(&c->procs[i]);
+        }
+    }
+    c->nprocs = kept;
+    if (kept == 0 || c->procs[0].pid != c->pid) {
+        c->gone = 1;
+        return -1;
+    }
+
+    int64_t mono = mdock_monotonic_ns();
+    sum.time_ns = mdock_realtime_ns();
+    /* Processes that leave the tree take their CPU time with them */
+    if (c->samples > 0 && mono > c->last_mono_ns && sum.cpu_ns > c->last_cpu_ns) {
+        sum.cpu_milli = (int)((sum.cpu_ns - c->last_cpu_ns) * 1000 / (mono - c->last_mono_ns));
+    }
+    c->last_mono_ns = mono;
+    c->last_cpu_ns = sum.cpu_ns;
+    c->sample = sum;
+    c->samples++;
+    return 0;
+}
+
+int stats_container_open(struct stats_container *c, const char *id, pid_t pid, uint64_t pid_start)
+{
+    memset(c, 0, sizeof(*c));
+    snprintf(c->id, sizeof(c->id), "%s", id);
+    c->pid = pid;
+
+    /* The root's stat file pins the process it was opened for: a reused pid fails to read */
+    if (pid <= 0 || find_proc(c, pid, 0) == NULL ||
+        (pid_start != 0 && proc_starttime(pid) != pid_start)) {
+        stats_container_close(c);
+        return -1;
+    }
+    return 0;
+}
+
+void stats_container_close(struct stats_container *c)
+{
+    for (int i = 0; i < c->nprocs; i++) {
+        proc_close(&c->procs[i]);
+    }
+    free(c->procs);
+    c->procs = NULL;
+    c->nprocs = 0;
+    c->cap = 0;
+}
+
+/* ----- Containers ----- */
+
+static int wanted(const struct stats_sampler *s, const struct db_field *id)
+{
+    if (!s->ids) {
+        return 1;
+    }
+    for (int i = 0; i < s->nids; i++) {
+        if (db_field_eq(id, s->ids[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static struct stats_container *find_container(struct stats_sampler *s, const struct db_field *id)
+{
+    for (int i = 0; i < s->count; i++) {
+        if (db_field_eq(id, s->containers[i].id)) {
+            return &s->containers[i];
+        }
+    }
+    return NULL;
+}
+
+static int add_container(struct stats_sampler *s, const struct container_record *rec)
+{
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 16;
+        struct stats_container *grown = realloc(s->containers, (size_t)cap * sizeof(*grown));
+        if (!grown) {
+            perror("[mdock] realloc");
+            return -1;
+        }
+        s->containers = grown;
+        s->cap = cap;
+    }
+    if (stats_container_open(&s->containers[s->count], rec->id, rec->pid, rec->pid_start) == 0) {
+        s->count++;
+    }
+    return 0;
+}
+
+/* Track the running containers of containers.db; a no-op while it is unchanged */
+static int refresh_containers(struct stats_sampler *s)
+{
+    struct stat sb;
+    if (stat(s->db_path, &sb) != 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    int64_t mtime = (int64_t)sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+    if (mtime == s->db_mtime_ns && (int64_t)sb.st_size == s->db_size) {
+        return 0;
+    }
+    s->db_mtime_ns = mtime;
+    s->db_size = (int64_t)sb.st_size;
+
+    struct db_map map;
+    if (db_map_open(s->db_path, &map) != 0) {
+        perror("[mdock] open containers.db");
+        return -1;
+    }
+    for (int i = 0; i < s->count; i++) {
+        s->containers[i].gone = 1;
+    }
+    struct db_scanner sc;
+    struct db_row row;
+    db_scanner_init(&sc, &map);
+    while (db_scanner_next(&sc, &row)) {
+        if (row.nfields < CF_REQUIRED || !db_field_eq(&row.fields[CF_STATUS], "running") ||
+            !wanted(s, &row.fields[CF_ID])) {
+            continue;
+        }
+        struct stats_container *c = find_container(s, &row.fields[CF_ID]);
+        if (c) {
+            c->gone = 0;
+            continue;
+        }
+        struct container_record rec;
+        if (container_record_parse(&row, &rec) == 0 && add_container(s, &rec) != 0) {
+            db_map_close(&map);
+            return -1;
+        }
+    }
+    db_map_close(&map);
+    return 0;
+}
+
+int stats_sampler_init(struct stats_sampler *s, const char *base_dir, char **ids, int nids)
+{
+    memset(s, 0, sizeof(*s));
+    s->ids = ids;
+    s->nids = nids;
+    s->db_mtime_ns = -1;
+    if (snprintf(s->db_path, sizeof(s->db_path), "%s/containers.db", base_dir) >= (int)sizeof(s->db_path)) {
+        fprintf(stderr, "[mdock] containers.db path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+int stats_sampler_tick(struct stats_sampler *s)
+{
+    if (refresh_containers(s) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < s->count; i++) {
+        if (!s->containers[i].gone) {
+            stats_container_sample(&s->containers[i]);
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < s->count; i++) {
+        if (s->containers[i].gone) {
+            stats_container_close(&s->containers[i]);
+        } else {
+            s->containers[kept++] = s->containers[i];
+        }
+    }
+    s->count = kept;
+    return 0;
+}
+
+void stats_sampler_free(struct stats_sampler *s)
+{
+    for (int i = 0; i < s->count; i++) {
+        stats_container_close(&s->containers[i]);
+    }
+    free(s->containers);
+    s->containers = NULL;
+    s->count = 0;
+    s->cap = 0;
+}
+
+/* ----- mdock stats ----- */
+
+static void format_bytes(uint64_t bytes, char *buf, size_t size)
+{
+    static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(buf, size, unit ? "%.1f%s" : "%.0f%s", value, units[unit]);
+}
+
+/* Sleep until the next tick of a fixed-rate loop, without drifting */
+static void sleep_interval(struct timespec *next, long interval_ms)
+{
+    next->tv_nsec += (interval_ms % 1000) * 1000000L;
+    next->tv_sec += interval_ms / 1000 + next->tv_nsec / 1000000000L;
+    next->tv_nsec %= 1000000000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) == EINTR) {
+    }
+}
+
+static void print_table(const struct stats_sampler *s)
+{
+    printf("%-10s %-8s %-8s %-10s %-10s %-8s %-10s %-10s %-8s %s\n",
+           "CONTAINER", "PID", "CPU %", "MEM", "MINFLT", "MAJFLT", "READ", "WRITE", "THREADS", "PIDS");
+    for (int i = 0; i < s->count; i++) {
+        const struct stats_container *c = &s->containers[i];
+        const struct stats_sample *st = &c->sample;
+        char cpu[16], mem[16], rd[16], wr[16];
+        snprintf(cpu, sizeof(cpu), "%.2f%%", st->cpu_milli / 10.0);
+        format_bytes((uint64_t)st->rss, mem, sizeof(mem));
+        format_bytes(st->read_bytes, rd, sizeof(rd));
+        format_bytes(st->write_bytes, wr, sizeof(wr));
+        printf("%-10s %-8d %-8s %-10s %-10llu %-8llu %-10s %-10s %-8d %d\n",
+               c->id, c->pid, cpu, mem, (unsigned long long)st->minflt,
+               (unsigned long long)st->majflt, rd, wr, st->threads, st->pids);
+    }
+}
+
+static void print_json(const struct stats_sampler *s)
+{
+    printf("[");
+    for (int i = 0; i < s->count; i++) {
+        const struct stats_container *c = &s->containers[i];
+        const struct stats_sample *st = &c->sample;
+        printf("%s{\"id\": \"%s\", \"pid\": %d, \"time_ns\": %lld, \"cpu_percent\": %.2f, "
+               "\"cpu_ns\": %lld, \"rss_bytes\": %lld, \"minflt\": %llu, \"majflt\": %llu, "
+               "\"read_bytes\": %llu, \"write_bytes\": %llu, \"threads\": %d, \"pids\": %d}",
+               i ? ", " : "", c->id, c->pid, (long long)st->time_ns, st->cpu_milli / 10.0,
+               (long long)st->cpu_ns, (long long)st->rss, (unsigned long long)st->minflt,
+               (unsigned long long)st->majflt, (unsigned long long)st->read_bytes,
+               (unsigned long long)st->write_bytes, st->threads, st->pids);
+    }
+    printf("]\n");
+}
+
+static void stats_usage(void)
+{
+    fprintf(stderr, "Usage: mdock stats [--no-stream] [--json] [--interval MS] [container_id...]\n");
+    fprintf(stderr, "       mdock stats --history <container_id> [--since DURATION] [--json]\n");
+}
+
+/* "90", "90s", "10m", "2h" or "1d" in nanoseconds, -1 when invalid */
+static int64_t parse_duration(const char *str)
+{
+    char *end;
+    long long value = strtoll(str, &end, 10);
+    if (end == str || value < 0) {
+        return -1;
+    }
+    int64_t unit;
+    if (*end == '\0' || strcmp(end, "s") == 0) {
+        unit = 1;
+    } else if (strcmp(end, "m") == 0) {
+        unit = 60;
+    } else if (strcmp(end, "h") == 0) {
+        unit = 3600;
+    } else if (strcmp(end, "d") == 0) {
+        unit = 86400;
+    } else {
+        return -1;
+    }
+    return (int64_t)value * unit * 1000000000LL;
+}
+
+static int print_history(const char *base_dir, const char *container_id, int64_t since_ns, int json)
+{
+    struct history_sample *samples;
+    int count = history_read(base_dir, container_id, since_ns, &samples);
+    if (count < 0) {
+        if (errno == ENOENT) {
+            fprintf(stderr, "[mdock] container '%s' has no history (run it with --history)\n",
+                    container_id);
+        } else {
+            fprintf(stderr, "[mdock] cannot read the history of '%s': %s\n",
+                    container_id, strerror(errno));
+        }
+        return 1;
+    }
+
+    if (json) {
+        printf("[");
+    } else {
+        printf("%-24s %-8s %-10s %-10s %-10s %-8s %-10s %-10s %-8s %s\n", "TIME", "CPU %", "MEM",
+               "MEM MAX", "MINFLT", "MAJFLT", "READ", "WRITE", "THREADS", "PIDS");
+    }
+    for (int i = 0; i < count; i++) {
+        const struct history_sample *hs = &samples[i];
+        if (json) {
+            printf("%s\n  {\"time_ns\": %lld, \"cpu_percent\": %.2f, \"cpu_ns\": %lld, "
+                   "\"rss_bytes\": %lld, \"rss_max_bytes\": %lld, \"minflt\": %llu, "
+                   "\"majflt\": %llu, \"read_bytes\": %llu, \"write_bytes\": %llu, "
+                   "\"threads\": %d, \"pids\": %d}",
+                   i ? "," : "", (long long)hs->time_ns, hs->cpu_milli / 10.0, (long long)hs->cpu_ns,
+                   (long long)hs->rss, (long long)hs->rss_max, (unsigned long long)hs->minflt,
+                   (unsigned long long)hs->majflt, (unsigned long long)hs->read_bytes,
+                   (unsigned long long)hs->write_bytes, hs->threads, hs->pids);
+            continue;
+        }
+        char when[MDOCK_TIME_MAX], cpu[16], mem[16], mem_max[16], rd[16], wr[16];
+        if (mdock_format_time(hs->time_ns, when, sizeof(when)) != 0) {
+            snprintf(when, sizeof(when), "-");
+        }
+        snprintf(cpu, sizeof(cpu), "%.2f%%", hs->cpu_milli / 10.0);
+        format_bytes((uint64_t)hs->rss, mem, sizeof(mem));
+        format_bytes((uint64_t)hs->rss_max, mem_max, sizeof(mem_max));
+        format_bytes(hs->read_bytes, rd, sizeof(rd));
+        format_bytes(hs->write_bytes, wr, sizeof(wr));
+        printf("%-24s %-8s %-10s %-10s %-10llu %-8llu %-10s %-10s %-8d %d\n", when, cpu, mem,
+               mem_max, (unsigned long long)hs->minflt, (unsigned long long)hs->majflt, rd, wr,
+               hs->threads, hs->pids);
+    }
+    if (json) {
+        printf("%s]\n", count ? "\n" : "");
+    }
+    free(samples);
+    return 0;
+}
+
+int cmd_stats(int argc, char **argv)
+{
+    int stream = 1;
+    int json = 0;
+    long interval_ms = STATS_INTERVAL_MS;
+    const char *history_id = NULL;
+    int64_t since_ns = -1;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--no-stream") == 0) {
+            stream = 0;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            char *end;
+            interval_ms = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || interval_ms < 10) {
+                fprintf(stderr, "[mdock] error: invalid interval '%s' (milliseconds, at least 10)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            history_id = argv[++i];
+        } else if (strcmp(argv[i], "--since") == 0 && i + 1 < argc) {
+            since_ns = parse_duration(argv[++i]);
+            if (since_ns < 0) {
+                fprintf(stderr, "[mdock] error: invalid duration '%s' (e.g. 90s, 10m, 2h)\n", argv[i]);
+                return 1;
+            }
+        } else {
+            stats_usage();
+            return 1;
+        }
+    }
+    if ((history_id && i < argc) || (!history_id && since_ns >= 0)) {
+        stats_usage();
+        return 1;
+    }
+
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        fprintf(stderr, "[mdock] failed to initialize home directory\n");
+        return 1;
+    }
+    if (history_id) {
+        return print_history(base_dir, history_id,
+                             since_ns >= 0 ? mdock_realtime_ns() - since_ns : 0, json);
+    }
+
+    /* Up to three fds per process stay open */
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+
+    struct stats_sampler sampler;
+    struct stats_sampler *s = &sampler;
+    int nids = argc - i;
+    int ret = 1;
+    if (stats_sampler_init(s, base_dir, nids > 0 ? &argv[i] : NULL, nids) != 0 ||
+        stats_sampler_tick(s) != 0) {
+        goto out;
+    }
+    for (int k = 0; k < nids; k++) {
+        struct db_field id = { argv[i + k], strlen(argv[i + k]) };
+        if (!find_container(s, &id)) {
+            fprintf(stderr, "[mdock] container '%s' is not running\n", argv[i + k]);
+        }
+    }
+    if (nids > 0 && s->count == 0) {
+        goto out;
+    }
+
+    /* Rates need two samples: a snapshot waits one interval too */
+    int interactive = stream && !json && isatty(STDOUT_FILENO);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        sleep_interval(&next, interval_ms);
+        if (stats_sampler_tick(s) != 0) {
+            goto out;
+        }
+
+        if (interactive) {
+            printf("\033[H\033[J");
+        }
+        if (json) {
+            print_json(s);
+        } else {
+            print_table(s);
+        }
+        fflush(stdout);
+        /* Named containers that have all exited leave nothing to watch */
+        if (!stream || (nids > 0 && s->count == 0)) {
+            break;
+        }
+    }
+    ret = 0;
+
+out:
+    stats_sampler_free(s);
+    return ret;
+}
+
+/* ----- mdock top ----- */
+
+struct top_thread {
+    pid_t pid;
+    pid_t tid;
+    int stat_fd;
+    int wchan_fd;           /* -1 when not readable */
+    int64_t last_cpu_ns;
+    int64_t last_mono_ns;   /* 0 before the first sample */
+    int seen;
+    struct proc_stat st;
+    int cpu_milli;
+    char wchan[64];
+};
+
+struct top_view {
+    int root_fd;            /* stat of the container process, which pins it */
+    struct top_thread *threads;
+    int count;
+    int cap;
+};
+
+static void top_thread_close(struct top_thread *t)
+{
+    close(t->stat_fd);
+    if (t->wchan_fd >= 0) {
+        close(t->wchan_fd);
+    }
+}
+
+static struct top_thread *top_find_thread(struct top_view *v, pid_t pid, pid_t tid)
+{
+    for (int i = 0; i < v->count; i++) {
+        if (v->threads[i].tid == tid && v->threads[i].pid == pid) {
+            return &v->threads[i];
+        }
+    }
+    if (v->count == v->cap) {
+        int cap = v->cap ? v->cap * 2 : 16;
+        struct top_thread *grown = realloc(v->threads, (size_t)cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        v->threads = grown;
+        v->cap = cap;
+    }
+    struct top_thread *t = &v->threads[v->count];
+    memset(t, 0, sizeof(*t));
+    t->pid = pid;
+    t->tid = tid;
+    t->stat_fd = proc_task_open(pid, tid, "stat");
+    if (t->stat_fd < 0) {
+        return NULL;
+    }
+    t->wchan_fd = proc_task_open(pid, tid, "wchan");
+    v->count++;
+    return t;
+}
+
+/* Re-read every thread of the tree; -1 once the container process is gone */
+static int top_refresh(struct top_view *v, pid_t root)
+{
+    struct proc_stat st;
+    if (proc_stat_read(v->root_fd, &st) != 0 || st.state == 'Z' || st.state == 'X') {
+        return -1;
+    }
+
+    pid_t *pids = tree_queue;
+    int npids = proc_tree(root, pids, STATS_MAX_PIDS);
+    for (int i = 0; i < v->count; i++) {
+        v->threads[i].seen = 0;
+    }
+    int64_t now = mdock_monotonic_ns();
+    for (int i = 0; i < npids; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", (int)pids[i]);
+        DIR *dir = opendir(path);
+        struct dirent *ent;
+        while (dir && (ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] < '0' || ent->d_name[0] > '9') {
+                continue;
+            }
+            struct top_thread *t = top_find_thread(v, pids[i], (pid_t)atoi(ent->d_name));
+            if (!t || proc_stat_read(t->stat_fd, &t->st) != 0) {
+                continue;
+            }
+            t->cpu_milli = 0;
+            if (t->last_mono_ns > 0 && now > t->last_mono_ns && t->st.cpu_ns > t->last_cpu_ns) {
+                t->cpu_milli = (int)((t->st.cpu_ns - t->last_cpu_ns) * 1000 / (now - t->last_mono_ns));
+            }
+            t->last_cpu_ns = t->st.cpu_ns;
+            t->last_mono_ns = now;
+            if (t->wchan_fd < 0 || proc_wchan_read(t->wchan_fd, t->wchan, sizeof(t->wchan)) != 0) {
+                t->wchan[0] = '\0';
+            }
+            t->seen = 1;
+        }
+        if (dir) {
+            closedir(dir);
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < v->count; i++) {
+        if (v->threads[i].seen) {
+            v->threads[kept++] = v->threads[i];
+        } else {
+            top_thread_close(&v->threads[i]);
+        }
+    }
+    v->count = kept;
+    return 0;
+}
+
+static int cmp_top_thread(const void *a, const void *b)
+{
+    const struct top_thread *x = a;
+    const struct top_thread *y = b;
+    if (x->cpu_milli != y->cpu_milli) {
+        return y->cpu_milli - x->cpu_milli;
+    }
+    if (x->pid != y->pid) {
+        return (x->pid > y->pid) - (x->pid < y->pid);
+    }
+    return (x->tid > y->tid) - (x->tid < y->tid);
+}
+
+static void top_print(const char *container_id, struct top_view *v, int max_rows)
+{
+    qsort(v->threads, (size_t)v->count, sizeof(*v->threads), cmp_top_thread);
+
+    int processes = 0;
+    int cpu_milli = 0;
+    int64_t rss = 0;
+    for (int i = 0; i < v->count; i++) {
+        const struct top_thread *t = &v->threads[i];
+        cpu_milli += t->cpu_milli;
+        /* Threads share their process's memory: count it once, on the main thread */
+        if (t->tid == t->pid) {
+            processes++;
+            rss += t->st.rss;
+        }
+    }
+    char mem[16];
+    format_bytes((uint64_t)rss, mem, sizeof(mem));
+    printf("%s: %d processes, %d threads, %.1f%% CPU, %s resident\n\n",
+           container_id, processes, v->count, cpu_milli / 10.0, mem);
+
+    printf("%-8s %-8s %-16s %-2s %-8s %-5s %-10s %s\n",
+           "PID", "TID", "COMM", "S", "CPU %", "LAST", "RSS", "WCHAN");
+    for (int i = 0; i < v->count && (max_rows <= 0 || i < max_rows); i++) {
+        const struct top_thread *t = &v->threads[i];
+        char cpu[16];
+        snprintf(cpu, sizeof(cpu), "%.1f%%", t->cpu_milli / 10.0);
+        format_bytes((uint64_t)t->st.rss, mem, sizeof(mem));
+        printf("%-8d %-8d %-16s %-2c %-8s %-5d %-10s %s\n", t->pid, t->tid, t->st.comm,
+               t->st.state, cpu, t->st.processor, mem, t->wchan[0] ? t->wchan : "-");
+    }
+}
+
+static void top_usage(void)
+{
+    fprintf(stderr, "Usage: mdock top [--no-stream] [--interval MS] <container_id>\n");
+}
+
+int cmd_top(int argc, char **argv)
+{
+    int stream = 1;
+    long interval_ms = STATS_INTERVAL_MS;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--no-stream") == 0) {
+            stream = 0;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            char *end;
+            interval_ms = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || interval_ms < 10) {
+                fprintf(stderr, "[mdock] error: invalid interval '%s' (milliseconds, at least 10)\n", argv[i]);
+                return 1;
+            }
+        } else {
+            top_usage();
+            return 1;
+        }
+    }
+    if (i + 1 != argc) {
+        top_usage();
+        return 1;
+    }
+    const char *container_id = argv[i];
+
+    char base_dir[PATH_MAX];
+    if (mdock_init_home(base_dir, sizeof(base_dir)) != 0) {
+        fprintf(stderr, "[mdock] failed to initialize home directory\n");
+        return 1;
+    }
+    struct container_record rec;
+    if (find_container_record(base_dir, container_id, &rec) != 0) {
+        fprintf(stderr, "[mdock] container '%s' not found\n", container_id);
+        return 1;
+    }
+
+    struct top_view v = { .root_fd = -1 };
+    if (strcmp(rec.status, "running") == 0 && rec.pid > 0) {
+        v.root_fd = proc_stat_open(rec.pid);
+    }
+    if (v.root_fd < 0 || (rec.pid_start != 0 && proc_starttime(rec.pid) != rec.pid_start)) {
+        fprintf(stderr, "[mdock] container '%s' is not running\n", container_id);
+        if (v.root_fd >= 0) {
+            close(v.root_fd);
+        }
+        return 1;
+    }
+
+    int interactive = stream && isatty(STDOUT_FILENO);
+    int exited = top_refresh(&v, rec.pid) != 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!exited) {
+        sleep_interval(&next, interval_ms);
+        if (top_refresh(&v, rec.pid) != 0) {
+            exited = 1;
+            break;
+        }
+        int max_rows = 0;
+        struct winsize ws;
+        if (interactive) {
+            printf("\033[H\033[J");
+            /* Leave room for the summary and the column headers */
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 4) {
+                max_rows = ws.ws_row - 4;
+            }
+        }
+        top_print(rec.id, &v, max_rows);
+        fflush(stdout);
+        if (!stream) {
+            break;
+        }
+        if (!interactive) {
+            putchar('\n');
+        }
+    }
+    if (exited) {
+        fprintf(stderr, "[mdock] container %s exited\n", rec.id);
+    }
+
+    for (int k = 0; k < v.count; k++) {
+        top_thread_close(&v.threads[k]);
+    }
+    free(v.threads);
+    close(v.root_fd);
+    return 0;
+}
@@ -1,33 +1,56 @@
+#define _XOPEN_SOURCE 700   /* strptime */
+
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
 
 #include "timeutil.h"
 
-int mdock_current_timestamp(char *buf, size_t size)
+static int64_t clock_ns(clockid_t clock)
 {
-    time_t now = time(NULL);
-    if (now == (time_t)-1) {
-        perror("[mdock] time");
-        return -1;
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        perror("[mdock] clock_gettime");
+        return 0;
     }
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-    struct tm tm_now;
-#if defined(_POSIX_THREAD_SAFE_FUNCTIONS)
-    if (localtime_r(&now, &tm_now) == NULL) {
-        perror("[mdock] localtime_r");
-        return -1;
+int64_t mdock_realtime_ns(void)
+{
+    return clock_ns(CLOCK_REALTIME);
+}
+
+int64_t mdock_monotonic_ns(void)
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+/* localtime_r() is not required to re-read TZ; load it once up front */
+static void tz_init_once(void)
+{
+    static int tz_loaded;
+    if (!tz_loaded) {
+        tzset();
+        tz_loaded = 1;
     }
-#else
-    struct tm *ptm = localtime(&now);
-    if (!ptm) {
-        perror("[mdock] localtime");
+}
+
+int mdock_format_time(int64_t ns, char *buf, size_t size)
+{
+    tz_init_once();
+
+    time_t secs = (time_t)(ns / 1000000000LL);
+    int millis = (int)((ns % 1000000000LL) / 1000000);
+
+    struct tm tm_local;
+    if (localtime_r(&secs, &tm_local) == NULL) {
+        perror("[mdock] localtime_r");
         return -1;
     }
-    tm_now = *ptm;
-#endif
 
-    if (strftime(buf, size, "%Y-%m-%dT%H:%M:%S", &tm_now) == 0) {
+    size_t n = strftime(buf, size, "%Y-%m-%dT%H:%M:%S", &tm_local);
+    if (n == 0 || snprintf(buf + n, size - n, ".%03d", millis) >= (int)(size - n)) {
         fprintf(stderr, "[mdock] strftime buffer too small\n");
         return -1;
     }
@@ -35,45 +58,36 @@ int mdock_current_timestamp(char *buf, size_t size)
     return 0;
 }
 
-int calculate_uptime(const char *start_time, const char *end_time,
-                     char *uptime_buf, size_t size)
+int mdock_format_duration(int64_t ns, char *buf, size_t size)
 {
-    struct tm tm_start = {0};
-    struct tm tm_end = {0};
-    
-    /* Parse start time */
-    if (!start_time || start_time[0] == '\0') {
-        snprintf(uptime_buf, size, "00:00:00");
-        return 0;
+    if (ns < 0) {
+        ns = 0;
     }
-    
-    if (strptime(start_time, "%Y-%m-%dT%H:%M:%S", &tm_start) == NULL) {
-        snprintf(uptime_buf, size, "??:??:??");
-        return -1;
+
+    int64_t millis = ns / 1000000;
+    long hours = (long)(millis / 3600000);
+    int minutes = (int)((millis / 60000) % 60);
+    int seconds = (int)((millis / 1000) % 60);
+
+    snprintf(buf, size, "%02ld:%02d:%02d.%03d", hours, minutes, seconds, (int)(millis % 1000));
+    return 0;
+}
+
+int64_t mdock_parse_timestamp(const char *str)
+{
+    struct tm tm_parsed;
+    memset(&tm_parsed, 0, sizeof(tm_parsed));
+
+    if (!str || str[0] == '\0' ||
+        strptime(str, "%Y-%m-%dT%H:%M:%S", &tm_parsed) == NULL) {
+        return 0;
     }
-    
-    time_t start = mktime(&tm_start);
-    time_t end;
-    
-    /* If end_time is empty or NULL, use current time */
-    if (!end_time || end_time[0] == '\0' || end_time[0] == '|') {
-        end = time(NULL);
-    } else {
-        if (strptime(end_time, "%Y-%m-%dT%H:%M:%S", &tm_end) == NULL) {
-            snprintf(uptime_buf, size, "??:??:??");
-            return -1;
-        }
-        end = mktime(&tm_end);
+
+    tz_init_once();
+    tm_parsed.tm_isdst = -1;
+    time_t secs = mktime(&tm_parsed);
+    if (secs == (time_t)-1) {
+        return 0;
     }
-    
-    /* Calculate difference */
-    long diff = (long)difftime(end, start);
-    if (diff < 0) diff = 0;
-    
-    int hours = diff / 3600;
-    int minutes = (diff % 3600) / 60;
-    int seconds = diff % 60;
-    
-    snprintf(uptime_buf, size, "%02d:%02d:%02d", hours, minutes, seconds);
-    return 0;
+    return (int64_t)secs * 1000000000LL;
 }
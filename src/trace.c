@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "record.h"
+
+int trace_enabled;
+
+struct trace_rec {
+    const char *name;       /* a string literal */
+    char id[MDOCK_ID_MAX];
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+static struct trace_rec *spans;
+static int nspans;
+static int dropped;
+static char *json_path;     /* NULL for lines on stderr */
+
+int trace_start(const char *dest)
+{
+    trace_finish();
+    spans = malloc(TRACE_MAX_SPANS * sizeof(*spans));
+    if (!spans) {
+        perror("[mdock] malloc");
+        return -1;
+    }
+    if (dest && dest[0] && strcmp(dest, "1") != 0) {
+        json_path = strdup(dest);
+        if (!json_path) {
+            perror("[mdock] strdup");
+            free(spans);
+            spans = NULL;
+            return -1;
+        }
+    }
+    nspans = 0;
+    dropped = 0;
+    trace_enabled = 1;
+    return 0;
+}
+
+void trace_span(const char *name, const char *id, int64_t start_ns, int64_t end_ns)
+{
+    if (!trace_enabled) {
+        return;
+    }
+    if (nspans == TRACE_MAX_SPANS) {
+        dropped++;
+        return;
+    }
+    struct trace_rec *r = &spans[nspans++];
+    r->name = name;
+    snprintf(r->id, sizeof(r->id), "%s", id ? id : "");
+    r->start_ns = start_ns;
+    r->end_ns = end_ns;
+}
+
+static void write_lines(int64_t origin)
+{
+    for (int i = 0; i < nspans; i++) {
+        const struct trace_rec *r = &spans[i];
+        fprintf(stderr, "[mdock] trace phase=%s id=%s start_ns=%lld offset_us=%.1f dur_us=%.1f\n",
+                r->name, r->id[0] ? r->id : "-", (long long)r->start_ns,
+                (r->start_ns - origin) / 1e3, (r->end_ns - r->start_ns) / 1e3);
+    }
+}
+
+/* Complete ("X") events in microseconds since the first span */
+static int write_json(int64_t origin)
+{
+    FILE *f = fopen(json_path, "w");
+    if (!f) {
+        perror("[mdock] trace file");
+        return -1;
+    }
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (int i = 0; i < nspans; i++) {
+        const struct trace_rec *r = &spans[i];
+        fprintf(f, "%s\n  {\"name\": \"%s\", \"cat\": \"run\", \"ph\": \"X\", \"ts\": %.3f, "
+                   "\"dur\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {\"id\": \"%s\", \"start_ns\": %lld}}",
+                i ? "," : "", r->name, (r->start_ns - origin) / 1e3, (r->end_ns - r->start_ns) / 1e3,
+                pid, pid, r->id, (long long)r->start_ns);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* Spans are recorded as they end; list them as they began, outer ones first */
+static int cmp_span(const void *a, const void *b)
+{
+    const struct trace_rec *x = a;
+    const struct trace_rec *y = b;
+    if (x->start_ns != y->start_ns) {
+        return x->start_ns < y->start_ns ? -1 : 1;
+    }
+    return (y->end_ns > x->end_ns) - (y->end_ns < x->end_ns);
+}
+
+void trace_finish(void)
+{
+    if (trace_enabled && nspans > 0) {
+        qsort(spans, (size_t)nspans, sizeof(*spans), cmp_span);
+        int64_t origin = spans[0].start_ns;
+        if (json_path) {
+            if (write_json(origin) == 0) {
+                fprintf(stderr, "[mdock] trace: %d spans written to %s\n", nspans, json_path);
+            }
+        } else {
+            write_lines(origin);
+        }
+        if (dropped > 0) {
+            fprintf(stderr, "[mdock] trace: %d spans dropped (max %d)\n", dropped, TRACE_MAX_SPANS);
+        }
+    }
+    trace_enabled = 0;
+    free(spans);
+    spans = NULL;
+    free(json_path);
+    json_path = NULL;
+    nspans = 0;
+}
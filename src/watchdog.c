@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "watchdog.h"
+#include "history.h"
+#include "proc.h"
+#include "stats.h"
+#include "log.h"
+#include "timeutil.h"
+
+#define NS_PER_MS 1000000LL
+#define NS_PER_SEC 1000000000LL
+
+#define WATCHDOG_CPU_SLICE_MIN_MS 10
+#define WATCHDOG_CPU_TREE_FDS     64
+
+int watchdog_active(const struct watchdog_limits *wd)
+{
+    return wd && (wd->rss_max > 0 || wd->cpu_milli > 0 || wd->history_size > 0);
+}
+
+int watchdog_parse_rate(const char *str)
+{
+    char *end;
+    double cpus = strtod(str, &end);
+    if (end == str || *end != '\0' || !(cpus >= 0.01) || cpus > 4096) {
+        return -1;
+    }
+    return (int)(cpus * 1000 + 0.5);
+}
+
+int64_t watchdog_tree_rss(pid_t pid)
+{
+    pid_t pids[WATCHDOG_MAX_PIDS];
+    int count = proc_tree(pid, pids, WATCHDOG_MAX_PIDS);
+    int64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        int64_t rss = proc_rss(pids[i]);
+        if (rss > 0) {
+            total += rss;
+        }
+    }
+    return total;
+}
+
+/* skip_root leaves pid itself alone (the monitor cleaning up after its container) */
+static void kill_tree(pid_t pid, int skip_root)
+{
+    pid_t pids[WATCHDOG_MAX_PIDS];
+    int count = proc_tree(pid, pids, WATCHDOG_MAX_PIDS);
+    /* Children first stops the root from starting replacements in between */
+    for (int i = count - 1; i >= skip_root; i--) {
+        kill(pids[i], SIGKILL);
+    }
+}
+
+/* Sleep up to ms or until the child exits; the pidfd makes the exit wake us */
+static void wait_tick(int pidfd, int ms)
+{
+    if (pidfd >= 0) {
+        struct pollfd pfd = { .fd = pidfd, .events = POLLIN };
+        poll(&pfd, 1, ms);
+        return;
+    }
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* ----- CPU duty cycle ----- */
+
+struct duty_cycle {
+    pid_t pgrp;
+    int stat_fds[WATCHDOG_CPU_TREE_FDS];    /* /proc/<pid>/stat of the tree, re-read with pread() */
+    int nfds;
+    int64_t tree_ns;        /* when the tree was last walked */
+    int milli;
+    int64_t period_ns;
+    int64_t burst_ns;       /* bucket capacity in CPU nanoseconds */
+    int64_t tokens;         /* CPU nanoseconds still allowed; negative while in debt */
+    int64_t last_cpu;
+    int64_t last_ns;
+    int stopped;
+    int64_t stopped_since;
+    int64_t stopped_ns;
+    int64_t start_cpu;
+    int64_t start_ns;
+    int64_t window_cpu;     /* one-second windows for the peak rate */
+    int64_t window_ns;
+    int peak_milli;
+};
+
+/*
+ * CPU time of the tree. The walk over /proc is repeated once a second;
+ * in between only the stat files already open are re-read.
+ */
+static int64_t duty_cputime(struct duty_cycle *d, pid_t pid, int64_t now)
+{
+    if (d->nfds == 0 || now - d->tree_ns >= NS_PER_SEC) {
+        for (int i = 0; i < d->nfds; i++) {
+            close(d->stat_fds[i]);
+        }
+        pid_t pids[WATCHDOG_CPU_TREE_FDS];
+        int count = proc_tree(pid, pids, WATCHDOG_CPU_TREE_FDS);
+        d->nfds = 0;
+        for (int i = 0; i < count; i++) {
+            int fd = proc_stat_open(pids[i]);
+            if (fd >= 0) {
+                d->stat_fds[d->nfds++] = fd;
+            }
+        }
+        d->tree_ns = now;
+    }
+
+    int64_t total = 0;
+    for (int i = 0; i < d->nfds; i++) {
+        int64_t ns = proc_cputime_fd(d->stat_fds[i]);
+        if (ns > 0) {
+            total += ns;
+        }
+    }
+    return total;
+}
+
+static void duty_close(struct duty_cycle *d)
+{
+    for (int i = 0; i < d->nfds; i++) {
+        close(d->stat_fds[i]);
+    }
+    d->nfds = 0;
+}
+
+static void duty_init(struct duty_cycle *d, pid_t pid, const struct watchdog_limits *wd, int64_t now)
+{
+    memset(d, 0, sizeof(*d));
+    d->pgrp = pid;
+    d->milli = wd->cpu_milli;
+    d->period_ns = (int64_t)(wd->cpu_period_ms > 0 ? wd->cpu_period_ms : WATCHDOG_CPU_PERIOD_MS) * NS_PER_MS;
+    d->burst_ns = wd->cpu_burst_ms > 0 ? (int64_t)wd->cpu_burst_ms * NS_PER_MS
+                                       : d->period_ns * d->milli / 1000;
+    /* Starting empty keeps the first second at the rate too; the burst is earned by idling */
+    d->tokens = 0;
+    d->last_cpu = d->start_cpu = d->window_cpu = duty_cputime(d, pid, now);
+    d->last_ns = d->start_ns = d->window_ns = now;
+}
+
+static void duty_resume(struct duty_cycle *d, int64_t now)
+{
+    if (d->stopped) {
+        kill(-d->pgrp, SIGCONT);
+        d->stopped = 0;
+        d->stopped_ns += now - d->stopped_since;
+    }
+}
+
+/* Charge the CPU used since the last sample; returns when to sample next */
+static int64_t duty_tick(struct duty_cycle *d, pid_t pid, int64_t now)
+{
+    int64_t cpu = duty_cputime(d, pid, now);
+    /* Orphans leave the tree and take their time with them */
+    int64_t used = cpu > d->last_cpu ? cpu - d->last_cpu : 0;
+    d->last_cpu = cpu;
+
+    d->tokens += (now - d->last_ns) * d->milli / 1000 - used;
+    d->last_ns = now;
+    if (d->tokens > d->burst_ns) {
+        d->tokens = d->burst_ns;
+    }
+
+    if (now - d->window_ns >= NS_PER_SEC) {
+        int64_t rate = (cpu - d->window_cpu) * 1000 / (now - d->window_ns);
+        if (rate > d->peak_milli) {
+            d->peak_milli = (int)rate;
+        }
+        d->window_cpu = cpu;
+        d->window_ns = now;
+    }
+
+    if (d->tokens >= 0) {
+        /*
+         * Look again once one busy thread could have spent the budget, so
+         * a run slice is rate * period and not a whole period: at low
+         * rates that keeps every second made of many short cycles. CPU
+         * times come in clock ticks, so shorter slices only cost wakeups.
+         */
+        duty_resume(d, now);
+        int64_t wait = d->tokens < WATCHDOG_CPU_SLICE_MIN_MS * NS_PER_MS
+                           ? WATCHDOG_CPU_SLICE_MIN_MS * NS_PER_MS : d->tokens;
+        return now + (wait < d->period_ns ? wait : d->period_ns);
+    }
+    if (!d->stopped) {
+        kill(-d->pgrp, SIGSTOP);
+        d->stopped = 1;
+        d->stopped_since = now;
+    }
+    /* Stay stopped until the rate has paid the debt back, checking at least once a period */
+    int64_t wait = -d->tokens * 1000 / d->milli;
+    if (wait < NS_PER_MS) {
+        wait = NS_PER_MS;
+    }
+    return now + (wait < d->period_ns ? wait : d->period_ns);
+}
+
+/* ----- Monitor loop ----- */
+
+static int64_t earliest(int64_t a, int64_t b)
+{
+    if (a == 0) {
+        return b;
+    }
+    return (b == 0 || a < b) ? a : b;
+}
+
+int watchdog_wait(const char *container_id, pid_t pid, const struct watchdog_limits *wd,
+                  struct history *hist, int *status, struct watchdog_result *res)
+{
+    memset(res, 0, sizeof(*res));
+    if (!watchdog_active(wd)) {
+        while (wait4(pid, status, 0, &res->ru) == -1) {
+            if (errno != EINTR) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    /* Processes the container orphans become our children instead of init's */
+    prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0);
+
+    int64_t now = mdock_monotonic_ns();
+    int interval = wd->interval_ms > 0 ? wd->interval_ms : WATCHDOG_INTERVAL_MS;
+    int64_t next_rss = wd->rss_max > 0 ? now : 0;
+    int64_t kill_at = 0;
+
+    struct duty_cycle duty;
+    int64_t next_cpu = 0;
+    if (wd->cpu_milli > 0) {
+        duty_init(&duty, pid, wd, now);
+        next_cpu = now + duty.period_ns;
+    }
+
+    struct stats_container tree;
+    int64_t next_hist = 0;
+    int hist_interval = wd->history_interval_ms > 0 ? wd->history_interval_ms : HISTORY_INTERVAL_MS;
+    if (hist && stats_container_open(&tree, container_id, pid, 0) == 0) {
+        next_hist = now;
+    }
+
+    int pidfd = proc_open(pid, 0);
+    struct rusage *ru = &res->ru;
+    for (;;) {
+        /* As a subreaper we also get what the container orphans: reap those as they exit */
+        int st;
+        struct rusage usage;
+        pid_t got;
+        while ((got = wait4(-1, &st, WNOHANG, &usage)) > 0 && got != pid) {
+        }
+        if (got == pid) {
+            *status = st;
+            *ru = usage;
+            break;
+        }
+        if (got == -1 && errno != EINTR) {
+            if (pidfd >= 0) {
+                close(pidfd);
+            }
+            if (hist) {
+                stats_container_close(&tree);
+            }
+            return -1;
+        }
+
+        now = mdock_monotonic_ns();
+        if (kill_at != 0 && now >= kill_at) {
+            mdock_logf("WATCHDOG container_id=%s pid=%d action=SIGKILL", container_id, pid);
+            kill_tree(pid, 0);
+            kill_at = now + (int64_t)interval * NS_PER_MS;
+        }
+        if (next_rss != 0 && now >= next_rss) {
+            int64_t rss = watchdog_tree_rss(pid);
+            next_rss = now + (int64_t)interval * NS_PER_MS;
+            if (rss > wd->rss_max) {
+                mdock_logf("WATCHDOG container_id=%s pid=%d rss=%lld rss_max=%lld action=SIGTERM",
+                           container_id, pid, (long long)rss, (long long)wd->rss_max);
+                res->reason = WATCHDOG_REASON_RSS;
+                kill(pid, SIGTERM);
+                kill_at = now + (int64_t)WATCHDOG_GRACE_MS * NS_PER_MS;
+                next_rss = 0;
+                /* A stopped container could not act on the SIGTERM */
+                if (next_cpu != 0) {
+                    duty_resume(&duty, now);
+                    next_cpu = 0;
+                }
+            }
+        }
+        if (next_cpu != 0 && now >= next_cpu) {
+            next_cpu = duty_tick(&duty, pid, now);
+        }
+        if (next_hist != 0 && now >= next_hist) {
+            if (stats_container_sample(&tree) == 0) {
+                history_append(hist, &tree.sample);
+            }
+            next_hist = now + (int64_t)hist_interval * NS_PER_MS;
+        }
+
+        int64_t next = earliest(earliest(earliest(next_rss, next_cpu), kill_at), next_hist);
+        int64_t ms = next > now ? (next - now + NS_PER_MS - 1) / NS_PER_MS : 0;
+        wait_tick(pidfd, (int)ms);
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+    if (hist) {
+        stats_container_close(&tree);
+    }
+
+    if (wd->cpu_milli > 0) {
+        /* Whatever the group left behind must not stay stopped */
+        duty_resume(&duty, now);
+        duty_close(&duty);
+        int64_t cpu = (int64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * NS_PER_SEC +
+                      (int64_t)(ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) * 1000;
+        if (cpu < duty.last_cpu) {
+            cpu = duty.last_cpu;
+        }
+        int64_t wall = mdock_monotonic_ns() - duty.start_ns;
+        res->cpu_milli = wall > 0 ? (int)((cpu - duty.start_cpu) * 1000 / wall) : 0;
+        res->cpu_peak_milli = duty.peak_milli;
+        res->stopped_ns = duty.stopped_ns;
+        mdock_logf("CPU_RATE container_id=%s limit=%.3f achieved=%.3f peak_1s=%.3f stopped=%.3fs",
+                   container_id, wd->cpu_milli / 1000.0, res->cpu_milli / 1000.0,
+                   res->cpu_peak_milli / 1000.0, res->stopped_ns / 1e9);
+    }
+
+    /* The container is over the limit as a whole: nothing it started may outlive it */
+    if (res->reason) {
+        kill_tree(getpid(), 1);
+        while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+        }
+    }
+    return 0;
+}
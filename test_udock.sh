@@ -29,12 +29,12 @@ print_test() {
 
 print_success() {
     echo -e "${GREEN}[✓]${NC} $1"
-    ((TESTS_PASSED++))
+    TESTS_PASSED=$((TESTS_PASSED + 1))
 }
 
 print_error() {
     echo -e "${RED}[✗]${NC} $1"
-    ((TESTS_FAILED++))
+    TESTS_FAILED=$((TESTS_FAILED + 1))
 }
 
 print_info() {
@@ -110,26 +110,26 @@ check_prerequisites() {
     fi
 }
 
-# Create test rootfs
+# Create test rootfs; progress goes to stderr, the path to stdout
 create_test_rootfs() {
-    print_header "Creating Test Root Filesystem"
+    print_header "Creating Test Root Filesystem" >&2
     
     local ROOTFS="/tmp/udock-test-rootfs"
     rm -rf "$ROOTFS"
     
-    print_test "Creating directory structure"
+    print_test "Creating directory structure" >&2
     mkdir -p "$ROOTFS"/{bin,lib,lib64,usr/bin,tmp,home,root}
-    print_success "Directory structure created"
+    print_success "Directory structure created" >&2
     
-    print_test "Copying essential binaries"
+    print_test "Copying essential binaries" >&2
     for binary in /bin/sh /bin/bash /bin/ls /bin/echo /bin/cat /bin/sleep /bin/ps /usr/bin/env; do
         if [ -f "$binary" ]; then
             cp "$binary" "$ROOTFS/bin/" 2>/dev/null || cp "$binary" "$ROOTFS/usr/bin/" 2>/dev/null || true
         fi
     done
-    print_success "Binaries copied"
+    print_success "Binaries copied" >&2
     
-    print_test "Copying required libraries"
+    print_test "Copying required libraries" >&2
     # Copy libraries for /bin/sh
     if [ -f /bin/sh ]; then
         ldd /bin/sh 2>/dev/null | grep "=>" | awk '{print $3}' | while read lib; do
@@ -147,18 +147,18 @@ create_test_rootfs() {
             fi
         done
     fi
-    print_success "Libraries copied"
+    print_success "Libraries copied" >&2
     
-    print_test "Copying dynamic linker"
+    print_test "Copying dynamic linker" >&2
     if [ -f /lib64/ld-linux-x86-64.so.2 ]; then
         cp /lib64/ld-linux-x86-64.so.2 "$ROOTFS/lib64/" 2>/dev/null || true
     elif [ -f /lib/ld-linux.so.2 ]; then
         cp /lib/ld-linux.so.2 "$ROOTFS/lib/" 2>/dev/null || true
     fi
-    print_success "Dynamic linker copied"
+    print_success "Dynamic linker copied" >&2
     
     # Create test scripts inside rootfs
-    print_test "Creating test scripts inside rootfs"
+    print_test "Creating test scripts inside rootfs" >&2
     
     cat > "$ROOTFS/bin/test_env.sh" << 'EOF'
 #!/bin/sh
@@ -193,7 +193,7 @@ echo "CPU task completed"
 EOF
     chmod +x "$ROOTFS/bin/test_cpu.sh"
     
-    print_success "Test scripts created"
+    print_success "Test scripts created" >&2
     
     echo "$ROOTFS"
 }
@@ -489,6 +489,421 @@ test_global_log() {
     fi
 }
 
+# Test 12: Memory budget
+test_memory_budget() {
+    print_header "Test 12: Memory Budget"
+    
+    print_test "Starting a container that commits 64M of a 100M budget"
+    local OUTPUT=$(MDOCK_MEM_BUDGET=100M ./mdock run -d --mem 64M testimg1 /bin/sleep 10 2>&1)
+    local CONTAINER_ID=$(echo "$OUTPUT" | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2)
+    if [ -n "$CONTAINER_ID" ]; then
+        print_success "Container $CONTAINER_ID started within the budget"
+    else
+        print_error "Container within the budget did not start: $OUTPUT"
+        return 1
+    fi
+    
+    print_test "Starting a second 64M container (should be refused)"
+    local STATUS=0
+    OUTPUT=$(MDOCK_MEM_BUDGET=100M ./mdock run -d --mem 64M testimg1 /bin/sleep 10 2>&1) || STATUS=$?
+    if [ "$STATUS" -ne 0 ] && echo "$OUTPUT" | grep -q "exceed the memory budget"; then
+        print_success "Over-budget run refused with a non-zero exit"
+    else
+        print_error "Over-budget run was not refused"
+    fi
+    
+    print_test "Checking the committed sum in info"
+    if MDOCK_MEM_BUDGET=100M ./mdock info | grep -q "Committed: *64.0MiB by 1 containers"; then
+        print_success "info shows 64.0MiB committed"
+        MDOCK_MEM_BUDGET=100M ./mdock info
+    else
+        print_error "info does not show the committed memory"
+    fi
+    
+    ./mdock stop "$CONTAINER_ID" 2>/dev/null || true
+}
+
+# Test 13: Compose
+test_compose() {
+    print_header "Test 13: Compose"
+    
+    local DIR="/tmp/udock-test-compose"
+    local ROOTFS_TMP=~/.mdock/images/testimg1/rootfs/tmp
+    mkdir -p "$DIR"
+    rm -f "$ROOTFS_TMP"/compose-*
+    
+    cat > "$DIR/app.conf" << 'EOF'
+[db]
+image = testimg1
+command = /bin/sh -c 'echo up > tmp/compose-db; exec /bin/sleep 30'
+ready = file:tmp/compose-db
+
+[cache]
+image = testimg1
+command = /bin/sleep 30
+
+[api]
+image = testimg1
+command = /bin/sh -c 'echo up > tmp/compose-api; exec /bin/sleep 30'
+depends_on = db, cache
+ready = file:tmp/compose-api
+
+[web]
+image = testimg1
+command = /bin/sleep 30
+depends_on = api
+EOF
+    
+    print_test "Starting a project in dependency waves"
+    local OUTPUT
+    if OUTPUT=$(./mdock compose up -f "$DIR/app.conf" 2>&1); then
+        print_success "Project app started"
+        echo "$OUTPUT"
+    else
+        print_error "compose up failed: $OUTPUT"
+        return 1
+    fi
+    
+    print_test "Verifying wave order (db and cache, then api, then web)"
+    local PS=$(./mdock compose ps -f "$DIR/app.conf")
+    echo "$PS"
+    if echo "$PS" | grep -q "^db  *1 " && echo "$PS" | grep -q "^cache  *1 " &&
+       echo "$PS" | grep -q "^api  *2 " && echo "$PS" | grep -q "^web  *3 "; then
+        print_success "Services placed in three waves"
+    else
+        print_error "Unexpected wave order"
+    fi
+    
+    print_test "Checking the project state file"
+    if [ -f ~/.mdock/compose/app.state ] && [ "$(wc -l < ~/.mdock/compose/app.state)" -eq 4 ]; then
+        print_success "app.state records 4 containers"
+    else
+        print_error "app.state missing or incomplete"
+    fi
+    
+    print_test "Stopping the project"
+    if ./mdock compose down -f "$DIR/app.conf" -t 2 && [ ! -f ~/.mdock/compose/app.state ]; then
+        print_success "Project stopped and state file removed"
+    else
+        print_error "compose down failed or left app.state"
+    fi
+    
+    print_test "Rejecting a dependency cycle (should report line numbers)"
+    cat > "$DIR/cycle.conf" << 'EOF'
+[a]
+image = testimg1
+depends_on = b
+
+[b]
+image = testimg1
+depends_on = a
+EOF
+    if ! OUTPUT=$(./mdock compose up -f "$DIR/cycle.conf" 2>&1) &&
+       echo "$OUTPUT" | grep -q "dependency cycle among: a (line 1), b (line 5)"; then
+        print_success "Cycle reported: $OUTPUT"
+    else
+        print_error "Cycle not reported as expected: $OUTPUT"
+    fi
+    
+    print_test "Rejecting an unknown dependency (should report its line)"
+    cat > "$DIR/unknown.conf" << 'EOF'
+[a]
+image = testimg1
+
+[b]
+image = testimg1
+depends_on = a, missing
+EOF
+    if ! OUTPUT=$(./mdock compose up -f "$DIR/unknown.conf" 2>&1) &&
+       echo "$OUTPUT" | grep -q "unknown.conf:4: service 'b' depends on unknown service 'missing'"; then
+        print_success "Unknown dependency reported: $OUTPUT"
+    else
+        print_error "Unknown dependency not reported as expected: $OUTPUT"
+    fi
+    
+    print_test "Timing out a file readiness check"
+    cat > "$DIR/slow.conf" << 'EOF'
+[slow]
+image = testimg1
+command = /bin/sleep 30
+ready = file:tmp/compose-never
+ready_timeout = 1
+EOF
+    if ! OUTPUT=$(./mdock compose up -f "$DIR/slow.conf" 2>&1) && echo "$OUTPUT" | grep -q "not ready after 1s"; then
+        print_success "Readiness timeout reported: $OUTPUT"
+    else
+        print_error "Readiness timeout not reported: $OUTPUT"
+    fi
+    ./mdock compose down -f "$DIR/slow.conf" -t 1 2>/dev/null || true
+}
+
+# Test 14: Daemon
+test_daemon() {
+    print_header "Test 14: Daemon (mdockd)"
+    
+    print_test "Starting mdockd"
+    ./mdockd 2>/tmp/udock-test-mdockd.log &
+    local DAEMON_PID=$!
+    for i in $(seq 50); do
+        [ -S ~/.mdock/mdockd.sock ] && break
+        sleep 0.1
+    done
+    if [ -S ~/.mdock/mdockd.sock ]; then
+        print_success "mdockd serving ~/.mdock (PID $DAEMON_PID)"
+    else
+        print_error "mdockd did not create its socket"
+        kill "$DAEMON_PID" 2>/dev/null || true
+        return 1
+    fi
+    
+    print_test "Checking that commands go to the daemon (a stopped daemon holds them up)"
+    local STATUS=0
+    kill -STOP "$DAEMON_PID"
+    timeout 1 ./mdock images > /dev/null 2>&1 || STATUS=$?
+    kill -CONT "$DAEMON_PID"
+    if [ "$STATUS" -eq 124 ]; then
+        print_success "images waited for the daemon"
+    else
+        print_error "images did not go through the daemon (exit $STATUS)"
+    fi
+    
+    print_test "Listing images through the daemon into a pipe"
+    local OUTPUT=$(./mdock images | cat)
+    if echo "$OUTPUT" | grep -q "^testimg1 "; then
+        print_success "Piped output came back from the daemon"
+    else
+        print_error "Piped output missing: $OUTPUT"
+    fi
+    
+    print_test "Passing an error and its exit status back through a pipe"
+    STATUS=0
+    OUTPUT=$(./mdock inspect nosuch 2>&1 | cat; exit "${PIPESTATUS[0]}") || STATUS=$?
+    if [ "$STATUS" -eq 1 ] && echo "$OUTPUT" | grep -q "container 'nosuch' not found"; then
+        print_success "inspect of a missing container failed with its message"
+    else
+        print_error "Unexpected result (exit $STATUS): $OUTPUT"
+    fi
+    
+    print_test "Starting a detached container through the daemon"
+    OUTPUT=$(./mdock run -d testimg1 /bin/sleep 1 2>&1)
+    local CONTAINER_ID=$(echo "$OUTPUT" | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2)
+    if [ -n "$CONTAINER_ID" ] && ./mdock ps -q | grep -q "^$CONTAINER_ID$"; then
+        print_success "Container $CONTAINER_ID started and listed"
+    else
+        print_error "Detached run through the daemon failed: $OUTPUT"
+    fi
+    ./mdock wait "$CONTAINER_ID" > /dev/null 2>&1 || true
+    
+    print_test "Stopping mdockd"
+    kill "$DAEMON_PID"
+    wait "$DAEMON_PID" 2>/dev/null || true
+    if [ ! -e ~/.mdock/mdockd.sock ]; then
+        print_success "mdockd stopped and removed its socket"
+    else
+        print_error "mdockd left its socket behind"
+    fi
+}
+
+# Test 15: ps options
+test_ps_options() {
+    print_header "Test 15: ps Options"
+    
+    print_test "Starting two running containers and one that exits"
+    local RUN1=$(./mdock run -d testimg1 /bin/sleep 30 2>&1 | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2)
+    local RUN2=$(./mdock run -d testimg1 /bin/sleep 30 2>&1 | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2)
+    local DONE=$(./mdock run -d testimg1 /bin/true 2>&1 | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2)
+    ./mdock wait "$DONE" > /dev/null 2>&1 || true
+    if [ -n "$RUN1" ] && [ -n "$RUN2" ] && [ -n "$DONE" ]; then
+        print_success "Started $RUN1, $RUN2 and $DONE"
+    else
+        print_error "Could not start the ps test containers"
+        return 1
+    fi
+    
+    print_test "Printing only IDs with -q"
+    local OUTPUT=$(./mdock ps -q)
+    if [ "$(echo "$OUTPUT" | grep -vc '^c[0-9a-z]*$')" -eq 0 ] &&
+       [ "$(echo "$OUTPUT" | wc -l)" -eq "$(wc -l < ~/.mdock/containers.db)" ]; then
+        print_success "ps -q printed one ID per container"
+    else
+        print_error "ps -q printed more than IDs: $OUTPUT"
+    fi
+    
+    print_test "Filtering on status=running"
+    OUTPUT=$(./mdock ps -q -f status=running)
+    if echo "$OUTPUT" | grep -q "^$RUN1$" && echo "$OUTPUT" | grep -q "^$RUN2$" &&
+       ! echo "$OUTPUT" | grep -q "^$DONE$"; then
+        print_success "Only the running containers matched"
+    else
+        print_error "status=running matched: $OUTPUT"
+    fi
+    
+    print_test "Keeping the most recent containers with --last, oldest first"
+    OUTPUT=$(./mdock ps -q --last 3 | tr '\n' ' ')
+    if [ "$OUTPUT" = "$RUN1 $RUN2 $DONE " ]; then
+        print_success "--last 3 gave $OUTPUT"
+    else
+        print_error "--last 3 gave $OUTPUT"
+    fi
+    
+    print_test "Printing valid JSON with --json"
+    if ! command -v python3 &> /dev/null; then
+        print_info "Skipping JSON validation (python3 not found)"
+    elif ./mdock ps --json -f status=running |
+         python3 -c 'import json, sys; rows = json.load(sys.stdin); sys.exit(len(rows) < 2 or any(r["status"] != "running" for r in rows))'; then
+        print_success "ps --json parsed as an array of running containers"
+    else
+        print_error "ps --json did not parse"
+    fi
+    
+    ./mdock stop -t 1 "$RUN1" "$RUN2" > /dev/null 2>&1 || true
+}
+
+# Start a detached container and print its ID
+start_detached() {
+    ./mdock run -d testimg1 "$@" 2>&1 | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2
+}
+
+# Milliseconds since the epoch
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# Test 16: Stop and wait
+test_stop_wait() {
+    print_header "Test 16: Stop and Wait"
+    
+    print_test "Stopping two containers in one call"
+    local A=$(start_detached /bin/sleep 30)
+    local B=$(start_detached /bin/sleep 30)
+    local START=$(now_ms)
+    ./mdock stop -t 5 "$A" "$B" || true
+    local ELAPSED=$(( $(now_ms) - START ))
+    if ! ./mdock ps -q -f status=running | grep -q "^$A$\|^$B$"; then
+        print_success "$A and $B stopped"
+    else
+        print_error "$A or $B still running"
+    fi
+    
+    print_test "Returning early when containers exit on SIGTERM"
+    if [ "$ELAPSED" -lt 2000 ]; then
+        print_success "stop took ${ELAPSED}ms of a 5s grace period"
+    else
+        print_error "stop took ${ELAPSED}ms of a 5s grace period"
+    fi
+    
+    print_test "Killing a container that ignores SIGTERM after --timeout"
+    local C=$(start_detached /bin/sh -c 'trap "" TERM; exec /bin/sleep 30')
+    sleep 0.2
+    START=$(now_ms)
+    ./mdock stop --timeout 1 "$C" || true
+    ELAPSED=$(( $(now_ms) - START ))
+    if ./mdock ps -q -f status=killed | grep -q "^$C$" && [ "$ELAPSED" -ge 1000 ] && [ "$ELAPSED" -lt 3000 ]; then
+        print_success "$C killed after ${ELAPSED}ms"
+    else
+        print_error "$C not killed after the 1s timeout (${ELAPSED}ms)"
+    fi
+    
+    print_test "Stopping every running container with --all"
+    start_detached /bin/sleep 30 > /dev/null
+    start_detached /bin/sleep 30 > /dev/null
+    ./mdock stop -t 1 --all || true
+    if [ -z "$(./mdock ps -q -f status=running)" ]; then
+        print_success "No containers left running"
+    else
+        print_error "Containers still running after stop --all"
+    fi
+    
+    print_test "Printing each container's exit code with wait"
+    local D=$(start_detached /bin/sh -c 'exit 3')
+    local E=$(start_detached /bin/true)
+    local OUTPUT=$(./mdock wait "$D" "$E" 2>&1)
+    if [ "$OUTPUT" = "$D 3
+$E 0" ]; then
+        print_success "wait printed: $(echo $OUTPUT)"
+    else
+        print_error "wait printed: $OUTPUT"
+    fi
+}
+
+# Test 17: Replicas
+test_replicas() {
+    print_header "Test 17: Replicas"
+    
+    print_test "Starting 4 replicas in one run"
+    local BEFORE=$(wc -l < ~/.mdock/containers.db)
+    local IDS=$(./mdock run -d --replicas 4 testimg1 /bin/sleep 1 2>&1 | grep -o 'Container c[0-9a-z]*' | cut -d' ' -f2)
+    local AFTER=$(wc -l < ~/.mdock/containers.db)
+    if [ "$(echo "$IDS" | sort -u | wc -l)" -eq 4 ] && [ $((AFTER - BEFORE)) -eq 4 ]; then
+        print_success "4 records with distinct IDs: $(echo $IDS)"
+    else
+        print_error "Expected 4 new records with distinct IDs, got $((AFTER - BEFORE)): $(echo $IDS)"
+    fi
+    
+    print_test "Checking each replica's record"
+    local ID
+    local MISSING=0
+    for ID in $IDS; do
+        [ "$(cut -d'|' -f1 ~/.mdock/containers.db | grep -c "^$ID$")" -eq 1 ] || MISSING=$((MISSING + 1))
+    done
+    if [ "$MISSING" -eq 0 ]; then
+        print_success "Every replica has exactly one record"
+    else
+        print_error "$MISSING replicas without exactly one record"
+    fi
+    ./mdock wait $IDS > /dev/null 2>&1 || true
+}
+
+# Test 18: Job queue
+test_job_queue() {
+    print_header "Test 18: Job Queue"
+    
+    print_test "Submitting jobs before any scheduler runs"
+    local JOB1=$(./mdock submit testimg1 /bin/sh -c 'exit 5' 2>&1 | grep -o 'Job j[0-9a-z]*' | cut -d' ' -f2)
+    local JOB2=$(./mdock submit testimg1 /bin/true 2>&1 | grep -o 'Job j[0-9a-z]*' | cut -d' ' -f2)
+    if [ -n "$JOB1" ] && [ -n "$JOB2" ] && ./mdock jobs --state queued | grep -q "^$JOB1 "; then
+        print_success "$JOB1 and $JOB2 queued"
+    else
+        print_error "Jobs were not queued"
+        return 1
+    fi
+    
+    print_test "Running the queue with a scheduler"
+    if ./mdock scheduler start --max-concurrent 2; then
+        print_success "Scheduler started"
+    else
+        print_error "Scheduler did not start"
+        return 1
+    fi
+    for i in $(seq 50); do
+        ./mdock jobs | grep -q "^Queue: 0 queued, 0 running" && break
+        sleep 0.1
+    done
+    
+    print_test "Checking the jobs' exit codes"
+    local ROW1=$(./mdock jobs | awk -v id="$JOB1" '$1 == id { print $2, $6 }')
+    local ROW2=$(./mdock jobs | awk -v id="$JOB2" '$1 == id { print $2, $6 }')
+    if [ "$ROW1" = "exited 5" ] && [ "$ROW2" = "exited 0" ]; then
+        print_success "$JOB1 exited 5, $JOB2 exited 0"
+        ./mdock jobs
+    else
+        print_error "Unexpected job states: $JOB1 '$ROW1', $JOB2 '$ROW2'"
+        ./mdock jobs
+    fi
+    
+    print_test "Stopping the scheduler"
+    ./mdock scheduler stop || true
+    for i in $(seq 50); do
+        ./mdock scheduler status > /dev/null 2>&1 || break
+        sleep 0.1
+    done
+    if ! ./mdock scheduler status > /dev/null 2>&1; then
+        print_success "Scheduler stopped"
+    else
+        print_error "Scheduler still running"
+    fi
+}
+
 # Main test execution
 main() {
     print_header "uDock Comprehensive Test Suite"
@@ -512,6 +927,13 @@ main() {
     test_rmi
     test_resource_limits
     test_global_log
+    test_memory_budget
+    test_compose
+    test_daemon
+    test_ps_options
+    test_stop_wait
+    test_replicas
+    test_job_queue
     
     # Final cleanup
     cleanup